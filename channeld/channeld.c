@@ -3628,10 +3628,10 @@ static void send_shutdown_complete(struct peer *peer)
 
 static void try_read_gossip_store(struct peer *peer)
 {
-	u8 *msg = gossip_store_next(tmpctx, peer->pps);
+	u8 **msgs = gossip_store_next_batch(tmpctx, peer->pps);
 
-	if (msg)
-		sync_crypto_write(peer->pps, take(msg));
+	if (msgs)
+		sync_crypto_write_arr(peer->pps, msgs);
 }
 
 int main(int argc, char *argv[])
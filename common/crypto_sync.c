@@ -14,16 +14,20 @@
 #include <wire/wire.h>
 #include <wire/wire_sync.h>
 
-void sync_crypto_write(struct per_peer_state *pps, const void *msg TAKES)
+/* Encrypt msg for the peer: NULL if dev_disconnect says to drop it.  Sets
+ * *post_sabotage if we should break the connection after sending. */
+static u8 *encrypt_for_peer(const tal_t *ctx,
+			    struct per_peer_state *pps,
+			    const void *msg TAKES,
+			    bool *post_sabotage)
 {
 #if DEVELOPER
-	bool post_sabotage = false;
 	int type = fromwire_peektype(msg);
 #endif
 	u8 *enc;
 
 	status_peer_io(LOG_IO_OUT, NULL, msg);
-	enc = cryptomsg_encrypt_msg(NULL, &pps->cs, msg);
+	enc = cryptomsg_encrypt_msg(ctx, &pps->cs, msg);
 
 #if DEVELOPER
 	switch (dev_disconnect(type)) {
@@ -33,7 +37,7 @@ void sync_crypto_write(struct per_peer_state *pps, const void *msg TAKES)
 	case DEV_DISCONNECT_DROPPKT:
 		enc = tal_free(enc); /* FALL THRU */
 	case DEV_DISCONNECT_AFTER:
-		post_sabotage = true;
+		*post_sabotage = true;
 		break;
 	case DEV_DISCONNECT_BLACKHOLE:
 		dev_blackhole_fd(pps->peer_fd);
@@ -42,6 +46,15 @@ void sync_crypto_write(struct per_peer_state *pps, const void *msg TAKES)
 		break;
 	}
 #endif
+	return enc;
+}
+
+void sync_crypto_write(struct per_peer_state *pps, const void *msg TAKES)
+{
+	bool post_sabotage = false;
+	u8 *enc;
+
+	enc = encrypt_for_peer(NULL, pps, msg, &post_sabotage);
 	if (!write_all(pps->peer_fd, enc, tal_count(enc)))
 		peer_failed_connection_lost();
 	tal_free(enc);
@@ -52,6 +65,32 @@ void sync_crypto_write(struct per_peer_state *pps, const void *msg TAKES)
 #endif
 }
 
+void sync_crypto_write_arr(struct per_peer_state *pps, u8 **msgs)
+{
+	bool post_sabotage = false;
+	u8 *buf = tal_arr(NULL, u8, 0);
+
+	for (size_t i = 0; i < tal_count(msgs); i++) {
+		u8 *enc = encrypt_for_peer(tmpctx, pps, msgs[i],
+					   &post_sabotage);
+		if (enc)
+			tal_expand(&buf, enc, tal_count(enc));
+		tal_free(enc);
+		/* Nothing after this would get through anyway. */
+		if (post_sabotage)
+			break;
+	}
+
+	if (!write_all(pps->peer_fd, buf, tal_count(buf)))
+		peer_failed_connection_lost();
+	tal_free(buf);
+
+#if DEVELOPER
+	if (post_sabotage)
+		dev_sabotage_fd(pps->peer_fd);
+#endif
+}
+
 /* We're happy for the kernel to batch update and gossip messages, but a
  * commitment message, for example, should be instantly sent.  There's no
  * great way of doing this, unfortunately.
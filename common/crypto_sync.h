@@ -9,6 +9,10 @@ struct per_peer_state;
 /* Exits with peer_failed_connection_lost() if write fails. */
 void sync_crypto_write(struct per_peer_state *pps, const void *msg TAKES);
 
+/* Same, but for several messages at once, with a single write: they're
+ * not freed. */
+void sync_crypto_write_arr(struct per_peer_state *pps, u8 **msgs);
+
 /* Same, but disabled nagle for this message. */
 void sync_crypto_write_no_delay(struct per_peer_state *pps,
 				const void *msg TAKES);
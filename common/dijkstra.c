@@ -1,6 +1,5 @@
 /* Without this, gheap is *really* slow!  Comment out for debugging. */
 #define NDEBUG
-#include <ccan/cast/cast.h>
 #include <ccan/err/err.h>
 #include <ccan/tal/str/str.h>
 #include <ccan/time/time.h>
@@ -9,18 +8,19 @@
 #include <gheap.h>
 #include <inttypes.h>
 #include <stdio.h>
+#include <stdlib.h>
 
 /* Each node has this side-info. */
-struct dijkstra {
+struct dijkstra_node {
+	/* If this isn't dij->generation, we haven't reached it this run. */
+	u32 generation;
 	u32 distance;
 	/* Total CLTV delay */
 	u32 total_delay;
+	/* Once it's popped from the heap, the values here are final. */
+	bool visited;
 	/* Total cost from here to destination */
 	struct amount_msat cost;
-	/* I want to use an index here, except that gheap moves things onto
-	 * a temporary on the stack and that makes things complex. */
-	/* NULL means it's been visited already. */
-	const struct gossmap_node **heapptr;
 
 	/* How we decide "best", lower is better */
 	u64 score;
@@ -29,39 +29,85 @@ struct dijkstra {
 	struct gossmap_chan *best_chan;
 };
 
-/* Because item_mover doesn't provide a ctx ptr, we need a global anyway. */
-static struct dijkstra *global_dijkstra;
-static const struct gossmap *global_map;
+/* We don't move nodes within the heap (gheap's item_mover gives us no
+ * context to find them with), we just push them again when their score
+ * improves, and ignore stale entries as we pop them. */
+struct dijkstra_heap_entry {
+	u64 score;
+	u32 node_idx;
+};
+
+struct dijkstra {
+	/* Bumped on every run, so we don't have to reset every node. */
+	u32 generation;
+	/* Indexed by gossmap_node_idx() */
+	struct dijkstra_node *nodes;
+	size_t num_nodes;
+};
+
+/* The arrays are malloc'd, not tal'd: tal isn't thread-safe, and runs
+ * (which may need to grow them) can happen on worker threads. */
+struct dijkstra_ctx {
+	/* The results of the last run. */
+	struct dijkstra dij;
+	/* Reused between runs. */
+	struct dijkstra_heap_entry *heap;
+	size_t heapsize, heapmax;
+};
+
+/* What a node looks like if we haven't reached it. */
+static const struct dijkstra_node unreached = {
+	.distance = UINT_MAX,
+	.total_delay = 0,
+	.visited = false,
+	.cost = AMOUNT_MSAT(-1ULL),
+	.score = -1ULL,
+	.best_chan = NULL,
+};
+
+static const struct dijkstra_node *get_node(const struct dijkstra *dij,
+					    u32 node_idx)
+{
+	if (node_idx >= dij->num_nodes
+	    || dij->nodes[node_idx].generation != dij->generation)
+		return &unreached;
+	return &dij->nodes[node_idx];
+}
 
 /* Returns UINT_MAX if unreachable. */
 u32 dijkstra_distance(const struct dijkstra *dij, u32 node_idx)
 {
-	return dij[node_idx].distance;
+	return get_node(dij, node_idx)->distance;
 }
 
 /* Total CLTV delay */
 u32 dijkstra_delay(const struct dijkstra *dij, u32 node_idx)
 {
-	return dij[node_idx].total_delay;
+	return get_node(dij, node_idx)->total_delay;
 }
 
 /* Total cost to get here. */
 struct amount_msat dijkstra_amount(const struct dijkstra *dij, u32 node_idx)
 {
-	return dij[node_idx].cost;
+	return get_node(dij, node_idx)->cost;
 }
 
 struct gossmap_chan *dijkstra_best_chan(const struct dijkstra *dij,
 					u32 node_idx)
 {
-	return dij[node_idx].best_chan;
+	return get_node(dij, node_idx)->best_chan;
 }
 
-static struct dijkstra *get_dijkstra(const struct dijkstra *dij,
-				     const struct gossmap *map,
-				     const struct gossmap_node *n)
+/* Get node for writing: initializes it if we haven't touched it this run. */
+static struct dijkstra_node *touch_node(struct dijkstra *dij, u32 node_idx)
 {
-	return cast_const(struct dijkstra *, dij) + gossmap_node_idx(map, n);
+	struct dijkstra_node *d = &dij->nodes[node_idx];
+
+	if (d->generation != dij->generation) {
+		*d = unreached;
+		d->generation = dij->generation;
+	}
+	return d;
 }
 
 /* We want a minheap, not a maxheap, so this is backwards! */
@@ -69,54 +115,90 @@ static int less_comparer(const void *const ctx,
 			 const void *const a,
 			 const void *const b)
 {
-	return get_dijkstra(global_dijkstra, global_map,
-			    *(struct gossmap_node **)a)->score
-		> get_dijkstra(global_dijkstra, global_map,
-			       *(struct gossmap_node **)b)->score;
+	return ((const struct dijkstra_heap_entry *)a)->score
+		> ((const struct dijkstra_heap_entry *)b)->score;
 }
 
 static void item_mover(void *const dst, const void *const src)
 {
-	struct gossmap_node *n = *((struct gossmap_node **)src);
-	get_dijkstra(global_dijkstra, global_map, n)->heapptr = dst;
-	*((struct gossmap_node **)dst) = n;
+	memcpy(dst, src, sizeof(struct dijkstra_heap_entry));
 }
 
-static const struct gossmap_node **mkheap(const tal_t *ctx,
-					  struct dijkstra *dij,
-					  const struct gossmap *map,
-					  const struct gossmap_node *start,
-					  struct amount_msat sent)
+static void heap_push(struct dijkstra_ctx *dctx,
+		      const struct gheap_ctx *gheap_ctx,
+		      u32 node_idx, u64 score)
 {
-	const struct gossmap_node *n, **heap;
-	size_t i;
-
-	heap = tal_arr(tmpctx, const struct gossmap_node *,
-		       gossmap_num_nodes(map));
-	for (i = 1, n = gossmap_first_node(map);
-	     n;
-	     n = gossmap_next_node(map, n), i++) {
-		struct dijkstra *d = get_dijkstra(dij, map, n);
-		if (n == start) {
-			/* First entry in heap is start, distance 0 */
-			heap[0] = start;
-			d->heapptr = &heap[0];
-			d->distance = 0;
-			d->total_delay = 0;
-			d->cost = sent;
-			d->score = 0;
-			i--;
-		} else {
-			heap[i] = n;
-			d->heapptr = &heap[i];
-			d->distance = UINT_MAX;
-			d->cost = AMOUNT_MSAT(-1ULL);
-			d->total_delay = 0;
-			d->score = -1ULL;
-		}
+	if (dctx->heapsize == dctx->heapmax) {
+		dctx->heapmax = dctx->heapmax * 2 + 1;
+		dctx->heap = realloc(dctx->heap,
+				     dctx->heapmax * sizeof(*dctx->heap));
+		if (!dctx->heap)
+			abort();
 	}
-	assert(i == tal_count(heap));
-	return heap;
+
+	dctx->heap[dctx->heapsize].score = score;
+	dctx->heap[dctx->heapsize].node_idx = node_idx;
+	gheap_push_heap(gheap_ctx, dctx->heap, ++dctx->heapsize);
+}
+
+static void destroy_dijkstra_ctx(struct dijkstra_ctx *dctx)
+{
+	free(dctx->dij.nodes);
+	free(dctx->heap);
+}
+
+struct dijkstra_ctx *dijkstra_ctx_new(const tal_t *ctx)
+{
+	struct dijkstra_ctx *dctx = tal(ctx, struct dijkstra_ctx);
+
+	dctx->dij.generation = 0;
+	dctx->dij.nodes = NULL;
+	dctx->dij.num_nodes = 0;
+	dctx->heap = NULL;
+	dctx->heapsize = dctx->heapmax = 0;
+	tal_add_destructor(dctx, destroy_dijkstra_ctx);
+	return dctx;
+}
+
+/* Start a new run: only start is reached. */
+static void dijkstra_reset(struct dijkstra_ctx *dctx,
+			   const struct gheap_ctx *gheap_ctx,
+			   const struct gossmap *map,
+			   const struct gossmap_node *start,
+			   struct amount_msat sent)
+{
+	struct dijkstra *dij = &dctx->dij;
+	size_t old_max = dij->num_nodes;
+	struct dijkstra_node *d;
+
+	/* Map may have grown since last time (gossmap_refresh) */
+	if (gossmap_max_node_idx(map) > old_max) {
+		dij->num_nodes = gossmap_max_node_idx(map);
+		dij->nodes = realloc(dij->nodes,
+				     dij->num_nodes * sizeof(*dij->nodes));
+		if (!dij->nodes)
+			abort();
+		for (size_t i = old_max; i < dij->num_nodes; i++)
+			dij->nodes[i].generation = dij->generation;
+	}
+
+	/* Zero is never a valid generation, so on wrap we have to
+	 * reset everything. */
+	if (++dij->generation == 0) {
+		for (size_t i = 0; i < dij->num_nodes; i++)
+			dij->nodes[i].generation = 0;
+		dij->generation = 1;
+	}
+
+	/* First entry in heap is start, distance 0 */
+	d = touch_node(dij, gossmap_node_idx(map, start));
+	d->distance = 0;
+	d->total_delay = 0;
+	d->cost = sent;
+	d->score = 0;
+
+	dctx->heapsize = 0;
+	heap_push(dctx, gheap_ctx, gossmap_node_idx(map, start), 0);
 }
 
 /* 365.25 * 24 * 60 / 10 */
@@ -135,43 +217,89 @@ static struct amount_msat risk_price(struct amount_msat amount,
 	return riskfee;
 }
 
-/* Do Dijkstra: start in this case is the dst node. */
+/* Consider reaching the node at the other end of c via cur_d: h is
+ * c->half[dir], so h->nodeidx is that node. */
+static void relax(struct dijkstra_ctx *dctx,
+		  const struct gheap_ctx *gheap_ctx,
+		  const struct gossmap *map,
+		  const struct dijkstra_node *cur_d,
+		  struct gossmap_chan *c,
+		  int dir,
+		  const struct gossmap_half_chan *h,
+		  double riskfactor,
+		  bool (*channel_ok)(const struct gossmap *map,
+				     const struct gossmap_chan *c,
+				     int dir,
+				     struct amount_msat amount,
+				     void *arg),
+		  u64 (*path_score)(u32 distance,
+				    struct amount_msat cost,
+				    struct amount_msat risk),
+		  void *arg)
+{
+	struct dijkstra_node *d;
+	struct amount_msat cost, risk;
+	u64 score;
+
+	d = touch_node(&dctx->dij, h->nodeidx);
+	/* Ignore if already visited. */
+	if (d->visited)
+		return;
+
+	if (!channel_ok(map, c, dir, cur_d->cost, arg))
+		return;
+
+	cost = cur_d->cost;
+	if (!amount_msat_add_fee(&cost, h->base_fee, h->proportional_fee))
+		/* Shouldn't happen! */
+		return;
+
+	/* cltv_delay can't overflow: only 20 bits per hop. */
+	risk = risk_price(cost, riskfactor, cur_d->total_delay + h->delay);
+	score = path_score(cur_d->distance + 1, cost, risk);
+	if (score >= d->score)
+		return;
+
+	d->distance = cur_d->distance + 1;
+	d->total_delay = cur_d->total_delay + h->delay;
+	d->cost = cost;
+	d->best_chan = c;
+	d->score = score;
+	heap_push(dctx, gheap_ctx, h->nodeidx, score);
+}
+
+/* Do Dijkstra: start in this case is the dst node, stop is the src (or
+ * NULL to explore the whole graph). */
 const struct dijkstra *
-dijkstra_(const tal_t *ctx,
-	  const struct gossmap *map,
-	  const struct gossmap_node *start,
-	  struct amount_msat amount,
-	  double riskfactor,
-	  bool (*channel_ok)(const struct gossmap *map,
-			     const struct gossmap_chan *c,
-			     int dir,
-			     struct amount_msat amount,
-			     void *arg),
-	  u64 (*path_score)(u32 distance,
-			    struct amount_msat cost,
-			    struct amount_msat risk),
-	  void *arg)
+dijkstra_run_(struct dijkstra_ctx *dctx,
+	      const struct gossmap *map,
+	      const struct gossmap_node *start,
+	      const struct gossmap_node *stop,
+	      struct amount_msat amount,
+	      double riskfactor,
+	      bool (*channel_ok)(const struct gossmap *map,
+				 const struct gossmap_chan *c,
+				 int dir,
+				 struct amount_msat amount,
+				 void *arg),
+	      u64 (*path_score)(u32 distance,
+				struct amount_msat cost,
+				struct amount_msat risk),
+	      void *arg)
 {
-	struct dijkstra *dij;
-	const struct gossmap_node **heap;
-	size_t heapsize;
+	struct dijkstra *dij = &dctx->dij;
+	const struct gossmap_csr *csr = gossmap_csr(map);
 	struct gheap_ctx gheap_ctx;
 
 	/* There doesn't seem to be much difference with fanout 2-4. */
 	gheap_ctx.fanout = 2;
 	/* There seems to be a slight decrease if we alter this value. */
 	gheap_ctx.page_chunks = 1;
-	gheap_ctx.item_size = sizeof(*heap);
+	gheap_ctx.item_size = sizeof(*dctx->heap);
 	gheap_ctx.less_comparer = less_comparer;
 	gheap_ctx.less_comparer_ctx = NULL;
 	gheap_ctx.item_mover = item_mover;
 
-	dij = tal_arr(ctx, struct dijkstra, gossmap_max_node_idx(map));
-
-	/* Pay no attention to the man behind the curtain! */
-	global_map = map;
-	global_dijkstra = dij;
-
 	/* Wikipedia's article on Dijkstra is excellent:
 	 *    https://en.wikipedia.org/wiki/Dijkstra's_algorithm
 	 * (License https://creativecommons.org/licenses/by-sa/3.0/)
@@ -185,8 +313,7 @@ dijkstra_(const tal_t *ctx,
 	 * for our initial node and to infinity for all other nodes. Set the
 	 * initial node as current.[14]
 	 */
-	heap = mkheap(NULL, dij, map, start, amount);
-	heapsize = tal_count(heap);
+	dijkstra_reset(dctx, &gheap_ctx, map, start, amount);
 
 	/*
 	 * 3. For the current node, consider all of its unvisited neighbouds
@@ -214,65 +341,70 @@ dijkstra_(const tal_t *ctx,
 	 * smallest tentative distance, set it as the new "current node", and
 	 * go back to step 3.
 	 */
-	while (heapsize != 0) {
-		struct dijkstra *cur_d;
-		const struct gossmap_node *cur = heap[0];
+	while (dctx->heapsize != 0) {
+		struct dijkstra_node *cur_d;
+		const struct gossmap_node *cur;
+		struct dijkstra_heap_entry top = dctx->heap[0];
+
+		gheap_pop_heap(&gheap_ctx, dctx->heap, dctx->heapsize--);
+
+		cur_d = &dij->nodes[top.node_idx];
+		/* Stale entry: we've already found a better path to it. */
+		if (cur_d->visited || top.score != cur_d->score)
+			continue;
+		cur_d->visited = true;
 
-		cur_d = get_dijkstra(dij, map, cur);
-		assert(cur_d->heapptr == heap);
+		cur = gossmap_node_byidx(map, top.node_idx);
 
-		/* Finished all reachable nodes */
-		if (cur_d->distance == UINT_MAX)
+		/* Step 5: we have the best path to stop, we're done. */
+		if (cur == stop)
 			break;
 
+		/* The csr has our channels (and their halves) inline */
+		if (csr) {
+			const struct gossmap_edge *e, *end;
+
+			e = csr->edges + csr->first[top.node_idx];
+			end = csr->edges + csr->first[top.node_idx + 1];
+			for (; e < end; e++)
+				relax(dctx, &gheap_ctx, map, cur_d,
+				      gossmap_chan_byidx(map, e->chan_idx),
+				      e->dir, &e->half,
+				      riskfactor, channel_ok, path_score, arg);
+			continue;
+		}
+
 		for (size_t i = 0; i < cur->num_chans; i++) {
-			struct gossmap_node *neighbor;
 			int which_half;
 			struct gossmap_chan *c;
-			struct dijkstra *d;
-			struct amount_msat cost, risk;
-			u64 score;
 
 			c = gossmap_nth_chan(map, cur, i, &which_half);
-			neighbor = gossmap_nth_node(map, c, !which_half);
-
-			d = get_dijkstra(dij, map, neighbor);
-			/* Ignore if already visited. */
-			if (!d->heapptr)
-				continue;
-
 			/* We're going from neighbor to c, hence !which_half */
-			if (!channel_ok(map, c, !which_half, cur_d->cost, arg))
-				continue;
-
-			cost = cur_d->cost;
-			if (!amount_msat_add_fee(&cost,
-						 c->half[!which_half].base_fee,
-						 c->half[!which_half].proportional_fee))
-				/* Shouldn't happen! */
-				continue;
-
-			/* cltv_delay can't overflow: only 20 bits per hop. */
-			risk = risk_price(cost, riskfactor,
-					  cur_d->total_delay
-					  + c->half[!which_half].delay);
-			score = path_score(cur_d->distance + 1, cost, risk);
-			if (score >= d->score)
-				continue;
-
-			d->distance = cur_d->distance + 1;
-			d->total_delay = cur_d->total_delay
-				+ c->half[!which_half].delay;
-			d->cost = cost;
-			d->best_chan = c;
-			d->score = score;
-			gheap_restore_heap_after_item_increase(&gheap_ctx,
-							       heap, heapsize,
-							       d->heapptr - heap);
+			relax(dctx, &gheap_ctx, map, cur_d,
+			      c, !which_half, &c->half[!which_half],
+			      riskfactor, channel_ok, path_score, arg);
 		}
-		gheap_pop_heap(&gheap_ctx, heap, heapsize--);
-		cur_d->heapptr = NULL;
 	}
-	tal_free(heap);
 	return dij;
 }
+
+const struct dijkstra *
+dijkstra_to_(const tal_t *ctx,
+	     const struct gossmap *map,
+	     const struct gossmap_node *start,
+	     const struct gossmap_node *stop,
+	     struct amount_msat amount,
+	     double riskfactor,
+	     bool (*channel_ok)(const struct gossmap *map,
+				const struct gossmap_chan *c,
+				int dir,
+				struct amount_msat amount,
+				void *arg),
+	     u64 (*path_score)(u32 distance,
+			       struct amount_msat cost,
+			       struct amount_msat risk),
+	     void *arg)
+{
+	return dijkstra_run_(dijkstra_ctx_new(ctx), map, start, stop,
+			     amount, riskfactor, channel_ok, path_score, arg);
+}
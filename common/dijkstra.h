@@ -5,36 +5,81 @@
 #include <ccan/typesafe_cb/typesafe_cb.h>
 #include <common/amount.h>
 
+struct dijkstra_ctx;
 struct gossmap;
 struct gossmap_chan;
 struct gossmap_node;
 
-/* Do Dijkstra: start in this case is the dst node. */
+/* Scratch space for dijkstra runs: reusing it avoids reallocating and
+ * reinitializing per-node state every time.  There's no global state, and
+ * runs don't use tal, so you can run searches concurrently on other threads,
+ * as long as each has its own ctx (created and freed on the main thread). */
+struct dijkstra_ctx *dijkstra_ctx_new(const tal_t *ctx);
+
+/* As dijkstra_to() below, but the result lives in dctx, and is only
+ * valid until the next run on it. */
 const struct dijkstra *
-dijkstra_(const tal_t *ctx,
-	  const struct gossmap *gossmap,
-	  const struct gossmap_node *start,
-	  struct amount_msat amount,
-	  double riskfactor,
-	  bool (*channel_ok)(const struct gossmap *map,
-			     const struct gossmap_chan *c,
-			     int dir,
-			     struct amount_msat amount,
-			     void *arg),
-	  u64 (*path_score)(u32 distance,
-			    struct amount_msat cost,
-			    struct amount_msat risk),
-	  void *arg);
+dijkstra_run_(struct dijkstra_ctx *dctx,
+	      const struct gossmap *gossmap,
+	      const struct gossmap_node *start,
+	      const struct gossmap_node *stop,
+	      struct amount_msat amount,
+	      double riskfactor,
+	      bool (*channel_ok)(const struct gossmap *map,
+				 const struct gossmap_chan *c,
+				 int dir,
+				 struct amount_msat amount,
+				 void *arg),
+	      u64 (*path_score)(u32 distance,
+				struct amount_msat cost,
+				struct amount_msat risk),
+	      void *arg);
+
+#define dijkstra_run(dctx, map, start, stop, amount, riskfactor,	\
+		     channel_ok, path_score, arg)			\
+	dijkstra_run_((dctx), (map), (start), (stop), (amount), (riskfactor), \
+		      typesafe_cb_preargs(bool, void *, (channel_ok), (arg), \
+					  const struct gossmap *,	\
+					  const struct gossmap_chan *,	\
+					  int, struct amount_msat),	\
+		      (path_score),					\
+		      (arg))
+
+/* Do Dijkstra: start in this case is the dst node.  If stop is non-NULL
+ * (usually the src node), we finish as soon as we have the best path to it:
+ * only nodes on that path are guaranteed to have their final values. */
+const struct dijkstra *
+dijkstra_to_(const tal_t *ctx,
+	     const struct gossmap *gossmap,
+	     const struct gossmap_node *start,
+	     const struct gossmap_node *stop,
+	     struct amount_msat amount,
+	     double riskfactor,
+	     bool (*channel_ok)(const struct gossmap *map,
+				const struct gossmap_chan *c,
+				int dir,
+				struct amount_msat amount,
+				void *arg),
+	     u64 (*path_score)(u32 distance,
+			       struct amount_msat cost,
+			       struct amount_msat risk),
+	     void *arg);
+
+#define dijkstra_to(ctx, map, start, stop, amount, riskfactor,		\
+		    channel_ok, path_score, arg)			\
+	dijkstra_to_((ctx), (map), (start), (stop), (amount), (riskfactor), \
+		     typesafe_cb_preargs(bool, void *, (channel_ok), (arg), \
+					 const struct gossmap *,	\
+					 const struct gossmap_chan *,	\
+					 int, struct amount_msat),	\
+		     (path_score),					\
+		     (arg))
 
+/* Do Dijkstra over the whole graph: start in this case is the dst node. */
 #define dijkstra(ctx, map, start, amount, riskfactor, channel_ok,	\
 		 path_score, arg)					\
-	dijkstra_((ctx), (map), (start), (amount), (riskfactor),	\
-		  typesafe_cb_preargs(bool, void *, (channel_ok), (arg), \
-				      const struct gossmap *,		\
-				      const struct gossmap_chan *,	\
-				      int, struct amount_msat),		\
-		  (path_score),						\
-		  (arg))
+	dijkstra_to((ctx), (map), (start), NULL, (amount), (riskfactor), \
+		    (channel_ok), (path_score), (arg))
 
 /* Returns UINT_MAX if unreachable. */
 u32 dijkstra_distance(const struct dijkstra *dij, u32 node_idx);
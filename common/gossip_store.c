@@ -9,8 +9,17 @@
 #include <errno.h>
 #include <inttypes.h>
 #include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include <wire/peer_wire.h>
 
+#if DEVELOPER
+bool gossip_store_check_crc = true;
+#else
+/* gossipd checked them all when it loaded the store. */
+bool gossip_store_check_crc = false;
+#endif
+
 void gossip_setup_timestamp_filter(struct per_peer_state *pps,
 				   u32 first_timestamp,
 				   u32 timestamp_range)
@@ -41,7 +50,7 @@ void gossip_setup_timestamp_filter(struct per_peer_state *pps,
 	 */
 
 	/* Restart just after header. */
-	lseek(pps->gossip_store_fd, 1, SEEK_SET);
+	pps->gossip_store_off = 1;
 }
 
 static bool timestamp_filter(const struct per_peer_state *pps, u32 timestamp)
@@ -57,94 +66,151 @@ static bool timestamp_filter(const struct per_peer_state *pps, u32 timestamp)
 		&& timestamp <= pps->gs->timestamp_max;
 }
 
-static void undo_read(int fd, int len, size_t wanted)
+/* Make sure we've mapped the store up to off + len: false if it's not
+ * that long (yet). */
+static bool map_store(struct per_peer_state *pps, u64 off, size_t len)
 {
-	if (len < 0) {
-		/* Grab errno before lseek overrides it */
-		const char *err = strerror(errno);
+	struct stat st;
+	size_t maplen;
+	void *p;
+
+	if (off + len <= pps->gossip_store_size)
+		return true;
+
+	if (fstat(pps->gossip_store_fd, &st) != 0)
 		status_failed(STATUS_FAIL_INTERNAL_ERROR,
-			      "gossip_store: failed read @%"PRIu64": %s",
-			      (u64)lseek(fd, 0, SEEK_CUR), err);
-	}
+			      "gossip_store: failed stat: %s",
+			      strerror(errno));
+
+	/* We expect to hit the end here (or a partially-written record) */
+	if (off + len > st.st_size)
+		return false;
 
-	/* Shouldn't happen, but some filesystems are not as atomic as
-	 * they should be! */
-	status_unusual("gossip_store: short read %i of %zu @%"PRIu64,
-		       len, wanted, (u64)lseek(fd, 0, SEEK_CUR) - len);
-	lseek(fd, -len, SEEK_CUR);
+	pps->gossip_store_size = st.st_size;
+	if (st.st_size <= pps->gossip_store_mmap_len)
+		return true;
+
+	/* We map extra, so we don't need to remap every time the store
+	 * grows: we never access past gossip_store_size, so the pages past
+	 * the end of file are harmless. */
+	maplen = st.st_size + st.st_size / 2;
+#ifdef MREMAP_MAYMOVE
+	if (pps->gossip_store_mmap) {
+		p = mremap((void *)pps->gossip_store_mmap,
+			   pps->gossip_store_mmap_len, maplen, MREMAP_MAYMOVE);
+		if (p != MAP_FAILED)
+			goto mapped;
+	}
+#endif
+	if (pps->gossip_store_mmap)
+		munmap((void *)pps->gossip_store_mmap,
+		       pps->gossip_store_mmap_len);
+	p = mmap(NULL, maplen, PROT_READ, MAP_SHARED,
+		 pps->gossip_store_fd, 0);
+	if (p == MAP_FAILED)
+		status_failed(STATUS_FAIL_INTERNAL_ERROR,
+			      "gossip_store: failed mmap of %zu: %s",
+			      maplen, strerror(errno));
+#ifdef MREMAP_MAYMOVE
+mapped:
+#endif
+	pps->gossip_store_mmap = p;
+	pps->gossip_store_mmap_len = maplen;
+	return true;
 }
 
 u8 *gossip_store_next(const tal_t *ctx, struct per_peer_state *pps)
 {
-	u8 *msg = NULL;
-
 	/* Don't read until we're initialized. */
 	if (!pps->gs)
 		return NULL;
 
-	while (!msg) {
+	/* Pick up where whoever had the fd before us left off. */
+	if (pps->gossip_store_off == 0)
+		pps->gossip_store_off = lseek(pps->gossip_store_fd,
+					      0, SEEK_CUR);
+
+	for (;;) {
 		struct gossip_hdr hdr;
-		u32 msglen, checksum, timestamp;
+		const u8 *p;
+		u8 *msg;
+		u32 msglen, timestamp;
 		bool push;
-		int type, r;
-
-		r = read(pps->gossip_store_fd, &hdr, sizeof(hdr));
-		if (r != sizeof(hdr)) {
-			/* We expect a 0 read here at EOF */
-			if (r != 0)
-				undo_read(pps->gossip_store_fd, r, sizeof(hdr));
-			per_peer_state_reset_gossip_timer(pps);
-			return NULL;
-		}
+		int type;
 
-		/* Skip any deleted entries. */
-		if (be32_to_cpu(hdr.len) & GOSSIP_STORE_LEN_DELETED_BIT) {
-			/* Skip over it. */
-			lseek(pps->gossip_store_fd,
-			      be32_to_cpu(hdr.len) & GOSSIP_STORE_LEN_MASK,
-			      SEEK_CUR);
-			continue;
-		}
+		if (!map_store(pps, pps->gossip_store_off, sizeof(hdr)))
+			break;
+		memcpy(&hdr, pps->gossip_store_mmap + pps->gossip_store_off,
+		       sizeof(hdr));
 
 		msglen = be32_to_cpu(hdr.len);
 		push = (msglen & GOSSIP_STORE_LEN_PUSH_BIT);
 		msglen &= GOSSIP_STORE_LEN_MASK;
 
-		checksum = be32_to_cpu(hdr.crc);
-		timestamp = be32_to_cpu(hdr.timestamp);
-		msg = tal_arr(ctx, u8, msglen);
-		r = read(pps->gossip_store_fd, msg, msglen);
-		if (r != msglen) {
-			undo_read(pps->gossip_store_fd, r, msglen);
-			per_peer_state_reset_gossip_timer(pps);
-			return NULL;
-		}
+		/* Wait for the rest if it's only partially written */
+		if (!map_store(pps, pps->gossip_store_off + sizeof(hdr),
+			       msglen))
+			break;
+		p = pps->gossip_store_mmap + pps->gossip_store_off
+			+ sizeof(hdr);
+		pps->gossip_store_off += sizeof(hdr) + msglen;
+
+		/* Skip any deleted entries. */
+		if (be32_to_cpu(hdr.len) & GOSSIP_STORE_LEN_DELETED_BIT)
+			continue;
 
-		if (checksum != crc32c(be32_to_cpu(hdr.timestamp), msg, msglen))
+		timestamp = be32_to_cpu(hdr.timestamp);
+		if (gossip_store_check_crc
+		    && be32_to_cpu(hdr.crc) != crc32c(timestamp, p, msglen))
 			status_failed(STATUS_FAIL_INTERNAL_ERROR,
 				      "gossip_store: bad checksum offset %"
-				      PRIi64": %s",
-				      (s64)lseek(pps->gossip_store_fd,
-						 0, SEEK_CUR) - msglen,
-				      tal_hex(tmpctx, msg));
+				      PRIu64": %s",
+				      pps->gossip_store_off - msglen,
+				      tal_hexstr(tmpctx, p, msglen));
+
+		/* Ignore gossipd internal messages. */
+		if (msglen < sizeof(be16))
+			continue;
+		type = ((int)p[0] << 8) | p[1];
+		if (type != WIRE_CHANNEL_ANNOUNCEMENT
+		    && type != WIRE_CHANNEL_UPDATE
+		    && type != WIRE_NODE_ANNOUNCEMENT)
+			continue;
+		if (!push && !timestamp_filter(pps, timestamp))
+			continue;
 
 		/* Don't send back gossip they sent to us! */
+		msg = tal_dup_arr(ctx, u8, p, msglen, 0);
 		if (gossip_rcvd_filter_del(pps->grf, msg)) {
-			msg = tal_free(msg);
+			tal_free(msg);
 			continue;
 		}
+		return msg;
+	}
 
-		/* Ignore gossipd internal messages. */
-		type = fromwire_peektype(msg);
-		if (type != WIRE_CHANNEL_ANNOUNCEMENT
-		    && type != WIRE_CHANNEL_UPDATE
-		    && type != WIRE_NODE_ANNOUNCEMENT)
-			msg = tal_free(msg);
-		else if (!push && !timestamp_filter(pps, timestamp))
-			msg = tal_free(msg);
+	/* Leave the fd at the end too, in case we hand it on. */
+	per_peer_state_sync_gossip_store(pps);
+	per_peer_state_reset_gossip_timer(pps);
+	return NULL;
+}
+
+u8 **gossip_store_next_batch(const tal_t *ctx, struct per_peer_state *pps)
+{
+	u8 **msgs = tal_arr(ctx, u8 *, 0);
+	size_t bytes = 0;
+
+	/* We only send what's there now: we don't wait for more. */
+	while (bytes < pps->gossip_batch_bytes) {
+		u8 *msg = gossip_store_next(msgs, pps);
+		if (!msg)
+			break;
+		tal_arr_expand(&msgs, msg);
+		bytes += tal_bytelen(msg);
 	}
 
-	return msg;
+	if (tal_count(msgs) == 0)
+		return tal_free(msgs);
+	return msgs;
 }
 
 /* newfd is at offset 1.  We need to adjust it to similar offset as our
@@ -152,7 +218,10 @@ u8 *gossip_store_next(const tal_t *ctx, struct per_peer_state *pps)
 void gossip_store_switch_fd(struct per_peer_state *pps,
 			    int newfd, u64 offset_shorter)
 {
-	u64 cur = lseek(pps->gossip_store_fd, 0, SEEK_CUR);
+	u64 cur;
+
+	per_peer_state_sync_gossip_store(pps);
+	cur = lseek(pps->gossip_store_fd, 0, SEEK_CUR);
 
 	/* If we're already at end (common), we know where to go in new one. */
 	if (cur == lseek(pps->gossip_store_fd, 0, SEEK_END)) {
@@ -196,4 +265,12 @@ void gossip_store_switch_fd(struct per_peer_state *pps,
 
 	close(pps->gossip_store_fd);
 	pps->gossip_store_fd = newfd;
+
+	/* Start again with the new one. */
+	if (pps->gossip_store_mmap)
+		munmap((void *)pps->gossip_store_mmap,
+		       pps->gossip_store_mmap_len);
+	pps->gossip_store_mmap = NULL;
+	pps->gossip_store_mmap_len = 0;
+	pps->gossip_store_off = 0;
 }
@@ -35,6 +35,12 @@ struct gossip_hdr {
 	beint32_t timestamp; /* timestamp of msg. */
 };
 
+/**
+ * Whether gossip_store_next checks each record's crc (only by default if
+ * DEVELOPER: gossipd checks them all on startup anyway).
+ */
+extern bool gossip_store_check_crc;
+
 /**
  * Direct store accessor: loads gossip msg from store.
  *
@@ -43,6 +49,21 @@ struct gossip_hdr {
  */
 u8 *gossip_store_next(const tal_t *ctx, struct per_peer_state *pps);
 
+/**
+ * How much gossip_store_next_batch gathers up at once, unless
+ * --gossip-batch-bytes says otherwise.
+ */
+#define GOSSIP_STORE_BATCH_BYTES 65536
+
+/**
+ * Loads as many gossip msgs as are in the store, up to around
+ * pps->gossip_batch_bytes, so we can send them all at once.
+ *
+ * Returns NULL and resets time_to_next_gossip(pps) if there are no
+ * more gossip msgs.
+ */
+u8 **gossip_store_next_batch(const tal_t *ctx, struct per_peer_state *pps);
+
 /**
  * Switches the gossip store fd, and gets to the correct offset.
  */
@@ -1,11 +1,14 @@
 #include <assert.h>
+#include <ccan/bitmap/bitmap.h>
 #include <ccan/bitops/bitops.h>
+#include <ccan/crc32c/crc32c.h>
 #include <ccan/crypto/siphash24/siphash24.h>
 #include <ccan/endian/endian.h>
 #include <ccan/err/err.h>
 #include <ccan/htable/htable_type.h>
 #include <ccan/mem/mem.h>
 #include <ccan/ptrint/ptrint.h>
+#include <ccan/read_write_all/read_write_all.h>
 #include <ccan/tal/str/str.h>
 #include <common/features.h>
 #include <common/gossip_store.h>
@@ -17,6 +20,7 @@
 #include <errno.h>
 #include <fcntl.h>
 #include <gossipd/gossip_store_wiregen.h>
+#include <stdio.h>
 #include <sys/mman.h>
 #include <sys/stat.h>
 #include <sys/types.h>
@@ -64,6 +68,9 @@ struct gossmap {
 	u8 *mmap;
 	/* map_end is where we read to so far, map_size is total size */
 	size_t map_end, map_size;
+	/* How much we actually mapped: more than map_size, so the file can
+	 * grow without us remapping. */
+	size_t mmap_len;
 
 	/* Map of node id -> node */
 	struct nodeidx_htable nodes;
@@ -79,6 +86,24 @@ struct gossmap {
 
 	/* Linked list of freed ones, if any. */
 	u32 freed_nodes, freed_chans;
+
+	/* While moving to a compacted store, the old identities of channels
+	 * we haven't found in the new store yet (by chan idx). */
+	struct chan_ident *old_ids;
+	bitmap *unmoved;
+
+	struct gossmap_stats stats;
+
+	/* Compact copy of the graph, if enabled, and whether it's out of
+	 * date. */
+	struct gossmap_csr *csr;
+	bool csr_stale;
+};
+
+/* A channel's identity, which we need for the htables. */
+struct chan_ident {
+	struct short_channel_id scid;
+	struct node_id node_id[2];
 };
 
 /* Accessors for the gossmap */
@@ -175,6 +200,18 @@ u32 gossmap_chan_idx(const struct gossmap *map, const struct gossmap_chan *chan)
 	return chan - map->chan_arr;
 }
 
+struct gossmap_node *gossmap_node_byidx(const struct gossmap *map, u32 idx)
+{
+	assert(idx < tal_count(map->node_arr));
+	return map->node_arr + idx;
+}
+
+struct gossmap_chan *gossmap_chan_byidx(const struct gossmap *map, u32 idx)
+{
+	assert(idx < tal_count(map->chan_arr));
+	return map->chan_arr + idx;
+}
+
 /* htable can't handle NULL values, so we add 1 */
 static struct gossmap_chan *ptrint2chan(const ptrint_t *pidx)
 {
@@ -196,15 +233,38 @@ static ptrint_t *node2ptrint(const struct gossmap_node *node)
 	return int2ptr(node - map->node_arr + 1);
 }
 
+/* Is this a channel from the old store, which we haven't seen yet in the
+ * new (compacted) store? */
+static bool chan_unmoved(const struct gossmap *map,
+			 const struct gossmap_chan *chan)
+{
+	u32 chanidx = chan - map->chan_arr;
+
+	return map->unmoved
+		&& chanidx < tal_count(map->old_ids)
+		&& bitmap_test_bit(map->unmoved, chanidx);
+}
+
 static struct short_channel_id chanidx_id(const ptrint_t *pidx)
 {
-	return gossmap_chan_scid(map, ptrint2chan(pidx));
+	struct gossmap_chan *chan = ptrint2chan(pidx);
+
+	if (chan_unmoved(map, chan))
+		return map->old_ids[chan - map->chan_arr].scid;
+	return gossmap_chan_scid(map, chan);
 }
 
 static struct node_id nodeidx_id(const ptrint_t *pidx)
 {
+	struct gossmap_node *node = ptrint2node(pidx);
 	struct node_id id;
-	gossmap_node_get_id(map, ptrint2node(pidx), &id);
+	struct gossmap_chan *chan;
+	int dir;
+
+	chan = gossmap_nth_chan(map, node, 0, &dir);
+	if (chan_unmoved(map, chan))
+		return map->old_ids[chan - map->chan_arr].node_id[dir];
+	gossmap_node_get_id(map, node, &id);
 	return id;
 }
 
@@ -362,6 +422,7 @@ static struct gossmap_chan *new_channel(struct gossmap *map,
 	chan->cann_off = cannounce_off;
 	chan->scid_off = scid_off;
 	memset(chan->half, 0, sizeof(chan->half));
+	chan->cupdate_off[0] = chan->cupdate_off[1] = 0;
 	chan->half[0].nodeidx = n1idx;
 	chan->half[1].nodeidx = n2idx;
 	node_add_channel(map->node_arr + n1idx, gossmap_chan_idx(map, chan));
@@ -400,6 +461,11 @@ void gossmap_remove_chan(struct gossmap *map, struct gossmap_chan *chan)
 	chan->cann_off = map->freed_chans;
 	chan->scid_off = 0;
 	map->freed_chans = chanidx;
+
+	/* This slot can be reused by a new channel */
+	if (chan_unmoved(map, chan))
+		bitmap_clear_bit(map->unmoved, chanidx);
+	map->csr_stale = true;
 }
 
 void gossmap_remove_node(struct gossmap *map, struct gossmap_node *node)
@@ -435,6 +501,21 @@ static void add_channel(struct gossmap *map, size_t cannounce_off)
 	feature_len = map_be16(map, cannounce_off + feature_len_off);
 	scid_off = cannounce_off + feature_len_off + 2 + feature_len + 32;
 
+	/* If we're moving to a compacted store, we probably know it. */
+	if (map->unmoved) {
+		struct short_channel_id scid;
+		struct gossmap_chan *chan;
+
+		scid.u64 = map_be64(map, scid_off);
+		chan = gossmap_find_chan(map, &scid);
+		if (chan && chan_unmoved(map, chan)) {
+			chan->cann_off = cannounce_off;
+			chan->scid_off = scid_off;
+			bitmap_clear_bit(map->unmoved, gossmap_chan_idx(map, chan));
+			return;
+		}
+	}
+
 	map_nodeid(map, scid_off + 8, &node_id[0]);
 	map_nodeid(map, scid_off + 8 + PUBKEY_CMPR_LEN, &node_id[1]);
 
@@ -490,7 +571,7 @@ static void update_channel(struct gossmap *map, size_t cupdate_off)
 	const size_t htlc_maximum_off = fee_prop_off + 4;
 	struct short_channel_id scid;
 	struct gossmap_chan *chan;
-	struct half_chan hc;
+	struct gossmap_half_chan hc;
 	u8 chanflags;
 
 	scid.u64 = map_be64(map, scid_off);
@@ -499,6 +580,9 @@ static void update_channel(struct gossmap *map, size_t cupdate_off)
 		errx(1, "update for channel %s not found!",
 		     type_to_string(tmpctx, struct short_channel_id, &scid));
 
+	chanflags = map_u8(map, channel_flags_off);
+	chan->cupdate_off[chanflags & 1] = cupdate_off;
+
 	hc.htlc_min = u64_to_fp16(map_be64(map, htlc_minimum_off), true);
 	/* I checked my node: 60189 of 62358 channel_update have
 	 * htlc_maximum_msat, so we don't bother setting the rest to the
@@ -525,7 +609,6 @@ static void update_channel(struct gossmap *map, size_t cupdate_off)
 		return;
 	}
 
-	chanflags = map_u8(map, channel_flags_off);
 	hc.enabled = !(chanflags & 2);
 	/* Preserve this */
 	hc.nodeidx = chan->half[chanflags & 1].nodeidx;
@@ -585,7 +668,7 @@ static void node_announcement(struct gossmap *map, size_t nann_off)
 
 static bool map_catchup(struct gossmap *map)
 {
-	size_t reclen;
+	size_t reclen, start = map->map_end;
 	bool changed = false;
 
 	for (; map->map_end + sizeof(struct gossip_hdr) < map->map_size;
@@ -627,10 +710,56 @@ static bool map_catchup(struct gossmap *map)
 		changed = true;
 	}
 
+	map->stats.bytes_parsed += map->map_end - start;
+	if (changed)
+		map->csr_stale = true;
 	return changed;
 }
 
-static bool load_gossip_store(struct gossmap *map)
+/* Make sure our mmap covers the first size bytes of the file.  We map
+ * extra, so we don't need to remap every time the file grows: we never
+ * access past map_size, so the pages past the end of file are harmless. */
+static void map_file(struct gossmap *map, size_t size)
+{
+	size_t len;
+
+	map->map_size = size;
+	if (map->mmap && size <= map->mmap_len)
+		return;
+
+	map->stats.remaps++;
+	len = size + size / 2;
+#ifdef MREMAP_MAYMOVE
+	if (map->mmap) {
+		void *p = mremap(map->mmap, map->mmap_len, len, MREMAP_MAYMOVE);
+		if (p != MAP_FAILED) {
+			map->mmap = p;
+			map->mmap_len = len;
+			return;
+		}
+	}
+#endif
+	if (map->mmap)
+		munmap(map->mmap, map->mmap_len);
+	/* If this fails, we fall back to read */
+	map->mmap = mmap(NULL, len, PROT_READ, MAP_SHARED, map->fd, 0);
+	if (map->mmap == MAP_FAILED) {
+		map->mmap = NULL;
+		map->mmap_len = 0;
+	} else
+		map->mmap_len = len;
+}
+
+static void unmap_file(struct gossmap *map)
+{
+	if (map->mmap)
+		munmap(map->mmap, map->mmap_len);
+	map->mmap = NULL;
+	map->mmap_len = 0;
+	close(map->fd);
+}
+
+static bool open_gossip_store(struct gossmap *map)
 {
 	struct stat st;
 
@@ -641,42 +770,508 @@ static bool load_gossip_store(struct gossmap *map)
 	fstat(map->fd, &st);
 	map->st_dev = st.st_dev;
 	map->st_ino = st.st_ino;
-	map->map_size = st.st_size;
-	/* If this fails, we fall back to read */
-	map->mmap = mmap(NULL, map->map_size, PROT_READ, MAP_SHARED, map->fd, 0);
-	if (map->mmap == MAP_FAILED)
-		map->mmap = NULL;
+	map->mmap = NULL;
+	map_file(map, st.st_size);
 
 	if (map_u8(map, 0) != GOSSIP_STORE_VERSION) {
-		close(map->fd);
-		if (map->mmap)
-			munmap(map->mmap, map->map_size);
+		unmap_file(map);
 		errno = EINVAL;
 		return false;
 	}
+	map->map_end = 1;
+	return true;
+}
+
+/* The index file is just our arrays, and the keys for our htables, as of
+ * some point in the gossip_store (which gossipd only ever appends to, until
+ * it compacts it into a new file). */
+#define GOSSMAP_INDEX_VERSION 2
+
+/* A compacted store can get the old one's inode, and even be the same
+ * length, so we also check the bytes at the start and just before
+ * map_end. */
+#define GOSSMAP_INDEX_CHECK_LEN 4096
+
+struct gossmap_index_hdr {
+	u32 version;
+	/* In case we change these structures */
+	u32 chan_size, node_size;
+	u32 store_version;
+	/* Which gossip_store this is for, and how far we'd read. */
+	u32 store_crc;
+	u64 st_dev, st_ino;
+	u64 map_end;
+	u64 num_chans, num_nodes, num_chan_idxs;
+	u32 freed_chans, freed_nodes;
+	/* Followed by:
+	 * struct gossmap_chan chan_arr[num_chans];
+	 * struct short_channel_id scids[num_chans];
+	 * struct gossmap_node node_arr[num_nodes];
+	 * struct node_id node_ids[num_nodes];
+	 * u32 chan_idxs[num_chan_idxs];
+	 */
+};
+
+static const char *index_filename(const tal_t *ctx, const struct gossmap *map)
+{
+	return tal_fmt(ctx, "%s.idx", map->fname);
+}
+
+static size_t index_len(const struct gossmap_index_hdr *hdr)
+{
+	return sizeof(*hdr)
+		+ hdr->num_chans * (sizeof(struct gossmap_chan)
+				    + sizeof(struct short_channel_id))
+		+ hdr->num_nodes * (sizeof(struct gossmap_node)
+				    + sizeof(struct node_id))
+		+ hdr->num_chan_idxs * sizeof(u32);
+}
+
+/* crc32c of the store's first and last GOSSMAP_INDEX_CHECK_LEN bytes
+ * before map_end. */
+static u32 store_crc(const struct gossmap *map, u64 map_end)
+{
+	size_t len = map_end < GOSSMAP_INDEX_CHECK_LEN
+		? map_end : GOSSMAP_INDEX_CHECK_LEN;
+	u8 *buf = tal_arr(tmpctx, u8, len);
+	u32 crc;
+
+	map_copy(map, 0, buf, len);
+	crc = crc32c(0, buf, len);
+	map_copy(map, map_end - len, buf, len);
+	return crc32c(crc, buf, len);
+}
+
+static struct gossmap_chan index_chan(const struct gossmap_index_hdr *hdr,
+				      const u8 *idx, u32 i)
+{
+	struct gossmap_chan chan;
+
+	memcpy(&chan, idx + sizeof(*hdr) + i * sizeof(chan), sizeof(chan));
+	return chan;
+}
+
+static struct gossmap_node index_node(const struct gossmap_index_hdr *hdr,
+				      const u8 *idx, u32 i)
+{
+	struct gossmap_node node;
+
+	memcpy(&node,
+	       idx + sizeof(*hdr)
+	       + hdr->num_chans * (sizeof(struct gossmap_chan)
+				   + sizeof(struct short_channel_id))
+	       + i * sizeof(node),
+	       sizeof(node));
+	return node;
+}
+
+/* The store_crc tells us the store hasn't changed, not that the index
+ * wasn't damaged: make sure it can't send us outside the store or our
+ * arrays.  Free entries (scid_off 0 for chans, num_chans 0 for nodes)
+ * link to the next free one via cann_off/nann_off. */
+static bool index_contents_ok(const struct gossmap_index_hdr *hdr,
+			      const u8 *idx)
+{
+	const u8 *chan_idxs;
+	size_t total = 0, num_free = 0;
+	u32 f;
+
+	for (u32 i = 0; i < hdr->num_chans; i++) {
+		struct gossmap_chan chan = index_chan(hdr, idx, i);
+
+		if (chan.scid_off == 0) {
+			if (chan.cann_off >= hdr->num_chans
+			    && chan.cann_off != UINT_MAX)
+				return false;
+			num_free++;
+			continue;
+		}
+		if (chan.cann_off == 0
+		    || chan.scid_off <= chan.cann_off
+		    || chan.scid_off + sizeof(struct short_channel_id)
+		    > hdr->map_end)
+			return false;
+		for (int dir = 0; dir < 2; dir++) {
+			if (chan.cupdate_off[dir] >= hdr->map_end)
+				return false;
+			if (chan.half[dir].nodeidx >= hdr->num_nodes
+			    || index_node(hdr, idx,
+					  chan.half[dir].nodeidx).num_chans == 0)
+				return false;
+		}
+	}
+
+	/* The free list must only contain free entries, and end. */
+	for (f = hdr->freed_chans; f != UINT_MAX; num_free--) {
+		if (num_free == 0 || f >= hdr->num_chans)
+			return false;
+		if (index_chan(hdr, idx, f).scid_off != 0)
+			return false;
+		f = index_chan(hdr, idx, f).cann_off;
+	}
+
+	chan_idxs = idx + index_len(hdr) - hdr->num_chan_idxs * sizeof(u32);
+	num_free = 0;
+	for (u32 i = 0; i < hdr->num_nodes; i++) {
+		struct gossmap_node node = index_node(hdr, idx, i);
+
+		if (node.num_chans == 0) {
+			if (node.nann_off >= hdr->num_nodes
+			    && node.nann_off != UINT_MAX)
+				return false;
+			num_free++;
+			continue;
+		}
+		if (node.nann_off >= hdr->map_end)
+			return false;
+
+		/* Make sure the nodes' channels add up, and are real. */
+		if (node.num_chans > hdr->num_chan_idxs - total)
+			return false;
+		for (u32 j = 0; j < node.num_chans; j++) {
+			struct gossmap_chan chan;
+			u32 chanidx;
+
+			memcpy(&chanidx, chan_idxs + (total + j) * sizeof(u32),
+			       sizeof(chanidx));
+			if (chanidx >= hdr->num_chans)
+				return false;
+			chan = index_chan(hdr, idx, chanidx);
+			if (chan.scid_off == 0
+			    || (chan.half[0].nodeidx != i
+				&& chan.half[1].nodeidx != i))
+				return false;
+		}
+		total += node.num_chans;
+	}
+
+	for (f = hdr->freed_nodes; f != UINT_MAX; num_free--) {
+		if (num_free == 0 || f >= hdr->num_nodes)
+			return false;
+		if (index_node(hdr, idx, f).num_chans != 0)
+			return false;
+		f = index_node(hdr, idx, f).nann_off;
+	}
+
+	return true;
+}
+
+/* Pull these many bytes off the (already length-checked) index */
+static const u8 *index_pull(const u8 **p, size_t len)
+{
+	const u8 *ret = *p;
+	*p += len;
+	return ret;
+}
+
+/* Populate the map from the index, instead of reading the whole store.
+ * On failure, map is untouched. */
+static bool load_index(struct gossmap *map)
+{
+	struct gossmap_index_hdr hdr;
+	const struct short_channel_id *scids;
+	const struct node_id *node_ids;
+	const u8 *idx, *p, *chan_idxs;
+	int fd;
+	struct stat st;
+
+	fd = open(index_filename(tmpctx, map), O_RDONLY);
+	if (fd < 0)
+		return false;
+	if (fstat(fd, &st) != 0 || st.st_size < sizeof(hdr)) {
+		close(fd);
+		return false;
+	}
+	idx = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (idx == MAP_FAILED)
+		return false;
+
+	memcpy(&hdr, idx, sizeof(hdr));
+	if (hdr.version != GOSSMAP_INDEX_VERSION
+	    || hdr.chan_size != sizeof(struct gossmap_chan)
+	    || hdr.node_size != sizeof(struct gossmap_node)
+	    || hdr.store_version != map_u8(map, 0)
+	    || hdr.st_dev != map->st_dev
+	    || hdr.st_ino != map->st_ino
+	    || hdr.map_end < 1
+	    || hdr.map_end > map->map_size
+	    || hdr.num_chans == 0
+	    || hdr.num_nodes == 0
+	    /* Indexes are u32, and this means index_len() can't wrap. */
+	    || hdr.num_chans >= UINT_MAX
+	    || hdr.num_nodes >= UINT_MAX
+	    || hdr.num_chan_idxs >= UINT_MAX
+	    || index_len(&hdr) != st.st_size
+	    || hdr.store_crc != store_crc(map, hdr.map_end))
+		goto fail;
+
+	if (!index_contents_ok(&hdr, idx))
+		goto fail;
+
+	p = idx + sizeof(hdr);
+	map->chan_arr = tal_dup_arr(map, struct gossmap_chan,
+				    (const struct gossmap_chan *)
+				    index_pull(&p, hdr.num_chans
+					       * sizeof(struct gossmap_chan)),
+				    hdr.num_chans, 0);
+	scids = (const struct short_channel_id *)
+		index_pull(&p, hdr.num_chans * sizeof(*scids));
+	map->node_arr = tal_dup_arr(map, struct gossmap_node,
+				    (const struct gossmap_node *)
+				    index_pull(&p, hdr.num_nodes
+					       * sizeof(struct gossmap_node)),
+				    hdr.num_nodes, 0);
+	node_ids = (const struct node_id *)
+		index_pull(&p, hdr.num_nodes * sizeof(*node_ids));
+	chan_idxs = index_pull(&p, hdr.num_chan_idxs * sizeof(u32));
+
+	map->freed_chans = hdr.freed_chans;
+	map->freed_nodes = hdr.freed_nodes;
+	map->map_end = hdr.map_end;
+
+	/* We know the keys already, so we don't need to touch the store to
+	 * hash them. */
+	chanidx_htable_init_sized(&map->channels, hdr.num_chans);
+	for (size_t i = 0; i < hdr.num_chans; i++) {
+		struct short_channel_id scid;
+
+		if (map->chan_arr[i].scid_off == 0)
+			continue;
+		memcpy(&scid, &scids[i], sizeof(scid));
+		htable_add(&map->channels.raw, scid_hash(scid),
+			   chan2ptrint(&map->chan_arr[i]));
+	}
+
+	nodeidx_htable_init_sized(&map->nodes, hdr.num_nodes);
+	for (size_t i = 0; i < hdr.num_nodes; i++) {
+		struct gossmap_node *node = &map->node_arr[i];
+		struct node_id id;
+		size_t len;
+
+		if (node->num_chans == 0) {
+			node->chan_idxs = NULL;
+			continue;
+		}
+		len = node->num_chans * sizeof(*node->chan_idxs);
+		node->chan_idxs = malloc(len);
+		memcpy(node->chan_idxs, chan_idxs, len);
+		chan_idxs += len;
+
+		memcpy(&id, &node_ids[i], sizeof(id));
+		htable_add(&map->nodes.raw, nodeid_hash(id), node2ptrint(node));
+	}
+
+	munmap((void *)idx, st.st_size);
+	return true;
+
+fail:
+	munmap((void *)idx, st.st_size);
+	return false;
+}
+
+/* Save what we've read so far, for next time.  It's only an optimization,
+ * so if it fails, it fails. */
+static void write_index(const struct gossmap *map)
+{
+	struct gossmap_index_hdr hdr;
+	const char *fname = index_filename(tmpctx, map);
+	const char *tmpname = tal_fmt(tmpctx, "%s.%u", fname, getpid());
+	struct short_channel_id *scids;
+	struct gossmap_node *node_arr;
+	struct node_id *node_ids;
+	u32 *chan_idxs;
+	int fd;
+	bool ok;
+
+	memset(&hdr, 0, sizeof(hdr));
+	hdr.version = GOSSMAP_INDEX_VERSION;
+	hdr.chan_size = sizeof(struct gossmap_chan);
+	hdr.node_size = sizeof(struct gossmap_node);
+	hdr.store_version = map_u8(map, 0);
+	hdr.st_dev = map->st_dev;
+	hdr.st_ino = map->st_ino;
+	hdr.map_end = map->map_end;
+	hdr.store_crc = store_crc(map, map->map_end);
+	hdr.num_chans = tal_count(map->chan_arr);
+	hdr.num_nodes = tal_count(map->node_arr);
+	hdr.freed_chans = map->freed_chans;
+	hdr.freed_nodes = map->freed_nodes;
+
+	scids = tal_arrz(tmpctx, struct short_channel_id, hdr.num_chans);
+	for (size_t i = 0; i < hdr.num_chans; i++) {
+		if (map->chan_arr[i].scid_off != 0)
+			scids[i] = gossmap_chan_scid(map, &map->chan_arr[i]);
+	}
+
+	node_arr = tal_dup_talarr(tmpctx, struct gossmap_node, map->node_arr);
+	node_ids = tal_arrz(tmpctx, struct node_id, hdr.num_nodes);
+	chan_idxs = tal_arr(tmpctx, u32, 0);
+	for (size_t i = 0; i < hdr.num_nodes; i++) {
+		/* Pointers are meaningless in the file, of course. */
+		node_arr[i].chan_idxs = NULL;
+		if (!map->node_arr[i].chan_idxs) {
+			node_arr[i].num_chans = 0;
+			continue;
+		}
+		gossmap_node_get_id(map, &map->node_arr[i], &node_ids[i]);
+		for (size_t j = 0; j < node_arr[i].num_chans; j++)
+			tal_arr_expand(&chan_idxs, map->node_arr[i].chan_idxs[j]);
+	}
+	hdr.num_chan_idxs = tal_count(chan_idxs);
+
+	fd = open(tmpname, O_WRONLY|O_CREAT|O_TRUNC, 0600);
+	if (fd < 0)
+		return;
+	ok = write_all(fd, &hdr, sizeof(hdr))
+		&& write_all(fd, map->chan_arr,
+			     hdr.num_chans * sizeof(*map->chan_arr))
+		&& write_all(fd, scids, hdr.num_chans * sizeof(*scids))
+		&& write_all(fd, node_arr, hdr.num_nodes * sizeof(*node_arr))
+		&& write_all(fd, node_ids, hdr.num_nodes * sizeof(*node_ids))
+		&& write_all(fd, chan_idxs,
+			     hdr.num_chan_idxs * sizeof(*chan_idxs));
+	close(fd);
+	if (!ok || rename(tmpname, fname) != 0)
+		unlink(tmpname);
+}
+
+static bool load_gossip_store(struct gossmap *map, bool use_index)
+{
+	bool indexed;
+
+	if (!open_gossip_store(map))
+		return false;
+
+	indexed = use_index && load_index(map);
+	if (indexed)
+		goto catchup;
 
 	/* Since channel_announcement is ~430 bytes, and channel_update is 136,
 	 * node_announcement is 144, and current topology has 35000 channels
 	 * and 10000 nodes, let's assume each channel gets about 750 bytes.
 	 *
 	 * We halve this, since often some records are deleted. */
-	chanidx_htable_init_sized(&map->channels, st.st_size / 750 / 2);
-	nodeidx_htable_init_sized(&map->nodes, st.st_size / 2500 / 2);
+	chanidx_htable_init_sized(&map->channels, map->map_size / 750 / 2);
+	nodeidx_htable_init_sized(&map->nodes, map->map_size / 2500 / 2);
 
-	map->chan_arr = tal_arr(map, struct gossmap_chan, st.st_size / 750 / 2 + 1);
+	map->chan_arr = tal_arr(map, struct gossmap_chan, map->map_size / 750 / 2 + 1);
 	map->freed_chans = init_chan_arr(map->chan_arr, 0);
-	map->node_arr = tal_arr(map, struct gossmap_node, st.st_size / 2500 / 2 + 1);
+	map->node_arr = tal_arr(map, struct gossmap_node, map->map_size / 2500 / 2 + 1);
 	map->freed_nodes = init_node_arr(map->node_arr, 0);
 
-	map->map_end = 1;
+catchup:
 	map_catchup(map);
+
+	/* Rewrite the index if it's missing, or getting out of date. */
+	if (use_index
+	    && (!indexed || map->stats.bytes_parsed > map->map_end / 4))
+		write_index(map);
 	return true;
 }
 
+/* gossipd has compacted the store, so all the offsets have changed.  But
+ * it's mostly the same channels and nodes, so rather than rebuild
+ * everything (and give everyone new indexes), we remember their ids and
+ * find them again in the new store. */
+static bool move_to_compacted_store(struct gossmap *map)
+{
+	size_t num_chans = tal_count(map->chan_arr);
+
+	map->old_ids = tal_arr(map, struct chan_ident, num_chans);
+	map->unmoved = tal_arrz(map, bitmap, BITMAP_NWORDS(num_chans));
+	for (size_t i = 0; i < num_chans; i++) {
+		struct gossmap_chan *chan = &map->chan_arr[i];
+
+		if (chan->scid_off == 0)
+			continue;
+		/* We'll find the latest updates again, too. */
+		chan->cupdate_off[0] = chan->cupdate_off[1] = 0;
+		map->old_ids[i].scid = gossmap_chan_scid(map, chan);
+		map_nodeid(map, chan->scid_off + 8, &map->old_ids[i].node_id[0]);
+		map_nodeid(map, chan->scid_off + 8 + PUBKEY_CMPR_LEN,
+			   &map->old_ids[i].node_id[1]);
+		bitmap_set_bit(map->unmoved, i);
+	}
+
+	/* We'll find their node_announcements again, if any. */
+	for (size_t i = 0; i < tal_count(map->node_arr); i++) {
+		if (map->node_arr[i].chan_idxs)
+			map->node_arr[i].nann_off = 0;
+	}
+
+	unmap_file(map);
+	if (!open_gossip_store(map))
+		return false;
+	map_catchup(map);
+
+	/* Anything we didn't find was deleted before compaction. */
+	for (size_t i = 0; i < num_chans; i++) {
+		if (bitmap_test_bit(map->unmoved, i))
+			gossmap_remove_chan(map, &map->chan_arr[i]);
+	}
+	map->old_ids = tal_free(map->old_ids);
+	map->unmoved = tal_free(map->unmoved);
+	map->stats.compactions++;
+	return true;
+}
+
+static void build_csr(struct gossmap *map)
+{
+	struct gossmap_csr *csr = map->csr;
+	size_t num_nodes = tal_count(map->node_arr), num_edges = 0;
+
+	for (size_t i = 0; i < num_nodes; i++) {
+		if (map->node_arr[i].chan_idxs)
+			num_edges += map->node_arr[i].num_chans;
+	}
+	tal_resize(&csr->first, num_nodes + 1);
+	tal_resize(&csr->edges, num_edges);
+
+	num_edges = 0;
+	for (size_t i = 0; i < num_nodes; i++) {
+		const struct gossmap_node *node = &map->node_arr[i];
+
+		csr->first[i] = num_edges;
+		if (!node->chan_idxs)
+			continue;
+		for (size_t j = 0; j < node->num_chans; j++) {
+			struct gossmap_edge *e = &csr->edges[num_edges++];
+			int which_half;
+			const struct gossmap_chan *c;
+
+			c = gossmap_nth_chan(map, node, j, &which_half);
+			e->chan_idx = node->chan_idxs[j];
+			/* From the other node, to this one. */
+			e->dir = !which_half;
+			e->half = c->half[!which_half];
+		}
+	}
+	csr->first[num_nodes] = num_edges;
+	map->csr_stale = false;
+}
+
+void gossmap_enable_csr(struct gossmap *map)
+{
+	if (map->csr)
+		return;
+	map->csr = tal(map, struct gossmap_csr);
+	map->csr->first = tal_arr(map->csr, u32, 0);
+	map->csr->edges = tal_arr(map->csr, struct gossmap_edge, 0);
+	build_csr(map);
+}
+
+const struct gossmap_csr *gossmap_csr(const struct gossmap *map)
+{
+	if (map->csr_stale)
+		return NULL;
+	return map->csr;
+}
+
 static void destroy_map(struct gossmap *map)
 {
 	if (map->mmap)
-		munmap(map->mmap, map->map_size);
+		munmap(map->mmap, map->mmap_len);
 	chanidx_htable_clear(&map->channels);
 	nodeidx_htable_clear(&map->nodes);
 
@@ -684,47 +1279,84 @@ static void destroy_map(struct gossmap *map)
 		free(map->node_arr[i].chan_idxs);
 }
 
+bool gossmap_refresh_needed(const struct gossmap *map)
+{
+	struct stat st;
+
+	/* Let gossmap_refresh() complain about this. */
+	if (stat(map->fname, &st) != 0)
+		return true;
+
+	return map->st_ino != st.st_ino || map->st_dev != st.st_dev
+		|| st.st_size != map->map_size;
+}
+
 bool gossmap_refresh(struct gossmap *map)
 {
 	struct stat st;
+	struct timemono start = time_mono();
+	bool changed;
 
 	/* If file has changed, move to it. */
 	if (stat(map->fname, &st) != 0)
 		err(1, "statting %s", map->fname);
 
 	if (map->st_ino != st.st_ino || map->st_dev != st.st_dev) {
-		destroy_map(map);
-		tal_free(map->chan_arr);
-		tal_free(map->node_arr);
-		if (!load_gossip_store(map))
+		if (!move_to_compacted_store(map))
 			err(1, "reloading %s", map->fname);
-		return true;
+		changed = true;
+	} else if (st.st_size == map->map_size) {
+		changed = false;
+	} else {
+		/* File has gotten larger, try rereading */
+		map_file(map, st.st_size);
+		changed = map_catchup(map);
 	}
 
-	/* If file has gotten larger, try rereading */
-	if (st.st_size == map->map_size)
-		return false;
+	/* Anyone using the csr has to wait until now, anyway */
+	if (map->csr && map->csr_stale)
+		build_csr(map);
 
-	if (map->mmap)
-		munmap(map->mmap, map->map_size);
-	map->map_size = st.st_size;
-	map->mmap = mmap(NULL, map->map_size, PROT_READ, MAP_SHARED, map->fd, 0);
-	if (map->mmap == MAP_FAILED)
-		map->mmap = NULL;
-	return map_catchup(map);
+	map->stats.refreshes++;
+	if (changed)
+		map->stats.changed++;
+	map->stats.refresh_time = timerel_add(map->stats.refresh_time,
+					      timemono_since(start));
+	return changed;
 }
 
-struct gossmap *gossmap_load(const tal_t *ctx, const char *filename)
+const struct gossmap_stats *gossmap_stats(const struct gossmap *map)
+{
+	return &map->stats;
+}
+
+static struct gossmap *load(const tal_t *ctx, const char *filename,
+			     bool use_index)
 {
 	map = tal(ctx, struct gossmap);
 	map->fname = tal_strdup(map, filename);
-	if (load_gossip_store(map))
+	map->old_ids = NULL;
+	map->unmoved = NULL;
+	map->csr = NULL;
+	map->csr_stale = false;
+	memset(&map->stats, 0, sizeof(map->stats));
+	if (load_gossip_store(map, use_index))
 		tal_add_destructor(map, destroy_map);
 	else
 		map = tal_free(map);
 	return map;
 }
 
+struct gossmap *gossmap_load(const tal_t *ctx, const char *filename)
+{
+	return load(ctx, filename, false);
+}
+
+struct gossmap *gossmap_load_indexed(const tal_t *ctx, const char *filename)
+{
+	return load(ctx, filename, true);
+}
+
 void gossmap_node_get_id(const struct gossmap *map,
 			 const struct gossmap_node *node,
 			 struct node_id *id)
@@ -832,12 +1464,93 @@ bool gossmap_chan_capacity(const struct gossmap_chan *chan,
 	return true;
 }
 
+/* Private channels are wrapped in gossip_store_private_channel (and their
+ * updates in gossip_store_private_update), so the announcement is preceded
+ * by type, satoshis and len.  For a public one, that's the record header,
+ * and the top of its len is only ever flags, never a message type. */
+bool gossmap_chan_is_private(const struct gossmap *map,
+			     const struct gossmap_chan *c)
+{
+	return map_be16(map, c->cann_off - 2 - 8 - 2)
+		== WIRE_GOSSIP_STORE_PRIVATE_CHANNEL;
+}
+
+/* Records in the store have their length in the header, but wrapped ones
+ * have their own length just before them. */
+static size_t msg_len(const struct gossmap *map, size_t off, bool wrapped)
+{
+	if (wrapped)
+		return map_be16(map, off - 2);
+	return map_be32(map, off - sizeof(struct gossip_hdr))
+		& GOSSIP_STORE_LEN_MASK;
+}
+
+bool gossmap_chan_get_capacity(const struct gossmap *map,
+			       const struct gossmap_chan *c,
+			       struct amount_sat *amount)
+{
+	size_t off;
+
+	/* Just before the len of the wrapped channel_announcement */
+	if (gossmap_chan_is_private(map, c)) {
+		amount->satoshis = map_be64(map, c->cann_off - 2 - 8); /* Raw: from store */
+		return true;
+	}
+
+	/* Otherwise, gossipd puts a gossip_store_channel_amount straight
+	 * after the channel_announcement. */
+	off = c->cann_off + msg_len(map, c->cann_off, false)
+		+ sizeof(struct gossip_hdr);
+	if (off + 2 + 8 > map->map_size
+	    || map_be16(map, off) != WIRE_GOSSIP_STORE_CHANNEL_AMOUNT)
+		return false;
+	amount->satoshis = map_be64(map, off + 2); /* Raw: from store */
+	return true;
+}
+
+void gossmap_chan_get_update_details(const struct gossmap *map,
+				     const struct gossmap_chan *chan,
+				     int dir,
+				     u32 *timestamp,
+				     u8 *message_flags,
+				     u8 *channel_flags,
+				     u16 *cltv_expiry_delta,
+				     u32 *fee_base_msat,
+				     u32 *fee_proportional_millionths,
+				     struct amount_msat *htlc_minimum_msat,
+				     struct amount_msat *htlc_maximum_msat)
+{
+	/* Note that first two bytes are message type */
+	const size_t scid_off = chan->cupdate_off[dir] + 2 + (64 + 32);
+	const size_t timestamp_off = scid_off + 8;
+	const size_t message_flags_off = timestamp_off + 4;
+	const size_t channel_flags_off = message_flags_off + 1;
+	const size_t cltv_expiry_delta_off = channel_flags_off + 1;
+	const size_t htlc_minimum_off = cltv_expiry_delta_off + 2;
+	const size_t fee_base_off = htlc_minimum_off + 8;
+	const size_t fee_prop_off = fee_base_off + 4;
+	const size_t htlc_maximum_off = fee_prop_off + 4;
+
+	assert(gossmap_chan_has_update(chan, dir));
+	*timestamp = map_be32(map, timestamp_off);
+	*message_flags = map_u8(map, message_flags_off);
+	*channel_flags = map_u8(map, channel_flags_off);
+	*cltv_expiry_delta = map_be16(map, cltv_expiry_delta_off);
+	*fee_base_msat = map_be32(map, fee_base_off);
+	*fee_proportional_millionths = map_be32(map, fee_prop_off);
+	htlc_minimum_msat->millisatoshis = map_be64(map, htlc_minimum_off); /* Raw: from store */
+	if (*message_flags & 1)
+		htlc_maximum_msat->millisatoshis /* Raw: from store */
+			= map_be64(map, htlc_maximum_off);
+}
+
 /* Get the announcement msg which created this chan */
 u8 *gossmap_chan_get_announce(const tal_t *ctx,
 			      const struct gossmap *map,
 			      const struct gossmap_chan *c)
 {
-	u16 len = map_be16(map, c->cann_off);
+	size_t len = msg_len(map, c->cann_off,
+			     gossmap_chan_is_private(map, c));
 	u8 *msg = tal_arr(ctx, u8, len);
 
 	map_copy(map, c->cann_off, msg, len);
@@ -849,13 +1562,13 @@ u8 *gossmap_node_get_announce(const tal_t *ctx,
 			      const struct gossmap *map,
 			      const struct gossmap_node *n)
 {
-	u16 len;
+	size_t len;
 	u8 *msg;
 
 	if (n->nann_off == 0)
 		return NULL;
 
-	len = map_be16(map, n->nann_off);
+	len = msg_len(map, n->nann_off, false);
 	msg = tal_arr(ctx, u8, len);
 
 	map_copy(map, n->nann_off, msg, len);
@@ -890,6 +1603,21 @@ int gossmap_chan_has_feature(const struct gossmap *map,
 				c->cann_off + feature_len_off + 2, feature_len);
 }
 
+u8 *gossmap_chan_get_features(const tal_t *ctx,
+			      const struct gossmap *map,
+			      const struct gossmap_chan *c)
+{
+	/* Note that first two bytes are message type */
+	const size_t feature_len_off = 2 + (64 + 64 + 64 + 64);
+	size_t feature_len;
+	u8 *features;
+
+	feature_len = map_be16(map, c->cann_off + feature_len_off);
+	features = tal_arr(ctx, u8, feature_len);
+	map_copy(map, c->cann_off + feature_len_off + 2, features, feature_len);
+	return features;
+}
+
 /* BOLT #7:
  * 1. type: 257 (`node_announcement`)
  * 2. data:
@@ -2,6 +2,7 @@
 #define LIGHTNING_COMMON_GOSSMAP_H
 #include "config.h"
 #include <bitcoin/short_channel_id.h>
+#include <ccan/time/time.h>
 #include <ccan/typesafe_cb/typesafe_cb.h>
 #include <common/amount.h>
 
@@ -22,7 +23,7 @@ struct gossmap_chan {
 	/* Technically redundant, but we have a hole anyway. */
 	u32 scid_off;
 	/* two nodes we connect (lesser idx first) */
-	struct half_chan {
+	struct gossmap_half_chan {
 		/* Top bit indicates it's enabled */
 		u32 enabled: 1;
 		u32 nodeidx : 31;
@@ -35,6 +36,24 @@ struct gossmap_chan {
 		/* Delay for HTLC in blocks. */
 		u64 delay : 20;
 	} half[2];
+	/* Offset in memory map for latest channel_update each way, or 0. */
+	u32 cupdate_off[2];
+};
+
+/* An entry in gossmap_csr: a channel into a node. */
+struct gossmap_edge {
+	/* Copy of chan->half[dir]: nodeidx is the node at the other end. */
+	struct gossmap_half_chan half;
+	/* The channel, and the direction from the other node to this. */
+	u32 chan_idx : 31;
+	u32 dir : 1;
+};
+
+/* A compact copy of every node's channels, for route finding: the edges
+ * into node n are edges[first[n]] up to edges[first[n+1]]. */
+struct gossmap_csr {
+	u32 *first;
+	struct gossmap_edge *edges;
 };
 
 static inline u64 fp16_to_u64(fp16_t val)
@@ -44,14 +63,50 @@ static inline u64 fp16_to_u64(fp16_t val)
 
 struct gossmap *gossmap_load(const tal_t *ctx, const char *filename);
 
+/* Same, but keep an index in filename.idx: if it's valid, we only need to
+ * read the store from where it left off. */
+struct gossmap *gossmap_load_indexed(const tal_t *ctx, const char *filename);
+
 /* Call this before using to ensure it's up-to-date.  Returns true if something
- * was updated. Note: this can scramble node and chan indexes! */
+ * was updated. Note: this can move nodes and chans, and new ones can reuse
+ * the indexes of removed ones, but the rest keep their indexes (even when
+ * the gossip_store is compacted). */
 bool gossmap_refresh(struct gossmap *map);
 
+/* Would gossmap_refresh() find anything?  Cheap: it only stats the file. */
+bool gossmap_refresh_needed(const struct gossmap *map);
+
+/* What gossmap_refresh has cost so far. */
+struct gossmap_stats {
+	/* Calls to gossmap_refresh, and how many found something new. */
+	u64 refreshes, changed;
+	/* How many times we had to map more of the file. */
+	u64 remaps;
+	/* How many times the gossip_store was compacted under us. */
+	u64 compactions;
+	/* How much of the gossip_store we've parsed. */
+	u64 bytes_parsed;
+	/* Total time spent in gossmap_refresh. */
+	struct timerel refresh_time;
+};
+
+const struct gossmap_stats *gossmap_stats(const struct gossmap *map);
+
+/* Keep a gossmap_csr for this map (it's rebuilt by gossmap_refresh) */
+void gossmap_enable_csr(struct gossmap *map);
+
+/* Get the gossmap_csr, or NULL if not enabled or out-of-date (the map was
+ * changed, without calling gossmap_refresh). */
+const struct gossmap_csr *gossmap_csr(const struct gossmap *map);
+
 /* Each channel has a unique (low) index. */
 u32 gossmap_node_idx(const struct gossmap *map, const struct gossmap_node *node);
 u32 gossmap_chan_idx(const struct gossmap *map, const struct gossmap_chan *chan);
 
+/* Reverse of the above: idx must be < gossmap_max_*_idx() */
+struct gossmap_node *gossmap_node_byidx(const struct gossmap *map, u32 idx);
+struct gossmap_chan *gossmap_chan_byidx(const struct gossmap *map, u32 idx);
+
 /* Every node_idx/chan_idx will be < these.
  * These values can change across calls to gossmap_check. */
 u32 gossmap_max_node_idx(const struct gossmap *map);
@@ -79,6 +134,43 @@ static inline bool gossmap_chan_set(const struct gossmap_chan *chan, int dir)
 	return chan->half[dir].htlc_max != 0;
 }
 
+/* Do we have a channel_update for this halfchannel?  (Unlike
+ * gossmap_chan_set, this is true even if we couldn't use its values) */
+static inline bool gossmap_chan_has_update(const struct gossmap_chan *chan,
+					   int dir)
+{
+	return chan->cupdate_off[dir] != 0;
+}
+
+/* Get the fields of the latest channel_update for this halfchannel, which
+ * must exist.  *htlc_maximum_msat is only set if message_flags has
+ * option_channel_htlc_max. */
+void gossmap_chan_get_update_details(const struct gossmap *map,
+				     const struct gossmap_chan *chan,
+				     int dir,
+				     u32 *timestamp,
+				     u8 *message_flags,
+				     u8 *channel_flags,
+				     u16 *cltv_expiry_delta,
+				     u32 *fee_base_msat,
+				     u32 *fee_proportional_millionths,
+				     struct amount_msat *htlc_minimum_msat,
+				     struct amount_msat *htlc_maximum_msat);
+
+/* Is this a channel we were only told about locally? */
+bool gossmap_chan_is_private(const struct gossmap *map,
+			     const struct gossmap_chan *c);
+
+/* Get the capacity of this channel: false if the store doesn't say. */
+bool gossmap_chan_get_capacity(const struct gossmap *map,
+			       const struct gossmap_chan *c,
+			       struct amount_sat *amount);
+
+/* Get the features from the channel_announcement */
+u8 *gossmap_chan_get_features(const tal_t *ctx,
+			      const struct gossmap *map,
+			      const struct gossmap_chan *c);
+
 /* Get the announcement msg which created this chan */
 u8 *gossmap_chan_get_announce(const tal_t *ctx,
 			      const struct gossmap *map,
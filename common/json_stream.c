@@ -33,6 +33,7 @@ struct json_stream *new_json_stream(const tal_t *ctx,
 	json_out_call_on_move(js->jout, adjust_io_write, js);
 	js->writer = writer;
 	js->reader = NULL;
+	js->drained_cb = NULL;
 	js->log = log;
 	return js;
 }
@@ -45,6 +46,7 @@ struct json_stream *json_stream_dup(const tal_t *ctx,
 
 	if (original->jout)
 		js->jout = json_out_dup(js, original->jout);
+	js->drained_cb = NULL;
 	js->log = log;
 	return js;
 }
@@ -119,6 +121,25 @@ void json_stream_close(struct json_stream *js, struct command *writer)
 	js->writer = NULL;
 }
 
+void json_stream_when_drained_(struct json_stream *js,
+			       void (*cb)(struct json_stream *js, void *arg),
+			       void *arg)
+{
+	assert(!js->drained_cb);
+	js->drained_cb = cb;
+	js->drained_arg = arg;
+}
+
+void json_stream_drained(struct json_stream *js)
+{
+	void (*cb)(struct json_stream *js, void *arg) = js->drained_cb;
+
+	if (!cb)
+		return;
+	js->drained_cb = NULL;
+	cb(js, js->drained_arg);
+}
+
 /* Also called when we're oom, so it will kill reader. */
 void json_stream_flush(struct json_stream *js)
 {
@@ -214,6 +235,14 @@ static struct io_plan *json_stream_output_write(struct io_conn *conn,
 	/* Get how much we can write out from js */
 	p = json_out_contents(js->jout, &js->len_read);
 
+	/* If the writer was waiting for us, it can add more now. */
+	if (!p && js->drained_cb) {
+		json_stream_drained(js);
+		if (!js->jout)
+			return io_close(conn);
+		p = json_out_contents(js->jout, &js->len_read);
+	}
+
 	/* Nothing in buffer? */
 	if (!p) {
 		/* We're not doing io_write now, unset. */
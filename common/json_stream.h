@@ -31,6 +31,10 @@ struct json_stream {
 	void *reader_arg;
 	size_t len_read;
 
+	/* Who wants to know when the reader has written everything out. */
+	void (*drained_cb)(struct json_stream *js, void *arg);
+	void *drained_arg;
+
 	/* Where to log I/O */
 	struct log *log;
 };
@@ -160,6 +164,30 @@ struct io_plan *json_stream_output_(struct json_stream *js,
 							  void *arg),
 				    void *arg);
 
+/**
+ * json_stream_when_drained - call this once everything has been written out.
+ * @js: the json_stream
+ * @cb: the callback
+ * @arg: the argument to @cb
+ *
+ * This lets a writer with a great deal to say add it a piece at a time,
+ * as fast as the reader takes it, rather than buffering it all.  If the
+ * reader goes away, whoever owned it must call json_stream_drained().
+ */
+#define json_stream_when_drained(js, cb, arg)				\
+	json_stream_when_drained_((js),					\
+				  typesafe_cb_preargs(void, void *,	\
+						      (cb), (arg),	\
+						      struct json_stream *), \
+				  (arg))
+
+void json_stream_when_drained_(struct json_stream *js,
+			       void (*cb)(struct json_stream *js, void *arg),
+			       void *arg);
+
+/* Call (and clear) the json_stream_when_drained callback, if any. */
+void json_stream_drained(struct json_stream *js);
+
 /* Ensure there's a double \n after a JSON response. */
 void json_stream_double_cr(struct json_stream *js);
 void json_stream_flush(struct json_stream *js);
@@ -4,6 +4,7 @@
 #include <common/peer_billboard.h>
 #include <common/peer_failed.h>
 #include <common/peer_status_wiregen.h>
+#include <common/per_peer_state.h>
 #include <common/status.h>
 #include <common/status_wiregen.h>
 #include <common/wire_error.h>
@@ -19,6 +20,7 @@ peer_fatal_continue(const u8 *msg TAKES, const struct per_peer_state *pps)
 
 	status_send_fd(pps->peer_fd);
 	status_send_fd(pps->gossip_fd);
+	per_peer_state_sync_gossip_store(pps);
 	status_send_fd(pps->gossip_store_fd);
 	exit(0x80 | (reason & 0xFF));
 }
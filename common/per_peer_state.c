@@ -2,7 +2,9 @@
 #include <ccan/fdpass/fdpass.h>
 #include <common/gossip_constants.h>
 #include <common/gossip_rcvd_filter.h>
+#include <common/gossip_store.h>
 #include <common/per_peer_state.h>
+#include <sys/mman.h>
 #include <unistd.h>
 #include <wire/wire.h>
 
@@ -16,6 +18,9 @@ static void destroy_per_peer_state(struct per_peer_state *pps)
 		close(pps->gossip_fd);
 	if (pps->gossip_store_fd != -1)
 		close(pps->gossip_store_fd);
+	if (pps->gossip_store_mmap)
+		munmap((void *)pps->gossip_store_mmap,
+		       pps->gossip_store_mmap_len);
 }
 
 struct per_peer_state *new_per_peer_state(const tal_t *ctx,
@@ -26,6 +31,10 @@ struct per_peer_state *new_per_peer_state(const tal_t *ctx,
 	pps->cs = *cs;
 	pps->gs = NULL;
 	pps->peer_fd = pps->gossip_fd = pps->gossip_store_fd = -1;
+	pps->gossip_store_mmap = NULL;
+	pps->gossip_store_mmap_len = pps->gossip_store_size = 0;
+	pps->gossip_store_off = 0;
+	pps->gossip_batch_bytes = GOSSIP_STORE_BATCH_BYTES;
 	pps->grf = new_gossip_rcvd_filter(pps);
 	tal_add_destructor(pps, destroy_per_peer_state);
 	return pps;
@@ -72,14 +81,22 @@ void towire_per_peer_state(u8 **pptr, const struct per_peer_state *pps)
 	towire_bool(pptr, pps->gs != NULL);
 	if (pps->gs)
 		towire_gossip_state(pptr, pps->gs);
+	towire_u32(pptr, pps->gossip_batch_bytes);
 	/* We don't pass the gossip_rcvd_filter: it's merely an optimization */
 }
 
+void per_peer_state_sync_gossip_store(const struct per_peer_state *pps)
+{
+	if (pps->gossip_store_off != 0)
+		lseek(pps->gossip_store_fd, pps->gossip_store_off, SEEK_SET);
+}
+
 void per_peer_state_fdpass_send(int fd, const struct per_peer_state *pps)
 {
 	assert(pps->peer_fd != -1);
 	assert(pps->gossip_fd != -1);
 	assert(pps->gossip_store_fd != -1);
+	per_peer_state_sync_gossip_store(pps);
 	fdpass_send(fd, pps->peer_fd);
 	fdpass_send(fd, pps->gossip_fd);
 	fdpass_send(fd, pps->gossip_store_fd);
@@ -97,6 +114,7 @@ struct per_peer_state *fromwire_per_peer_state(const tal_t *ctx,
 		pps->gs = tal(pps, struct gossip_state);
 		fromwire_gossip_state(cursor, max, pps->gs);
 	}
+	pps->gossip_batch_bytes = fromwire_u32(cursor, max);
 	return pps;
 }
 
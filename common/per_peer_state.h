@@ -24,10 +24,19 @@ struct per_peer_state {
 	struct gossip_rcvd_filter *grf;
 	/* If not -1, closed on freeing */
 	int peer_fd, gossip_fd, gossip_store_fd;
+	/* gossip_store_next() reads gossip_store_fd via this map (NULL until
+	 * it needs it), and keeps its own offset (0 if it should ask the fd).
+	 * The map is longer than the store (gossip_store_size, last we
+	 * looked), so it doesn't need remapping every time that grows. */
+	const u8 *gossip_store_mmap;
+	size_t gossip_store_mmap_len, gossip_store_size;
+	u64 gossip_store_off;
+	/* How much gossip_store_next_batch() gathers up at once. */
+	u32 gossip_batch_bytes;
 };
 
 /* Allocate a new per-peer state and add destructor to close fds if set;
- * sets fds to -1 and ->gs to NULL.. */
+ * sets fds to -1, ->gs to NULL and ->gossip_batch_bytes to the default. */
 struct per_peer_state *new_per_peer_state(const tal_t *ctx,
 					  const struct crypto_state *cs);
 
@@ -38,6 +47,10 @@ void per_peer_state_set_fds(struct per_peer_state *pps,
 /* Array version of above: tal_count(fds) must be 3 */
 void per_peer_state_set_fds_arr(struct per_peer_state *pps, const int *fds);
 
+/* Move gossip_store_fd's offset to where gossip_store_next() is up to: do
+ * this before handing it to someone else. */
+void per_peer_state_sync_gossip_store(const struct per_peer_state *pps);
+
 /* These routines do *part* of the work: you need to per_peer_state_fdpass_send
  * or receive the three fds afterwards! */
 void towire_per_peer_state(u8 **pptr, const struct per_peer_state *pps);
@@ -0,0 +1,347 @@
+#include <assert.h>
+#include <ccan/err/err.h>
+#include <ccan/opt/opt.h>
+#include <ccan/time/time.h>
+#include <common/setup.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "../amount.c"
+#include "../dijkstra.c"
+#include "../gossmap.c"
+#include "../route.c"
+
+/* dijkstra.c sets NDEBUG, but we want our asserts! */
+#undef NDEBUG
+#include <assert.h>
+
+/* AUTOGENERATED MOCKS START */
+/* Generated stub for fromwire */
+const u8 *fromwire(const u8 **cursor UNNEEDED, size_t *max UNNEEDED, void *copy UNNEEDED, size_t n UNNEEDED)
+{ fprintf(stderr, "fromwire called!\n"); abort(); }
+/* Generated stub for fromwire_bool */
+bool fromwire_bool(const u8 **cursor UNNEEDED, size_t *max UNNEEDED)
+{ fprintf(stderr, "fromwire_bool called!\n"); abort(); }
+/* Generated stub for fromwire_fail */
+void *fromwire_fail(const u8 **cursor UNNEEDED, size_t *max UNNEEDED)
+{ fprintf(stderr, "fromwire_fail called!\n"); abort(); }
+/* Generated stub for fromwire_secp256k1_ecdsa_signature */
+void fromwire_secp256k1_ecdsa_signature(const u8 **cursor UNNEEDED, size_t *max UNNEEDED,
+					secp256k1_ecdsa_signature *signature UNNEEDED)
+{ fprintf(stderr, "fromwire_secp256k1_ecdsa_signature called!\n"); abort(); }
+/* Generated stub for fromwire_sha256 */
+void fromwire_sha256(const u8 **cursor UNNEEDED, size_t *max UNNEEDED, struct sha256 *sha256 UNNEEDED)
+{ fprintf(stderr, "fromwire_sha256 called!\n"); abort(); }
+/* Generated stub for fromwire_tal_arrn */
+u8 *fromwire_tal_arrn(const tal_t *ctx UNNEEDED,
+		       const u8 **cursor UNNEEDED, size_t *max UNNEEDED, size_t num UNNEEDED)
+{ fprintf(stderr, "fromwire_tal_arrn called!\n"); abort(); }
+/* Generated stub for fromwire_u16 */
+u16 fromwire_u16(const u8 **cursor UNNEEDED, size_t *max UNNEEDED)
+{ fprintf(stderr, "fromwire_u16 called!\n"); abort(); }
+/* Generated stub for fromwire_u32 */
+u32 fromwire_u32(const u8 **cursor UNNEEDED, size_t *max UNNEEDED)
+{ fprintf(stderr, "fromwire_u32 called!\n"); abort(); }
+/* Generated stub for fromwire_u64 */
+u64 fromwire_u64(const u8 **cursor UNNEEDED, size_t *max UNNEEDED)
+{ fprintf(stderr, "fromwire_u64 called!\n"); abort(); }
+/* Generated stub for fromwire_u8 */
+u8 fromwire_u8(const u8 **cursor UNNEEDED, size_t *max UNNEEDED)
+{ fprintf(stderr, "fromwire_u8 called!\n"); abort(); }
+/* Generated stub for towire */
+void towire(u8 **pptr UNNEEDED, const void *data UNNEEDED, size_t len UNNEEDED)
+{ fprintf(stderr, "towire called!\n"); abort(); }
+/* Generated stub for towire_bool */
+void towire_bool(u8 **pptr UNNEEDED, bool v UNNEEDED)
+{ fprintf(stderr, "towire_bool called!\n"); abort(); }
+/* Generated stub for towire_secp256k1_ecdsa_signature */
+void towire_secp256k1_ecdsa_signature(u8 **pptr UNNEEDED,
+			      const secp256k1_ecdsa_signature *signature UNNEEDED)
+{ fprintf(stderr, "towire_secp256k1_ecdsa_signature called!\n"); abort(); }
+/* Generated stub for towire_sha256 */
+void towire_sha256(u8 **pptr UNNEEDED, const struct sha256 *sha256 UNNEEDED)
+{ fprintf(stderr, "towire_sha256 called!\n"); abort(); }
+/* Generated stub for towire_u16 */
+void towire_u16(u8 **pptr UNNEEDED, u16 v UNNEEDED)
+{ fprintf(stderr, "towire_u16 called!\n"); abort(); }
+/* Generated stub for towire_u32 */
+void towire_u32(u8 **pptr UNNEEDED, u32 v UNNEEDED)
+{ fprintf(stderr, "towire_u32 called!\n"); abort(); }
+/* Generated stub for towire_u64 */
+void towire_u64(u8 **pptr UNNEEDED, u64 v UNNEEDED)
+{ fprintf(stderr, "towire_u64 called!\n"); abort(); }
+/* Generated stub for towire_u8 */
+void towire_u8(u8 **pptr UNNEEDED, u8 v UNNEEDED)
+{ fprintf(stderr, "towire_u8 called!\n"); abort(); }
+/* Generated stub for towire_u8_array */
+void towire_u8_array(u8 **pptr UNNEEDED, const u8 *arr UNNEEDED, size_t num UNNEEDED)
+{ fprintf(stderr, "towire_u8_array called!\n"); abort(); }
+/* Generated stub for type_to_string_ */
+const char *type_to_string_(const tal_t *ctx UNNEEDED, const char *typename UNNEEDED,
+			    union printable_types u UNNEEDED)
+{ fprintf(stderr, "type_to_string_ called!\n"); abort(); }
+/* AUTOGENERATED MOCKS END */
+
+/* We don't want gossmap's hashes to be random: we're a benchmark. */
+const struct siphash_seed *siphash_seed(void)
+{
+	static struct siphash_seed seed;
+	return &seed;
+}
+
+static struct node_id nodeid(u32 n)
+{
+	struct node_id id;
+
+	/* gossmap never checks these are valid points */
+	memset(&id, 0, sizeof(id));
+	id.k[0] = 0x02;
+	id.k[1] = n >> 24;
+	id.k[2] = n >> 16;
+	id.k[3] = n >> 8;
+	id.k[4] = n;
+	return id;
+}
+
+static void add_bytes(u8 **p, const void *mem, size_t len)
+{
+	size_t off = tal_count(*p);
+	tal_resize(p, off + len);
+	memcpy(*p + off, mem, len);
+}
+
+static void add_be16(u8 **p, u16 v)
+{
+	be16 be = cpu_to_be16(v);
+	add_bytes(p, &be, sizeof(be));
+}
+
+static void add_be32(u8 **p, u32 v)
+{
+	be32 be = cpu_to_be32(v);
+	add_bytes(p, &be, sizeof(be));
+}
+
+static void add_be64(u8 **p, u64 v)
+{
+	be64 be = cpu_to_be64(v);
+	add_bytes(p, &be, sizeof(be));
+}
+
+static void add_zeros(u8 **p, size_t len)
+{
+	size_t off = tal_count(*p);
+	tal_resizez(p, off + len);
+}
+
+static void write_record(int fd, const u8 *msg)
+{
+	struct gossip_hdr hdr;
+
+	hdr.len = cpu_to_be32(tal_count(msg));
+	hdr.crc = 0;
+	hdr.timestamp = 0;
+	if (write(fd, &hdr, sizeof(hdr)) != sizeof(hdr)
+	    || write(fd, msg, tal_count(msg)) != tal_count(msg))
+		err(1, "writing gossip_store");
+}
+
+static void write_announce(int fd, u64 scid, u32 n1, u32 n2)
+{
+	u8 *msg = tal_arr(tmpctx, u8, 0);
+	struct node_id id[2];
+
+	/* Lesser node_id goes first */
+	id[0] = nodeid(n1 < n2 ? n1 : n2);
+	id[1] = nodeid(n1 < n2 ? n2 : n1);
+
+	add_be16(&msg, WIRE_CHANNEL_ANNOUNCEMENT);
+	add_zeros(&msg, 64 * 4);
+	/* features */
+	add_be16(&msg, 0);
+	/* chain_hash */
+	add_zeros(&msg, 32);
+	add_be64(&msg, scid);
+	add_bytes(&msg, id[0].k, sizeof(id[0].k));
+	add_bytes(&msg, id[1].k, sizeof(id[1].k));
+	/* bitcoin keys */
+	add_zeros(&msg, PUBKEY_CMPR_LEN * 2);
+	write_record(fd, msg);
+}
+
+static void write_update(int fd, u64 scid, int dir,
+			 u32 base_fee, u32 proportional_fee, u16 delay)
+{
+	u8 *msg = tal_arr(tmpctx, u8, 0);
+
+	add_be16(&msg, WIRE_CHANNEL_UPDATE);
+	add_zeros(&msg, 64 + 32);
+	add_be64(&msg, scid);
+	/* timestamp */
+	add_be32(&msg, 1);
+	/* message_flags: option_channel_htlc_max */
+	tal_arr_expand(&msg, 1);
+	/* channel_flags */
+	tal_arr_expand(&msg, dir);
+	add_be16(&msg, delay);
+	add_be64(&msg, 0);
+	add_be32(&msg, base_fee);
+	add_be32(&msg, proportional_fee);
+	add_be64(&msg, 1000000000);
+	write_record(fd, msg);
+}
+
+/* Like gossipd's run-bench-find_route: every node gets two random
+ * channels to lower nodes. */
+static struct gossmap *random_gossmap(const tal_t *ctx, size_t num_nodes)
+{
+	char *fname = tal_strdup(tmpctx, "/tmp/run-bench-dijkstra.XXXXXX");
+	int fd = mkstemp(fname);
+	u8 version = GOSSIP_STORE_VERSION;
+	struct gossmap *map;
+	u64 scid = 1;
+
+	if (fd < 0)
+		err(1, "Creating %s", fname);
+	if (write(fd, &version, sizeof(version)) != sizeof(version))
+		err(1, "writing gossip_store");
+
+	for (size_t n = 1; n < num_nodes; n++) {
+		for (size_t i = 0; i < 2; i++) {
+			u32 randnode = random() % n;
+
+			write_announce(fd, scid, n, randnode);
+			for (int dir = 0; dir < 2; dir++)
+				write_update(fd, scid, dir,
+					     random() % 1000,
+					     random() % 1000,
+					     random() % 144);
+			scid++;
+		}
+	}
+	close(fd);
+
+	map = gossmap_load(ctx, fname);
+	unlink(fname);
+	return map;
+}
+
+int main(int argc, char *argv[])
+{
+	struct gossmap *map;
+	struct dijkstra_ctx *dctx;
+	size_t num_nodes = 100, num_runs = 2;
+	struct timerel full_time = time_from_sec(0), to_time = time_from_sec(0),
+		reuse_time = time_from_sec(0), csr_time = time_from_sec(0);
+	u32 *srcidxs, *dstidxs;
+	struct amount_msat *costs;
+	struct amount_msat amount = AMOUNT_MSAT(100000);
+
+	common_setup(argv[0]);
+	opt_parse(&argc, argv, opt_log_stderr_exit);
+
+	if (argc > 1)
+		num_nodes = atoi(argv[1]);
+	if (argc > 2)
+		num_runs = atoi(argv[2]);
+	if (argc > 3)
+		opt_usage_and_exit("[num_nodes [num_runs]]");
+
+	srandom(1);
+	map = random_gossmap(NULL, num_nodes);
+	assert(map);
+	assert(gossmap_num_nodes(map) == num_nodes);
+	dctx = dijkstra_ctx_new(map);
+	srcidxs = tal_arr(map, u32, num_runs);
+	dstidxs = tal_arr(map, u32, num_runs);
+	costs = tal_arr(map, struct amount_msat, num_runs);
+	assert(!gossmap_csr(map));
+
+	for (size_t i = 0; i < num_runs; i++) {
+		struct node_id srcid = nodeid(random() % num_nodes);
+		struct node_id dstid = nodeid(random() % num_nodes);
+		const struct gossmap_node *src, *dst;
+		const struct dijkstra *full, *to, *reuse;
+		struct route **full_route, **to_route, **reuse_route;
+		struct timemono start;
+		u32 srcidx;
+
+		src = gossmap_find_node(map, &srcid);
+		dst = gossmap_find_node(map, &dstid);
+		srcidx = gossmap_node_idx(map, src);
+
+		start = time_mono();
+		full = dijkstra(tmpctx, map, dst, amount, 10,
+				route_can_carry, route_score_cheaper, NULL);
+		full_time = timerel_add(full_time,
+					timemono_since(start));
+
+		start = time_mono();
+		to = dijkstra_to(tmpctx, map, dst, src, amount, 10,
+				 route_can_carry, route_score_cheaper, NULL);
+		to_time = timerel_add(to_time, timemono_since(start));
+
+		start = time_mono();
+		reuse = dijkstra_run(dctx, map, dst, src, amount, 10,
+				     route_can_carry, route_score_cheaper,
+				     NULL);
+		reuse_time = timerel_add(reuse_time, timemono_since(start));
+
+		/* Stopping early must not change the answer. */
+		assert(dijkstra_distance(full, srcidx)
+		       == dijkstra_distance(to, srcidx));
+		assert(dijkstra_delay(full, srcidx)
+		       == dijkstra_delay(to, srcidx));
+		assert(amount_msat_eq(dijkstra_amount(full, srcidx),
+				      dijkstra_amount(to, srcidx)));
+
+		/* Nor must reusing the scratch space. */
+		assert(dijkstra_distance(to, srcidx)
+		       == dijkstra_distance(reuse, srcidx));
+		assert(amount_msat_eq(dijkstra_amount(to, srcidx),
+				      dijkstra_amount(reuse, srcidx)));
+
+		full_route = route_from_dijkstra(tmpctx, map, full, src);
+		to_route = route_from_dijkstra(tmpctx, map, to, src);
+		reuse_route = route_from_dijkstra(tmpctx, map, reuse, src);
+		assert(tal_count(full_route) == tal_count(to_route));
+		assert(tal_count(to_route) == tal_count(reuse_route));
+
+		srcidxs[i] = srcidx;
+		dstidxs[i] = gossmap_node_idx(map, dst);
+		costs[i] = dijkstra_amount(reuse, srcidx);
+		clean_tmpctx();
+	}
+
+	/* Now the same routes again, using the compact adjacency. */
+	gossmap_enable_csr(map);
+	assert(gossmap_csr(map));
+	for (size_t i = 0; i < num_runs; i++) {
+		const struct dijkstra *dij;
+		struct timemono start;
+
+		start = time_mono();
+		dij = dijkstra_run(dctx, map,
+				   gossmap_node_byidx(map, dstidxs[i]),
+				   gossmap_node_byidx(map, srcidxs[i]),
+				   amount, 10,
+				   route_can_carry, route_score_cheaper, NULL);
+		csr_time = timerel_add(csr_time, timemono_since(start));
+		assert(amount_msat_eq(dijkstra_amount(dij, srcidxs[i]),
+				      costs[i]));
+	}
+
+	printf("%zu routes in %zu nodes: full graph %"PRIu64" usec,"
+	       " stopping at source %"PRIu64" usec,"
+	       " reusing dijkstra_ctx %"PRIu64" usec,"
+	       " with csr %"PRIu64" usec\n",
+	       num_runs, num_nodes,
+	       time_to_usec(full_time), time_to_usec(to_time),
+	       time_to_usec(reuse_time), time_to_usec(csr_time));
+
+	tal_free(map);
+	common_shutdown();
+	opt_free_table();
+	return 0;
+}
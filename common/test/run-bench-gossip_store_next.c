@@ -0,0 +1,392 @@
+#include <assert.h>
+#include <ccan/crc32c/crc32c.h>
+#include <ccan/err/err.h>
+#include <ccan/opt/opt.h>
+#include <ccan/time/time.h>
+#include <common/features.h>
+#include <common/gossip_rcvd_filter.h>
+#include <common/gossip_store.h>
+#include <common/per_peer_state.h>
+#include <common/setup.h>
+#include <common/status.h>
+#include <common/utils.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <gossipd/gossip_store_wiregen.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <wire/peer_wire.h>
+
+/* Count the syscalls the readers make, and how many (re)map. */
+static size_t num_syscalls, num_maps;
+
+static ssize_t counted_read(int fd, void *buf, size_t count)
+{
+	num_syscalls++;
+	return read(fd, buf, count);
+}
+
+static off_t counted_lseek(int fd, off_t offset, int whence)
+{
+	num_syscalls++;
+	return lseek(fd, offset, whence);
+}
+
+static int counted_fstat(int fd, struct stat *st)
+{
+	num_syscalls++;
+	return fstat(fd, st);
+}
+
+static void *counted_mmap(void *addr, size_t len, int prot, int flags,
+			  int fd, off_t offset)
+{
+	num_syscalls++;
+	num_maps++;
+	return mmap(addr, len, prot, flags, fd, offset);
+}
+
+static void *counted_mremap(void *old_addr, size_t old_len, size_t new_len,
+			    int flags)
+{
+	num_syscalls++;
+	num_maps++;
+	return mremap(old_addr, old_len, new_len, flags);
+}
+
+static int counted_munmap(void *addr, size_t len)
+{
+	num_syscalls++;
+	return munmap(addr, len);
+}
+
+#define read counted_read
+#define lseek counted_lseek
+#define fstat counted_fstat
+#define mmap counted_mmap
+#define mremap counted_mremap
+#define munmap counted_munmap
+
+#include "../gossip_rcvd_filter.c"
+#include "../gossip_store.c"
+#include "../per_peer_state.c"
+#include "../pseudorand.c"
+#include "../../wire/fromwire.c"
+
+#undef read
+#undef lseek
+#undef fstat
+#undef mmap
+#undef mremap
+#undef munmap
+
+/* AUTOGENERATED MOCKS START */
+/* Generated stub for fromwire_crypto_state */
+void fromwire_crypto_state(const u8 **ptr UNNEEDED, size_t *max UNNEEDED, struct crypto_state *cs UNNEEDED)
+{ fprintf(stderr, "fromwire_crypto_state called!\n"); abort(); }
+/* Generated stub for memleak_add_helper_ */
+void memleak_add_helper_(const tal_t *p UNNEEDED, void (*cb)(struct htable *memtable UNNEEDED,
+						    const tal_t *)){ }
+/* Generated stub for memleak_remove_htable */
+void memleak_remove_htable(struct htable *memtable UNNEEDED, const struct htable *ht UNNEEDED)
+{ fprintf(stderr, "memleak_remove_htable called!\n"); abort(); }
+/* Generated stub for status_failed */
+void status_failed(enum status_failreason code UNNEEDED,
+		   const char *fmt UNNEEDED, ...)
+{ fprintf(stderr, "status_failed called!\n"); abort(); }
+/* Generated stub for status_fmt */
+void status_fmt(enum log_level level UNNEEDED,
+		const struct node_id *peer UNNEEDED,
+		const char *fmt UNNEEDED, ...)
+
+{ fprintf(stderr, "status_fmt called!\n"); abort(); }
+/* Generated stub for towire */
+void towire(u8 **pptr UNNEEDED, const void *data UNNEEDED, size_t len UNNEEDED)
+{ fprintf(stderr, "towire called!\n"); abort(); }
+/* Generated stub for towire_bool */
+void towire_bool(u8 **pptr UNNEEDED, bool v UNNEEDED)
+{ fprintf(stderr, "towire_bool called!\n"); abort(); }
+/* Generated stub for towire_crypto_state */
+void towire_crypto_state(u8 **pptr UNNEEDED, const struct crypto_state *cs UNNEEDED)
+{ fprintf(stderr, "towire_crypto_state called!\n"); abort(); }
+/* Generated stub for towire_sha256 */
+void towire_sha256(u8 **pptr UNNEEDED, const struct sha256 *sha256 UNNEEDED)
+{ fprintf(stderr, "towire_sha256 called!\n"); abort(); }
+/* Generated stub for towire_u32 */
+void towire_u32(u8 **pptr UNNEEDED, u32 v UNNEEDED)
+{ fprintf(stderr, "towire_u32 called!\n"); abort(); }
+/* Generated stub for towire_u64 */
+void towire_u64(u8 **pptr UNNEEDED, u64 v UNNEEDED)
+{ fprintf(stderr, "towire_u64 called!\n"); abort(); }
+/* AUTOGENERATED MOCKS END */
+
+/* This is what gossip_store_next used to do: read() the header, then the
+ * message, then check the crc. */
+static u8 *read_store_next(const tal_t *ctx, struct per_peer_state *pps)
+{
+	u8 *msg = NULL;
+
+	while (!msg) {
+		struct gossip_hdr hdr;
+		u32 msglen;
+		bool push;
+		int type;
+
+		if (counted_read(pps->gossip_store_fd, &hdr, sizeof(hdr))
+		    != sizeof(hdr))
+			return NULL;
+
+		if (be32_to_cpu(hdr.len) & GOSSIP_STORE_LEN_DELETED_BIT) {
+			counted_lseek(pps->gossip_store_fd,
+				      be32_to_cpu(hdr.len)
+				      & GOSSIP_STORE_LEN_MASK,
+				      SEEK_CUR);
+			continue;
+		}
+
+		msglen = be32_to_cpu(hdr.len);
+		push = (msglen & GOSSIP_STORE_LEN_PUSH_BIT);
+		msglen &= GOSSIP_STORE_LEN_MASK;
+		msg = tal_arr(ctx, u8, msglen);
+		if (counted_read(pps->gossip_store_fd, msg, msglen) != msglen)
+			abort();
+		if (be32_to_cpu(hdr.crc)
+		    != crc32c(be32_to_cpu(hdr.timestamp), msg, msglen))
+			abort();
+
+		if (gossip_rcvd_filter_del(pps->grf, msg)) {
+			msg = tal_free(msg);
+			continue;
+		}
+
+		type = fromwire_peektype(msg);
+		if (type != WIRE_CHANNEL_ANNOUNCEMENT
+		    && type != WIRE_CHANNEL_UPDATE
+		    && type != WIRE_NODE_ANNOUNCEMENT)
+			msg = tal_free(msg);
+		else if (!push
+			 && !timestamp_filter(pps, be32_to_cpu(hdr.timestamp)))
+			msg = tal_free(msg);
+	}
+	return msg;
+}
+
+static void write_record(int fd, u16 type, size_t len, u32 timestamp,
+			 bool deleted, bool push)
+{
+	struct gossip_hdr hdr;
+	u8 *msg = tal_arrz(tmpctx, u8, len);
+	u32 hlen = len;
+
+	msg[0] = type >> 8;
+	msg[1] = type;
+	/* Make them all different, for the gossip_rcvd_filter */
+	memcpy(msg + 2, &timestamp, sizeof(timestamp));
+	msg[len - 1] = random();
+
+	if (deleted)
+		hlen |= GOSSIP_STORE_LEN_DELETED_BIT;
+	if (push)
+		hlen |= GOSSIP_STORE_LEN_PUSH_BIT;
+	hdr.len = cpu_to_be32(hlen);
+	hdr.crc = cpu_to_be32(crc32c(timestamp, msg, len));
+	hdr.timestamp = cpu_to_be32(timestamp);
+
+	if (write(fd, &hdr, sizeof(hdr)) != sizeof(hdr)
+	    || write(fd, msg, len) != len)
+		err(1, "writing gossip_store");
+}
+
+/* A store which looks roughly like the real one: for every channel, an
+ * announcement, amount and two updates, and every few a
+ * node_announcement.  Some are deleted, a few are pushed. */
+static void write_store(int fd, size_t num_chans)
+{
+	u8 version = GOSSIP_STORE_VERSION;
+
+	if (write(fd, &version, sizeof(version)) != sizeof(version))
+		err(1, "writing gossip_store");
+
+	for (size_t i = 0; i < num_chans; i++) {
+		u32 timestamp = 1000 + i;
+
+		write_record(fd, WIRE_CHANNEL_ANNOUNCEMENT, 430, timestamp,
+			     false, false);
+		write_record(fd, WIRE_GOSSIP_STORE_CHANNEL_AMOUNT, 10,
+			     timestamp, false, false);
+		write_record(fd, WIRE_CHANNEL_UPDATE, 136, timestamp,
+			     i % 3 == 0, i % 50 == 0);
+		write_record(fd, WIRE_CHANNEL_UPDATE, 136, timestamp,
+			     i % 3 == 1, false);
+		if (i % 4 == 0)
+			write_record(fd, WIRE_NODE_ANNOUNCEMENT, 144,
+				     timestamp, i % 8 == 0, false);
+		clean_tmpctx();
+	}
+}
+
+static struct per_peer_state *new_pps(const char *fname)
+{
+	struct crypto_state cs;
+	struct per_peer_state *pps;
+
+	memset(&cs, 0, sizeof(cs));
+	pps = new_per_peer_state(tmpctx, &cs);
+	pps->gossip_store_fd = open(fname, O_RDONLY);
+	if (pps->gossip_store_fd < 0)
+		err(1, "opening %s", fname);
+	return pps;
+}
+
+/* Read it all, with either reader: returns number of msgs. */
+static size_t read_all(struct per_peer_state *pps,
+		       u8 *(*next)(const tal_t *, struct per_peer_state *),
+		       u32 first_timestamp, u32 timestamp_range,
+		       size_t *syscalls, struct timerel *time)
+{
+	size_t num = 0;
+	struct timemono start;
+	u8 *msg;
+
+	gossip_setup_timestamp_filter(pps, first_timestamp, timestamp_range);
+	/* The old reader doesn't know about pps->gossip_store_off */
+	lseek(pps->gossip_store_fd, 1, SEEK_SET);
+
+	num_syscalls = 0;
+	start = time_mono();
+	while ((msg = next(tmpctx, pps)) != NULL) {
+		num++;
+		tal_free(msg);
+	}
+	*time = timemono_since(start);
+	*syscalls = num_syscalls;
+	return num;
+}
+
+/* Read it all with gossip_store_next_batch: returns number of msgs. */
+static size_t read_batches(struct per_peer_state *pps)
+{
+	size_t num = 0;
+
+	gossip_setup_timestamp_filter(pps, 0, UINT32_MAX);
+	for (;;) {
+		u8 **msgs = gossip_store_next_batch(tmpctx, pps);
+		size_t bytes = 0;
+		if (!msgs)
+			break;
+		for (size_t i = 0; i < tal_count(msgs); i++)
+			bytes += tal_bytelen(msgs[i]);
+		/* Only the last one can take it over the limit */
+		assert(bytes - tal_bytelen(msgs[tal_count(msgs)-1])
+		       < pps->gossip_batch_bytes);
+		num += tal_count(msgs);
+		tal_free(msgs);
+	}
+	return num;
+}
+
+int main(int argc, char *argv[])
+{
+	char *fname;
+	int fd;
+	struct per_peer_state *pps;
+	size_t num_chans = 100, num_records, num, num2, syscalls;
+	struct timerel time;
+	struct stat st;
+
+	common_setup(argv[0]);
+	opt_parse(&argc, argv, opt_log_stderr_exit);
+	if (argc > 1)
+		num_chans = atoi(argv[1]);
+	if (argc > 2)
+		opt_usage_and_exit("[num_chans]");
+
+	fname = tal_strdup(tmpctx, "/tmp/run-bench-gossip_store_next.XXXXXX");
+	fd = mkstemp(fname);
+	if (fd < 0)
+		err(1, "Creating %s", fname);
+	write_store(fd, num_chans);
+	num_records = num_chans * 4 + (num_chans + 3) / 4;
+
+	pps = new_pps(fname);
+	gossip_store_check_crc = true;
+
+	/* Everything: push doesn't matter. */
+	num = read_all(pps, read_store_next, 0, UINT32_MAX,
+		       &syscalls, &time);
+	printf("%zu records, all: read() %zu msgs, %zu syscalls,"
+	       " %"PRIu64" nsec/record\n",
+	       num_records, num, syscalls,
+	       time_to_nsec(time) / num_records);
+
+	num2 = read_all(pps, gossip_store_next, 0, UINT32_MAX,
+			&syscalls, &time);
+	assert(num2 == num);
+	/* open, map, remap check at end, then sync */
+	assert(syscalls <= 4);
+	printf("%zu records, all: mmap (crc) %zu msgs, %zu syscalls,"
+	       " %"PRIu64" nsec/record\n",
+	       num_records, num2, syscalls,
+	       time_to_nsec(time) / num_records);
+
+	gossip_store_check_crc = false;
+	num2 = read_all(pps, gossip_store_next, 0, UINT32_MAX,
+			&syscalls, &time);
+	assert(num2 == num);
+	printf("%zu records, all: mmap (no crc) %zu msgs, %zu syscalls,"
+	       " %"PRIu64" nsec/record\n",
+	       num_records, num2, syscalls,
+	       time_to_nsec(time) / num_records);
+
+	/* Batches give the same msgs, a bounded amount at a time. */
+	assert(pps->gossip_batch_bytes == GOSSIP_STORE_BATCH_BYTES);
+	num2 = read_batches(pps);
+	assert(num2 == num);
+
+	/* Even if --gossip-batch-bytes is tiny. */
+	pps->gossip_batch_bytes = 1;
+	num2 = read_batches(pps);
+	assert(num2 == num);
+	pps->gossip_batch_bytes = GOSSIP_STORE_BATCH_BYTES;
+
+	/* fd is left at the end, for whoever gets it next. */
+	fstat(fd, &st);
+	assert(lseek(pps->gossip_store_fd, 0, SEEK_CUR) == st.st_size);
+
+	/* A recent timestamp filter: most are skipped. */
+	num = read_all(pps, read_store_next, 1000 + num_chans * 9 / 10,
+		       UINT32_MAX, &syscalls, &time);
+	printf("%zu records, recent: read() %zu msgs, %zu syscalls,"
+	       " %"PRIu64" nsec/record\n",
+	       num_records, num, syscalls,
+	       time_to_nsec(time) / num_records);
+	num2 = read_all(pps, gossip_store_next, 1000 + num_chans * 9 / 10,
+			UINT32_MAX, &syscalls, &time);
+	assert(num2 == num);
+	printf("%zu records, recent: mmap (no crc) %zu msgs, %zu syscalls,"
+	       " %"PRIu64" nsec/record\n",
+	       num_records, num2, syscalls,
+	       time_to_nsec(time) / num_records);
+
+	/* It picks up where it left off when the store grows (these are
+	 * too old for the filter, but pushed), without remapping. */
+	num_maps = 0;
+	write_record(fd, WIRE_CHANNEL_UPDATE, 136, 1, false, true);
+	write_record(fd, WIRE_CHANNEL_UPDATE, 136, 2, true, true);
+	write_record(fd, WIRE_CHANNEL_UPDATE, 136, 3, false, false);
+	write_record(fd, WIRE_CHANNEL_UPDATE, 136, 4, false, true);
+	assert(gossip_store_next(tmpctx, pps));
+	assert(gossip_store_next(tmpctx, pps));
+	assert(!gossip_store_next(tmpctx, pps));
+	assert(num_maps == 0);
+	fstat(fd, &st);
+	assert(lseek(pps->gossip_store_fd, 0, SEEK_CUR) == st.st_size);
+
+	close(fd);
+	unlink(fname);
+	common_shutdown();
+	return 0;
+}
@@ -0,0 +1,262 @@
+#include "../crypto_sync.c"
+#include "../cryptomsg.c"
+#include <assert.h>
+#include <common/gossip_store.h>
+#include <common/setup.h>
+#include <stdio.h>
+#include <sys/wait.h>
+
+/* AUTOGENERATED MOCKS START */
+/* Generated stub for amount_asset_is_main */
+bool amount_asset_is_main(struct amount_asset *asset UNNEEDED)
+{ fprintf(stderr, "amount_asset_is_main called!\n"); abort(); }
+/* Generated stub for amount_asset_to_sat */
+struct amount_sat amount_asset_to_sat(struct amount_asset *asset UNNEEDED)
+{ fprintf(stderr, "amount_asset_to_sat called!\n"); abort(); }
+/* Generated stub for amount_sat */
+struct amount_sat amount_sat(u64 satoshis UNNEEDED)
+{ fprintf(stderr, "amount_sat called!\n"); abort(); }
+/* Generated stub for amount_sat_add */
+ bool amount_sat_add(struct amount_sat *val UNNEEDED,
+				       struct amount_sat a UNNEEDED,
+				       struct amount_sat b UNNEEDED)
+{ fprintf(stderr, "amount_sat_add called!\n"); abort(); }
+/* Generated stub for amount_sat_eq */
+bool amount_sat_eq(struct amount_sat a UNNEEDED, struct amount_sat b UNNEEDED)
+{ fprintf(stderr, "amount_sat_eq called!\n"); abort(); }
+/* Generated stub for amount_sat_greater_eq */
+bool amount_sat_greater_eq(struct amount_sat a UNNEEDED, struct amount_sat b UNNEEDED)
+{ fprintf(stderr, "amount_sat_greater_eq called!\n"); abort(); }
+/* Generated stub for amount_sat_sub */
+ bool amount_sat_sub(struct amount_sat *val UNNEEDED,
+				       struct amount_sat a UNNEEDED,
+				       struct amount_sat b UNNEEDED)
+{ fprintf(stderr, "amount_sat_sub called!\n"); abort(); }
+/* Generated stub for amount_sat_to_asset */
+struct amount_asset amount_sat_to_asset(struct amount_sat *sat UNNEEDED, const u8 *asset UNNEEDED)
+{ fprintf(stderr, "amount_sat_to_asset called!\n"); abort(); }
+/* Generated stub for amount_tx_fee */
+struct amount_sat amount_tx_fee(u32 fee_per_kw UNNEEDED, size_t weight UNNEEDED)
+{ fprintf(stderr, "amount_tx_fee called!\n"); abort(); }
+#if DEVELOPER
+/* Generated stub for dev_blackhole_fd */
+void dev_blackhole_fd(int fd UNNEEDED)
+{ fprintf(stderr, "dev_blackhole_fd called!\n"); abort(); }
+/* Generated stub for dev_sabotage_fd */
+void dev_sabotage_fd(int fd UNNEEDED)
+{ fprintf(stderr, "dev_sabotage_fd called!\n"); abort(); }
+#endif
+/* Generated stub for fromwire */
+const u8 *fromwire(const u8 **cursor UNNEEDED, size_t *max UNNEEDED, void *copy UNNEEDED, size_t n UNNEEDED)
+{ fprintf(stderr, "fromwire called!\n"); abort(); }
+/* Generated stub for fromwire_amount_sat */
+struct amount_sat fromwire_amount_sat(const u8 **cursor UNNEEDED, size_t *max UNNEEDED)
+{ fprintf(stderr, "fromwire_amount_sat called!\n"); abort(); }
+/* Generated stub for fromwire_bool */
+bool fromwire_bool(const u8 **cursor UNNEEDED, size_t *max UNNEEDED)
+{ fprintf(stderr, "fromwire_bool called!\n"); abort(); }
+/* Generated stub for fromwire_fail */
+void *fromwire_fail(const u8 **cursor UNNEEDED, size_t *max UNNEEDED)
+{ fprintf(stderr, "fromwire_fail called!\n"); abort(); }
+/* Generated stub for fromwire_secp256k1_ecdsa_signature */
+void fromwire_secp256k1_ecdsa_signature(const u8 **cursor UNNEEDED, size_t *max UNNEEDED,
+					secp256k1_ecdsa_signature *signature UNNEEDED)
+{ fprintf(stderr, "fromwire_secp256k1_ecdsa_signature called!\n"); abort(); }
+/* Generated stub for fromwire_sha256 */
+void fromwire_sha256(const u8 **cursor UNNEEDED, size_t *max UNNEEDED, struct sha256 *sha256 UNNEEDED)
+{ fprintf(stderr, "fromwire_sha256 called!\n"); abort(); }
+/* Generated stub for fromwire_tal_arrn */
+u8 *fromwire_tal_arrn(const tal_t *ctx UNNEEDED,
+		       const u8 **cursor UNNEEDED, size_t *max UNNEEDED, size_t num UNNEEDED)
+{ fprintf(stderr, "fromwire_tal_arrn called!\n"); abort(); }
+/* Generated stub for fromwire_u16 */
+u16 fromwire_u16(const u8 **cursor UNNEEDED, size_t *max UNNEEDED)
+{ fprintf(stderr, "fromwire_u16 called!\n"); abort(); }
+/* Generated stub for fromwire_u32 */
+u32 fromwire_u32(const u8 **cursor UNNEEDED, size_t *max UNNEEDED)
+{ fprintf(stderr, "fromwire_u32 called!\n"); abort(); }
+/* Generated stub for fromwire_u64 */
+u64 fromwire_u64(const u8 **cursor UNNEEDED, size_t *max UNNEEDED)
+{ fprintf(stderr, "fromwire_u64 called!\n"); abort(); }
+/* Generated stub for fromwire_u8 */
+u8 fromwire_u8(const u8 **cursor UNNEEDED, size_t *max UNNEEDED)
+{ fprintf(stderr, "fromwire_u8 called!\n"); abort(); }
+/* Generated stub for peer_failed_connection_lost */
+void peer_failed_connection_lost(void)
+{ fprintf(stderr, "peer_failed_connection_lost called!\n"); abort(); }
+/* Generated stub for status_fmt */
+void status_fmt(enum log_level level UNNEEDED,
+		const struct node_id *peer UNNEEDED,
+		const char *fmt UNNEEDED, ...)
+
+{ fprintf(stderr, "status_fmt called!\n"); abort(); }
+/* Generated stub for towire */
+void towire(u8 **pptr UNNEEDED, const void *data UNNEEDED, size_t len UNNEEDED)
+{ fprintf(stderr, "towire called!\n"); abort(); }
+/* Generated stub for towire_amount_sat */
+void towire_amount_sat(u8 **pptr UNNEEDED, const struct amount_sat sat UNNEEDED)
+{ fprintf(stderr, "towire_amount_sat called!\n"); abort(); }
+/* Generated stub for towire_bool */
+void towire_bool(u8 **pptr UNNEEDED, bool v UNNEEDED)
+{ fprintf(stderr, "towire_bool called!\n"); abort(); }
+/* Generated stub for towire_secp256k1_ecdsa_signature */
+void towire_secp256k1_ecdsa_signature(u8 **pptr UNNEEDED,
+			      const secp256k1_ecdsa_signature *signature UNNEEDED)
+{ fprintf(stderr, "towire_secp256k1_ecdsa_signature called!\n"); abort(); }
+/* Generated stub for towire_sha256 */
+void towire_sha256(u8 **pptr UNNEEDED, const struct sha256 *sha256 UNNEEDED)
+{ fprintf(stderr, "towire_sha256 called!\n"); abort(); }
+/* Generated stub for towire_u16 */
+void towire_u16(u8 **pptr UNNEEDED, u16 v UNNEEDED)
+{ fprintf(stderr, "towire_u16 called!\n"); abort(); }
+/* Generated stub for towire_u32 */
+void towire_u32(u8 **pptr UNNEEDED, u32 v UNNEEDED)
+{ fprintf(stderr, "towire_u32 called!\n"); abort(); }
+/* Generated stub for towire_u64 */
+void towire_u64(u8 **pptr UNNEEDED, u64 v UNNEEDED)
+{ fprintf(stderr, "towire_u64 called!\n"); abort(); }
+/* Generated stub for towire_u8 */
+void towire_u8(u8 **pptr UNNEEDED, u8 v UNNEEDED)
+{ fprintf(stderr, "towire_u8 called!\n"); abort(); }
+/* Generated stub for towire_u8_array */
+void towire_u8_array(u8 **pptr UNNEEDED, const u8 *arr UNNEEDED, size_t num UNNEEDED)
+{ fprintf(stderr, "towire_u8_array called!\n"); abort(); }
+/* AUTOGENERATED MOCKS END */
+
+/* We don't log the packets. */
+void status_peer_io(enum log_level iodir UNNEEDED,
+		    const struct node_id *peer UNNEEDED,
+		    const u8 *p UNNEEDED)
+{
+}
+
+#if DEVELOPER
+enum dev_disconnect dev_disconnect(int pkt_type UNNEEDED)
+{
+	return DEV_DISCONNECT_NORMAL;
+}
+
+int fromwire_peektype(const u8 *cursor UNNEEDED)
+{
+	return 0;
+}
+#endif
+
+/* The largest message there can be. */
+#define MAX_MSG_LEN 65535
+
+static u8 *make_msg(const tal_t *ctx, size_t len, u8 fill)
+{
+	u8 *msg = tal_arr(ctx, u8, len);
+
+	memset(msg, fill, len);
+	return msg;
+}
+
+/* Write msgs in one batch from a child, read them back one by one: the
+ * batch can be bigger than the socket buffer, so we need both at once. */
+static void check_batch(struct per_peer_state *out,
+			struct per_peer_state *in,
+			u8 **msgs)
+{
+	pid_t pid;
+	int status;
+
+	pid = fork();
+	assert(pid >= 0);
+	if (pid == 0) {
+		sync_crypto_write_arr(out, msgs);
+		exit(0);
+	}
+
+	for (size_t i = 0; i < tal_count(msgs); i++) {
+		u8 *msg = sync_crypto_read(tmpctx, in);
+		assert(tal_bytelen(msg) == tal_bytelen(msgs[i]));
+		assert(memeq(msg, tal_bytelen(msg),
+			     msgs[i], tal_bytelen(msgs[i])));
+	}
+	assert(waitpid(pid, &status, 0) == pid);
+	assert(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+
+	/* The child sent them, so catch up with what we received. */
+	out->cs.sn = in->cs.rn;
+	out->cs.sk = in->cs.rk;
+	out->cs.s_ck = in->cs.r_ck;
+}
+
+int main(int argc, char *argv[])
+{
+	struct per_peer_state *out, *in;
+	struct crypto_state cs;
+	struct secret sk, rk, ck;
+	int fds[2];
+	u8 **msgs, buf[1];
+	size_t bytes;
+
+	common_setup(argv[0]);
+
+	memset(&sk, 1, sizeof(sk));
+	memset(&rk, 2, sizeof(rk));
+	memset(&ck, 3, sizeof(ck));
+
+	assert(socketpair(AF_LOCAL, SOCK_STREAM, 0, fds) == 0);
+	out = tal(tmpctx, struct per_peer_state);
+	in = tal(tmpctx, struct per_peer_state);
+	out->cs.sn = out->cs.rn = in->cs.sn = in->cs.rn = 0;
+	out->cs.sk = in->cs.rk = sk;
+	out->cs.rk = in->cs.sk = rk;
+	out->cs.s_ck = out->cs.r_ck = in->cs.s_ck = in->cs.r_ck = ck;
+	out->peer_fd = fds[0];
+	in->peer_fd = fds[1];
+
+	/* Nothing at all: nothing is written. */
+	msgs = tal_arr(tmpctx, u8 *, 0);
+	sync_crypto_write_arr(out, msgs);
+	assert(recv(in->peer_fd, buf, sizeof(buf), MSG_DONTWAIT) == -1);
+
+	/* Just one. */
+	tal_arr_expand(&msgs, make_msg(msgs, 100, 1));
+	check_batch(out, in, msgs);
+
+	/* Lots of little ones, exactly filling a batch, then one more the
+	 * way gossip_store_next_batch() can go over. */
+	msgs = tal_arr(tmpctx, u8 *, 0);
+	bytes = 0;
+	while (bytes < GOSSIP_STORE_BATCH_BYTES) {
+		size_t len = GOSSIP_STORE_BATCH_BYTES - bytes;
+		if (len > 100)
+			len = 100;
+		tal_arr_expand(&msgs, make_msg(msgs, len, tal_count(msgs)));
+		bytes += len;
+	}
+	assert(bytes == GOSSIP_STORE_BATCH_BYTES);
+	check_batch(out, in, msgs);
+	tal_arr_expand(&msgs, make_msg(msgs, MAX_MSG_LEN, 0xFF));
+	check_batch(out, in, msgs);
+
+	/* Enough to rotate keys (every 1000 msgs) in the middle. */
+	msgs = tal_arr(tmpctx, u8 *, 0);
+	for (size_t i = 0; i < 1500; i++)
+		tal_arr_expand(&msgs, make_msg(msgs, 1 + i % 300, i));
+	check_batch(out, in, msgs);
+
+	/* A single message whose encryption is bigger than a batch. */
+	msgs = tal_arr(tmpctx, u8 *, 0);
+	tal_arr_expand(&msgs, make_msg(msgs, MAX_MSG_LEN, 0xAA));
+	cs = out->cs;
+	assert(tal_bytelen(cryptomsg_encrypt_msg(tmpctx, &cs, msgs[0]))
+	       > GOSSIP_STORE_BATCH_BYTES);
+	check_batch(out, in, msgs);
+
+	/* And a few of them, either side of a small one. */
+	tal_arr_expand(&msgs, make_msg(msgs, 1, 0xBB));
+	tal_arr_expand(&msgs, make_msg(msgs, MAX_MSG_LEN, 0xCC));
+	tal_arr_expand(&msgs, make_msg(msgs, MAX_MSG_LEN, 0xDD));
+	check_batch(out, in, msgs);
+
+	/* Nothing left over. */
+	assert(recv(in->peer_fd, buf, sizeof(buf), MSG_DONTWAIT) == -1);
+
+	common_shutdown();
+	return 0;
+}
@@ -0,0 +1,498 @@
+#include <assert.h>
+#include <ccan/err/err.h>
+#include <common/setup.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <unistd.h>
+
+#include "../amount.c"
+#include "../gossmap.c"
+
+/* AUTOGENERATED MOCKS START */
+/* Generated stub for fromwire */
+const u8 *fromwire(const u8 **cursor UNNEEDED, size_t *max UNNEEDED, void *copy UNNEEDED, size_t n UNNEEDED)
+{ fprintf(stderr, "fromwire called!\n"); abort(); }
+/* Generated stub for fromwire_bool */
+bool fromwire_bool(const u8 **cursor UNNEEDED, size_t *max UNNEEDED)
+{ fprintf(stderr, "fromwire_bool called!\n"); abort(); }
+/* Generated stub for fromwire_fail */
+void *fromwire_fail(const u8 **cursor UNNEEDED, size_t *max UNNEEDED)
+{ fprintf(stderr, "fromwire_fail called!\n"); abort(); }
+/* Generated stub for fromwire_secp256k1_ecdsa_signature */
+void fromwire_secp256k1_ecdsa_signature(const u8 **cursor UNNEEDED, size_t *max UNNEEDED,
+					secp256k1_ecdsa_signature *signature UNNEEDED)
+{ fprintf(stderr, "fromwire_secp256k1_ecdsa_signature called!\n"); abort(); }
+/* Generated stub for fromwire_sha256 */
+void fromwire_sha256(const u8 **cursor UNNEEDED, size_t *max UNNEEDED, struct sha256 *sha256 UNNEEDED)
+{ fprintf(stderr, "fromwire_sha256 called!\n"); abort(); }
+/* Generated stub for fromwire_tal_arrn */
+u8 *fromwire_tal_arrn(const tal_t *ctx UNNEEDED,
+		       const u8 **cursor UNNEEDED, size_t *max UNNEEDED, size_t num UNNEEDED)
+{ fprintf(stderr, "fromwire_tal_arrn called!\n"); abort(); }
+/* Generated stub for fromwire_u16 */
+u16 fromwire_u16(const u8 **cursor UNNEEDED, size_t *max UNNEEDED)
+{ fprintf(stderr, "fromwire_u16 called!\n"); abort(); }
+/* Generated stub for fromwire_u32 */
+u32 fromwire_u32(const u8 **cursor UNNEEDED, size_t *max UNNEEDED)
+{ fprintf(stderr, "fromwire_u32 called!\n"); abort(); }
+/* Generated stub for fromwire_u64 */
+u64 fromwire_u64(const u8 **cursor UNNEEDED, size_t *max UNNEEDED)
+{ fprintf(stderr, "fromwire_u64 called!\n"); abort(); }
+/* Generated stub for fromwire_u8 */
+u8 fromwire_u8(const u8 **cursor UNNEEDED, size_t *max UNNEEDED)
+{ fprintf(stderr, "fromwire_u8 called!\n"); abort(); }
+/* Generated stub for towire */
+void towire(u8 **pptr UNNEEDED, const void *data UNNEEDED, size_t len UNNEEDED)
+{ fprintf(stderr, "towire called!\n"); abort(); }
+/* Generated stub for towire_bool */
+void towire_bool(u8 **pptr UNNEEDED, bool v UNNEEDED)
+{ fprintf(stderr, "towire_bool called!\n"); abort(); }
+/* Generated stub for towire_secp256k1_ecdsa_signature */
+void towire_secp256k1_ecdsa_signature(u8 **pptr UNNEEDED,
+			      const secp256k1_ecdsa_signature *signature UNNEEDED)
+{ fprintf(stderr, "towire_secp256k1_ecdsa_signature called!\n"); abort(); }
+/* Generated stub for towire_sha256 */
+void towire_sha256(u8 **pptr UNNEEDED, const struct sha256 *sha256 UNNEEDED)
+{ fprintf(stderr, "towire_sha256 called!\n"); abort(); }
+/* Generated stub for towire_u16 */
+void towire_u16(u8 **pptr UNNEEDED, u16 v UNNEEDED)
+{ fprintf(stderr, "towire_u16 called!\n"); abort(); }
+/* Generated stub for towire_u32 */
+void towire_u32(u8 **pptr UNNEEDED, u32 v UNNEEDED)
+{ fprintf(stderr, "towire_u32 called!\n"); abort(); }
+/* Generated stub for towire_u64 */
+void towire_u64(u8 **pptr UNNEEDED, u64 v UNNEEDED)
+{ fprintf(stderr, "towire_u64 called!\n"); abort(); }
+/* Generated stub for towire_u8 */
+void towire_u8(u8 **pptr UNNEEDED, u8 v UNNEEDED)
+{ fprintf(stderr, "towire_u8 called!\n"); abort(); }
+/* Generated stub for towire_u8_array */
+void towire_u8_array(u8 **pptr UNNEEDED, const u8 *arr UNNEEDED, size_t num UNNEEDED)
+{ fprintf(stderr, "towire_u8_array called!\n"); abort(); }
+/* Generated stub for type_to_string_ */
+const char *type_to_string_(const tal_t *ctx UNNEEDED, const char *typename UNNEEDED,
+			    union printable_types u UNNEEDED)
+{ fprintf(stderr, "type_to_string_ called!\n"); abort(); }
+/* AUTOGENERATED MOCKS END */
+
+const struct siphash_seed *siphash_seed(void)
+{
+	static struct siphash_seed seed;
+	return &seed;
+}
+
+static struct node_id nodeid(u32 n)
+{
+	struct node_id id;
+
+	/* gossmap never checks these are valid points */
+	memset(&id, 0, sizeof(id));
+	id.k[0] = 0x02;
+	id.k[1] = n >> 24;
+	id.k[2] = n >> 16;
+	id.k[3] = n >> 8;
+	id.k[4] = n;
+	return id;
+}
+
+static void add_bytes(u8 **p, const void *mem, size_t len)
+{
+	size_t off = tal_count(*p);
+	tal_resize(p, off + len);
+	memcpy(*p + off, mem, len);
+}
+
+static void add_be16(u8 **p, u16 v)
+{
+	be16 be = cpu_to_be16(v);
+	add_bytes(p, &be, sizeof(be));
+}
+
+static void add_be32(u8 **p, u32 v)
+{
+	be32 be = cpu_to_be32(v);
+	add_bytes(p, &be, sizeof(be));
+}
+
+static void add_be64(u8 **p, u64 v)
+{
+	be64 be = cpu_to_be64(v);
+	add_bytes(p, &be, sizeof(be));
+}
+
+static void add_zeros(u8 **p, size_t len)
+{
+	size_t off = tal_count(*p);
+	tal_resizez(p, off + len);
+}
+
+static void write_record(int fd, const u8 *msg)
+{
+	struct gossip_hdr hdr;
+
+	hdr.len = cpu_to_be32(tal_count(msg));
+	hdr.crc = 0;
+	hdr.timestamp = 0;
+	if (write(fd, &hdr, sizeof(hdr)) != sizeof(hdr)
+	    || write(fd, msg, tal_count(msg)) != tal_count(msg))
+		err(1, "writing gossip_store");
+}
+
+static void write_announce(int fd, u64 scid, u32 n1, u32 n2)
+{
+	u8 *msg = tal_arr(tmpctx, u8, 0);
+	struct node_id id[2];
+
+	/* Lesser node_id goes first */
+	id[0] = nodeid(n1 < n2 ? n1 : n2);
+	id[1] = nodeid(n1 < n2 ? n2 : n1);
+
+	add_be16(&msg, WIRE_CHANNEL_ANNOUNCEMENT);
+	add_zeros(&msg, 64 * 4);
+	/* features */
+	add_be16(&msg, 0);
+	/* chain_hash */
+	add_zeros(&msg, 32);
+	add_be64(&msg, scid);
+	add_bytes(&msg, id[0].k, sizeof(id[0].k));
+	add_bytes(&msg, id[1].k, sizeof(id[1].k));
+	/* bitcoin keys */
+	add_zeros(&msg, PUBKEY_CMPR_LEN * 2);
+	write_record(fd, msg);
+}
+
+static void write_update(int fd, u64 scid, int dir, u32 base_fee)
+{
+	u8 *msg = tal_arr(tmpctx, u8, 0);
+
+	add_be16(&msg, WIRE_CHANNEL_UPDATE);
+	add_zeros(&msg, 64 + 32);
+	add_be64(&msg, scid);
+	/* timestamp */
+	add_be32(&msg, 1);
+	/* message_flags: option_channel_htlc_max */
+	tal_arr_expand(&msg, 1);
+	/* channel_flags */
+	tal_arr_expand(&msg, dir);
+	/* cltv_expiry_delta */
+	add_be16(&msg, 6);
+	add_be64(&msg, 0);
+	add_be32(&msg, base_fee);
+	add_be32(&msg, 1);
+	add_be64(&msg, 1000000000);
+	write_record(fd, msg);
+}
+
+static void write_node_announce(int fd, u32 n)
+{
+	u8 *msg = tal_arr(tmpctx, u8, 0);
+	struct node_id id = nodeid(n);
+
+	add_be16(&msg, WIRE_NODE_ANNOUNCEMENT);
+	add_zeros(&msg, 64);
+	/* features */
+	add_be16(&msg, 0);
+	/* timestamp */
+	add_be32(&msg, 1);
+	add_bytes(&msg, id.k, sizeof(id.k));
+	/* rgb_color, alias */
+	add_zeros(&msg, 3 + 32);
+	/* addresses */
+	add_be16(&msg, 0);
+	write_record(fd, msg);
+}
+
+static void write_delete(int fd, u64 scid)
+{
+	u8 *msg = tal_arr(tmpctx, u8, 0);
+
+	add_be16(&msg, WIRE_GOSSIP_STORE_DELETE_CHAN);
+	add_be64(&msg, scid);
+	write_record(fd, msg);
+}
+
+/* Channel scid joins node scid-1 and node scid, with base_fee scid */
+static void write_channel(int fd, u64 scid)
+{
+	write_announce(fd, scid, scid - 1, scid);
+	write_update(fd, scid, 0, scid);
+	write_update(fd, scid, 1, scid);
+}
+
+static int new_store(const char *fname)
+{
+	u8 version = GOSSIP_STORE_VERSION;
+	int fd = open(fname, O_WRONLY|O_CREAT|O_TRUNC, 0600);
+
+	if (fd < 0)
+		err(1, "Creating %s", fname);
+	if (write(fd, &version, sizeof(version)) != sizeof(version))
+		err(1, "writing gossip_store");
+	return fd;
+}
+
+static void check_channel(struct gossmap *map, u64 scidval)
+{
+	struct short_channel_id scid;
+	struct gossmap_chan *chan;
+	struct node_id id, expect;
+
+	scid.u64 = scidval;
+	chan = gossmap_find_chan(map, &scid);
+	assert(chan);
+	assert(gossmap_chan_scid(map, chan).u64 == scidval);
+	assert(chan->half[0].base_fee == scidval);
+	assert(chan->half[1].base_fee == scidval);
+	gossmap_node_get_id(map, gossmap_nth_node(map, chan, 0), &id);
+	expect = nodeid(scidval - 1);
+	assert(node_id_eq(&id, &expect));
+	gossmap_node_get_id(map, gossmap_nth_node(map, chan, 1), &id);
+	expect = nodeid(scidval);
+	assert(node_id_eq(&id, &expect));
+}
+static struct gossmap_node *find_node(struct gossmap *map, u32 n)
+{
+	struct node_id id = nodeid(n);
+	return gossmap_find_node(map, &id);
+}
+
+/* What a map looks like, so we can compare (gossmap only handles one map
+ * at a time, so we can't just load both!) */
+struct snapshot {
+	u32 max_chan_idx, max_node_idx;
+	struct short_channel_id *scids;
+	struct gossmap_chan *chans;
+	struct node_id *ids;
+	struct gossmap_node *nodes;
+	u32 **chan_idxs;
+};
+
+static struct snapshot *snapshot(const tal_t *ctx, struct gossmap *map)
+{
+	struct snapshot *snap = tal(ctx, struct snapshot);
+
+	snap->max_chan_idx = gossmap_max_chan_idx(map);
+	snap->max_node_idx = gossmap_max_node_idx(map);
+	snap->scids = tal_arrz(snap, struct short_channel_id,
+			       snap->max_chan_idx);
+	snap->chans = tal_arrz(snap, struct gossmap_chan, snap->max_chan_idx);
+	snap->ids = tal_arrz(snap, struct node_id, snap->max_node_idx);
+	snap->nodes = tal_arrz(snap, struct gossmap_node, snap->max_node_idx);
+	snap->chan_idxs = tal_arrz(snap, u32 *, snap->max_node_idx);
+
+	for (struct gossmap_chan *c = gossmap_first_chan(map);
+	     c;
+	     c = gossmap_next_chan(map, c)) {
+		u32 idx = gossmap_chan_idx(map, c);
+		snap->scids[idx] = gossmap_chan_scid(map, c);
+		snap->chans[idx] = *c;
+	}
+	for (struct gossmap_node *n = gossmap_first_node(map);
+	     n;
+	     n = gossmap_next_node(map, n)) {
+		u32 idx = gossmap_node_idx(map, n);
+		gossmap_node_get_id(map, n, &snap->ids[idx]);
+		snap->nodes[idx] = *n;
+		snap->chan_idxs[idx] = tal_dup_arr(snap, u32, n->chan_idxs,
+						   n->num_chans, 0);
+	}
+	return snap;
+}
+
+/* Overwrite a u32 in the index, without changing its length. */
+static void corrupt_index(const char *idxname, off_t off, u32 val)
+{
+	int fd = open(idxname, O_WRONLY);
+
+	assert(fd >= 0);
+	assert(pwrite(fd, &val, sizeof(val), off) == sizeof(val));
+	close(fd);
+}
+
+/* Loading with the index must give exactly the same map as without. */
+static struct gossmap *load_and_check(const char *fname)
+{
+	struct gossmap *map;
+	struct snapshot *expect, *snap;
+
+	map = gossmap_load(NULL, fname);
+	assert(map);
+	expect = snapshot(tmpctx, map);
+	tal_free(map);
+
+	map = gossmap_load_indexed(NULL, fname);
+	assert(map);
+	snap = snapshot(tmpctx, map);
+
+	/* The arrays may have grown differently, but the indexes in use
+	 * must be the same. */
+	for (u32 i = 0; i < snap->max_chan_idx; i++) {
+		if (i >= expect->max_chan_idx) {
+			assert(snap->chans[i].scid_off == 0);
+			continue;
+		}
+		assert(short_channel_id_eq(&snap->scids[i],
+					   &expect->scids[i]));
+		assert(snap->chans[i].cann_off == expect->chans[i].cann_off);
+		assert(snap->chans[i].scid_off == expect->chans[i].scid_off);
+		assert(memeq(snap->chans[i].half, sizeof(snap->chans[i].half),
+			     expect->chans[i].half,
+			     sizeof(expect->chans[i].half)));
+		if (snap->chans[i].scid_off)
+			assert(gossmap_find_chan(map, &snap->scids[i])
+			       == gossmap_chan_byidx(map, i));
+	}
+	for (u32 i = snap->max_node_idx; i < expect->max_node_idx; i++)
+		assert(!expect->chan_idxs[i]);
+	for (u32 i = snap->max_chan_idx; i < expect->max_chan_idx; i++)
+		assert(expect->chans[i].scid_off == 0);
+	for (u32 i = 0; i < snap->max_node_idx; i++) {
+		if (i >= expect->max_node_idx) {
+			assert(!snap->chan_idxs[i]);
+			continue;
+		}
+		if (!snap->chan_idxs[i]) {
+			assert(!expect->chan_idxs[i]);
+			continue;
+		}
+		assert(expect->chan_idxs[i]);
+		assert(node_id_eq(&snap->ids[i], &expect->ids[i]));
+		assert(snap->nodes[i].nann_off == expect->nodes[i].nann_off);
+		assert(snap->nodes[i].num_chans == expect->nodes[i].num_chans);
+		assert(memeq(snap->chan_idxs[i], tal_bytelen(snap->chan_idxs[i]),
+			     expect->chan_idxs[i],
+			     tal_bytelen(expect->chan_idxs[i])));
+		assert(gossmap_find_node(map, &snap->ids[i])
+		       == gossmap_node_byidx(map, i));
+	}
+	return map;
+}
+
+int main(int argc, char *argv[])
+{
+	char *fname, *idxname, *tmpname;
+	struct gossmap *map;
+	struct stat st;
+	off_t len;
+	int fd, dirfd;
+
+	common_setup(argv[0]);
+
+	fname = tal_strdup(tmpctx, "/tmp/run-gossmap-index.XXXXXX");
+	dirfd = mkstemp(fname);
+	if (dirfd < 0)
+		err(1, "Creating %s", fname);
+	close(dirfd);
+	idxname = tal_fmt(tmpctx, "%s.idx", fname);
+	tmpname = tal_fmt(tmpctx, "%s.tmp", fname);
+
+	/* A line of 100 channels: 0 - 1 - 2 ... 100 */
+	fd = new_store(fname);
+	for (u64 i = 1; i <= 100; i++)
+		write_channel(fd, i);
+	write_node_announce(fd, 10);
+	write_node_announce(fd, 20);
+
+	/* No index yet: we read it all, and write one. */
+	map = load_and_check(fname);
+	assert(gossmap_stats(map)->bytes_parsed == map->map_size - 1);
+	assert(stat(idxname, &st) == 0);
+	tal_free(map);
+
+	/* Now we don't need to read anything. */
+	map = load_and_check(fname);
+	assert(gossmap_stats(map)->bytes_parsed == 0);
+	for (u64 i = 1; i <= 100; i++)
+		check_channel(map, i);
+	tal_free(map);
+
+	/* A little growth: we only read that (and don't rewrite index). */
+	len = lseek(fd, 0, SEEK_END);
+	write_channel(fd, 101);
+	write_update(fd, 50, 0, 50);
+	write_node_announce(fd, 30);
+	map = load_and_check(fname);
+	assert(gossmap_stats(map)->bytes_parsed == map->map_size - len);
+	check_channel(map, 101);
+	assert(find_node(map, 30)->nann_off != 0);
+	tal_free(map);
+
+	/* Deletion works too. */
+	write_delete(fd, 20);
+	map = load_and_check(fname);
+	assert(gossmap_stats(map)->bytes_parsed == map->map_size - len);
+	assert(gossmap_num_chans(map) == 100);
+	tal_free(map);
+
+	/* Lots of growth: we rewrite the index. */
+	for (u64 i = 102; i <= 200; i++)
+		write_channel(fd, i);
+	map = load_and_check(fname);
+	assert(gossmap_stats(map)->bytes_parsed > map->map_size / 4);
+	tal_free(map);
+	map = load_and_check(fname);
+	assert(gossmap_stats(map)->bytes_parsed == 0);
+	tal_free(map);
+	close(fd);
+
+	/* A corrupt index is ignored (and replaced). */
+	fd = open(idxname, O_WRONLY);
+	assert(fd >= 0);
+	assert(ftruncate(fd, 100) == 0);
+	close(fd);
+	map = load_and_check(fname);
+	assert(gossmap_stats(map)->bytes_parsed == map->map_size - 1);
+	tal_free(map);
+
+	/* Damaged contents which would take us outside the store or our
+	 * arrays are caught too. */
+	assert(stat(idxname, &st) == 0);
+	corrupt_index(idxname, st.st_size - sizeof(u32), UINT_MAX - 1);
+	map = load_and_check(fname);
+	assert(gossmap_stats(map)->bytes_parsed == map->map_size - 1);
+	tal_free(map);
+
+	corrupt_index(idxname,
+		      sizeof(struct gossmap_index_hdr)
+		      + offsetof(struct gossmap_chan, scid_off),
+		      UINT_MAX - 100);
+	map = load_and_check(fname);
+	assert(gossmap_stats(map)->bytes_parsed == map->map_size - 1);
+	tal_free(map);
+
+	/* Free list pointing at a channel in use. */
+	corrupt_index(idxname,
+		      offsetof(struct gossmap_index_hdr, freed_chans), 0);
+	map = load_and_check(fname);
+	assert(gossmap_stats(map)->bytes_parsed == map->map_size - 1);
+	tal_free(map);
+
+	/* Rewritten in place (so same file), and at least as long as the
+	 * index says, but different contents: index is ignored. */
+	fd = new_store(fname);
+	for (u64 i = 201; i > 0; i--)
+		write_channel(fd, i);
+	close(fd);
+	map = load_and_check(fname);
+	assert(gossmap_stats(map)->bytes_parsed == map->map_size - 1);
+	for (u64 i = 1; i <= 201; i++)
+		check_channel(map, i);
+	tal_free(map);
+
+	/* A compacted store is a different file, so index is ignored. */
+	fd = new_store(tmpname);
+	for (u64 i = 1; i <= 50; i++)
+		write_channel(fd, i);
+	close(fd);
+	if (rename(tmpname, fname) != 0)
+		err(1, "Renaming %s", tmpname);
+	map = load_and_check(fname);
+	assert(gossmap_stats(map)->bytes_parsed == map->map_size - 1);
+	assert(gossmap_num_chans(map) == 50);
+	tal_free(map);
+
+	unlink(fname);
+	unlink(idxname);
+	common_shutdown();
+	return 0;
+}
@@ -0,0 +1,493 @@
+#include <assert.h>
+#include <ccan/err/err.h>
+#include <common/setup.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <unistd.h>
+
+#include "../amount.c"
+#include "../gossmap.c"
+
+/* AUTOGENERATED MOCKS START */
+/* Generated stub for fromwire */
+const u8 *fromwire(const u8 **cursor UNNEEDED, size_t *max UNNEEDED, void *copy UNNEEDED, size_t n UNNEEDED)
+{ fprintf(stderr, "fromwire called!\n"); abort(); }
+/* Generated stub for fromwire_bool */
+bool fromwire_bool(const u8 **cursor UNNEEDED, size_t *max UNNEEDED)
+{ fprintf(stderr, "fromwire_bool called!\n"); abort(); }
+/* Generated stub for fromwire_fail */
+void *fromwire_fail(const u8 **cursor UNNEEDED, size_t *max UNNEEDED)
+{ fprintf(stderr, "fromwire_fail called!\n"); abort(); }
+/* Generated stub for fromwire_secp256k1_ecdsa_signature */
+void fromwire_secp256k1_ecdsa_signature(const u8 **cursor UNNEEDED, size_t *max UNNEEDED,
+					secp256k1_ecdsa_signature *signature UNNEEDED)
+{ fprintf(stderr, "fromwire_secp256k1_ecdsa_signature called!\n"); abort(); }
+/* Generated stub for fromwire_sha256 */
+void fromwire_sha256(const u8 **cursor UNNEEDED, size_t *max UNNEEDED, struct sha256 *sha256 UNNEEDED)
+{ fprintf(stderr, "fromwire_sha256 called!\n"); abort(); }
+/* Generated stub for fromwire_tal_arrn */
+u8 *fromwire_tal_arrn(const tal_t *ctx UNNEEDED,
+		       const u8 **cursor UNNEEDED, size_t *max UNNEEDED, size_t num UNNEEDED)
+{ fprintf(stderr, "fromwire_tal_arrn called!\n"); abort(); }
+/* Generated stub for fromwire_u16 */
+u16 fromwire_u16(const u8 **cursor UNNEEDED, size_t *max UNNEEDED)
+{ fprintf(stderr, "fromwire_u16 called!\n"); abort(); }
+/* Generated stub for fromwire_u32 */
+u32 fromwire_u32(const u8 **cursor UNNEEDED, size_t *max UNNEEDED)
+{ fprintf(stderr, "fromwire_u32 called!\n"); abort(); }
+/* Generated stub for fromwire_u64 */
+u64 fromwire_u64(const u8 **cursor UNNEEDED, size_t *max UNNEEDED)
+{ fprintf(stderr, "fromwire_u64 called!\n"); abort(); }
+/* Generated stub for fromwire_u8 */
+u8 fromwire_u8(const u8 **cursor UNNEEDED, size_t *max UNNEEDED)
+{ fprintf(stderr, "fromwire_u8 called!\n"); abort(); }
+/* Generated stub for towire */
+void towire(u8 **pptr UNNEEDED, const void *data UNNEEDED, size_t len UNNEEDED)
+{ fprintf(stderr, "towire called!\n"); abort(); }
+/* Generated stub for towire_bool */
+void towire_bool(u8 **pptr UNNEEDED, bool v UNNEEDED)
+{ fprintf(stderr, "towire_bool called!\n"); abort(); }
+/* Generated stub for towire_secp256k1_ecdsa_signature */
+void towire_secp256k1_ecdsa_signature(u8 **pptr UNNEEDED,
+			      const secp256k1_ecdsa_signature *signature UNNEEDED)
+{ fprintf(stderr, "towire_secp256k1_ecdsa_signature called!\n"); abort(); }
+/* Generated stub for towire_sha256 */
+void towire_sha256(u8 **pptr UNNEEDED, const struct sha256 *sha256 UNNEEDED)
+{ fprintf(stderr, "towire_sha256 called!\n"); abort(); }
+/* Generated stub for towire_u16 */
+void towire_u16(u8 **pptr UNNEEDED, u16 v UNNEEDED)
+{ fprintf(stderr, "towire_u16 called!\n"); abort(); }
+/* Generated stub for towire_u32 */
+void towire_u32(u8 **pptr UNNEEDED, u32 v UNNEEDED)
+{ fprintf(stderr, "towire_u32 called!\n"); abort(); }
+/* Generated stub for towire_u64 */
+void towire_u64(u8 **pptr UNNEEDED, u64 v UNNEEDED)
+{ fprintf(stderr, "towire_u64 called!\n"); abort(); }
+/* Generated stub for towire_u8 */
+void towire_u8(u8 **pptr UNNEEDED, u8 v UNNEEDED)
+{ fprintf(stderr, "towire_u8 called!\n"); abort(); }
+/* Generated stub for towire_u8_array */
+void towire_u8_array(u8 **pptr UNNEEDED, const u8 *arr UNNEEDED, size_t num UNNEEDED)
+{ fprintf(stderr, "towire_u8_array called!\n"); abort(); }
+/* Generated stub for type_to_string_ */
+const char *type_to_string_(const tal_t *ctx UNNEEDED, const char *typename UNNEEDED,
+			    union printable_types u UNNEEDED)
+{ fprintf(stderr, "type_to_string_ called!\n"); abort(); }
+/* AUTOGENERATED MOCKS END */
+
+const struct siphash_seed *siphash_seed(void)
+{
+	static struct siphash_seed seed;
+	return &seed;
+}
+
+static struct node_id nodeid(u32 n)
+{
+	struct node_id id;
+
+	/* gossmap never checks these are valid points */
+	memset(&id, 0, sizeof(id));
+	id.k[0] = 0x02;
+	id.k[1] = n >> 24;
+	id.k[2] = n >> 16;
+	id.k[3] = n >> 8;
+	id.k[4] = n;
+	return id;
+}
+
+static void add_bytes(u8 **p, const void *mem, size_t len)
+{
+	size_t off = tal_count(*p);
+	tal_resize(p, off + len);
+	memcpy(*p + off, mem, len);
+}
+
+static void add_be16(u8 **p, u16 v)
+{
+	be16 be = cpu_to_be16(v);
+	add_bytes(p, &be, sizeof(be));
+}
+
+static void add_be32(u8 **p, u32 v)
+{
+	be32 be = cpu_to_be32(v);
+	add_bytes(p, &be, sizeof(be));
+}
+
+static void add_be64(u8 **p, u64 v)
+{
+	be64 be = cpu_to_be64(v);
+	add_bytes(p, &be, sizeof(be));
+}
+
+static void add_zeros(u8 **p, size_t len)
+{
+	size_t off = tal_count(*p);
+	tal_resizez(p, off + len);
+}
+
+static void write_record(int fd, const u8 *msg)
+{
+	struct gossip_hdr hdr;
+
+	hdr.len = cpu_to_be32(tal_count(msg));
+	hdr.crc = 0;
+	hdr.timestamp = 0;
+	if (write(fd, &hdr, sizeof(hdr)) != sizeof(hdr)
+	    || write(fd, msg, tal_count(msg)) != tal_count(msg))
+		err(1, "writing gossip_store");
+}
+
+static u8 *announce(u64 scid, u32 n1, u32 n2)
+{
+	u8 *msg = tal_arr(tmpctx, u8, 0);
+	struct node_id id[2];
+
+	/* Lesser node_id goes first */
+	id[0] = nodeid(n1 < n2 ? n1 : n2);
+	id[1] = nodeid(n1 < n2 ? n2 : n1);
+
+	add_be16(&msg, WIRE_CHANNEL_ANNOUNCEMENT);
+	add_zeros(&msg, 64 * 4);
+	/* features */
+	add_be16(&msg, 0);
+	/* chain_hash */
+	add_zeros(&msg, 32);
+	add_be64(&msg, scid);
+	add_bytes(&msg, id[0].k, sizeof(id[0].k));
+	add_bytes(&msg, id[1].k, sizeof(id[1].k));
+	/* bitcoin keys */
+	add_zeros(&msg, PUBKEY_CMPR_LEN * 2);
+	return msg;
+}
+
+static void write_announce(int fd, u64 scid, u32 n1, u32 n2)
+{
+	write_record(fd, announce(scid, n1, n2));
+}
+
+static u8 *update(u64 scid, int dir, u32 base_fee)
+{
+	u8 *msg = tal_arr(tmpctx, u8, 0);
+
+	add_be16(&msg, WIRE_CHANNEL_UPDATE);
+	add_zeros(&msg, 64 + 32);
+	add_be64(&msg, scid);
+	/* timestamp */
+	add_be32(&msg, 1);
+	/* message_flags: option_channel_htlc_max */
+	tal_arr_expand(&msg, 1);
+	/* channel_flags */
+	tal_arr_expand(&msg, dir);
+	/* cltv_expiry_delta */
+	add_be16(&msg, 6);
+	add_be64(&msg, 0);
+	add_be32(&msg, base_fee);
+	add_be32(&msg, 1);
+	add_be64(&msg, 1000000000);
+	return msg;
+}
+
+static void write_update(int fd, u64 scid, int dir, u32 base_fee)
+{
+	write_record(fd, update(scid, dir, base_fee));
+}
+
+/* Our local channels are wrapped */
+static void write_private_channel(int fd, u64 scid, u32 n1, u32 n2, u64 sats)
+{
+	u8 *msg = tal_arr(tmpctx, u8, 0), *ann = announce(scid, n1, n2);
+	u8 *upd = update(scid, 0, scid);
+
+	add_be16(&msg, WIRE_GOSSIP_STORE_PRIVATE_CHANNEL);
+	add_be64(&msg, sats);
+	add_be16(&msg, tal_count(ann));
+	add_bytes(&msg, ann, tal_count(ann));
+	write_record(fd, msg);
+
+	msg = tal_arr(tmpctx, u8, 0);
+	add_be16(&msg, WIRE_GOSSIP_STORE_PRIVATE_UPDATE);
+	add_be16(&msg, tal_count(upd));
+	add_bytes(&msg, upd, tal_count(upd));
+	write_record(fd, msg);
+}
+
+static void write_node_announce(int fd, u32 n)
+{
+	u8 *msg = tal_arr(tmpctx, u8, 0);
+	struct node_id id = nodeid(n);
+
+	add_be16(&msg, WIRE_NODE_ANNOUNCEMENT);
+	add_zeros(&msg, 64);
+	/* features */
+	add_be16(&msg, 0);
+	/* timestamp */
+	add_be32(&msg, 1);
+	add_bytes(&msg, id.k, sizeof(id.k));
+	/* rgb_color, alias */
+	add_zeros(&msg, 3 + 32);
+	/* addresses */
+	add_be16(&msg, 0);
+	write_record(fd, msg);
+}
+
+static void write_amount(int fd, u64 sats)
+{
+	u8 *msg = tal_arr(tmpctx, u8, 0);
+
+	add_be16(&msg, WIRE_GOSSIP_STORE_CHANNEL_AMOUNT);
+	add_be64(&msg, sats);
+	write_record(fd, msg);
+}
+
+/* Channel scid joins node scid-1 and node scid, with base_fee scid, and
+ * capacity scid * 1000 */
+static void write_channel(int fd, u64 scid)
+{
+	write_announce(fd, scid, scid - 1, scid);
+	write_amount(fd, scid * 1000);
+	write_update(fd, scid, 0, scid);
+	write_update(fd, scid, 1, scid);
+}
+
+static int new_store(const char *fname)
+{
+	u8 version = GOSSIP_STORE_VERSION;
+	int fd = open(fname, O_WRONLY|O_CREAT|O_TRUNC, 0600);
+
+	if (fd < 0)
+		err(1, "Creating %s", fname);
+	if (write(fd, &version, sizeof(version)) != sizeof(version))
+		err(1, "writing gossip_store");
+	return fd;
+}
+
+static void check_channel(struct gossmap *map, u64 scidval)
+{
+	struct short_channel_id scid;
+	struct gossmap_chan *chan;
+	struct node_id id, expect;
+	struct amount_sat capacity;
+
+	scid.u64 = scidval;
+	chan = gossmap_find_chan(map, &scid);
+	assert(chan);
+	assert(gossmap_chan_scid(map, chan).u64 == scidval);
+	assert(chan->half[0].base_fee == scidval);
+	assert(chan->half[1].base_fee == scidval);
+	assert(!gossmap_chan_is_private(map, chan));
+	assert(gossmap_chan_get_capacity(map, chan, &capacity));
+	assert(amount_sat_eq(capacity, amount_sat(scidval * 1000)));
+	for (int dir = 0; dir < 2; dir++) {
+		u32 timestamp, fee_base, fee_prop;
+		u8 message_flags, channel_flags;
+		u16 delay;
+		struct amount_msat htlc_min, htlc_max;
+
+		assert(gossmap_chan_has_update(chan, dir));
+		gossmap_chan_get_update_details(map, chan, dir, &timestamp,
+						&message_flags, &channel_flags,
+						&delay, &fee_base, &fee_prop,
+						&htlc_min, &htlc_max);
+		assert(timestamp == 1);
+		assert(channel_flags == dir);
+		assert(fee_base == scidval);
+		assert(delay == 6);
+		assert(amount_msat_eq(htlc_max, AMOUNT_MSAT(1000000000)));
+	}
+	gossmap_node_get_id(map, gossmap_nth_node(map, chan, 0), &id);
+	expect = nodeid(scidval - 1);
+	assert(node_id_eq(&id, &expect));
+	gossmap_node_get_id(map, gossmap_nth_node(map, chan, 1), &id);
+	expect = nodeid(scidval);
+	assert(node_id_eq(&id, &expect));
+}
+
+/* The csr must match the map itself */
+static void check_csr(const struct gossmap *map)
+{
+	const struct gossmap_csr *csr = gossmap_csr(map);
+
+	assert(csr);
+	assert(tal_count(csr->first) == gossmap_max_node_idx(map) + 1);
+	for (u32 i = 0; i < gossmap_max_node_idx(map); i++) {
+		const struct gossmap_node *node = gossmap_node_byidx(map, i);
+		const struct gossmap_edge *e = csr->edges + csr->first[i];
+
+		if (!node->chan_idxs) {
+			assert(csr->first[i + 1] == csr->first[i]);
+			continue;
+		}
+		assert(csr->first[i + 1] - csr->first[i] == node->num_chans);
+		for (size_t j = 0; j < node->num_chans; j++, e++) {
+			int which_half;
+			const struct gossmap_chan *c;
+
+			c = gossmap_nth_chan(map, node, j, &which_half);
+			assert(gossmap_chan_byidx(map, e->chan_idx) == c);
+			assert(e->dir == !which_half);
+			assert(e->half.nodeidx
+			       == gossmap_node_idx(map,
+						   gossmap_nth_node(map, c,
+								    e->dir)));
+			assert(e->half.base_fee == c->half[e->dir].base_fee);
+		}
+	}
+}
+
+static struct gossmap_node *find_node(struct gossmap *map, u32 n)
+{
+	struct node_id id = nodeid(n);
+	return gossmap_find_node(map, &id);
+}
+
+int main(int argc, char *argv[])
+{
+	char *fname, *tmpname;
+	struct gossmap *map;
+	const struct gossmap_stats *stats;
+	struct short_channel_id scid;
+	u32 chanidx[100], nodeidx[100];
+	struct amount_sat capacity;
+	int fd, dirfd;
+
+	common_setup(argv[0]);
+
+	fname = tal_strdup(tmpctx, "/tmp/run-gossmap-refresh.XXXXXX");
+	dirfd = mkstemp(fname);
+	if (dirfd < 0)
+		err(1, "Creating %s", fname);
+	close(dirfd);
+	tmpname = tal_fmt(tmpctx, "%s.tmp", fname);
+
+	/* A line of 50 channels: 0 - 1 - 2 ... 50 */
+	fd = new_store(fname);
+	for (u64 i = 1; i <= 50; i++)
+		write_channel(fd, i);
+	write_node_announce(fd, 10);
+	write_node_announce(fd, 20);
+
+	map = gossmap_load(tmpctx, fname);
+	assert(map);
+	stats = gossmap_stats(map);
+	assert(gossmap_num_chans(map) == 50);
+	assert(gossmap_num_nodes(map) == 51);
+	assert(stats->remaps == 1);
+	gossmap_enable_csr(map);
+	check_csr(map);
+
+	/* Nothing changed. */
+	assert(!gossmap_refresh(map));
+	check_csr(map);
+	assert(stats->refreshes == 1);
+	assert(stats->changed == 0);
+
+	/* A little growth fits in our existing mapping. */
+	write_channel(fd, 51);
+	assert(gossmap_refresh(map));
+	assert(stats->changed == 1);
+	assert(stats->remaps == 1);
+	check_channel(map, 51);
+	check_csr(map);
+
+	/* A lot of growth doesn't. */
+	for (u64 i = 52; i <= 80; i++)
+		write_channel(fd, i);
+	assert(gossmap_refresh(map));
+	assert(stats->remaps == 2);
+	assert(gossmap_num_chans(map) == 80);
+	for (u64 i = 1; i <= 80; i++)
+		check_channel(map, i);
+	check_csr(map);
+	close(fd);
+
+	assert(stats->bytes_parsed == map->map_size - 1);
+
+	for (u64 i = 1; i <= 80; i++) {
+		scid.u64 = i;
+		chanidx[i] = gossmap_chan_idx(map,
+					      gossmap_find_chan(map, &scid));
+	}
+	for (u32 i = 0; i <= 80; i++)
+		nodeidx[i] = gossmap_node_idx(map, find_node(map, i));
+
+	/* Now "compact": channels 79 and 80 gone (so nodes 79 and 80 too),
+	 * node 20's announcement is gone, and everything else is in a
+	 * different order.  Plus one new channel. */
+	fd = new_store(tmpname);
+	write_node_announce(fd, 10);
+	for (u64 i = 78; i > 0; i--)
+		write_channel(fd, i);
+	write_announce(fd, 100, 5, 40);
+	write_update(fd, 100, 0, 100);
+	close(fd);
+	if (rename(tmpname, fname) != 0)
+		err(1, "Renaming %s", tmpname);
+
+	assert(gossmap_refresh(map));
+	assert(stats->compactions == 1);
+	assert(!map->old_ids);
+	assert(!map->unmoved);
+	check_csr(map);
+
+	assert(gossmap_num_chans(map) == 79);
+	assert(gossmap_num_nodes(map) == 79);
+	for (u64 i = 1; i <= 78; i++) {
+		check_channel(map, i);
+		scid.u64 = i;
+		assert(gossmap_chan_idx(map, gossmap_find_chan(map, &scid))
+		       == chanidx[i]);
+	}
+	for (u32 i = 0; i <= 78; i++)
+		assert(gossmap_node_idx(map, find_node(map, i)) == nodeidx[i]);
+
+	scid.u64 = 79;
+	assert(!gossmap_find_chan(map, &scid));
+	scid.u64 = 80;
+	assert(!gossmap_find_chan(map, &scid));
+	assert(!find_node(map, 79));
+	assert(!find_node(map, 80));
+
+	scid.u64 = 100;
+	assert(gossmap_find_chan(map, &scid));
+	assert(gossmap_nth_node(map, gossmap_find_chan(map, &scid), 0)
+	       == find_node(map, 5));
+
+	assert(find_node(map, 10)->nann_off != 0);
+	assert(find_node(map, 20)->nann_off == 0);
+	assert(tal_bytelen(gossmap_node_get_announce(tmpctx, map,
+						     find_node(map, 10)))
+	       == 2 + 64 + 2 + 4 + PUBKEY_CMPR_LEN + 3 + 32 + 2);
+
+	/* No amount for this one, and only one update. */
+	assert(!gossmap_chan_get_capacity(map, gossmap_find_chan(map, &scid),
+					  &capacity));
+	assert(gossmap_chan_has_update(gossmap_find_chan(map, &scid), 0));
+	assert(!gossmap_chan_has_update(gossmap_find_chan(map, &scid), 1));
+
+	/* Local changes make the csr stale until the next refresh. */
+	gossmap_remove_chan(map, gossmap_find_chan(map, &scid));
+	assert(!gossmap_csr(map));
+	assert(!gossmap_refresh(map));
+	check_csr(map);
+
+	/* Private channels have their capacity inside their wrapper. */
+	fd = open(fname, O_WRONLY|O_APPEND);
+	write_private_channel(fd, 101, 5, 200, 77777);
+	close(fd);
+	assert(gossmap_refresh(map));
+	scid.u64 = 101;
+	assert(gossmap_chan_is_private(map, gossmap_find_chan(map, &scid)));
+	assert(gossmap_chan_get_capacity(map, gossmap_find_chan(map, &scid),
+					 &capacity));
+	assert(amount_sat_eq(capacity, AMOUNT_SAT(77777)));
+	assert(tal_bytelen(gossmap_chan_get_announce(tmpctx, map,
+						     gossmap_find_chan(map, &scid)))
+	       == tal_bytelen(announce(101, 5, 200)));
+	assert(gossmap_chan_has_update(gossmap_find_chan(map, &scid), 0));
+	assert(gossmap_find_chan(map, &scid)->half[0].base_fee == 101);
+
+	unlink(fname);
+	common_shutdown();
+	return 0;
+}
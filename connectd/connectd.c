@@ -127,6 +127,9 @@ struct daemon {
 	struct timers timers;
 	u32 timeout_secs;
 
+	/* How much gossip each peer's daemon sends in one write */
+	u32 gossip_batch_bytes;
+
 	/* Peers that we've handed to `lightningd`, which it hasn't told us
 	 * have disconnected. */
 	struct node_set peers;
@@ -470,6 +473,7 @@ struct io_plan *peer_connected(struct io_conn *conn,
 
 	/* This contains the per-peer state info; gossipd fills in pps->gs */
 	pps = new_per_peer_state(tmpctx, cs);
+	pps->gossip_batch_bytes = daemon->gossip_batch_bytes;
 
 	/* If gossipd can't give us a file descriptor, we give up connecting. */
 	if (!get_gossipfds(daemon, id, their_features, pps))
@@ -1265,7 +1269,8 @@ static struct io_plan *connect_init(struct io_conn *conn,
 		&daemon->dev_allow_localhost, &daemon->use_dns,
 		&tor_password,
 		&daemon->use_v3_autotor,
-		    &daemon->timeout_secs)) {
+		    &daemon->timeout_secs,
+		    &daemon->gossip_batch_bytes)) {
 		/* This is a helper which prints the type expected and the actual
 		 * message, then exits (it should never be called!). */
 		master_badmsg(WIRE_CONNECTD_INIT, msg);
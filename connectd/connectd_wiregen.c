@@ -61,7 +61,7 @@ bool connectd_wire_is_defined(u16 type)
 
 
 /* WIRE: CONNECTD_INIT */
-u8 *towire_connectd_init(const tal_t *ctx, const struct chainparams *chainparams, const struct feature_set *our_features, const struct node_id *id, const struct wireaddr_internal *wireaddrs, const enum addr_listen_announce *listen_announce, const struct wireaddr *tor_proxyaddr, bool use_tor_proxy_always, bool dev_allow_localhost, bool use_dns, const wirestring *tor_password, bool use_v3_autotor, u32 timeout_secs)
+u8 *towire_connectd_init(const tal_t *ctx, const struct chainparams *chainparams, const struct feature_set *our_features, const struct node_id *id, const struct wireaddr_internal *wireaddrs, const enum addr_listen_announce *listen_announce, const struct wireaddr *tor_proxyaddr, bool use_tor_proxy_always, bool dev_allow_localhost, bool use_dns, const wirestring *tor_password, bool use_v3_autotor, u32 timeout_secs, u32 gossip_batch_bytes)
 {
 	u16 num_wireaddrs = tal_count(listen_announce);
 	u8 *p = tal_arr(ctx, u8, 0);
@@ -87,10 +87,11 @@ u8 *towire_connectd_init(const tal_t *ctx, const struct chainparams *chainparams
 	towire_wirestring(&p, tor_password);
 	towire_bool(&p, use_v3_autotor);
 	towire_u32(&p, timeout_secs);
+	towire_u32(&p, gossip_batch_bytes);
 
 	return memcheck(p, tal_count(p));
 }
-bool fromwire_connectd_init(const tal_t *ctx, const void *p, const struct chainparams **chainparams, struct feature_set **our_features, struct node_id *id, struct wireaddr_internal **wireaddrs, enum addr_listen_announce **listen_announce, struct wireaddr **tor_proxyaddr, bool *use_tor_proxy_always, bool *dev_allow_localhost, bool *use_dns, wirestring **tor_password, bool *use_v3_autotor, u32 *timeout_secs)
+bool fromwire_connectd_init(const tal_t *ctx, const void *p, const struct chainparams **chainparams, struct feature_set **our_features, struct node_id *id, struct wireaddr_internal **wireaddrs, enum addr_listen_announce **listen_announce, struct wireaddr **tor_proxyaddr, bool *use_tor_proxy_always, bool *dev_allow_localhost, bool *use_dns, wirestring **tor_password, bool *use_v3_autotor, u32 *timeout_secs, u32 *gossip_batch_bytes)
 {
 	u16 num_wireaddrs;
 
@@ -123,6 +124,7 @@ bool fromwire_connectd_init(const tal_t *ctx, const void *p, const struct chainp
  	*tor_password = fromwire_wirestring(ctx, &cursor, &plen);
  	*use_v3_autotor = fromwire_bool(&cursor, &plen);
  	*timeout_secs = fromwire_u32(&cursor, &plen);
+ 	*gossip_batch_bytes = fromwire_u32(&cursor, &plen);
 	return cursor != NULL;
 }
 
@@ -406,4 +408,4 @@ bool fromwire_connectd_dev_memleak_reply(const void *p, bool *leak)
  	*leak = fromwire_bool(&cursor, &plen);
 	return cursor != NULL;
 }
-// SHA256STAMP:85f646a5218fd260c3e73d270ea8f59aa14cb3ca02d7805f23b988625ca4deee
+// SHA256STAMP:d6154dc27dc65143cdd3843efb82cfe18f7c16d652811fc9c5afcb9c20be2ec6
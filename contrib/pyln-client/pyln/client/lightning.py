@@ -818,13 +818,15 @@ class LightningRpc(UnixDomainSocketRpc):
         }
         return self.call("invoice", payload)
 
-    def listchannels(self, short_channel_id=None, source=None):
+    def listchannels(self, short_channel_id=None, source=None, fields=None):
         """
         Show all known channels, accept optional {short_channel_id} or {source}.
+        Only show {fields} if specified.
         """
         payload = {
             "short_channel_id": short_channel_id,
-            "source": source
+            "source": source,
+            "fields": fields,
         }
         return self.call("listchannels", payload)
 
@@ -862,13 +864,14 @@ class LightningRpc(UnixDomainSocketRpc):
         }
         return self.call("listinvoices", payload)
 
-    def listnodes(self, node_id=None):
+    def listnodes(self, node_id=None, fields=None):
         """
         Show all nodes in our local network view, filter on node {id}
-        if provided.
+        if provided.  Only show {fields} if specified.
         """
         payload = {
-            "id": node_id
+            "id": node_id,
+            "fields": fields,
         }
         return self.call("listnodes", payload)
 
@@ -30,8 +30,10 @@ static struct amount_msat route_amount(struct route **path,
 }
 
 static struct route **least_cost(struct gossmap *map,
+				struct dijkstra_ctx *dctx,
 				struct gossmap_node *src,
-				struct gossmap_node *dst)
+				struct gossmap_node *dst,
+				bool full_graph)
 {
 	const struct dijkstra *dij;
 	u32 srcidx = gossmap_node_idx(map, src);
@@ -50,12 +52,13 @@ static struct route **least_cost(struct gossmap *map,
 	setup_tmpctx();
 
 	tstart = time_mono();
-	dij = dijkstra(tmpctx, map, dst,
-		       sent, riskfactor, route_can_carry,
-		       route_score_cheaper, NULL);
+	dij = dijkstra_run(dctx, map, dst, full_graph ? NULL : src,
+			   sent, riskfactor, route_can_carry,
+			   route_score_cheaper, NULL);
 	tstop = time_mono();
 
-	printf("# Time to find route: %"PRIu64" usec\n",
+	printf("# Time to find route%s: %"PRIu64" usec\n",
+	       full_graph ? " (full graph)" : "",
 	       time_to_usec(timemono_between(tstop, tstart)));
 
 	if (dijkstra_distance(dij, srcidx) > distance_budget) {
@@ -78,7 +81,6 @@ static struct route **least_cost(struct gossmap *map,
 		abort();
 	printf("# path fee %s\n",
 	       type_to_string(tmpctx, struct amount_msat, &fee));
-	tal_free(dij);
 	return path;
 }
 
@@ -87,11 +89,14 @@ int main(int argc, char *argv[])
 	struct timemono tstart, tstop;
 	struct gossmap_node *n, *dst;
 	struct gossmap *map;
+	struct dijkstra_ctx *dctx;
 	struct node_id dstid;
-	bool clean_topology = false;
+	bool clean_topology = false, full_graph = false;
 
 	opt_register_noarg("--clean-topology", opt_set_bool, &clean_topology,
 			   "Clean up topology before run");
+	opt_register_noarg("--full-graph", opt_set_bool, &full_graph,
+			   "Don't stop searching once we reach the source");
 	opt_register_noarg("-h|--help", opt_usage_and_exit,
 			   "<gossipstore> <srcid>|all <dstid>\n"
 			   "A routing test and benchmark program.",
@@ -101,7 +106,7 @@ int main(int argc, char *argv[])
 		opt_usage_exit_fail("Expect 3 arguments");
 
 	tstart = time_mono();
-	map = gossmap_load(NULL, argv[1]);
+	map = gossmap_load_indexed(NULL, argv[1]);
 	if (!map)
 		err(1, "Loading gossip store %s", argv[1]);
 	tstop = time_mono();
@@ -112,6 +117,8 @@ int main(int argc, char *argv[])
 	if (clean_topology)
 		clean_topo(map, false);
 
+	dctx = dijkstra_ctx_new(map);
+
 	if (!node_id_from_hexstr(argv[3], strlen(argv[3]), &dstid))
 		errx(1, "Bad dstid");
 	dst = gossmap_find_node(map, &dstid);
@@ -129,7 +136,7 @@ int main(int argc, char *argv[])
 			printf("# %s->%s\n",
 			       type_to_string(tmpctx, struct node_id, &srcid),
 			       type_to_string(tmpctx, struct node_id, &dstid));
-			tal_free(least_cost(map, n, dst));
+			tal_free(least_cost(map, dctx, n, dst, full_graph));
 		}
 	} else {
 		struct route **path;
@@ -140,7 +147,7 @@ int main(int argc, char *argv[])
 		n = gossmap_find_node(map, &srcid);
 		if (!n)
 			errx(1, "Unknown source node '%s'", argv[2]);
-		path = least_cost(map, n, dst);
+		path = least_cost(map, dctx, n, dst, full_graph);
 		if (!path)
 			exit(1);
 		for (size_t i = 0; i < tal_count(path); i++) {
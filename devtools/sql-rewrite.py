@@ -73,6 +73,68 @@ rewriters = {
     "postgres": PostgresRewriter(),
 }
 
+def query_hash(name):
+    # FNV-1a: must match db_query_hash() in wallet/db_common.h
+    h = 2166136261
+    for b in name.encode('utf-8'):
+        h ^= b
+        h = (h * 16777619) & 0xFFFFFFFF
+    return h
+
+
+def query_seeded_hash(h, seed):
+    # Must match db_query_seeded_hash() in wallet/db_common.h
+    h ^= (seed * 0x9E3779B9) & 0xFFFFFFFF
+    h ^= h >> 16
+    h = (h * 0x85EBCA6B) & 0xFFFFFFFF
+    h ^= h >> 13
+    h = (h * 0xC2B2AE35) & 0xFFFFFFFF
+    h ^= h >> 16
+    return h
+
+
+def perfect_hash(names):
+    """Hash-and-displace perfect hash of the query names.
+
+    The hash of a name picks a bucket, and each bucket has a seed which
+    sends all its names to distinct, unused slots.  Each slot holds the
+    index of the query, so a lookup is one pass over the name to hash it,
+    and one strcmp.
+    """
+    num_buckets = (len(names) + 3) // 4
+    num_slots = len(names)
+
+    hashes = []
+    buckets = [[] for _ in range(num_buckets)]
+    for i, name in enumerate(names):
+        # The generated C string must be exactly the name we hash
+        assert '\\' not in name
+        hashes.append(query_hash(name))
+        buckets[hashes[i] % num_buckets].append(i)
+
+    while True:
+        seeds = [0] * num_buckets
+        slots = [None] * num_slots
+        # Biggest buckets first, while there's the most room.
+        for b in sorted(range(num_buckets), key=lambda b: -len(buckets[b])):
+            if buckets[b] == []:
+                continue
+            for seed in range(1, 0x10000):
+                pos = [query_seeded_hash(hashes[i], seed) % num_slots for i in buckets[b]]
+                if len(set(pos)) == len(pos) and all(slots[p] is None for p in pos):
+                    break
+            else:
+                break
+            seeds[b] = seed
+            for i, p in zip(buckets[b], pos):
+                slots[p] = i
+        else:
+            # 0xFFFF marks an empty slot.
+            return seeds, [0xFFFF if s is None else s for s in slots]
+        # Give it some more room and try again.
+        num_slots += 1
+
+
 template = Template("""#ifndef LIGHTNINGD_WALLET_GEN_DB_${f.upper()}
 #define LIGHTNINGD_WALLET_GEN_DB_${f.upper()}
 
@@ -95,6 +157,18 @@ struct db_query db_${f}_queries[] = {
 
 #define DB_${f.upper()}_QUERY_COUNT ${len(queries)}
 
+const u16 db_${f}_query_seeds[] = {
+% for seed in seeds:
+    ${seed},
+% endfor
+};
+
+const u16 db_${f}_query_slots[] = {
+% for slot in slots:
+    ${slot},
+% endfor
+};
+
 #endif /* HAVE_${f.upper()} */
 
 #endif /* LIGHTNINGD_WALLET_GEN_DB_${f.upper()} */
@@ -158,4 +232,6 @@ if __name__ == "__main__":
     queries = extract_queries(sys.argv[1])
     queries = rewriter.rewrite(queries)
 
-    print(template.render(f=dialect, queries=queries))
+    seeds, slots = perfect_hash([q['name'] for q in queries])
+
+    print(template.render(f=dialect, queries=queries, seeds=seeds, slots=slots))
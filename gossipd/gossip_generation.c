@@ -1,5 +1,7 @@
 /* Routines to make our own gossip messages.  Not as in "we're the gossip
  * generation, man!" */
+#include <ccan/array_size/array_size.h>
+#include <ccan/crc32c/crc32c.h>
 #include <ccan/mem/mem.h>
 #include <common/features.h>
 #include <common/memleak.h>
@@ -71,9 +73,29 @@ void get_cupdate_parts(const u8 *channel_update,
 	sizes[1] = tal_count(channel_update) - (64 + 2 + 32 + 8 + 4);
 }
 
+/* BOLT #7:
+ *
+ * The checksum of a `channel_update` is the CRC32C checksum as specified in
+ * [RFC3720](https://tools.ietf.org/html/rfc3720#appendix-B.4) of this
+ * `channel_update` without its `signature` and `timestamp` fields.
+ */
+u32 crc32_of_update(const u8 *channel_update)
+{
+	u32 sum;
+	const u8 *parts[2];
+	size_t sizes[ARRAY_SIZE(parts)];
+
+	get_cupdate_parts(channel_update, parts, sizes);
+
+	sum = 0;
+	for (size_t i = 0; i < ARRAY_SIZE(parts); i++)
+		sum = crc32c(sum, parts[i], sizes[i]);
+	return sum;
+}
+
 /* Is this channel_update different from prev (not sigs and timestamps)? */
 bool cupdate_different(struct gossip_store *gs,
-		       const struct half_chan *hc,
+		       const struct chan *chan, int direction,
 		       const u8 *cupdate)
 {
 	const u8 *oparts[2], *nparts[2];
@@ -81,7 +103,7 @@ bool cupdate_different(struct gossip_store *gs,
 	const u8 *orig;
 
 	/* Get last one we have. */
-	orig = gossip_store_get(tmpctx, gs, hc->bcast.index);
+	orig = gossip_store_get(tmpctx, gs, chan->half_bcast[direction].index);
 	get_cupdate_parts(orig, oparts, osizes);
 	get_cupdate_parts(cupdate, nparts, nsizes);
 
@@ -256,7 +278,6 @@ static void update_local_channel(struct local_cupdate *lc /* frees! */)
 	u32 timestamp = gossip_time_now(daemon->rstate).ts.tv_sec, next;
 	u8 message_flags, channel_flags;
 	struct chan *chan = lc->local_chan->chan;
-	struct half_chan *hc;
 	const int direction = lc->local_chan->direction;
 
 	/* Discard existing timer. */
@@ -298,14 +319,11 @@ static void update_local_channel(struct local_cupdate *lc /* frees! */)
 	 */
 	message_flags = 0 | ROUTING_OPT_HTLC_MAX_MSAT;
 
-	/* Convenience variable. */
-	hc = &chan->half[direction];
-
 	/* If we ever use set-based propagation, ensuring the toggle
 	 * the lower bit in consecutive timestamps makes it more
 	 * robust. */
-	if (is_halfchan_defined(hc)
-	    && (timestamp & 1) == (hc->bcast.timestamp & 1))
+	if (is_halfchan_defined(chan, direction)
+	    && (timestamp & 1) == (chan->half_bcast[direction].timestamp & 1))
 		timestamp++;
 
 	/* We create an update with a dummy signature, and hand to hsmd to get
@@ -321,16 +339,17 @@ static void update_local_channel(struct local_cupdate *lc /* frees! */)
 				       lc->fee_proportional_millionths,
 				       lc->htlc_maximum);
 
-	if (is_halfchan_defined(hc)) {
+	if (is_halfchan_defined(chan, direction)) {
 		/* Suppress duplicates. */
 		if (!lc->even_if_identical
-		    && !cupdate_different(daemon->rstate->gs, hc, update)) {
+		    && !cupdate_different(daemon->rstate->gs, chan, direction,
+					  update)) {
 			tal_free(lc);
 			return;
 		}
 
 		/* Is it too soon to send another update? */
-		next = hc->bcast.timestamp
+		next = chan->half_bcast[direction].timestamp
 			+ GOSSIP_MIN_INTERVAL(daemon->rstate->dev_fast_gossip);
 
 		if (timestamp < next) {
@@ -418,7 +437,7 @@ void refresh_local_channel(struct daemon *daemon,
 	hc = &local_chan->chan->half[local_chan->direction];
 
 	/* Don't generate a channel_update for an uninitialized channel. */
-	if (!is_halfchan_defined(hc))
+	if (!is_halfchan_defined(local_chan->chan, local_chan->direction))
 		return;
 
 	lc = tal(NULL, struct local_cupdate);
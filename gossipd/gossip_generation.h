@@ -7,7 +7,6 @@
 
 struct chan;
 struct daemon;
-struct half_chan;
 struct local_chan;
 struct gossip_store;
 struct peer;
@@ -18,11 +17,14 @@ void get_cupdate_parts(const u8 *channel_update,
 		       const u8 *parts[2],
 		       size_t sizes[2]);
 
+/* The checksum of a channel_update, for reply_channel_range. */
+u32 crc32_of_update(const u8 *channel_update);
+
 
 /* Is this channel_update different from prev (not sigs and timestamps)?
- * is_halfchan_defined(hc) must be true! */
+ * is_halfchan_defined(chan, direction) must be true! */
 bool cupdate_different(struct gossip_store *gs,
-		       const struct half_chan *hc,
+		       const struct chan *chan, int direction,
 		       const u8 *cupdate);
 
 /* Is this node_announcement different from prev (not sigs and timestamps)?
@@ -1,15 +1,16 @@
 #include "gossip_store.h"
 
 #include <bitcoin/chainparams.h>
-#include <ccan/array_size/array_size.h>
 #include <ccan/crc32c/crc32c.h>
 #include <ccan/endian/endian.h>
 #include <ccan/noerr/noerr.h>
 #include <ccan/read_write_all/read_write_all.h>
 #include <ccan/tal/str/str.h>
 #include <common/gossip_store.h>
+#include <common/memleak.h>
 #include <common/private_channel_announcement.h>
 #include <common/status.h>
+#include <common/timeout.h>
 #include <common/type_to_string.h>
 #include <common/utils.h>
 #include <errno.h>
@@ -17,15 +18,24 @@
 #include <gossipd/gossip_store_wiregen.h>
 #include <gossipd/gossipd_peerd_wiregen.h>
 #include <gossipd/gossipd_wiregen.h>
+#include <pthread.h>
 #include <stdio.h>
+#include <sys/mman.h>
 #include <sys/stat.h>
-#include <sys/uio.h>
 #include <unistd.h>
 #include <wire/peer_wire.h>
 #include <wire/wire.h>
 
 #define GOSSIP_STORE_TEMP_FILENAME "gossip_store.tmp"
 
+/* We gather appends up, and write them out at most this long after the
+ * first, or once there are this many bytes. */
+#define GOSSIP_STORE_FLUSH_MSEC 10
+#define GOSSIP_STORE_FLUSH_BYTES 65536
+
+/* Online compaction copies this much each time around the event loop. */
+#define GOSSIP_STORE_COMPACT_SLICE_BYTES (1024 * 1024)
+
 struct gossip_store {
 	/* This is false when we're loading */
 	bool writable;
@@ -33,9 +43,14 @@ struct gossip_store {
 	int fd;
 	u8 version;
 
-	/* Offset of current EOF */
+	/* Offset of current EOF (including anything in wbuf) */
 	u64 len;
 
+	/* Appends we haven't written yet: these go at len - tal_bytelen(wbuf) */
+	u8 *wbuf;
+	/* Timer to write out wbuf, if it's not empty. */
+	struct oneshot *flush_timer;
+
 	/* Counters for entries in the gossip_store entries. This is used to
 	 * decide whether we should rewrite the on-disk store or not.
 	 * Note: count includes deleted. */
@@ -52,53 +67,88 @@ struct gossip_store {
 	 * compaction */
 	bool disable_compaction;
 
+	/* Compaction in progress, if any */
+	struct compaction *compaction;
+
 	/* Timestamp of store when we opened it (0 if we created it) */
 	u32 timestamp;
 };
 
-static void gossip_store_destroy(struct gossip_store *gs)
+/* Where wbuf starts in the file (i.e. the file's real length) */
+static u64 wbuf_off(const struct gossip_store *gs)
 {
-	close(gs->fd);
+	return gs->len - tal_bytelen(gs->wbuf);
 }
 
-#if HAVE_PWRITEV
-static ssize_t gossip_pwritev(int fd, const struct iovec *iov, int iovcnt,
-			      off_t offset)
+/* Readers only ever see whole records, since we only write out whole
+ * records, and they already ignore a partially-written one at the end. */
+static void write_wbuf(struct gossip_store *gs)
 {
-	return pwritev(fd, iov, iovcnt, offset);
+	size_t len = tal_bytelen(gs->wbuf);
+
+	if (len == 0)
+		return;
+
+	if (pwrite(gs->fd, gs->wbuf, len, wbuf_off(gs)) != len)
+		status_failed(STATUS_FAIL_INTERNAL_ERROR,
+			      "Failed writing %zu bytes to gossip store: %s",
+			      len, strerror(errno));
+	tal_resize(&gs->wbuf, 0);
 }
-#else /* Hello MacOS! */
-static ssize_t gossip_pwritev(int fd, const struct iovec *iov, int iovcnt,
-			      off_t offset)
+
+void gossip_store_flush(struct gossip_store *gs)
 {
-	u8 *buf;
-	size_t len;
-	ssize_t ret;
+	gs->flush_timer = tal_free(gs->flush_timer);
+	write_wbuf(gs);
+}
 
-	/* Make a temporary linear buffer to fall back to pwrite() */
-	len = 0;
-	for (size_t i = 0; i < iovcnt; i++)
-		len += iov[i].iov_len;
+static void flush_timer_expired(struct gossip_store *gs)
+{
+	/* gossip_store_flush would free us! */
+	gs->flush_timer = NULL;
+	write_wbuf(gs);
+}
 
-	buf = tal_arr(NULL, u8, len);
-	len = 0;
-	for (size_t i = 0; i < iovcnt; i++) {
-		memcpy(buf + len, iov[i].iov_base, iov[i].iov_len);
-		len += iov[i].iov_len;
-	}
+static void gossip_store_destroy(struct gossip_store *gs)
+{
+	write_wbuf(gs);
+	close(gs->fd);
+}
+
+/* pread, but records still in wbuf are read from there. */
+static bool store_pread(const struct gossip_store *gs,
+			void *buf, size_t len, u64 off)
+{
+	if (off < wbuf_off(gs))
+		return pread(gs->fd, buf, len, off) == len;
+
+	off -= wbuf_off(gs);
+	if (off + len > tal_bytelen(gs->wbuf))
+		return false;
+	memcpy(buf, gs->wbuf + off, len);
+	return true;
+}
 
-	ret = pwrite(fd, buf, len, offset);
-	tal_free(buf);
-	return ret;
+/* pwrite, but records still in wbuf are altered there. */
+static bool store_pwrite(struct gossip_store *gs,
+			 const void *buf, size_t len, u64 off)
+{
+	if (off < wbuf_off(gs))
+		return pwrite(gs->fd, buf, len, off) == len;
+
+	off -= wbuf_off(gs);
+	if (off + len > tal_bytelen(gs->wbuf))
+		return false;
+	memcpy(gs->wbuf + off, buf, len);
+	return true;
 }
-#endif /* !HAVE_PWRITEV */
 
-static bool append_msg(int fd, const u8 *msg, u32 timestamp,
-		       bool push, u64 *len)
+static void append_msg(struct gossip_store *gs, const u8 *msg, u32 timestamp,
+		       bool push)
 {
 	struct gossip_hdr hdr;
 	u32 msglen;
-	struct iovec iov[2];
+	size_t wlen = tal_bytelen(gs->wbuf);
 
 	msglen = tal_count(msg);
 	hdr.len = cpu_to_be32(msglen);
@@ -107,15 +157,10 @@ static bool append_msg(int fd, const u8 *msg, u32 timestamp,
 	hdr.crc = cpu_to_be32(crc32c(timestamp, msg, msglen));
 	hdr.timestamp = cpu_to_be32(timestamp);
 
-	/* Use pwritev so it will appear in store atomically */
-	iov[0].iov_base = &hdr;
-	iov[0].iov_len = sizeof(hdr);
-	iov[1].iov_base = (void *)msg;
-	iov[1].iov_len = msglen;
-	if (gossip_pwritev(fd, iov, ARRAY_SIZE(iov), *len) != sizeof(hdr) + msglen)
-		return false;
-	*len += sizeof(hdr) + msglen;
-	return true;
+	tal_resize(&gs->wbuf, wlen + sizeof(hdr) + msglen);
+	memcpy(gs->wbuf + wlen, &hdr, sizeof(hdr));
+	memcpy(gs->wbuf + wlen + sizeof(hdr), msg, msglen);
+	gs->len += sizeof(hdr) + msglen;
 }
 
 #ifdef COMPAT_V082
@@ -317,7 +362,10 @@ struct gossip_store *gossip_store_new(struct routing_state *rstate,
 			      strerror(errno));
 	gs->rstate = rstate;
 	gs->disable_compaction = false;
+	gs->compaction = NULL;
 	gs->len = sizeof(gs->version);
+	gs->wbuf = tal_arr(gs, u8, 0);
+	gs->flush_timer = NULL;
 	gs->peers = peers;
 
 	tal_add_destructor(gs, gossip_store_destroy);
@@ -405,6 +453,8 @@ static size_t transfer_store_msg(int from_fd, size_t from_off,
 /* We keep a htable map of old gossip_store offsets to new ones. */
 struct offset_map {
 	size_t from, to;
+	/* Does something in rstate point at it? */
+	bool broadcastable;
 };
 
 static size_t offset_map_key(const struct offset_map *omap)
@@ -425,6 +475,45 @@ static bool offset_map_eq(const struct offset_map *omap, const size_t from)
 HTABLE_DEFINE_TYPE(struct offset_map,
 		   offset_map_key, hash_offset, offset_map_eq, offmap);
 
+/*~ Rewriting the whole store at once stalls everything else, so we do it
+ * a slice at a time: we copy the live records into the new file, while
+ * appends keep going to the end of the old one (which we copy later) and
+ * deletions of records we've already copied are applied to both.  Once
+ * we've caught up, we swap the new file in. */
+struct compaction {
+	int fd;
+
+	/* How far we've copied the old store, and the new store's length */
+	u64 from_off, len;
+
+	/* Records copied, and those of which were deleted since. */
+	size_t count, deleted;
+
+	/* Old offset to new for every record we've copied */
+	struct offmap *offmap;
+
+	/* Timer for the next slice */
+	struct oneshot *slice_timer;
+};
+
+static void destroy_offmap(struct offmap *offmap)
+{
+	offmap_clear(offmap);
+}
+
+#if DEVELOPER
+static void memleak_help_offmap(struct htable *memtable,
+				struct offmap *offmap)
+{
+	memleak_remove_htable(memtable, &offmap->raw);
+}
+#endif /* DEVELOPER */
+
+static void destroy_compaction(struct compaction *cs)
+{
+	close(cs->fd);
+}
+
 static void move_broadcast(struct offmap *offmap,
 			   struct broadcastable *bcast,
 			   const char *what)
@@ -443,122 +532,142 @@ static void move_broadcast(struct offmap *offmap,
 	offmap_del(offmap, omap);
 }
 
-static void destroy_offmap(struct offmap *offmap)
+static void compaction_fail(struct gossip_store *gs)
 {
-	offmap_clear(offmap);
+	gs->compaction = tal_free(gs->compaction);
+	unlink(GOSSIP_STORE_TEMP_FILENAME);
+	status_debug("Encountered an error while compacting, disabling "
+		     "future compactions.");
+	gs->disable_compaction = true;
 }
 
-/**
- * Rewrite the on-disk gossip store, compacting it along the way
- *
- * Creates a new file, writes all the updates from the `broadcast_state`, and
- * then atomically swaps the files.
- */
-bool gossip_store_compact(struct gossip_store *gs)
+static bool compaction_start(struct gossip_store *gs)
 {
-	size_t count = 0, deleted = 0;
-	int fd;
-	u64 off, len = sizeof(gs->version), idx;
-	struct offmap *offmap;
-	struct gossip_hdr hdr;
-	struct offmap_iter oit;
-	struct node_map_iter nit;
-	struct offset_map *omap;
-
-	if (gs->disable_compaction)
-		return false;
+	struct compaction *cs;
 
 	status_debug(
 	    "Compacting gossip_store with %zu entries, %zu of which are stale",
 	    gs->count, gs->deleted);
 
-	fd = open(GOSSIP_STORE_TEMP_FILENAME, O_RDWR|O_TRUNC|O_CREAT, 0600);
-
-	if (fd < 0) {
+	cs = tal(gs, struct compaction);
+	cs->fd = open(GOSSIP_STORE_TEMP_FILENAME, O_RDWR|O_TRUNC|O_CREAT, 0600);
+	if (cs->fd < 0) {
 		status_broken(
 		    "Could not open file for gossip_store compaction");
-		goto disable;
+		tal_free(cs);
+		gs->disable_compaction = true;
+		return false;
 	}
+	tal_add_destructor(cs, destroy_compaction);
+	gs->compaction = cs;
 
-	if (write(fd, &gs->version, sizeof(gs->version))
+	if (write(cs->fd, &gs->version, sizeof(gs->version))
 	    != sizeof(gs->version)) {
 		status_broken("Writing version to store: %s", strerror(errno));
-		goto unlink_disable;
+		compaction_fail(gs);
+		return false;
 	}
 
-	/* Walk old file, copy everything and remember new offsets. */
-	offmap = tal(tmpctx, struct offmap);
-	offmap_init_sized(offmap, gs->count);
-	tal_add_destructor(offmap, destroy_offmap);
+	cs->from_off = cs->len = sizeof(gs->version);
+	cs->count = cs->deleted = 0;
+	cs->slice_timer = NULL;
+	cs->offmap = tal(cs, struct offmap);
+	offmap_init_sized(cs->offmap, gs->count - gs->deleted);
+	tal_add_destructor(cs->offmap, destroy_offmap);
+	memleak_add_helper(cs->offmap, memleak_help_offmap);
+	return true;
+}
+
+/* Copy up to @max bytes of live records across: false on error. */
+static bool compaction_copy(struct gossip_store *gs, u64 max)
+{
+	struct compaction *cs = gs->compaction;
+	u64 start = cs->from_off;
+	struct gossip_hdr hdr;
 
-	/* Start by writing all channel announcements and updates. */
-	off = 1;
-	while (pread(gs->fd, &hdr, sizeof(hdr), off) == sizeof(hdr)) {
+	/* We copy from the file, so it must all be there. */
+	gossip_store_flush(gs);
+
+	while (cs->from_off - start < max
+	       && pread(gs->fd, &hdr, sizeof(hdr), cs->from_off)
+	       == sizeof(hdr)) {
 		u32 msglen, wlen;
 		int msgtype;
+		struct offset_map *omap;
 
 		msglen = (be32_to_cpu(hdr.len) & GOSSIP_STORE_LEN_MASK);
 		if (be32_to_cpu(hdr.len) & GOSSIP_STORE_LEN_DELETED_BIT) {
-			off += sizeof(hdr) + msglen;
-			deleted++;
+			cs->from_off += sizeof(hdr) + msglen;
 			continue;
 		}
 
-		count++;
-		wlen = transfer_store_msg(gs->fd, off, fd, len, &msgtype);
+		wlen = transfer_store_msg(gs->fd, cs->from_off,
+					  cs->fd, cs->len, &msgtype);
 		if (wlen == 0)
-			goto unlink_disable;
-
-		/* We track location of all these message types. */
-		if (msgtype == WIRE_GOSSIP_STORE_PRIVATE_CHANNEL
-		    || msgtype == WIRE_GOSSIP_STORE_PRIVATE_UPDATE
-		    || msgtype == WIRE_CHANNEL_ANNOUNCEMENT
-		    || msgtype == WIRE_CHANNEL_UPDATE
-		    || msgtype == WIRE_NODE_ANNOUNCEMENT) {
-			omap = tal(offmap, struct offset_map);
-			omap->from = off;
-			omap->to = len;
-			offmap_add(offmap, omap);
-		}
-		len += wlen;
-		off += wlen;
+			return false;
+
+		/* We track everything, since anything can be deleted, but
+		 * these types should all be moved by compaction_finish. */
+		omap = tal(cs->offmap, struct offset_map);
+		omap->from = cs->from_off;
+		omap->to = cs->len;
+		omap->broadcastable
+			= (msgtype == WIRE_GOSSIP_STORE_PRIVATE_CHANNEL
+			   || msgtype == WIRE_GOSSIP_STORE_PRIVATE_UPDATE
+			   || msgtype == WIRE_CHANNEL_ANNOUNCEMENT
+			   || msgtype == WIRE_CHANNEL_UPDATE
+			   || msgtype == WIRE_NODE_ANNOUNCEMENT);
+		offmap_add(cs->offmap, omap);
+
+		cs->count++;
+		cs->len += wlen;
+		cs->from_off += wlen;
 	}
+	return true;
+}
+
+/* We've copied everything: move broadcasts and swap the new store in. */
+static void compaction_finish(struct gossip_store *gs)
+{
+	struct compaction *cs = gs->compaction;
+	struct node_map_iter nit;
+	struct offmap_iter oit;
+	struct offset_map *omap;
+	u64 idx, off;
 
-	/* OK, now we've written file successfully, we can move broadcasts. */
 	/* Remap node announcements. */
 	for (struct node *n = node_map_first(gs->rstate->nodes, &nit);
 	     n;
 	     n = node_map_next(gs->rstate->nodes, &nit)) {
-		move_broadcast(offmap, &n->bcast, "node_announce");
+		move_broadcast(cs->offmap, &n->bcast, "node_announce");
 	}
 
 	/* Remap channel announcements and updates */
 	for (struct chan *c = uintmap_first(&gs->rstate->chanmap, &idx);
 	     c;
 	     c = uintmap_after(&gs->rstate->chanmap, &idx)) {
-		move_broadcast(offmap, &c->bcast, "channel_announce");
-		move_broadcast(offmap, &c->half[0].bcast, "channel_update");
-		move_broadcast(offmap, &c->half[1].bcast, "channel_update");
+		move_broadcast(cs->offmap, &c->bcast, "channel_announce");
+		move_broadcast(cs->offmap, &c->half_bcast[0], "channel_update");
+		move_broadcast(cs->offmap, &c->half_bcast[1], "channel_update");
 	}
 
 	/* That should be everything. */
-	omap = offmap_first(offmap, &oit);
-	if (omap)
-		status_failed(STATUS_FAIL_INTERNAL_ERROR,
-			      "gossip_store: Entry at %zu->%zu not updated?",
-			      omap->from, omap->to);
+	for (omap = offmap_first(cs->offmap, &oit);
+	     omap;
+	     omap = offmap_next(cs->offmap, &oit)) {
+		if (omap->broadcastable)
+			status_failed(STATUS_FAIL_INTERNAL_ERROR,
+				      "gossip_store: Entry at %zu->%zu"
+				      " not updated?",
+				      omap->from, omap->to);
+	}
 
-	if (count != gs->count - gs->deleted)
+	if (cs->count - cs->deleted != gs->count - gs->deleted)
 		status_failed(STATUS_FAIL_INTERNAL_ERROR,
 			      "gossip_store: Expected %zu msgs in new"
 			      " gossip store, got %zu",
-			      gs->count - gs->deleted, count);
-
-	if (deleted != gs->deleted)
-		status_failed(STATUS_FAIL_INTERNAL_ERROR,
-			      "gossip_store: Expected %zu deleted msgs in old"
-			      " gossip store, got %zu",
-			      gs->deleted, deleted);
+			      gs->count - gs->deleted,
+			      cs->count - cs->deleted);
 
 	if (rename(GOSSIP_STORE_TEMP_FILENAME, GOSSIP_STORE_FILENAME) == -1)
 		status_failed(STATUS_FAIL_INTERNAL_ERROR,
@@ -568,24 +677,112 @@ bool gossip_store_compact(struct gossip_store *gs)
 
 	status_debug(
 	    "Compaction completed: dropped %zu messages, new count %zu, len %"PRIu64,
-	    deleted, count, len);
-	gs->count = count;
-	gs->deleted = 0;
-	off = gs->len - len;
-	gs->len = len;
+	    gs->count - cs->count, cs->count, cs->len);
+	gs->count = cs->count;
+	gs->deleted = cs->deleted;
+	off = gs->len - cs->len;
+	gs->len = cs->len;
+
+	/* The new store's fd is now ours. */
 	close(gs->fd);
-	gs->fd = fd;
+	gs->fd = cs->fd;
+	tal_del_destructor(cs, destroy_compaction);
+	gs->compaction = tal_free(cs);
 
 	update_peers_broadcast_index(gs->peers, off);
+}
+
+/* Returns true once it's finished (or failed) */
+static bool compaction_slice(struct gossip_store *gs, u64 max)
+{
+	if (!compaction_copy(gs, max)) {
+		compaction_fail(gs);
+		return true;
+	}
+
+	/* compaction_copy flushed, so gs->len is the end of the file. */
+	if (gs->compaction->from_off != gs->len)
+		return false;
+
+	compaction_finish(gs);
 	return true;
+}
 
-unlink_disable:
-	unlink(GOSSIP_STORE_TEMP_FILENAME);
-disable:
-	status_debug("Encountered an error while compacting, disabling "
-		     "future compactions.");
-	gs->disable_compaction = true;
-	return false;
+static void compaction_slice_timer(struct gossip_store *gs)
+{
+	gs->compaction->slice_timer = NULL;
+	if (!compaction_slice(gs, GOSSIP_STORE_COMPACT_SLICE_BYTES))
+		gs->compaction->slice_timer
+			= new_reltimer(gs->rstate->timers, gs->compaction,
+				       time_from_msec(0),
+				       compaction_slice_timer, gs);
+}
+
+/* If we've copied this record already, delete it from the new store too. */
+static void compaction_delete(struct gossip_store *gs, u32 index)
+{
+	struct compaction *cs = gs->compaction;
+	struct offset_map *omap;
+	beint32_t belen;
+
+	if (!cs || index >= cs->from_off)
+		return;
+
+	omap = offmap_get(cs->offmap, index);
+	if (!omap)
+		status_failed(STATUS_FAIL_INTERNAL_ERROR,
+			      "gossip_store: deleting %u, not compacted?",
+			      index);
+
+	if (pread(cs->fd, &belen, sizeof(belen), omap->to) != sizeof(belen))
+		status_failed(STATUS_FAIL_INTERNAL_ERROR,
+			      "Failed reading len to delete @%zu: %s",
+			      omap->to, strerror(errno));
+	belen |= cpu_to_be32(GOSSIP_STORE_LEN_DELETED_BIT);
+	if (pwrite(cs->fd, &belen, sizeof(belen), omap->to) != sizeof(belen))
+		status_failed(STATUS_FAIL_INTERNAL_ERROR,
+			      "Failed writing len to delete @%zu: %s",
+			      omap->to, strerror(errno));
+	offmap_del(cs->offmap, omap);
+	tal_free(omap);
+	cs->deleted++;
+}
+
+/**
+ * Rewrite the on-disk gossip store, compacting it along the way
+ *
+ * Creates a new file, writes all the updates from the `broadcast_state`, and
+ * then atomically swaps the files.  This does it all at once (finishing
+ * any compaction already in progress).
+ */
+bool gossip_store_compact(struct gossip_store *gs)
+{
+	if (gs->disable_compaction)
+		return false;
+
+	if (!gs->compaction && !compaction_start(gs))
+		return false;
+
+	gs->compaction->slice_timer = tal_free(gs->compaction->slice_timer);
+	compaction_slice(gs, UINT64_MAX);
+	return !gs->disable_compaction;
+}
+
+/* Start compacting in the background, if it's worth it. */
+static void gossip_store_maybe_compact(struct gossip_store *gs)
+{
+	if (gs->compaction || gs->disable_compaction)
+		return;
+	if (gs->count < 1000)
+		return;
+	if (gs->deleted < gs->count / 2)
+		return;
+
+	if (compaction_start(gs))
+		gs->compaction->slice_timer
+			= new_reltimer(gs->rstate->timers, gs->compaction,
+				       time_from_msec(0),
+				       compaction_slice_timer, gs);
 }
 
 u64 gossip_store_add(struct gossip_store *gs, const u8 *gossip_msg,
@@ -597,20 +794,20 @@ u64 gossip_store_add(struct gossip_store *gs, const u8 *gossip_msg,
 	/* Should never get here during loading! */
 	assert(gs->writable);
 
-	if (!append_msg(gs->fd, gossip_msg, timestamp, push, &gs->len)) {
-		status_broken("Failed writing to gossip store: %s",
-			      strerror(errno));
-		return 0;
-	}
-	if (addendum && !append_msg(gs->fd, addendum, 0, false, &gs->len)) {
-		status_broken("Failed writing addendum to gossip store: %s",
-			      strerror(errno));
-		return 0;
-	}
+	append_msg(gs, gossip_msg, timestamp, push);
+	if (addendum)
+		append_msg(gs, addendum, 0, false);
 
 	gs->count++;
 	if (addendum)
 		gs->count++;
+
+	if (tal_bytelen(gs->wbuf) >= GOSSIP_STORE_FLUSH_BYTES)
+		gossip_store_flush(gs);
+	else if (!gs->flush_timer)
+		gs->flush_timer = new_reltimer(gs->rstate->timers, gs,
+					       time_from_msec(GOSSIP_STORE_FLUSH_MSEC),
+					       flush_timer_expired, gs);
 	return off;
 }
 
@@ -635,18 +832,19 @@ static u32 delete_by_index(struct gossip_store *gs, u32 index, int type)
 	assert(fromwire_peektype(msg) == type);
 #endif
 
-	if (pread(gs->fd, &belen, sizeof(belen), index) != sizeof(belen))
+	if (!store_pread(gs, &belen, sizeof(belen), index))
 		status_failed(STATUS_FAIL_INTERNAL_ERROR,
 			      "Failed reading len to delete @%u: %s",
 			      index, strerror(errno));
 
 	assert((be32_to_cpu(belen) & GOSSIP_STORE_LEN_DELETED_BIT) == 0);
 	belen |= cpu_to_be32(GOSSIP_STORE_LEN_DELETED_BIT);
-	if (pwrite(gs->fd, &belen, sizeof(belen), index) != sizeof(belen))
+	if (!store_pwrite(gs, &belen, sizeof(belen), index))
 		status_failed(STATUS_FAIL_INTERNAL_ERROR,
 			      "Failed writing len to delete @%u: %s",
 			      index, strerror(errno));
 	gs->deleted++;
+	compaction_delete(gs, index);
 
 	return index + sizeof(struct gossip_hdr)
 		+ (be32_to_cpu(belen) & GOSSIP_STORE_LEN_MASK);
@@ -670,6 +868,8 @@ void gossip_store_delete(struct gossip_store *gs,
 	if (type == WIRE_CHANNEL_ANNOUNCEMENT)
 		delete_by_index(gs, next_index,
 				WIRE_GOSSIP_STORE_CHANNEL_AMOUNT);
+
+	gossip_store_maybe_compact(gs);
 }
 
 void gossip_store_mark_channel_deleted(struct gossip_store *gs,
@@ -691,7 +891,7 @@ const u8 *gossip_store_get(const tal_t *ctx,
 		status_failed(STATUS_FAIL_INTERNAL_ERROR,
 			      "gossip_store: can't access offset %"PRIu64,
 			      offset);
-	if (pread(gs->fd, &hdr, sizeof(hdr), offset) != sizeof(hdr)) {
+	if (!store_pread(gs, &hdr, sizeof(hdr), offset)) {
 		status_failed(STATUS_FAIL_INTERNAL_ERROR,
 			      "gossip_store: can't read hdr offset %"PRIu64
 			      "/%"PRIu64": %s",
@@ -707,7 +907,7 @@ const u8 *gossip_store_get(const tal_t *ctx,
 	msglen = (be32_to_cpu(hdr.len) & GOSSIP_STORE_LEN_MASK);
 	checksum = be32_to_cpu(hdr.crc);
 	msg = tal_arr(ctx, u8, msglen);
-	if (pread(gs->fd, msg, msglen, offset + sizeof(hdr)) != msglen)
+	if (!store_pread(gs, msg, msglen, offset + sizeof(hdr)))
 		status_failed(STATUS_FAIL_INTERNAL_ERROR,
 			      "gossip_store: can't read len %u offset %"PRIu64
 			      "/%"PRIu64, msglen, offset, gs->len);
@@ -746,10 +946,208 @@ int gossip_store_readonly_fd(struct gossip_store *gs)
 	return fd;
 }
 
-u32 gossip_store_load(struct routing_state *rstate, struct gossip_store *gs)
+/* We check the store's checksums in chunks of about this size on worker
+ * threads, while the main loop replays the chunks already checked. */
+#define LOAD_CHUNK_BYTES (1024 * 1024)
+
+struct load_chunk {
+	/* Whole records, from start to end of the map */
+	size_t start, end;
+	/* First record with a bad checksum (or end), once done. */
+	size_t bad;
+	bool done;
+};
+
+struct load_workers {
+	const u8 *map;
+	size_t maplen;
+
+	/* Everything below is protected by lock */
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+	struct load_chunk *chunks;
+	size_t num_chunks;
+	/* Next chunk nobody has started on. */
+	size_t next;
+
+	/* End of the last whole record. */
+	size_t end;
+
+	pthread_t *threads;
+};
+
+/* Returns the offset of the first record which fails its checksum. */
+static size_t check_chunk(const u8 *map, const struct load_chunk *chunk)
+{
+	size_t off = chunk->start;
+
+	while (off < chunk->end) {
+		struct gossip_hdr hdr;
+		u32 msglen;
+
+		memcpy(&hdr, map + off, sizeof(hdr));
+		msglen = be32_to_cpu(hdr.len) & GOSSIP_STORE_LEN_MASK;
+		if (be32_to_cpu(hdr.crc)
+		    != crc32c(be32_to_cpu(hdr.timestamp),
+			      map + off + sizeof(hdr), msglen))
+			break;
+		off += sizeof(hdr) + msglen;
+	}
+	return off;
+}
+
+/* Called with lock held: checks the next chunk, if any. */
+static bool check_next_chunk(struct load_workers *lw)
+{
+	struct load_chunk *chunk;
+	size_t bad;
+
+	if (lw->next == lw->num_chunks)
+		return false;
+
+	chunk = &lw->chunks[lw->next++];
+	pthread_mutex_unlock(&lw->lock);
+	bad = check_chunk(lw->map, chunk);
+	pthread_mutex_lock(&lw->lock);
+
+	chunk->bad = bad;
+	chunk->done = true;
+	pthread_cond_broadcast(&lw->cond);
+	return true;
+}
+
+/* Note: this doesn't touch tal, which isn't thread-safe. */
+static void *load_worker(void *arg)
+{
+	struct load_workers *lw = arg;
+
+	pthread_mutex_lock(&lw->lock);
+	while (check_next_chunk(lw))
+		;
+	pthread_mutex_unlock(&lw->lock);
+	return NULL;
+}
+
+/* Wait for this chunk to be checked, helping out if there's work left. */
+static const struct load_chunk *wait_chunk(struct load_workers *lw, size_t i)
+{
+	pthread_mutex_lock(&lw->lock);
+	while (!lw->chunks[i].done) {
+		if (!check_next_chunk(lw))
+			pthread_cond_wait(&lw->cond, &lw->lock);
+	}
+	pthread_mutex_unlock(&lw->lock);
+	return &lw->chunks[i];
+}
+
+/* Map the store, divide it into chunks and start checking them.  Sets
+ * *truncated if there's an incomplete record at the end. */
+static struct load_workers *start_load(const tal_t *ctx,
+				       struct gossip_store *gs,
+				       u32 num_threads,
+				       bool *truncated)
+{
+	struct load_workers *lw = tal(ctx, struct load_workers);
+	struct stat st;
+	size_t off, start;
+
+	*truncated = false;
+	lw->map = NULL;
+	lw->maplen = 0;
+	lw->num_chunks = lw->next = 0;
+	lw->threads = tal_arr(lw, pthread_t, 0);
+	pthread_mutex_init(&lw->lock, NULL);
+	pthread_cond_init(&lw->cond, NULL);
+
+	if (fstat(gs->fd, &st) != 0)
+		status_failed(STATUS_FAIL_INTERNAL_ERROR,
+			      "gossip_store: failed stat: %s",
+			      strerror(errno));
+	lw->end = gs->len;
+	if (st.st_size <= gs->len) {
+		lw->chunks = NULL;
+		return lw;
+	}
+
+	lw->maplen = st.st_size;
+	lw->map = mmap(NULL, lw->maplen, PROT_READ, MAP_SHARED, gs->fd, 0);
+	if (lw->map == MAP_FAILED)
+		status_failed(STATUS_FAIL_INTERNAL_ERROR,
+			      "gossip_store: failed mmap of %zu: %s",
+			      lw->maplen, strerror(errno));
+
+	/* Every chunk but the last is at least LOAD_CHUNK_BYTES. */
+	lw->chunks = tal_arr(lw, struct load_chunk,
+			     lw->maplen / LOAD_CHUNK_BYTES + 1);
+	off = start = gs->len;
+	while (off + sizeof(struct gossip_hdr) <= lw->maplen) {
+		struct gossip_hdr hdr;
+		u32 msglen;
+
+		memcpy(&hdr, lw->map + off, sizeof(hdr));
+		msglen = be32_to_cpu(hdr.len) & GOSSIP_STORE_LEN_MASK;
+		if (off + sizeof(hdr) + msglen > lw->maplen) {
+			*truncated = true;
+			break;
+		}
+		off += sizeof(hdr) + msglen;
+
+		if (off - start >= LOAD_CHUNK_BYTES) {
+			struct load_chunk *chunk = &lw->chunks[lw->num_chunks++];
+			chunk->start = start;
+			chunk->end = off;
+			chunk->done = false;
+			start = off;
+		}
+	}
+	/* Whatever's left over (there may be nothing). */
+	if (off != start) {
+		struct load_chunk *chunk = &lw->chunks[lw->num_chunks++];
+		chunk->start = start;
+		chunk->end = off;
+		chunk->done = false;
+	}
+	lw->end = off;
+
+	/* No point having more threads than chunks. */
+	if (num_threads > lw->num_chunks)
+		num_threads = lw->num_chunks;
+	for (size_t i = 0; i < num_threads; i++) {
+		pthread_t thread;
+		int err;
+
+		err = pthread_create(&thread, NULL, load_worker, lw);
+		if (err)
+			status_failed(STATUS_FAIL_INTERNAL_ERROR,
+				      "Creating load thread: %s",
+				      strerror(err));
+		tal_arr_expand(&lw->threads, thread);
+	}
+	return lw;
+}
+
+/* Stop any workers (we might be giving up early) and unmap. */
+static void finish_load(struct load_workers *lw)
+{
+	pthread_mutex_lock(&lw->lock);
+	lw->next = lw->num_chunks;
+	pthread_mutex_unlock(&lw->lock);
+
+	for (size_t i = 0; i < tal_count(lw->threads); i++)
+		pthread_join(lw->threads[i], NULL);
+
+	if (lw->map)
+		munmap((void *)lw->map, lw->maplen);
+	pthread_mutex_destroy(&lw->lock);
+	pthread_cond_destroy(&lw->cond);
+	tal_free(lw);
+}
+
+u32 gossip_store_load(struct routing_state *rstate, struct gossip_store *gs,
+		      u32 num_threads)
 {
 	struct gossip_hdr hdr;
-	u32 msglen, checksum;
+	u32 msglen;
 	u8 *msg;
 	struct amount_sat satoshis;
 	const char *bad;
@@ -757,19 +1155,24 @@ u32 gossip_store_load(struct routing_state *rstate, struct gossip_store *gs)
 	struct timeabs start = time_now();
 	u8 *chan_ann = NULL;
 	u64 chan_ann_off = 0; /* Spurious gcc-9 (Ubuntu 9-20190402-1ubuntu1) 9.0.1 20190402 (experimental) warning */
+	struct load_workers *lw;
+	const struct load_chunk *chunk = NULL;
+	size_t i = 0;
+	bool truncated;
 
 	gs->writable = false;
-	while (pread(gs->fd, &hdr, sizeof(hdr), gs->len) == sizeof(hdr)) {
-		msglen = be32_to_cpu(hdr.len) & GOSSIP_STORE_LEN_MASK;
-		checksum = be32_to_cpu(hdr.crc);
-		msg = tal_arr(tmpctx, u8, msglen);
+	lw = start_load(gs, gs, num_threads, &truncated);
+	while (gs->len < lw->end) {
+		/* Wait for workers to check the next chunk. */
+		if (!chunk || gs->len == chunk->end)
+			chunk = wait_chunk(lw, i++);
 
-		if (pread(gs->fd, msg, msglen, gs->len+sizeof(hdr)) != msglen) {
-			bad = "gossip_store: truncated file?";
-			goto corrupt;
-		}
+		memcpy(&hdr, lw->map + gs->len, sizeof(hdr));
+		msglen = be32_to_cpu(hdr.len) & GOSSIP_STORE_LEN_MASK;
+		msg = tal_dup_arr(tmpctx, u8, lw->map + gs->len + sizeof(hdr),
+				  msglen, 0);
 
-		if (checksum != crc32c(be32_to_cpu(hdr.timestamp), msg, msglen)) {
+		if (gs->len == chunk->bad) {
 			bad = "Checksum verification failed";
 			goto badmsg;
 		}
@@ -855,6 +1258,11 @@ u32 gossip_store_load(struct routing_state *rstate, struct gossip_store *gs)
 		clean_tmpctx();
 	}
 
+	if (truncated) {
+		bad = "gossip_store: truncated file?";
+		goto corrupt;
+	}
+
 	if (chan_ann) {
 		bad = "dangling channel_announcement";
 		goto corrupt;
@@ -885,6 +1293,7 @@ corrupt:
 	gs->len = 1;
 	gs->timestamp = 0;
 out:
+	finish_load(lw);
 	gs->writable = true;
 	status_debug("total store load time: %"PRIu64" msec",
 		     time_to_msec(time_between(time_now(), start)));
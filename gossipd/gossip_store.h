@@ -23,10 +23,12 @@ struct gossip_store *gossip_store_new(struct routing_state *rstate,
  *
  * @param rstate The routing state to load init.
  * @param gs  The `gossip_store` to read from
+ * @param num_threads  Extra threads to check checksums with (can be 0)
  *
  * Returns the last-modified time of the store, or 0 if it was created new.
  */
-u32 gossip_store_load(struct routing_state *rstate, struct gossip_store *gs);
+u32 gossip_store_load(struct routing_state *rstate, struct gossip_store *gs,
+		      u32 num_threads);
 
 /**
  * Add a private channel_update message to the gossip_store
@@ -80,6 +82,9 @@ const u8 *gossip_store_get_private_update(const tal_t *ctx,
 					  struct gossip_store *gs,
 					  u64 offset);
 
+/* Write out anything we've buffered, for readers of the file. */
+void gossip_store_flush(struct gossip_store *gs);
+
 /* Exposed for dev-compact-gossip-store to force compaction. */
 bool gossip_store_compact(struct gossip_store *gs);
 
@@ -53,6 +53,7 @@
 #include <gossipd/queries.h>
 #include <gossipd/routing.h>
 #include <gossipd/seeker.h>
+#include <gossipd/sigcheck.h>
 #include <inttypes.h>
 #include <lightningd/gossip_msg.h>
 #include <netdb.h>
@@ -100,6 +101,9 @@ static void destroy_peer(struct peer *peer)
 	/* Remove it from the peers list */
 	list_del_from(&peer->daemon->peers, &peer->list);
 
+	/* Don't apply any gossip it still has waiting. */
+	sigcheck_peer_gone(peer);
+
 	/* If we have a channel with this peer, disable it. */
 	node = get_node(peer->daemon->rstate, &peer->id);
 	if (node)
@@ -375,11 +379,11 @@ static bool handle_get_local_channel_update(struct peer *peer, const u8 *msg)
 
  	/* It's possible this is zero, if we've never sent a channel_update
 	 * for that channel. */
-	if (!is_halfchan_defined(&chan->half[local_chan->direction]))
+	if (!is_halfchan_defined(chan, local_chan->direction))
 		update = NULL;
 	else
 		update = gossip_store_get(tmpctx, rstate->gs,
-					  chan->half[local_chan->direction].bcast.index);
+					  chan->half_bcast[local_chan->direction].index);
 out:
 	status_peer_debug(&peer->id, "schanid %s: %s update",
 			  type_to_string(tmpctx, struct short_channel_id, &scid),
@@ -429,12 +433,24 @@ static bool handle_local_channel_announcement(struct daemon *daemon,
 	return true;
 }
 
+/*~ We don't read any more from a peer which has too much gossip waiting for
+ * the sigcheck workers: otherwise a peer flooding us with gossip could grow
+ * our memory without bound.  Once we stop reading, their socket fills up,
+ * and they have to wait too. */
+static struct io_plan *peer_read_next(struct io_conn *conn, struct peer *peer)
+{
+	if (sigcheck_peer_full(peer))
+		return io_wait(conn, &peer->sigchecks_inflight,
+			       peer_read_next, peer);
+	return daemon_conn_read_next(conn, peer->dc);
+}
+
 /*~ This is where the per-peer daemons send us messages.  It's either forwarded
  * gossip, or a request for information.  We deliberately use non-overlapping
  * message types so we can distinguish them. */
-static struct io_plan *peer_msg_in(struct io_conn *conn,
-				    const u8 *msg,
-				    struct peer *peer)
+static struct io_plan *handle_peer_msg(struct io_conn *conn,
+				       const u8 *msg,
+				       struct peer *peer)
 {
 	const u8 *err;
 	bool ok;
@@ -550,7 +566,74 @@ handled_relay:
 	if (err)
 		queue_peer_msg(peer, take(err));
 done:
-	return daemon_conn_read_next(conn, peer->dc);
+	return peer_read_next(conn, peer);
+}
+
+/*~ Anything else a peer sends has to wait until the gossip it sent before
+ * has been applied: a reply_short_channel_ids_end, say, means the
+ * announcements we asked for have all arrived. */
+static struct io_plan *peer_held_msg(struct io_conn *conn, struct peer *peer)
+{
+	const u8 *msg;
+
+	if (peer->sigchecks_inflight)
+		return io_wait(conn, &peer->sigchecks_inflight,
+			       peer_held_msg, peer);
+
+	msg = tal_steal(tmpctx, peer->held_msg);
+	peer->held_msg = NULL;
+	return handle_peer_msg(conn, msg, peer);
+}
+
+static struct io_plan *peer_msg_in(struct io_conn *conn,
+				   const u8 *msg,
+				   struct peer *peer)
+{
+	switch (fromwire_peektype(msg)) {
+	case WIRE_CHANNEL_ANNOUNCEMENT:
+	case WIRE_CHANNEL_UPDATE:
+	case WIRE_NODE_ANNOUNCEMENT:
+		if (sigcheck_submit(peer->daemon, peer, msg))
+			return peer_read_next(conn, peer);
+		break;
+	default:
+		if (peer->sigchecks_inflight) {
+			peer->held_msg = tal_dup_talarr(peer, u8, msg);
+			return peer_held_msg(conn, peer);
+		}
+	}
+	return handle_peer_msg(conn, msg, peer);
+}
+
+/*~ Once sigcheck workers have checked the signatures on gossip, we handle
+ * it exactly as above, in the order it arrived. */
+void peer_gossip_checked(struct daemon *daemon, const struct sigcheck *sc)
+{
+	struct peer *peer = sc->peer;
+	const u8 *err;
+
+	/* If they've gone, we'll get it from someone else. */
+	if (!peer)
+		return;
+
+	daemon->rstate->sigchecked = sc;
+	switch (fromwire_peektype(sc->msg)) {
+	case WIRE_CHANNEL_ANNOUNCEMENT:
+		err = handle_channel_announcement_msg(peer, sc->msg);
+		break;
+	case WIRE_CHANNEL_UPDATE:
+		err = handle_channel_update_msg(peer, sc->msg);
+		break;
+	case WIRE_NODE_ANNOUNCEMENT:
+		err = handle_node_announce(peer, sc->msg);
+		break;
+	default:
+		abort();
+	}
+	daemon->rstate->sigchecked = NULL;
+
+	if (err)
+		queue_peer_msg(peer, take(err));
 }
 
 /*~ This is where connectd tells us about a new peer, and we hand back an fd for
@@ -609,6 +692,8 @@ static struct io_plan *connectd_new_peer(struct io_conn *conn,
 	peer->query_channel_blocks = NULL;
 	peer->query_channel_range_cb = NULL;
 	peer->num_pings_outstanding = 0;
+	peer->sigchecks_inflight = 0;
+	peer->held_msg = NULL;
 
 	/* We keep a list so we can find peer by id */
 	list_add_tail(&peer->daemon->peers, &peer->list);
@@ -768,23 +853,23 @@ static void gossip_refresh_network(struct daemon *daemon)
 
 		for (c = first_chan(n, &i); c; c = next_chan(n, &i)) {
 			struct local_chan *local_chan;
-			struct half_chan *hc;
+			int direction;
 
 			local_chan = is_local_chan(daemon->rstate, c);
-			hc = &c->half[local_chan->direction];
+			direction = local_chan->direction;
 
-			if (!is_halfchan_defined(hc)) {
+			if (!is_halfchan_defined(c, direction)) {
 				/* Connection is not announced yet, so don't even
 				 * try to re-announce it */
 				continue;
 			}
 
-			if (hc->bcast.timestamp > highwater) {
+			if (c->half_bcast[direction].timestamp > highwater) {
 				/* No need to send a keepalive update message */
 				continue;
 			}
 
-			if (!is_halfchan_enabled(hc)) {
+			if (!is_halfchan_enabled(c, direction)) {
 				/* Only send keepalives for active connections */
 				continue;
 			}
@@ -843,7 +928,7 @@ static struct io_plan *gossip_init(struct io_conn *conn,
 {
 	u32 *dev_gossip_time;
 	bool dev_fast_gossip, dev_fast_gossip_prune;
-	u32 timestamp;
+	u32 timestamp, sigcheck_threads;
 
 	if (!fromwire_gossipd_init(daemon, msg,
 				     &chainparams,
@@ -854,7 +939,8 @@ static struct io_plan *gossip_init(struct io_conn *conn,
 				     &daemon->announcable,
 				     &dev_gossip_time,
 				     &dev_fast_gossip,
-				     &dev_fast_gossip_prune)) {
+				     &dev_fast_gossip_prune,
+				     &sigcheck_threads)) {
 		master_badmsg(WIRE_GOSSIPD_INIT, msg);
 	}
 
@@ -866,8 +952,12 @@ static struct io_plan *gossip_init(struct io_conn *conn,
 					   dev_fast_gossip,
 					   dev_fast_gossip_prune);
 
-	/* Load stored gossip messages, get last modified time of file */
-	timestamp = gossip_store_load(daemon->rstate, daemon->rstate->gs);
+	sigcheck_init(daemon, sigcheck_threads);
+
+	/* Load stored gossip messages, get last modified time of file (the
+	 * signature checking threads aren't busy yet, so use as many). */
+	timestamp = gossip_store_load(daemon->rstate, daemon->rstate->gs,
+				      sigcheck_threads);
 
 	/* If last_timestamp was > modified time of file, reduce it.
 	 * Usually it's capped to "now", but in the reload case it needs to
@@ -963,13 +1053,13 @@ static struct gossip_halfchannel_entry *hc_entry(const tal_t *ctx,
 	struct gossip_halfchannel_entry *e;
 
 	/* If we've never seen a channel_update for this direction... */
-	if (!is_halfchan_defined(c))
+	if (!is_halfchan_defined(chan, idx))
 		return NULL;
 
 	e = tal(ctx, struct gossip_halfchannel_entry);
 	e->channel_flags = c->channel_flags;
 	e->message_flags = c->message_flags;
-	e->last_update_timestamp = c->bcast.timestamp;
+	e->last_update_timestamp = chan->half_bcast[idx].timestamp;
 	e->base_fee_msat = c->base_fee;
 	e->fee_per_millionth = c->proportional_fee;
 	e->delay = c->delay;
@@ -1270,12 +1360,13 @@ static struct io_plan *get_incoming_channels(struct io_conn *conn,
 			const struct half_chan *hc;
 			struct route_info ri;
 			bool deadend;
+			int dir = half_chan_to(node, c);
 
-			hc = &c->half[half_chan_to(node, c)];
-
-			if (!is_halfchan_enabled(hc))
+			if (!is_halfchan_enabled(c, dir))
 				continue;
 
+			hc = &c->half[dir];
+
 			ri.pubkey = other_node(node, c)->id;
 			ri.short_channel_id = c->scid;
 			ri.fee_base_msat = hc->base_fee;
@@ -1302,6 +1393,57 @@ static struct io_plan *get_incoming_channels(struct io_conn *conn,
 	return daemon_conn_read_next(conn, daemon->master);
 }
 
+/*~ lightningd's getroutecache command just wants to know how well
+ * get_route()'s cache is doing. */
+static struct io_plan *get_route_cache_stats(struct io_conn *conn,
+					     struct daemon *daemon,
+					     const u8 *msg)
+{
+	const struct routing_state *rstate = daemon->rstate;
+
+	if (!fromwire_gossipd_get_route_cache_stats(msg))
+		master_badmsg(WIRE_GOSSIPD_GET_ROUTE_CACHE_STATS, msg);
+
+	msg = towire_gossipd_get_route_cache_stats_reply(NULL,
+							 rstate->route_cache_num,
+							 rstate->route_cache_hits,
+							 rstate->route_cache_misses);
+	daemon_conn_send(daemon->master, take(msg));
+
+	return daemon_conn_read_next(conn, daemon->master);
+}
+
+/*~ lightningd reads the gossip_store itself for listchannels and
+ * listnodes, so it just needs it up-to-date, and to know which of our
+ * channels we've disabled (which only we know about). */
+static struct io_plan *sync_store(struct io_conn *conn,
+				  struct daemon *daemon,
+				  const u8 *msg)
+{
+	struct routing_state *rstate = daemon->rstate;
+	struct short_channel_id *disabled;
+	struct local_chan_map_iter i;
+	struct local_chan *lc;
+
+	if (!fromwire_gossipd_sync_store(msg))
+		master_badmsg(WIRE_GOSSIPD_SYNC_STORE, msg);
+
+	gossip_store_flush(rstate->gs);
+
+	disabled = tal_arr(tmpctx, struct short_channel_id, 0);
+	for (lc = local_chan_map_first(&rstate->local_chan_map, &i);
+	     lc;
+	     lc = local_chan_map_next(&rstate->local_chan_map, &i)) {
+		if (lc->local_disabled)
+			tal_arr_expand(&disabled, lc->chan->scid);
+	}
+
+	msg = towire_gossipd_sync_store_reply(NULL, disabled);
+	daemon_conn_send(daemon->master, take(msg));
+
+	return daemon_conn_read_next(conn, daemon->master);
+}
+
 static struct io_plan *new_blockheight(struct io_conn *conn,
 				       struct daemon *daemon,
 				       const u8 *msg)
@@ -1356,6 +1498,9 @@ static struct io_plan *dev_gossip_memleak(struct io_conn *conn,
 	memleak_remove_region(memtable, daemon, sizeof(*daemon));
 
 	found_leak = dump_memleak(memtable);
+	status_debug("pubkey cache: %"PRIu64" hits, %"PRIu64" misses",
+		     daemon->rstate->pubkey_cache_hits,
+		     daemon->rstate->pubkey_cache_misses);
 	daemon_conn_send(daemon->master,
 			 take(towire_gossipd_dev_memleak_reply(NULL,
 							      found_leak)));
@@ -1409,17 +1554,17 @@ static struct io_plan *get_stripped_cupdate(struct io_conn *conn,
 			     type_to_string(tmpctx, struct short_channel_id, &scid));
 		stripped_update = NULL;
 	} else {
-		const struct half_chan *hc;
+		const struct chan *chan = local_chan->chan;
+		const int direction = local_chan->direction;
 
 		/* Since we're going to use it, make sure it's up-to-date. */
 		refresh_local_channel(daemon, local_chan, false);
 
-		hc = &local_chan->chan->half[local_chan->direction];
-		if (is_halfchan_defined(hc)) {
+		if (is_halfchan_defined(chan, direction)) {
 			const u8 *update;
 
 			update = gossip_store_get(tmpctx, daemon->rstate->gs,
-						  hc->bcast.index);
+						  chan->half_bcast[direction].index);
 			stripped_update = tal_dup_arr(tmpctx, u8, update + 2,
 						      tal_count(update) - 2, 0);
 		} else
@@ -1640,6 +1785,12 @@ static struct io_plan *recv_req(struct io_conn *conn,
 	case WIRE_GOSSIPD_GET_INCOMING_CHANNELS:
 		return get_incoming_channels(conn, daemon, msg);
 
+	case WIRE_GOSSIPD_GET_ROUTE_CACHE_STATS:
+		return get_route_cache_stats(conn, daemon, msg);
+
+	case WIRE_GOSSIPD_SYNC_STORE:
+		return sync_store(conn, daemon, msg);
+
 	case WIRE_GOSSIPD_NEW_BLOCKHEIGHT:
 		return new_blockheight(conn, daemon, msg);
 
@@ -1670,6 +1821,8 @@ static struct io_plan *recv_req(struct io_conn *conn,
 	case WIRE_GOSSIPD_PING_REPLY:
 	case WIRE_GOSSIPD_GET_STRIPPED_CUPDATE_REPLY:
 	case WIRE_GOSSIPD_GET_INCOMING_CHANNELS_REPLY:
+	case WIRE_GOSSIPD_GET_ROUTE_CACHE_STATS_REPLY:
+	case WIRE_GOSSIPD_SYNC_STORE_REPLY:
 	case WIRE_GOSSIPD_GET_TXOUT:
 	case WIRE_GOSSIPD_DEV_MEMLEAK_REPLY:
 	case WIRE_GOSSIPD_DEV_COMPACT_STORE_REPLY:
@@ -1702,6 +1855,7 @@ int main(int argc, char *argv[])
 	list_head_init(&daemon->peers);
 	daemon->deferred_txouts = tal_arr(daemon, struct short_channel_id, 0);
 	daemon->node_announce_timer = NULL;
+	daemon->range_reply_cache = NULL;
 	daemon->current_blockheight = 0; /* i.e. unknown */
 
 	/* Note the use of time_mono() here.  That's a monotonic clock, which
@@ -17,6 +17,7 @@
 struct chan;
 struct channel_update_timestamps;
 struct broadcastable;
+struct range_reply_cache;
 struct seeker;
 
 /*~ The core daemon structure: */
@@ -60,6 +61,9 @@ struct daemon {
 
 	/* Features lightningd told us to set. */
 	struct feature_set *our_features;
+
+	/* Replies we've built for query_channel_range (see queries.c) */
+	struct range_reply_cache *range_reply_cache;
 };
 
 /* This represents each peer we're gossiping with */
@@ -108,6 +112,11 @@ struct peer {
 				       const struct channel_update_timestamps *,
 				       bool complete);
 
+	/* How many of their gossip msgs are waiting for sigcheck workers? */
+	size_t sigchecks_inflight;
+	/* A non-gossip msg which has to wait until those are applied. */
+	const u8 *held_msg;
+
 	/* The daemon_conn used to queue messages to/from the peer. */
 	struct daemon_conn *dc;
 };
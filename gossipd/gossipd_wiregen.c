@@ -43,6 +43,10 @@ const char *gossipd_wire_name(int e)
 	case WIRE_GOSSIPD_DEV_MEMLEAK_REPLY: return "WIRE_GOSSIPD_DEV_MEMLEAK_REPLY";
 	case WIRE_GOSSIPD_DEV_COMPACT_STORE: return "WIRE_GOSSIPD_DEV_COMPACT_STORE";
 	case WIRE_GOSSIPD_DEV_COMPACT_STORE_REPLY: return "WIRE_GOSSIPD_DEV_COMPACT_STORE_REPLY";
+	case WIRE_GOSSIPD_GET_ROUTE_CACHE_STATS: return "WIRE_GOSSIPD_GET_ROUTE_CACHE_STATS";
+	case WIRE_GOSSIPD_GET_ROUTE_CACHE_STATS_REPLY: return "WIRE_GOSSIPD_GET_ROUTE_CACHE_STATS_REPLY";
+	case WIRE_GOSSIPD_SYNC_STORE: return "WIRE_GOSSIPD_SYNC_STORE";
+	case WIRE_GOSSIPD_SYNC_STORE_REPLY: return "WIRE_GOSSIPD_SYNC_STORE_REPLY";
 	case WIRE_GOSSIPD_GET_INCOMING_CHANNELS: return "WIRE_GOSSIPD_GET_INCOMING_CHANNELS";
 	case WIRE_GOSSIPD_GET_INCOMING_CHANNELS_REPLY: return "WIRE_GOSSIPD_GET_INCOMING_CHANNELS_REPLY";
 	case WIRE_GOSSIPD_NEW_BLOCKHEIGHT: return "WIRE_GOSSIPD_NEW_BLOCKHEIGHT";
@@ -78,6 +82,10 @@ bool gossipd_wire_is_defined(u16 type)
 	case WIRE_GOSSIPD_DEV_MEMLEAK_REPLY:;
 	case WIRE_GOSSIPD_DEV_COMPACT_STORE:;
 	case WIRE_GOSSIPD_DEV_COMPACT_STORE_REPLY:;
+	case WIRE_GOSSIPD_GET_ROUTE_CACHE_STATS:;
+	case WIRE_GOSSIPD_GET_ROUTE_CACHE_STATS_REPLY:;
+	case WIRE_GOSSIPD_SYNC_STORE:;
+	case WIRE_GOSSIPD_SYNC_STORE_REPLY:;
 	case WIRE_GOSSIPD_GET_INCOMING_CHANNELS:;
 	case WIRE_GOSSIPD_GET_INCOMING_CHANNELS_REPLY:;
 	case WIRE_GOSSIPD_NEW_BLOCKHEIGHT:;
@@ -92,7 +100,7 @@ bool gossipd_wire_is_defined(u16 type)
 
 /* WIRE: GOSSIPD_INIT */
 /* Initialize the gossip daemon. */
-u8 *towire_gossipd_init(const tal_t *ctx, const struct chainparams *chainparams, const struct feature_set *our_features, const struct node_id *id, const u8 rgb[3], const u8 alias[32], const struct wireaddr *announcable, u32 *dev_gossip_time, bool dev_fast_gossip, bool dev_fast_gossip_prune)
+u8 *towire_gossipd_init(const tal_t *ctx, const struct chainparams *chainparams, const struct feature_set *our_features, const struct node_id *id, const u8 rgb[3], const u8 alias[32], const struct wireaddr *announcable, u32 *dev_gossip_time, bool dev_fast_gossip, bool dev_fast_gossip_prune, u32 sigcheck_threads)
 {
 	u16 num_announcable = tal_count(announcable);
 	u8 *p = tal_arr(ctx, u8, 0);
@@ -114,10 +122,11 @@ u8 *towire_gossipd_init(const tal_t *ctx, const struct chainparams *chainparams,
 	}
 	towire_bool(&p, dev_fast_gossip);
 	towire_bool(&p, dev_fast_gossip_prune);
+	towire_u32(&p, sigcheck_threads);
 
 	return memcheck(p, tal_count(p));
 }
-bool fromwire_gossipd_init(const tal_t *ctx, const void *p, const struct chainparams **chainparams, struct feature_set **our_features, struct node_id *id, u8 rgb[3], u8 alias[32], struct wireaddr **announcable, u32 **dev_gossip_time, bool *dev_fast_gossip, bool *dev_fast_gossip_prune)
+bool fromwire_gossipd_init(const tal_t *ctx, const void *p, const struct chainparams **chainparams, struct feature_set **our_features, struct node_id *id, u8 rgb[3], u8 alias[32], struct wireaddr **announcable, u32 **dev_gossip_time, bool *dev_fast_gossip, bool *dev_fast_gossip_prune, u32 *sigcheck_threads)
 {
 	u16 num_announcable;
 
@@ -144,6 +153,7 @@ bool fromwire_gossipd_init(const tal_t *ctx, const void *p, const struct chainpa
 	}
  	*dev_fast_gossip = fromwire_bool(&cursor, &plen);
  	*dev_fast_gossip_prune = fromwire_bool(&cursor, &plen);
+ 	*sigcheck_threads = fromwire_u32(&cursor, &plen);
 	return cursor != NULL;
 }
 
@@ -763,6 +773,102 @@ bool fromwire_gossipd_dev_compact_store_reply(const void *p, bool *success)
 	return cursor != NULL;
 }
 
+/* WIRE: GOSSIPD_GET_ROUTE_CACHE_STATS */
+/* master -> gossipd: how is the route cache doing? */
+u8 *towire_gossipd_get_route_cache_stats(const tal_t *ctx)
+{
+	u8 *p = tal_arr(ctx, u8, 0);
+
+	towire_u16(&p, WIRE_GOSSIPD_GET_ROUTE_CACHE_STATS);
+
+	return memcheck(p, tal_count(p));
+}
+bool fromwire_gossipd_get_route_cache_stats(const void *p)
+{
+	const u8 *cursor = p;
+	size_t plen = tal_count(p);
+
+	if (fromwire_u16(&cursor, &plen) != WIRE_GOSSIPD_GET_ROUTE_CACHE_STATS)
+		return false;
+	return cursor != NULL;
+}
+
+/* WIRE: GOSSIPD_GET_ROUTE_CACHE_STATS_REPLY */
+u8 *towire_gossipd_get_route_cache_stats_reply(const tal_t *ctx, u32 entries, u64 hits, u64 misses)
+{
+	u8 *p = tal_arr(ctx, u8, 0);
+
+	towire_u16(&p, WIRE_GOSSIPD_GET_ROUTE_CACHE_STATS_REPLY);
+	towire_u32(&p, entries);
+	towire_u64(&p, hits);
+	towire_u64(&p, misses);
+
+	return memcheck(p, tal_count(p));
+}
+bool fromwire_gossipd_get_route_cache_stats_reply(const void *p, u32 *entries, u64 *hits, u64 *misses)
+{
+	const u8 *cursor = p;
+	size_t plen = tal_count(p);
+
+	if (fromwire_u16(&cursor, &plen) != WIRE_GOSSIPD_GET_ROUTE_CACHE_STATS_REPLY)
+		return false;
+ 	*entries = fromwire_u32(&cursor, &plen);
+ 	*hits = fromwire_u64(&cursor, &plen);
+ 	*misses = fromwire_u64(&cursor, &plen);
+	return cursor != NULL;
+}
+
+/* WIRE: GOSSIPD_SYNC_STORE */
+/* master -> gossipd: write out the gossip_store */
+u8 *towire_gossipd_sync_store(const tal_t *ctx)
+{
+	u8 *p = tal_arr(ctx, u8, 0);
+
+	towire_u16(&p, WIRE_GOSSIPD_SYNC_STORE);
+
+	return memcheck(p, tal_count(p));
+}
+bool fromwire_gossipd_sync_store(const void *p)
+{
+	const u8 *cursor = p;
+	size_t plen = tal_count(p);
+
+	if (fromwire_u16(&cursor, &plen) != WIRE_GOSSIPD_SYNC_STORE)
+		return false;
+	return cursor != NULL;
+}
+
+/* WIRE: GOSSIPD_SYNC_STORE_REPLY */
+/* gossipd -> master: done.  These local channels are disabled (not in store). */
+u8 *towire_gossipd_sync_store_reply(const tal_t *ctx, const struct short_channel_id *local_disabled)
+{
+	u16 num_local_disabled = tal_count(local_disabled);
+	u8 *p = tal_arr(ctx, u8, 0);
+
+	towire_u16(&p, WIRE_GOSSIPD_SYNC_STORE_REPLY);
+	towire_u16(&p, num_local_disabled);
+	for (size_t i = 0; i < num_local_disabled; i++)
+		towire_short_channel_id(&p, local_disabled + i);
+
+	return memcheck(p, tal_count(p));
+}
+bool fromwire_gossipd_sync_store_reply(const tal_t *ctx, const void *p, struct short_channel_id **local_disabled)
+{
+	u16 num_local_disabled;
+
+	const u8 *cursor = p;
+	size_t plen = tal_count(p);
+
+	if (fromwire_u16(&cursor, &plen) != WIRE_GOSSIPD_SYNC_STORE_REPLY)
+		return false;
+ 	num_local_disabled = fromwire_u16(&cursor, &plen);
+ 	// 2nd case local_disabled
+	*local_disabled = num_local_disabled ? tal_arr(ctx, struct short_channel_id, num_local_disabled) : NULL;
+	for (size_t i = 0; i < num_local_disabled; i++)
+		fromwire_short_channel_id(&cursor, &plen, *local_disabled + i);
+	return cursor != NULL;
+}
+
 /* WIRE: GOSSIPD_GET_INCOMING_CHANNELS */
 /* master -> gossipd: get route_info for our incoming channels */
 u8 *towire_gossipd_get_incoming_channels(const tal_t *ctx)
@@ -857,4 +963,4 @@ bool fromwire_gossipd_new_blockheight(const void *p, u32 *blockheight)
  	*blockheight = fromwire_u32(&cursor, &plen);
 	return cursor != NULL;
 }
-// SHA256STAMP:9b93deed184d5f5c0d5a9e649fae6449645501ded555b63350bfa3ce8eef70ba
+// SHA256STAMP:903815cc31e393da199a7ff649a5181d4f8e2e23ed041f0fb1eced08b4ad2147
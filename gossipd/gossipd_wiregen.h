@@ -54,6 +54,13 @@ enum gossipd_wire {
         WIRE_GOSSIPD_DEV_COMPACT_STORE = 3034,
         /*  gossipd -> master: ok */
         WIRE_GOSSIPD_DEV_COMPACT_STORE_REPLY = 3134,
+        /*  master -> gossipd: how is the route cache doing? */
+        WIRE_GOSSIPD_GET_ROUTE_CACHE_STATS = 3035,
+        WIRE_GOSSIPD_GET_ROUTE_CACHE_STATS_REPLY = 3135,
+        /*  master -> gossipd: write out the gossip_store */
+        WIRE_GOSSIPD_SYNC_STORE = 3036,
+        /*  gossipd -> master: done.  These local channels are disabled (not in store). */
+        WIRE_GOSSIPD_SYNC_STORE_REPLY = 3136,
         /*  master -> gossipd: get route_info for our incoming channels */
         WIRE_GOSSIPD_GET_INCOMING_CHANNELS = 3025,
         /*  gossipd -> master: here they are. */
@@ -76,8 +83,8 @@ bool gossipd_wire_is_defined(u16 type);
 
 /* WIRE: GOSSIPD_INIT */
 /*  Initialize the gossip daemon. */
-u8 *towire_gossipd_init(const tal_t *ctx, const struct chainparams *chainparams, const struct feature_set *our_features, const struct node_id *id, const u8 rgb[3], const u8 alias[32], const struct wireaddr *announcable, u32 *dev_gossip_time, bool dev_fast_gossip, bool dev_fast_gossip_prune);
-bool fromwire_gossipd_init(const tal_t *ctx, const void *p, const struct chainparams **chainparams, struct feature_set **our_features, struct node_id *id, u8 rgb[3], u8 alias[32], struct wireaddr **announcable, u32 **dev_gossip_time, bool *dev_fast_gossip, bool *dev_fast_gossip_prune);
+u8 *towire_gossipd_init(const tal_t *ctx, const struct chainparams *chainparams, const struct feature_set *our_features, const struct node_id *id, const u8 rgb[3], const u8 alias[32], const struct wireaddr *announcable, u32 *dev_gossip_time, bool dev_fast_gossip, bool dev_fast_gossip_prune, u32 sigcheck_threads);
+bool fromwire_gossipd_init(const tal_t *ctx, const void *p, const struct chainparams **chainparams, struct feature_set **our_features, struct node_id *id, u8 rgb[3], u8 alias[32], struct wireaddr **announcable, u32 **dev_gossip_time, bool *dev_fast_gossip, bool *dev_fast_gossip_prune, u32 *sigcheck_threads);
 
 /* WIRE: GOSSIPD_DEV_SET_TIME */
 /*  In developer mode */
@@ -182,6 +189,25 @@ bool fromwire_gossipd_dev_compact_store(const void *p);
 u8 *towire_gossipd_dev_compact_store_reply(const tal_t *ctx, bool success);
 bool fromwire_gossipd_dev_compact_store_reply(const void *p, bool *success);
 
+/* WIRE: GOSSIPD_GET_ROUTE_CACHE_STATS */
+/*  master -> gossipd: how is the route cache doing? */
+u8 *towire_gossipd_get_route_cache_stats(const tal_t *ctx);
+bool fromwire_gossipd_get_route_cache_stats(const void *p);
+
+/* WIRE: GOSSIPD_GET_ROUTE_CACHE_STATS_REPLY */
+u8 *towire_gossipd_get_route_cache_stats_reply(const tal_t *ctx, u32 entries, u64 hits, u64 misses);
+bool fromwire_gossipd_get_route_cache_stats_reply(const void *p, u32 *entries, u64 *hits, u64 *misses);
+
+/* WIRE: GOSSIPD_SYNC_STORE */
+/*  master -> gossipd: write out the gossip_store */
+u8 *towire_gossipd_sync_store(const tal_t *ctx);
+bool fromwire_gossipd_sync_store(const void *p);
+
+/* WIRE: GOSSIPD_SYNC_STORE_REPLY */
+/*  gossipd -> master: done.  These local channels are disabled (not in store). */
+u8 *towire_gossipd_sync_store_reply(const tal_t *ctx, const struct short_channel_id *local_disabled);
+bool fromwire_gossipd_sync_store_reply(const tal_t *ctx, const void *p, struct short_channel_id **local_disabled);
+
 /* WIRE: GOSSIPD_GET_INCOMING_CHANNELS */
 /*  master -> gossipd: get route_info for our incoming channels */
 u8 *towire_gossipd_get_incoming_channels(const tal_t *ctx);
@@ -199,4 +225,4 @@ bool fromwire_gossipd_new_blockheight(const void *p, u32 *blockheight);
 
 
 #endif /* LIGHTNING_GOSSIPD_GOSSIPD_WIREGEN_H */
-// SHA256STAMP:9b93deed184d5f5c0d5a9e649fae6449645501ded555b63350bfa3ce8eef70ba
+// SHA256STAMP:903815cc31e393da199a7ff649a5181d4f8e2e23ed041f0fb1eced08b4ad2147
@@ -1,8 +1,6 @@
 /* Routines to generate and handle gossip query messages */
 #include <bitcoin/chainparams.h>
-#include <ccan/array_size/array_size.h>
 #include <ccan/asort/asort.h>
-#include <ccan/crc32c/crc32c.h>
 #include <ccan/tal/tal.h>
 #include <common/daemon_conn.h>
 #include <common/decode_array.h>
@@ -345,7 +343,7 @@ const u8 *handle_query_short_channel_ids(struct peer *peer, const u8 *msg)
 
 /*~ We can send multiple replies when the peer queries for all channels in
  * a given range of blocks; each one indicates the range of blocks it covers. */
-static void reply_channel_range(struct peer *peer,
+static void reply_channel_range(const u8 ***replies,
 				u32 first_blocknum, u32 number_of_blocks,
 				const u8 *encoded_scids,
 				struct tlv_reply_channel_range_tlvs_timestamps_tlv *timestamps,
@@ -368,48 +366,23 @@ static void reply_channel_range(struct peer *peer,
 	tlvs->timestamps_tlv = timestamps;
 	tlvs->checksums_tlv = checksums;
 
-	u8 *msg = towire_reply_channel_range(NULL,
+	u8 *msg = towire_reply_channel_range(*replies,
 					     &chainparams->genesis_blockhash,
 					     first_blocknum,
 					     number_of_blocks,
 					     1, encoded_scids, tlvs);
-	queue_peer_msg(peer, take(msg));
-}
-
-/* BOLT #7:
- *
- * The checksum of a `channel_update` is the CRC32C checksum as specified in
- * [RFC3720](https://tools.ietf.org/html/rfc3720#appendix-B.4) of this
- * `channel_update` without its `signature` and `timestamp` fields.
- */
-static u32 crc32_of_update(const u8 *channel_update)
-{
-	u32 sum;
-	const u8 *parts[2];
-	size_t sizes[ARRAY_SIZE(parts)];
-
-	get_cupdate_parts(channel_update, parts, sizes);
-
-	sum = 0;
-	for (size_t i = 0; i < ARRAY_SIZE(parts); i++)
-		sum = crc32c(sum, parts[i], sizes[i]);
-	return sum;
+	tal_arr_expand(replies, msg);
 }
 
-static void get_checksum_and_timestamp(struct routing_state *rstate,
-				       const struct chan *chan,
+static void get_checksum_and_timestamp(const struct chan *chan,
 				       int direction,
 				       u32 *tstamp, u32 *csum)
 {
-	const struct half_chan *hc = &chan->half[direction];
-
-	if (!is_chan_public(chan) || !is_halfchan_defined(hc)) {
+	if (!is_chan_public(chan) || !is_halfchan_defined(chan, direction)) {
 		*tstamp = *csum = 0;
 	} else {
-		const u8 *update = gossip_store_get(tmpctx, rstate->gs,
-						    hc->bcast.index);
-		*tstamp = hc->bcast.timestamp;
-		*csum = crc32_of_update(update);
+		*tstamp = chan->half_bcast[direction].timestamp;
+		*csum = chan->half_csum[direction];
 	}
 }
 
@@ -427,12 +400,12 @@ static size_t tlv_len(const tal_t *msg)
  * tail_blocks is the empty blocks at the end, in case they asked for all
  * blocks to 4 billion.
  */
-static bool queue_channel_ranges(struct peer *peer,
+static bool queue_channel_ranges(struct routing_state *rstate,
+				 const u8 ***replies,
 				 u32 first_blocknum, u32 number_of_blocks,
 				 u32 tail_blocks,
 				 enum query_option_flags query_option_flags)
 {
-	struct routing_state *rstate = peer->daemon->rstate;
 	u8 *encoded_scids = encoding_start(tmpctx);
 	struct tlv_reply_channel_range_tlvs_timestamps_tlv *tstamps;
 	struct channel_update_checksums *csums;
@@ -489,17 +462,16 @@ static bool queue_channel_ranges(struct peer *peer,
 		if (blocknum >= first_blocknum + number_of_blocks)
 			break;
 
-		/* FIXME: Store csum in header. */
 		chan = get_channel(rstate, &scid);
 		if (!is_chan_public(chan))
 			continue;
 
 		encoding_add_short_channel_id(&encoded_scids, &scid);
 
-		get_checksum_and_timestamp(rstate, chan, 0,
+		get_checksum_and_timestamp(chan, 0,
 					   &ts.timestamp_node_id_1,
 					   &cs.checksum_node_id_1);
-		get_checksum_and_timestamp(rstate, chan, 1,
+		get_checksum_and_timestamp(chan, 1,
 					   &ts.timestamp_node_id_2,
 					   &cs.checksum_node_id_2);
 
@@ -531,7 +503,7 @@ static bool queue_channel_ranges(struct peer *peer,
 	if (extension_bytes <= max_encoded_bytes
 	    && encoding_end_prepend_type(&encoded_scids,
 					 max_encoded_bytes - extension_bytes)) {
-		reply_channel_range(peer, first_blocknum,
+		reply_channel_range(replies, first_blocknum,
 				    number_of_blocks + tail_blocks,
 				    encoded_scids,
 				    tstamps, csums);
@@ -553,22 +525,145 @@ wont_fit:
 		     first_blocknum + number_of_blocks / 2,
 		     number_of_blocks - number_of_blocks / 2,
 		     tail_blocks);
-	return queue_channel_ranges(peer, first_blocknum, number_of_blocks / 2,
+	return queue_channel_ranges(rstate, replies,
+				    first_blocknum, number_of_blocks / 2,
 				    0, query_option_flags)
-		&& queue_channel_ranges(peer, first_blocknum + number_of_blocks / 2,
+		&& queue_channel_ranges(rstate, replies,
+					first_blocknum + number_of_blocks / 2,
 					number_of_blocks - number_of_blocks / 2,
 					tail_blocks, query_option_flags);
 }
 
+/* Build all the replies for this query_channel_range: NULL if invalid. */
+static const u8 **channel_range_replies(const tal_t *ctx,
+					struct routing_state *rstate,
+					u32 first_blocknum,
+					u32 number_of_blocks,
+					enum query_option_flags query_option_flags)
+{
+	struct short_channel_id last_scid;
+	u32 tail_blocks;
+	const u8 **replies = tal_arr(ctx, const u8 *, 0);
+
+	/* If they ask for number_of_blocks UINTMAX, and we have to divide
+	 * and conquer, we'll do a lot of unnecessary work.  Cap it at the
+	 * last value we have, then send an empty reply. */
+	if (uintmap_last(&rstate->chanmap, &last_scid.u64)) {
+		u32 last_block = short_channel_id_blocknum(&last_scid);
+
+		/* u64 here avoids overflow on number_of_blocks
+		   UINTMAX for example */
+		if ((u64)first_blocknum + number_of_blocks > last_block) {
+			tail_blocks = first_blocknum + number_of_blocks
+				- last_block - 1;
+			number_of_blocks -= tail_blocks;
+		} else
+			tail_blocks = 0;
+	} else
+		tail_blocks = 0;
+
+	if (!queue_channel_ranges(rstate, &replies,
+				  first_blocknum, number_of_blocks,
+				  tail_blocks, query_option_flags))
+		return tal_free(replies);
+	return replies;
+}
+
+/*~ Peers tend to ask for every channel as soon as they connect, and the
+ * answer doesn't change until a public channel does.  So we keep the last
+ * few sets of replies we built, and simply send them again.  The bare scid
+ * lists only change when a channel is announced or removed; channel_updates
+ * arrive far more often, so those only stale replies with timestamps or
+ * checksums in them. */
+#define RANGE_REPLY_CACHE_MAX 4
+
+struct range_reply {
+	u32 first_blocknum, number_of_blocks;
+	enum query_option_flags query_option_flags;
+	/* The rstate->updates_generation this was built at (only
+	 * matters if query_option_flags is non-zero). */
+	u64 updates_generation;
+	const u8 **msgs;
+};
+
+struct range_reply_cache {
+	/* The rstate->chans_generation these are valid for. */
+	u64 chans_generation;
+	/* Oldest first. */
+	struct range_reply *replies;
+};
+
+static const u8 **range_reply_cache_get(struct daemon *daemon,
+					u32 first_blocknum,
+					u32 number_of_blocks,
+					enum query_option_flags query_option_flags)
+{
+	struct range_reply_cache *cache = daemon->range_reply_cache;
+
+	if (!cache)
+		return NULL;
+
+	if (cache->chans_generation != daemon->rstate->chans_generation) {
+		daemon->range_reply_cache = tal_free(cache);
+		return NULL;
+	}
+
+	for (size_t i = 0; i < tal_count(cache->replies); i++) {
+		const struct range_reply *r = &cache->replies[i];
+		if (r->first_blocknum != first_blocknum
+		    || r->number_of_blocks != number_of_blocks
+		    || r->query_option_flags != query_option_flags)
+			continue;
+
+		if (query_option_flags
+		    && r->updates_generation
+		    != daemon->rstate->updates_generation) {
+			tal_free(r->msgs);
+			tal_arr_remove(&cache->replies, i);
+			return NULL;
+		}
+		return r->msgs;
+	}
+	return NULL;
+}
+
+static void range_reply_cache_add(struct daemon *daemon,
+				  u32 first_blocknum,
+				  u32 number_of_blocks,
+				  enum query_option_flags query_option_flags,
+				  const u8 **msgs)
+{
+	struct range_reply_cache *cache = daemon->range_reply_cache;
+	struct range_reply r;
+
+	if (!cache) {
+		cache = daemon->range_reply_cache
+			= tal(daemon, struct range_reply_cache);
+		cache->chans_generation = daemon->rstate->chans_generation;
+		cache->replies = tal_arr(cache, struct range_reply, 0);
+	}
+
+	if (tal_count(cache->replies) == RANGE_REPLY_CACHE_MAX) {
+		tal_free(cache->replies[0].msgs);
+		tal_arr_remove(&cache->replies, 0);
+	}
+
+	r.first_blocknum = first_blocknum;
+	r.number_of_blocks = number_of_blocks;
+	r.query_option_flags = query_option_flags;
+	r.updates_generation = daemon->rstate->updates_generation;
+	r.msgs = tal_steal(cache, msgs);
+	tal_arr_expand(&cache->replies, r);
+}
+
 /*~ The peer can ask for all channels in a series of blocks.  We reply with one
  * or more messages containing the short_channel_ids. */
 const u8 *handle_query_channel_range(struct peer *peer, const u8 *msg)
 {
-	struct routing_state *rstate = peer->daemon->rstate;
 	struct bitcoin_blkid chain_hash;
-	u32 first_blocknum, number_of_blocks, tail_blocks;
-	struct short_channel_id last_scid;
+	u32 first_blocknum, number_of_blocks;
 	enum query_option_flags query_option_flags;
+	const u8 **replies;
 	struct tlv_query_channel_range_tlvs *tlvs
 		= tlv_query_channel_range_tlvs_new(msg);
 
@@ -602,28 +697,24 @@ const u8 *handle_query_channel_range(struct peer *peer, const u8 *msg)
 		return NULL;
 	}
 
-	/* If they ask for number_of_blocks UINTMAX, and we have to divide
-	 * and conquer, we'll do a lot of unnecessary work.  Cap it at the
-	 * last value we have, then send an empty reply. */
-	if (uintmap_last(&rstate->chanmap, &last_scid.u64)) {
-		u32 last_block = short_channel_id_blocknum(&last_scid);
-
-		/* u64 here avoids overflow on number_of_blocks
-		   UINTMAX for example */
-		if ((u64)first_blocknum + number_of_blocks > last_block) {
-			tail_blocks = first_blocknum + number_of_blocks
-				- last_block - 1;
-			number_of_blocks -= tail_blocks;
-		} else
-			tail_blocks = 0;
-	} else
-		tail_blocks = 0;
+	replies = range_reply_cache_get(peer->daemon, first_blocknum,
+					number_of_blocks, query_option_flags);
+	if (!replies) {
+		replies = channel_range_replies(tmpctx, peer->daemon->rstate,
+						first_blocknum,
+						number_of_blocks,
+						query_option_flags);
+		if (!replies)
+			return towire_errorfmt(peer, NULL,
+					       "Invalid query_channel_range %u+%u",
+					       first_blocknum, number_of_blocks);
+		range_reply_cache_add(peer->daemon, first_blocknum,
+				      number_of_blocks, query_option_flags,
+				      replies);
+	}
 
-	if (!queue_channel_ranges(peer, first_blocknum, number_of_blocks,
-				  tail_blocks, query_option_flags))
-		return towire_errorfmt(peer, NULL,
-				       "Invalid query_channel_range %u+%u",
-				       first_blocknum, number_of_blocks + tail_blocks);
+	for (size_t i = 0; i < tal_count(replies); i++)
+		queue_peer_msg(peer, replies[i]);
 
 	return NULL;
 }
@@ -915,13 +1006,13 @@ void maybe_send_query_responses(struct peer *peer)
 		 *   - MUST reply with the latest `channel_update` for
 		 *   `node_id_2` */
 		if ((peer->scid_query_flags[i] & SCID_QF_UPDATE1)
-		    && is_halfchan_defined(&chan->half[0])) {
-			queue_peer_from_store(peer, &chan->half[0].bcast);
+		    && is_halfchan_defined(chan, 0)) {
+			queue_peer_from_store(peer, &chan->half_bcast[0]);
 			sent = true;
 		}
 		if ((peer->scid_query_flags[i] & SCID_QF_UPDATE2)
-		    && is_halfchan_defined(&chan->half[1])) {
-			queue_peer_from_store(peer, &chan->half[1].bcast);
+		    && is_halfchan_defined(chan, 1)) {
+			queue_peer_from_store(peer, &chan->half_bcast[1]);
 			sent = true;
 		}
 
@@ -1076,6 +1167,8 @@ struct io_plan *dev_set_max_scids_encode_size(struct io_conn *conn,
 							   &max_encoding_bytes))
 		master_badmsg(WIRE_GOSSIPD_DEV_SET_MAX_SCIDS_ENCODE_SIZE, msg);
 
+	/* Any replies we built before are the wrong size now. */
+	daemon->range_reply_cache = tal_free(daemon->range_reply_cache);
 	status_debug("Set max_scids_encode_bytes to %u", max_encoding_bytes);
 	return daemon_conn_read_next(conn, daemon->master);
 }
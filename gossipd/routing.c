@@ -5,6 +5,7 @@
 #include <bitcoin/script.h>
 #include <ccan/array_size/array_size.h>
 #include <ccan/endian/endian.h>
+#include <ccan/ilog/ilog.h>
 #include <ccan/mem/mem.h>
 #include <ccan/tal/str/str.h>
 #include <common/features.h>
@@ -20,6 +21,7 @@
 #include <gossipd/gossipd.h>
 #include <gossipd/gossipd_peerd_wiregen.h>
 #include <gossipd/gossipd_wiregen.h>
+#include <gossipd/sigcheck.h>
 #include <inttypes.h>
 #include <wire/peer_wire.h>
 
@@ -206,9 +208,10 @@ static void destroy_routing_state(struct routing_state *rstate)
 	     chan = uintmap_after(&rstate->chanmap, &idx))
 		free_chan(rstate, chan);
 
-	/* Free up our htables */
+	/* Free up our htables (freeing chans emptied the route cache) */
 	pending_cannouncement_map_clear(&rstate->pending_cannouncements);
 	local_chan_map_clear(&rstate->local_chan_map);
+	route_cache_map_clear(&rstate->route_cache);
 }
 
 /* We don't check this when loading from the gossip_store: that would break
@@ -238,6 +241,8 @@ static void memleak_help_routing_tables(struct htable *memtable,
 	memleak_remove_htable(memtable, &rstate->pending_cannouncements.raw);
 	memleak_remove_htable(memtable, &rstate->local_chan_map.raw);
 	memleak_remove_uintmap(memtable, &rstate->unupdated_chanmap);
+	memleak_remove_htable(memtable, &rstate->route_cache.raw);
+	memleak_remove_uintmap(memtable, &rstate->route_cache_scids);
 
 	for (n = node_map_first(rstate->nodes, &nit);
 	     n;
@@ -296,6 +301,17 @@ struct routing_state *new_routing_state(const tal_t *ctx,
 	struct routing_state *rstate = tal(ctx, struct routing_state);
 	rstate->nodes = new_node_map(rstate);
 	rstate->timers = timers;
+	rstate->sigchecked = NULL;
+	memset(rstate->pubkey_cache, 0, sizeof(rstate->pubkey_cache));
+	rstate->pubkey_cache_hits = rstate->pubkey_cache_misses = 0;
+	rstate->reachable_dirty = true;
+	route_cache_map_init(&rstate->route_cache);
+	uintmap_init(&rstate->route_cache_scids);
+	list_head_init(&rstate->route_cache_lru);
+	rstate->route_cache_num = 0;
+	rstate->route_cache_hits = rstate->route_cache_misses = 0;
+	rstate->chans_generation = 0;
+	rstate->updates_generation = 0;
 	rstate->local_id = *local_id;
 	rstate->gs = gossip_store_new(rstate, peers);
 	rstate->local_channel_announced = false;
@@ -370,6 +386,43 @@ struct node *get_node(struct routing_state *rstate,
 	return node_map_get(rstate->nodes, id);
 }
 
+bool get_node_pubkey(struct routing_state *rstate,
+		     const struct node_id *id,
+		     struct pubkey *key)
+{
+	struct node *node = get_node(rstate, id);
+	struct pubkey_cache_entry *e;
+
+	/* Known nodes keep their own key, so they never get evicted. */
+	if (node) {
+		if (node->key_parsed) {
+			rstate->pubkey_cache_hits++;
+			*key = node->key;
+			return true;
+		}
+		rstate->pubkey_cache_misses++;
+		if (!pubkey_from_node_id(&node->key, id))
+			return false;
+		node->key_parsed = true;
+		*key = node->key;
+		return true;
+	}
+
+	e = &rstate->pubkey_cache[node_map_hash_key(id) % PUBKEY_CACHE_SIZE];
+	if (e->valid && node_id_eq(&e->id, id)) {
+		rstate->pubkey_cache_hits++;
+		*key = e->key;
+		return true;
+	}
+	rstate->pubkey_cache_misses++;
+	if (!pubkey_from_node_id(key, id))
+		return false;
+	e->valid = true;
+	e->id = *id;
+	e->key = *key;
+	return true;
+}
+
 static struct node *new_node(struct routing_state *rstate,
 			     const struct node_id *id)
 {
@@ -384,6 +437,11 @@ static struct node *new_node(struct routing_state *rstate,
 	/* We don't know, so assume legacy. */
 	n->hop_style = ROUTE_HOP_LEGACY;
 	n->tokens = TOKEN_MAX;
+	n->reachable = false;
+	n->key_parsed = false;
+	/* Everything else is reachable from us, so start again. */
+	if (node_id_eq(id, &rstate->local_id))
+		rstate->reachable_dirty = true;
 	node_map_add(rstate->nodes, n);
 	tal_add_destructor2(n, destroy_node, rstate);
 
@@ -414,8 +472,7 @@ static bool node_has_broadcastable_channels(struct node *node)
 	for (c = first_chan(node, &i); c; c = next_chan(node, &i)) {
 		if (!is_chan_public(c))
 			continue;
-		if (is_halfchan_defined(&c->half[0])
-		    || is_halfchan_defined(&c->half[1]))
+		if (is_halfchan_defined(c, 0) || is_halfchan_defined(c, 1))
 			return true;
 	}
 	return false;
@@ -501,10 +558,25 @@ static void destroy_chan_check(struct chan *chan)
 }
 #endif
 
+/* This half-channel is no longer routable: if it led from a reachable
+ * node, it might have been the only way to the other end. */
+static void reachable_remove(struct routing_state *rstate,
+			     const struct chan *chan, int idx)
+{
+	if (!(chan->half[idx].channel_flags & ROUTING_FLAGS_DISABLED)
+	    && chan->nodes[idx]->reachable)
+		rstate->reachable_dirty = true;
+}
+
 /* We used to make this a tal_add_destructor2, but that costs 40 bytes per
  * chan, and we only ever explicitly free it anyway. */
 void free_chan(struct routing_state *rstate, struct chan *chan)
 {
+	reachable_remove(rstate, chan, 0);
+	reachable_remove(rstate, chan, 1);
+	route_cache_invalidate(rstate, &chan->scid);
+	if (is_chan_public(chan))
+		rstate->chans_generation++;
 	remove_chan_from_node(rstate, chan->nodes[0], chan);
 	remove_chan_from_node(rstate, chan->nodes[1], chan);
 
@@ -522,12 +594,14 @@ static void init_half_chan(struct routing_state *rstate,
 {
 	struct half_chan *c = &chan->half[channel_idx];
 
-	/* Set the channel direction */
-	c->channel_flags = channel_idx;
+	/* Set the channel direction; it's disabled until we get an update,
+	 * so routing never needs to look at half_bcast. */
+	c->channel_flags = channel_idx | ROUTING_FLAGS_DISABLED;
 	// TODO: wireup message_flags
 	c->message_flags = 0;
-	broadcastable_init(&c->bcast);
-	c->tokens = TOKEN_MAX;
+	broadcastable_init(&chan->half_bcast[channel_idx]);
+	chan->half_csum[channel_idx] = 0;
+	chan->half_tokens[channel_idx] = TOKEN_MAX;
 }
 
 static void bad_gossip_order(const u8 *msg,
@@ -638,23 +712,18 @@ struct unvisited {
 
 /* Risk of passing through this channel.
  *
- * There are two ways this function is used:
- *
- * 1. Normally, riskbias = 1.  A tiny bias here in order to prefer
- *    shorter routes, all things equal.
- * 2. Trying to find a shorter route, riskbias > 1.  By adding an extra
- *    cost to every hop, we're trying to bias against overlength routes.
+ * We add 1msat per hop: a tiny bias here in order to prefer shorter
+ * routes, all things equal.
  */
 static WARN_UNUSED_RESULT bool risk_add_fee(struct amount_msat *risk,
 					    struct amount_msat msat,
-					    u32 delay, double riskfactor,
-					    u64 riskbias)
+					    u32 delay, double riskfactor)
 {
 	struct amount_msat riskfee;
 
 	if (!amount_msat_scale(&riskfee, msat, riskfactor * delay))
 		return false;
-	if (!amount_msat_add(&riskfee, riskfee, amount_msat(riskbias)))
+	if (!amount_msat_add(&riskfee, riskfee, AMOUNT_MSAT(1)))
 		return false;
 	return amount_msat_add(risk, *risk, riskfee);
 }
@@ -703,7 +772,6 @@ static bool can_reach(const struct half_chan *c,
 		      struct amount_msat total,
 		      struct amount_msat risk,
 		      double riskfactor,
-		      u64 riskbias,
 		      double fuzz, const struct siphash_seed *base_seed,
 		      struct amount_msat *newtotal, struct amount_msat *newrisk)
 {
@@ -736,7 +804,7 @@ static bool can_reach(const struct half_chan *c,
 	if (!hc_can_carry(c, *newtotal))
 		return false;
 
-	if (!risk_add_fee(newrisk, *newtotal, c->delay, riskfactor, riskbias))
+	if (!risk_add_fee(newrisk, *newtotal, c->delay, riskfactor))
 		return false;
 
 	return true;
@@ -760,19 +828,6 @@ normal_cost_function(struct amount_msat *cost,
 	return false;
 }
 
-static WARN_UNUSED_RESULT bool
-shortest_cost_function(struct amount_msat *cost,
-		       struct amount_msat total, struct amount_msat risk)
-{
-	/* We add 1, so cost is never 0, for our hacky uintmap-as-minheap. */
-	if (amount_msat_add(cost, risk, AMOUNT_MSAT(1)))
-		return true;
-
-	status_broken("Can't add 1 to risk of node %s",
-		      type_to_string(tmpctx, struct amount_msat, &risk));
-	return false;
-}
-
 /* Does totala+riska add up to less than totalb+riskb?
  * Saves sums if you want them.
  */
@@ -802,10 +857,69 @@ static bool costs_less(struct amount_msat totala,
 static bool hc_is_routable(struct routing_state *rstate,
 			   const struct chan *chan, int idx)
 {
-	return is_halfchan_enabled(&chan->half[idx])
+	/* Undefined halves are marked disabled, so this is equivalent to
+	 * is_halfchan_enabled() without touching the cold half_bcast. */
+	return !(chan->half[idx].channel_flags & ROUTING_FLAGS_DISABLED)
 		&& !is_chan_local_disabled(rstate, chan);
 }
 
+/* Mark everything we can route to from n. */
+static void mark_reachable(struct routing_state *rstate, struct node *n)
+{
+	struct node **queue = tal_arr(tmpctx, struct node *, 1);
+
+	n->reachable = true;
+	queue[0] = n;
+	for (size_t i = 0; i < tal_count(queue); i++) {
+		struct chan_map_iter it;
+		struct chan *chan;
+
+		for (chan = first_chan(queue[i], &it);
+		     chan;
+		     chan = next_chan(queue[i], &it)) {
+			struct node *peer = other_node(queue[i], chan);
+
+			if (peer->reachable
+			    || !hc_is_routable(rstate, chan,
+					       !half_chan_to(queue[i], chan)))
+				continue;
+			peer->reachable = true;
+			tal_arr_expand(&queue, peer);
+		}
+	}
+	tal_free(queue);
+}
+
+/* This half-channel is now routable: it may let us reach more. */
+static void reachable_add(struct routing_state *rstate,
+			  const struct chan *chan, int idx)
+{
+	if (rstate->reachable_dirty)
+		return;
+
+	if (chan->nodes[idx]->reachable && !chan->nodes[!idx]->reachable
+	    && !is_chan_local_disabled(rstate, chan))
+		mark_reachable(rstate, chan->nodes[!idx]);
+}
+
+/* Make sure node->reachable is correct for every node, from us. */
+static void update_reachable(struct routing_state *rstate, struct node *me)
+{
+	struct node_map_iter it;
+	struct node *n;
+
+	if (!rstate->reachable_dirty)
+		return;
+
+	for (n = node_map_first(rstate->nodes, &it);
+	     n;
+	     n = node_map_next(rstate->nodes, &it))
+		n->reachable = false;
+
+	mark_reachable(rstate, me);
+	rstate->reachable_dirty = false;
+}
+
 static void unvisited_add(struct unvisited *unvisited, struct amount_msat cost,
 			  struct node **arr)
 {
@@ -932,7 +1046,6 @@ static void update_unvisited_neighbors(struct routing_state *rstate,
 				       struct node *cur,
 				       const struct node *me,
 				       double riskfactor,
-				       u64 riskbias,
 				       double fuzz,
 				       const struct siphash_seed *base_seed,
 				       struct unvisited *unvisited,
@@ -962,6 +1075,12 @@ static void update_unvisited_neighbors(struct routing_state *rstate,
 			continue;
 		}
 
+		/* If we're routing from us, dead ends aren't interesting. */
+		if (me && !peer->reachable) {
+			SUPERVERBOSE("... not reachable");
+			continue;
+		}
+
 		if (!is_unvisited(peer, unvisited, costfn)) {
 			SUPERVERBOSE("... already visited");
 			continue;
@@ -971,7 +1090,7 @@ static void update_unvisited_neighbors(struct routing_state *rstate,
 		 * is the right test here for whether we don't charge fees. */
 		if (!can_reach(&chan->half[idx], &chan->scid, peer == me,
 			       cur->dijkstra.total, cur->dijkstra.risk,
-			       riskfactor, riskbias, fuzz, base_seed,
+			       riskfactor, fuzz, base_seed,
 			       &total, &risk)) {
 			SUPERVERBOSE("... can't reach");
 			continue;
@@ -1018,7 +1137,6 @@ static void dijkstra(struct routing_state *rstate,
 		     const struct node *dst,
 		     const struct node *me,
 		     double riskfactor,
-		     u64 riskbias,
 		     double fuzz, const struct siphash_seed *base_seed,
 		     struct unvisited *unvisited,
 		     costfn_t *costfn)
@@ -1026,8 +1144,7 @@ static void dijkstra(struct routing_state *rstate,
 	struct node *cur;
 
 	while ((cur = first_unvisited(unvisited)) != NULL) {
-		update_unvisited_neighbors(rstate, cur, me,
-					   riskfactor, riskbias,
+		update_unvisited_neighbors(rstate, cur, me, riskfactor,
 					   fuzz, base_seed, unvisited, costfn);
 		remove_unvisited(cur, unvisited, costfn);
 		if (cur == dst)
@@ -1043,7 +1160,6 @@ static struct chan **build_route(const tal_t *ctx,
 				 const struct node *to,
 				 const struct node *me,
 				 double riskfactor,
-				 u64 riskbias,
 				 double fuzz,
 				 const struct siphash_seed *base_seed,
 				 struct amount_msat *fee)
@@ -1091,7 +1207,6 @@ static struct chan **build_route(const tal_t *ctx,
 			if (!can_reach(hc, &chan->scid, i == me,
 				       peer->dijkstra.total, peer->dijkstra.risk,
 				       riskfactor,
-				       riskbias,
 				       fuzz, base_seed,
 				       &total, &risk))
 				continue;
@@ -1180,135 +1295,172 @@ static void dijkstra_cleanup(struct unvisited *unvisited)
 	tal_free(unvisited);
 }
 
-/* We need to start biassing against long routes. */
+/* A route (backwards, from the destination) which reaches node in hops. */
+struct hop_label {
+	const struct hop_label *prev;
+	struct node *node;
+	/* The channel from node to prev->node. */
+	struct chan *chan;
+	u32 hops;
+	struct amount_msat total, risk, cost;
+};
+
+static struct hop_label *new_hop_label(const tal_t *ctx,
+				       const struct hop_label *prev,
+				       struct node *node, struct chan *chan,
+				       struct amount_msat total,
+				       struct amount_msat risk,
+				       struct amount_msat cost)
+{
+	struct hop_label *label = tal(ctx, struct hop_label);
+
+	label->prev = prev;
+	label->node = node;
+	label->chan = chan;
+	label->hops = prev ? prev->hops + 1 : 0;
+	label->total = total;
+	label->risk = risk;
+	label->cost = cost;
+	return label;
+}
+
+/* The cheapest route found so far to each node, by node pointer. */
+typedef UINTMAP(struct hop_label *) hop_label_map;
+
+static struct hop_label *best_label(const hop_label_map *best,
+				    const struct node *node)
+{
+	return uintmap_get(best, (uintptr_t)node);
+}
+
+/* The route dijkstra() found was too long: instead of rerunning it with
+ * ever-greater bias against extra hops, do a Bellman-Ford limited to
+ * max_hops rounds.  After round k, each node has the cheapest route of
+ * at most k hops, so this finds the cheapest route within the limit in
+ * one pass, using the same costs as dijkstra(). */
 static struct chan **
 find_shorter_route(const tal_t *ctx, struct routing_state *rstate,
 		   struct node *src, struct node *dst,
 		   const struct node *me,
 		   struct amount_msat msat,
+		   double riskfactor,
 		   u32 max_hops,
 		   double fuzz, const struct siphash_seed *base_seed,
 		   struct chan **long_route,
 		   struct amount_msat *fee)
 {
-	struct unvisited *unvisited;
-	struct chan **short_route = NULL;
-	struct amount_msat long_cost, short_cost, cost_diff;
-	u64 min_bias, max_bias;
-	double riskfactor;
-
-	/* We traverse backwards, so dst has largest total */
-	if (!amount_msat_sub(&long_cost,
-			     dst->dijkstra.total, src->dijkstra.total))
-		goto bad_total;
+	const tal_t *labels = tal(tmpctx, char);
+	hop_label_map best;
+	struct hop_label **frontier, *label;
+	struct chan **route;
+	struct amount_msat cost;
+	u64 mapidx;
+
 	tal_free(long_route);
 
-	/* FIXME: It's hard to juggle both the riskfactor and riskbias here,
-	 * so we set our riskfactor to rougly equate to 1 millisatoshi
-	 * per block delay, which is close enough to zero to not break
-	 * this algorithm, but still provide some bias towards
-	 * low-delay routes. */
-	riskfactor = amount_msat_ratio(AMOUNT_MSAT(1), msat);
+	uintmap_init(&best);
+	if (!normal_cost_function(&cost, msat, AMOUNT_MSAT(0)))
+		abort();
+	label = new_hop_label(labels, NULL, src, NULL, msat, AMOUNT_MSAT(0),
+			      cost);
+	uintmap_add(&best, (uintptr_t)src, label);
+	frontier = tal_arr(labels, struct hop_label *, 1);
+	frontier[0] = label;
 
-	/* First, figure out if a short route is even possible.
-	 * We set the cost function to ignore total, riskbias 1 and riskfactor
-	 * ~0 so risk simply operates as a simple hop counter. */
-	unvisited = dijkstra_prepare(tmpctx, rstate, src, msat,
-				     shortest_cost_function);
-	SUPERVERBOSE("Running shortest path from %s -> %s",
-		     type_to_string(tmpctx, struct node_id, &dst->id),
-		     type_to_string(tmpctx, struct node_id, &src->id));
-	dijkstra(rstate, dst, NULL, riskfactor, 1, fuzz, base_seed,
-		 unvisited, shortest_cost_function);
-	dijkstra_cleanup(unvisited);
+	for (u32 hops = 1; hops <= max_hops && tal_count(frontier); hops++) {
+		struct hop_label **next = tal_arr(labels, struct hop_label *, 0);
 
-	/* This will usually succeed, since we found a route before; however
-	 * it's possible that it fails in corner cases.  Consider that the reduced
-	 * riskfactor may make us select a more fee-expensive route, which then
-	 * makes us unable to complete the route due to htlc_max restrictions. */
-	short_route = build_route(ctx, rstate, dst, src, me, riskfactor, 1,
-				  fuzz, base_seed, fee);
-	if (!short_route) {
-		status_info("Could't find short enough route %s->%s",
-			    type_to_string(tmpctx, struct node_id, &dst->id),
-			    type_to_string(tmpctx, struct node_id, &src->id));
-		goto out;
-	}
+		for (size_t f = 0; f < tal_count(frontier); f++) {
+			const struct hop_label *cur = frontier[f];
+			struct chan_map_iter i;
+			struct chan *chan;
+
+			/* Routes don't go through the source. */
+			if (cur->node == dst)
+				continue;
 
-	if (!amount_msat_sub(&short_cost,
-			     dst->dijkstra.total, src->dijkstra.total))
-		goto bad_total;
+			for (chan = first_chan(cur->node, &i);
+			     chan;
+			     chan = next_chan(cur->node, &i)) {
+				struct amount_msat total, risk;
+				int idx = half_chan_to(cur->node, chan);
+				struct node *peer = chan->nodes[idx];
+				struct hop_label *old;
+
+				if (!hc_is_routable(rstate, chan, idx))
+					continue;
+
+				if (me && !peer->reachable)
+					continue;
+
+				/* Backwards, so peer == me doesn't pay. */
+				if (!can_reach(&chan->half[idx], &chan->scid,
+					       peer == me,
+					       cur->total, cur->risk,
+					       riskfactor, fuzz, base_seed,
+					       &total, &risk))
+					continue;
+
+				if (!normal_cost_function(&cost, total, risk))
+					continue;
+
+				old = best_label(&best, peer);
+				if (old && !amount_msat_less(cost, old->cost))
+					continue;
+
+				/* Nothing refers to this round's labels yet,
+				 * so we can simply improve them. */
+				if (old && old->hops == hops) {
+					old->prev = cur;
+					old->chan = chan;
+					old->total = total;
+					old->risk = risk;
+					old->cost = cost;
+					continue;
+				}
+
+				label = new_hop_label(labels, cur, peer, chan,
+						      total, risk, cost);
+				if (old)
+					uintmap_del(&best, (uintptr_t)peer);
+				uintmap_add(&best, (uintptr_t)peer, label);
+				tal_arr_expand(&next, label);
+			}
+		}
+		tal_free(frontier);
+		frontier = next;
+	}
 
-	/* Still too long?  Oh well. */
-	if (tal_count(short_route) > max_hops) {
-		status_info("Minimal possible route %s->%s is %zu",
+	label = best_label(&best, dst);
+	if (!label) {
+		status_info("Could't find short enough route %s->%s",
 			    type_to_string(tmpctx, struct node_id, &dst->id),
-			    type_to_string(tmpctx, struct node_id, &src->id),
-			    tal_count(short_route));
+			    type_to_string(tmpctx, struct node_id, &src->id));
+		route = NULL;
 		goto out;
 	}
 
-	/* OK, so it's possible, just more expensive. */
-	min_bias = 0;
+	/* Walk back to src, which is the order the route goes in. */
+	route = tal_arr(ctx, struct chan *, 0);
+	for (const struct hop_label *l = label; l->prev; l = l->prev)
+		tal_arr_expand(&route, l->chan);
 
-	if (!amount_msat_sub(&cost_diff, short_cost, long_cost)) {
-		status_broken("Short cost %s < long cost %s?",
+	/* We don't charge ourselves fees, so skip first hop */
+	if (!amount_msat_sub(fee, label->prev->total, msat)) {
+		status_broken("Could not subtract %s - %s for fee",
 			      type_to_string(tmpctx, struct amount_msat,
-					     &short_cost),
+					     &label->prev->total),
 			      type_to_string(tmpctx, struct amount_msat,
-					     &long_cost));
-		goto out;
-	}
-
-	/* This is a gross overestimate, but it works. */
-	max_bias = cost_diff.millisatoshis; /* Raw: bias calc */
-
-	SUPERVERBOSE("maxbias %"PRIu64" gave rlen %zu",
-		     max_bias, tal_count(short_route));
-
-	/* Now, binary search */
-	while (min_bias < max_bias) {
-		struct chan **route;
-		struct amount_msat this_fee;
-		u64 riskbias = (min_bias + max_bias) / 2;
-
-		unvisited = dijkstra_prepare(tmpctx, rstate, src, msat,
-					     normal_cost_function);
-		dijkstra(rstate, dst, me, riskfactor, riskbias, fuzz, base_seed,
-			 unvisited, normal_cost_function);
-		dijkstra_cleanup(unvisited);
-
-		route = build_route(ctx, rstate, dst, src, me,
-				    riskfactor, riskbias,
-				    fuzz, base_seed, &this_fee);
-
-		SUPERVERBOSE("riskbias %"PRIu64" rlen %zu",
-			     riskbias, tal_count(route));
-		/* Too long still?  This is our new min_bias */
-		if (tal_count(route) > max_hops) {
-			tal_free(route);
-			min_bias = riskbias + 1;
-		} else {
-			/* This route is acceptable. */
-			tal_free(short_route);
-			short_route = route;
-			/* Save this fee in case we exit loop */
-			*fee = this_fee;
-			max_bias = riskbias;
-		}
+					     &msat));
+		route = tal_free(route);
 	}
 
-	return short_route;
-
-bad_total:
-	status_broken("dst total %s < src total %s?",
-		      type_to_string(tmpctx, struct amount_msat,
-				     &dst->dijkstra.total),
-		      type_to_string(tmpctx, struct amount_msat,
-				     &src->dijkstra.total));
 out:
-	tal_free(short_route);
-	return NULL;
+	/* uintmap uses malloc, so manual cleaning needed */
+	while (uintmap_first(&best, &mapidx) != NULL)
+		uintmap_del(&best, mapidx);
+	tal_free(labels);
+	return route;
 }
 
 /* riskfactor is already scaled to per-block amount */
@@ -1352,35 +1504,70 @@ find_route(const tal_t *ctx, struct routing_state *rstate,
 		return NULL;
 	}
 
+	/* From us, we can tell immediately if there's no way there. */
+	if (me) {
+		update_reachable(rstate, dst);
+		if (!src->reachable) {
+			status_info("find_route: %s is unreachable",
+				    type_to_string(tmpctx, struct node_id, to));
+			return NULL;
+		}
+	}
+
 	unvisited = dijkstra_prepare(tmpctx, rstate, src, msat,
 				     normal_cost_function);
-	dijkstra(rstate, dst, me, riskfactor, 1, fuzz, base_seed,
+	dijkstra(rstate, dst, me, riskfactor, fuzz, base_seed,
 		 unvisited, normal_cost_function);
 	dijkstra_cleanup(unvisited);
 
-	route = build_route(ctx, rstate, dst, src, me, riskfactor, 1,
+	route = build_route(ctx, rstate, dst, src, me, riskfactor,
 			    fuzz, base_seed, fee);
 	if (tal_count(route) <= max_hops)
 		return route;
 
 	/* This is the far more unlikely case */
-	return find_shorter_route(ctx, rstate, src, dst, me, msat,
+	return find_shorter_route(ctx, rstate, src, dst, me, msat, riskfactor,
 				  max_hops, fuzz, base_seed, route, fee);
 }
 
-/* Checks that key is valid, and signed this hash */
-static bool check_signed_hash_nodeid(const struct sha256_double *hash,
+/* Checks that key is valid, and signed this hash (unless a sigcheck
+ * worker already did) */
+static bool check_signed_hash_nodeid(struct routing_state *rstate,
+				     const struct sha256_double *hash,
 				     const secp256k1_ecdsa_signature *signature,
 				     const struct node_id *id)
 {
 	struct pubkey key;
+	bool ok;
 
-	return pubkey_from_node_id(&key, id)
+	if (sigcheck_result(rstate->sigchecked, hash, signature, id, &ok))
+		return ok;
+
+	return get_node_pubkey(rstate, id, &key)
 		&& check_signed_hash(hash, signature, &key);
 }
 
+static bool check_signed_hash_pubkey(struct routing_state *rstate,
+				     const struct sha256_double *hash,
+				     const secp256k1_ecdsa_signature *signature,
+				     const struct pubkey *key)
+{
+	struct node_id id;
+	bool ok;
+
+	if (rstate->sigchecked) {
+		node_id_from_pubkey(&id, key);
+		if (sigcheck_result(rstate->sigchecked,
+				    hash, signature, &id, &ok))
+			return ok;
+	}
+
+	return check_signed_hash(hash, signature, key);
+}
+
 /* Verify the signature of a channel_update message */
 static u8 *check_channel_update(const tal_t *ctx,
+				struct routing_state *rstate,
 				const struct node_id *node_id,
 				const secp256k1_ecdsa_signature *node_sig,
 				const u8 *update)
@@ -1390,7 +1577,7 @@ static u8 *check_channel_update(const tal_t *ctx,
 	struct sha256_double hash;
 	sha256_double(&hash, update + offset, tal_count(update) - offset);
 
-	if (!check_signed_hash_nodeid(&hash, node_sig, node_id))
+	if (!check_signed_hash_nodeid(rstate, &hash, node_sig, node_id))
 		return towire_errorfmt(ctx, NULL,
 				       "Bad signature for %s hash %s"
 				       " on channel_update %s",
@@ -1405,6 +1592,7 @@ static u8 *check_channel_update(const tal_t *ctx,
 }
 
 static u8 *check_channel_announcement(const tal_t *ctx,
+	struct routing_state *rstate,
 	const struct node_id *node1_id, const struct node_id *node2_id,
 	const struct pubkey *bitcoin1_key, const struct pubkey *bitcoin2_key,
 	const secp256k1_ecdsa_signature *node1_sig,
@@ -1418,7 +1606,7 @@ static u8 *check_channel_announcement(const tal_t *ctx,
 	sha256_double(&hash, announcement + offset,
 		      tal_count(announcement) - offset);
 
-	if (!check_signed_hash_nodeid(&hash, node1_sig, node1_id)) {
+	if (!check_signed_hash_nodeid(rstate, &hash, node1_sig, node1_id)) {
 		return towire_errorfmt(ctx, NULL,
 				       "Bad node_signature_1 %s hash %s"
 				       " on channel_announcement %s",
@@ -1430,7 +1618,7 @@ static u8 *check_channel_announcement(const tal_t *ctx,
 						      &hash),
 				       tal_hex(ctx, announcement));
 	}
-	if (!check_signed_hash_nodeid(&hash, node2_sig, node2_id)) {
+	if (!check_signed_hash_nodeid(rstate, &hash, node2_sig, node2_id)) {
 		return towire_errorfmt(ctx, NULL,
 				       "Bad node_signature_2 %s hash %s"
 				       " on channel_announcement %s",
@@ -1442,7 +1630,7 @@ static u8 *check_channel_announcement(const tal_t *ctx,
 						      &hash),
 				       tal_hex(ctx, announcement));
 	}
-	if (!check_signed_hash(&hash, bitcoin1_sig, bitcoin1_key)) {
+	if (!check_signed_hash_pubkey(rstate, &hash, bitcoin1_sig, bitcoin1_key)) {
 		return towire_errorfmt(ctx, NULL,
 				       "Bad bitcoin_signature_1 %s hash %s"
 				       " on channel_announcement %s",
@@ -1454,7 +1642,7 @@ static u8 *check_channel_announcement(const tal_t *ctx,
 						      &hash),
 				       tal_hex(ctx, announcement));
 	}
-	if (!check_signed_hash(&hash, bitcoin2_sig, bitcoin2_key)) {
+	if (!check_signed_hash_pubkey(rstate, &hash, bitcoin2_sig, bitcoin2_key)) {
 		return towire_errorfmt(ctx, NULL,
 				       "Bad bitcoin_signature_2 %s hash %s"
 				       " on channel_announcement %s",
@@ -1580,6 +1768,7 @@ static void add_channel_announce_to_broadcast(struct routing_state *rstate,
 	bool is_local = is_local_channel(rstate, chan);
 
 	chan->bcast.timestamp = timestamp;
+	rstate->chans_generation++;
 	/* 0, unless we're loading from store */
 	if (index)
 		chan->bcast.index = index;
@@ -1639,16 +1828,16 @@ bool routing_add_channel_announcement(struct routing_state *rstate,
 		}
 
 		/* Reload any private updates */
-		if (chan->half[0].bcast.index)
+		if (chan->half_bcast[0].index)
 			private_updates[0]
 				= gossip_store_get_private_update(NULL,
 						   rstate->gs,
-						   chan->half[0].bcast.index);
-		if (chan->half[1].bcast.index)
+						   chan->half_bcast[0].index);
+		if (chan->half_bcast[1].index)
 			private_updates[1]
 				= gossip_store_get_private_update(NULL,
 						   rstate->gs,
-						   chan->half[1].bcast.index);
+						   chan->half_bcast[1].index);
 
 		remove_channel_from_store(rstate, chan);
 		free_chan(rstate, chan);
@@ -1792,7 +1981,7 @@ u8 *handle_channel_announcement(struct routing_state *rstate,
 	}
 
 	/* Note that if node_id_1 or node_id_2 are malformed, it's caught here */
-	err = check_channel_announcement(rstate,
+	err = check_channel_announcement(rstate, rstate,
 					 &pending->node_id_1,
 					 &pending->node_id_2,
 					 &pending->bitcoin_key_1,
@@ -2007,7 +2196,7 @@ static void set_connection_values(struct chan *chan,
 	c->proportional_fee = proportional_fee;
 	c->message_flags = message_flags;
 	c->channel_flags = channel_flags;
-	c->bcast.timestamp = timestamp;
+	chan->half_bcast[idx].timestamp = timestamp;
 	assert((c->channel_flags & ROUTING_FLAGS_DIRECTION) == idx);
 
 	SUPERVERBOSE("Channel %s/%d was updated.",
@@ -2030,7 +2219,7 @@ bool routing_add_channel_update(struct routing_state *rstate,
 	u32 fee_proportional_millionths;
 	struct bitcoin_blkid chain_hash;
 	struct chan *chan;
-	struct half_chan *hc;
+	struct broadcastable *bcast;
 	struct unupdated_channel *uc;
 	u8 direction;
 	struct amount_sat sat;
@@ -2106,38 +2295,39 @@ bool routing_add_channel_update(struct routing_state *rstate,
 	}
 
 	/* Discard older updates */
-	hc = &chan->half[direction];
+	bcast = &chan->half_bcast[direction];
 
-	if (is_halfchan_defined(hc)) {
+	if (is_halfchan_defined(chan, direction)) {
 		/* If we're loading from store, duplicate entries are a bug. */
 		if (index != 0) {
 			status_broken("gossip_store channel_update %u replaces %u!",
-				      index, hc->bcast.index);
+				      index, bcast->index);
 			return false;
 		}
 
-		if (timestamp <= hc->bcast.timestamp) {
+		if (timestamp <= bcast->timestamp) {
 			SUPERVERBOSE("Ignoring outdated update.");
 			/* Ignoring != failing */
 			return true;
 		}
 
 		/* Allow redundant updates once every 7 days */
-		if (timestamp < hc->bcast.timestamp + GOSSIP_PRUNE_INTERVAL(rstate->dev_fast_gossip_prune) / 2
-		    && !cupdate_different(rstate->gs, hc, update)) {
+		if (timestamp < bcast->timestamp + GOSSIP_PRUNE_INTERVAL(rstate->dev_fast_gossip_prune) / 2
+		    && !cupdate_different(rstate->gs, chan, direction, update)) {
 			SUPERVERBOSE("Ignoring redundant update for %s/%u"
 				     " (last %u, now %u)",
 				     type_to_string(tmpctx,
 						    struct short_channel_id,
 						    &short_channel_id),
-				     direction, hc->bcast.timestamp, timestamp);
+				     direction, bcast->timestamp, timestamp);
 			/* Ignoring != failing */
 			return true;
 		}
 
 		/* Make sure it's not spamming us. */
 		if (!ratelimit(rstate,
-			       &hc->tokens, hc->bcast.timestamp, timestamp)) {
+			       &chan->half_tokens[direction],
+			       bcast->timestamp, timestamp)) {
 			status_peer_debug(peer ? &peer->id : NULL,
 					  "Ignoring spammy update for %s/%u"
 					  " (last %u, now %u)",
@@ -2145,7 +2335,7 @@ bool routing_add_channel_update(struct routing_state *rstate,
 							 struct short_channel_id,
 							 &short_channel_id),
 					  direction,
-					  hc->bcast.timestamp, timestamp);
+					  bcast->timestamp, timestamp);
 			/* Ignoring != failing */
 			return true;
 		}
@@ -2157,14 +2347,23 @@ bool routing_add_channel_update(struct routing_state *rstate,
 	if (amount_msat_greater(htlc_maximum, chainparams->max_payment))
 		htlc_maximum = chainparams->max_payment;
 
+	if (channel_flags & ROUTING_FLAGS_DISABLED)
+		reachable_remove(rstate, chan, direction);
 	set_connection_values(chan, direction, fee_base_msat,
 			      fee_proportional_millionths, expiry,
 			      message_flags, channel_flags,
 			      timestamp, htlc_minimum, htlc_maximum);
+	if (!(channel_flags & ROUTING_FLAGS_DISABLED))
+		reachable_add(rstate, chan, direction);
+	route_cache_invalidate(rstate, &chan->scid);
+	chan->half_csum[direction] = crc32_of_update(update);
+	/* Only timestamp/checksum replies care, and only for public chans. */
+	if (is_chan_public(chan))
+		rstate->updates_generation++;
 
 	/* Safe even if was never added, but if it's a private channel it
 	 * would be a WIRE_GOSSIP_STORE_PRIVATE_UPDATE. */
-	gossip_store_delete(rstate->gs, &hc->bcast,
+	gossip_store_delete(rstate->gs, bcast,
 			    is_chan_public(chan)
 			    ? WIRE_CHANNEL_UPDATE
 			    : WIRE_GOSSIP_STORE_PRIVATE_UPDATE);
@@ -2186,26 +2385,26 @@ bool routing_add_channel_update(struct routing_state *rstate,
 		assert(is_local_channel(rstate, chan));
 		/* Don't save if we're loading from store */
 		if (!index) {
-			hc->bcast.index
+			bcast->index
 				= gossip_store_add_private_update(rstate->gs,
 								  update);
 		} else
-			hc->bcast.index = index;
+			bcast->index = index;
 		return true;
 	}
 
 	/* If we're loading from store, this means we don't re-add to store. */
 	if (index)
-		hc->bcast.index = index;
+		bcast->index = index;
 	else {
-		hc->bcast.index
+		bcast->index
 			= gossip_store_add(rstate->gs, update,
-					   hc->bcast.timestamp,
+					   bcast->timestamp,
 					   is_local_channel(rstate, chan),
 					   NULL);
-		if (hc->bcast.timestamp > rstate->last_timestamp
-		    && hc->bcast.timestamp < time_now().ts.tv_sec)
-			rstate->last_timestamp = hc->bcast.timestamp;
+		if (bcast->timestamp > rstate->last_timestamp
+		    && bcast->timestamp < time_now().ts.tv_sec)
+			rstate->last_timestamp = bcast->timestamp;
 
 		peer_supplied_good_gossip(peer, 1);
 	}
@@ -2229,16 +2428,17 @@ bool routing_add_channel_update(struct routing_state *rstate,
 }
 
 bool would_ratelimit_cupdate(struct routing_state *rstate,
-			     const struct half_chan *hc,
+			     const struct chan *chan, int direction,
 			     u32 timestamp)
 {
-	return update_tokens(rstate, hc->tokens, hc->bcast.timestamp, timestamp)
+	return update_tokens(rstate, chan->half_tokens[direction],
+			     chan->half_bcast[direction].timestamp, timestamp)
 		>= TOKENS_PER_MSG;
 }
 
-static const struct node_id *get_channel_owner(struct routing_state *rstate,
-					       const struct short_channel_id *scid,
-					       int direction)
+const struct node_id *get_channel_owner(struct routing_state *rstate,
+					const struct short_channel_id *scid,
+					int direction)
 {
 	struct chan *chan = get_channel(rstate, scid);
 	struct unupdated_channel *uc;
@@ -2271,9 +2471,9 @@ void remove_channel_from_store(struct routing_state *rstate,
 	gossip_store_delete(rstate->gs,
 			    &chan->bcast, announcment_type);
 	gossip_store_delete(rstate->gs,
-			    &chan->half[0].bcast, update_type);
+			    &chan->half_bcast[0], update_type);
 	gossip_store_delete(rstate->gs,
-			    &chan->half[1].bcast, update_type);
+			    &chan->half_bcast[1], update_type);
 }
 
 u8 *handle_channel_update(struct routing_state *rstate, const u8 *update TAKES,
@@ -2359,7 +2559,8 @@ u8 *handle_channel_update(struct routing_state *rstate, const u8 *update TAKES,
 		return NULL;
 	}
 
-	err = check_channel_update(rstate, owner, &signature, serialized);
+	err = check_channel_update(rstate, rstate,
+				   owner, &signature, serialized);
 	if (err) {
 		/* BOLT #7:
 		 *
@@ -2589,7 +2790,7 @@ u8 *handle_node_announcement(struct routing_state *rstate, const u8 *node_ann,
 
 	sha256_double(&hash, serialized + 66, tal_count(serialized) - 66);
 	/* If node_id is invalid, it fails here */
-	if (!check_signed_hash_nodeid(&hash, &signature, &node_id)) {
+	if (!check_signed_hash_nodeid(rstate, &hash, &signature, &node_id)) {
 		/* BOLT #7:
 		 *
 		 * - if `signature` is not a valid signature, using
@@ -2633,6 +2834,183 @@ u8 *handle_node_announcement(struct routing_state *rstate, const u8 *node_ann,
 	return NULL;
 }
 
+const struct route_cache_key *route_cache_keyof(const struct route_cache_entry *e)
+{
+	return &e->key;
+}
+
+size_t route_cache_hash(const struct route_cache_key *key)
+{
+	return siphash24(siphash_seed(), key, sizeof(*key));
+}
+
+bool route_cache_eq(const struct route_cache_entry *e,
+		    const struct route_cache_key *key)
+{
+	return memcmp(&e->key, key, sizeof(*key)) == 0;
+}
+
+/* Four buckets per power of 2: fees are mostly proportional, and
+ * channel limits are checked again when we use a cached route. */
+static u64 amount_bucket(struct amount_msat msat)
+{
+	u64 v = msat.millisatoshis; /* Raw: bucketing */
+	int bits = ilog64(v);
+
+	if (bits <= 3)
+		return v;
+	return ((u64)bits << 2) | ((v >> (bits - 3)) & 3);
+}
+
+static void route_cache_key_init(struct route_cache_key *key,
+				 const struct node_id *source,
+				 const struct node_id *destination,
+				 struct amount_msat msat,
+				 double riskfactor,
+				 struct exclude_entry **excluded,
+				 u32 max_hops)
+{
+	/* We hash and compare it all, including padding. */
+	memset(key, 0, sizeof(*key));
+	if (source)
+		key->source = *source;
+	key->destination = *destination;
+	key->amount_bucket = amount_bucket(msat);
+	key->riskfactor = riskfactor;
+	key->max_hops = max_hops;
+	/* Callers may list the same exclusions in any order, so we add the
+	 * hashes of the entries together. */
+	key->excluded_hash = 0;
+	for (size_t i = 0; i < tal_count(excluded); i++) {
+		struct exclude_entry e;
+
+		memset(&e, 0, sizeof(e));
+		e.type = excluded[i]->type;
+		if (e.type == EXCLUDE_CHANNEL)
+			e.u.chan_id = excluded[i]->u.chan_id;
+		else
+			e.u.node_id = excluded[i]->u.node_id;
+		key->excluded_hash += siphash24(siphash_seed(), &e, sizeof(e));
+	}
+}
+
+static void destroy_route_cache_entry(struct route_cache_entry *e,
+				      struct routing_state *rstate)
+{
+	route_cache_map_del(&rstate->route_cache, e);
+	list_del_from(&rstate->route_cache_lru, &e->list);
+	rstate->route_cache_num--;
+
+	for (size_t i = 0; i < tal_count(e->scids); i++) {
+		u64 scid = e->scids[i].u64;
+		struct route_cache_entry **arr, **orig;
+
+		orig = arr = uintmap_get(&rstate->route_cache_scids, scid);
+		for (size_t j = 0; j < tal_count(arr); j++) {
+			if (arr[j] == e) {
+				tal_arr_remove(&arr, j);
+				break;
+			}
+		}
+		if (arr == orig && tal_count(arr) != 0)
+			continue;
+		uintmap_del(&rstate->route_cache_scids, scid);
+		if (tal_count(arr) == 0)
+			tal_free(arr);
+		else
+			uintmap_add(&rstate->route_cache_scids, scid, arr);
+	}
+}
+
+void route_cache_invalidate(struct routing_state *rstate,
+			    const struct short_channel_id *scid)
+{
+	struct route_cache_entry **arr;
+
+	/* Each entry removes itself from arr as it's freed. */
+	while ((arr = uintmap_get(&rstate->route_cache_scids, scid->u64)))
+		tal_free(arr[0]);
+}
+
+static void route_cache_add(struct routing_state *rstate,
+			    const struct route_cache_key *key,
+			    struct chan **route)
+{
+	struct route_cache_entry *e;
+
+	if (rstate->route_cache_num == ROUTE_CACHE_MAX)
+		tal_free(list_top(&rstate->route_cache_lru,
+				  struct route_cache_entry, list));
+
+	e = tal(rstate, struct route_cache_entry);
+	e->key = *key;
+	e->scids = tal_arr(e, struct short_channel_id, tal_count(route));
+	for (size_t i = 0; i < tal_count(route); i++) {
+		struct route_cache_entry **arr;
+
+		e->scids[i] = route[i]->scid;
+		arr = uintmap_get(&rstate->route_cache_scids, route[i]->scid.u64);
+		if (arr) {
+			uintmap_del(&rstate->route_cache_scids,
+				    route[i]->scid.u64);
+			tal_arr_expand(&arr, e);
+		} else {
+			arr = tal_arr(rstate, struct route_cache_entry *, 1);
+			arr[0] = e;
+		}
+		uintmap_add(&rstate->route_cache_scids, route[i]->scid.u64, arr);
+	}
+	route_cache_map_add(&rstate->route_cache, e);
+	list_add_tail(&rstate->route_cache_lru, &e->list);
+	rstate->route_cache_num++;
+	tal_add_destructor2(e, destroy_route_cache_entry, rstate);
+}
+
+/* Do we have a route for this, which can still carry msat? */
+static struct chan **route_cache_get(struct routing_state *rstate,
+				     const struct route_cache_key *key,
+				     const struct node_id *destination,
+				     struct amount_msat msat)
+{
+	struct route_cache_entry *e;
+	struct chan **route;
+	struct node *n;
+
+	e = route_cache_map_get(&rstate->route_cache, key);
+	if (!e)
+		goto miss;
+
+	/* Channels in it are all still there, or it would be gone. */
+	route = tal_arr(tmpctx, struct chan *, tal_count(e->scids));
+	for (size_t i = 0; i < tal_count(e->scids); i++)
+		route[i] = get_channel(rstate, &e->scids[i]);
+
+	/* Walk backwards, like get_route() does, checking limits. */
+	n = get_node(rstate, destination);
+	for (int i = tal_count(route) - 1; i >= 0; i--) {
+		int idx = half_chan_to(n, route[i]);
+		const struct half_chan *c = &route[i]->half[idx];
+
+		if (!hc_is_routable(rstate, route[i], idx)
+		    || !hc_can_carry(c, msat)
+		    || !amount_msat_add_fee(&msat,
+					    c->base_fee, c->proportional_fee)) {
+			tal_free(route);
+			goto miss;
+		}
+		n = other_node(n, route[i]);
+	}
+
+	list_del_from(&rstate->route_cache_lru, &e->list);
+	list_add_tail(&rstate->route_cache_lru, &e->list);
+	rstate->route_cache_hits++;
+	return route;
+
+miss:
+	rstate->route_cache_misses++;
+	return NULL;
+}
+
 struct route_hop **get_route(const tal_t *ctx, struct routing_state *rstate,
 			     const struct node_id *source,
 			     const struct node_id *destination,
@@ -2651,6 +3029,8 @@ struct route_hop **get_route(const tal_t *ctx, struct routing_state *rstate,
 	struct amount_msat *saved_capacity;
 	struct short_channel_id_dir *excluded_chan;
 	struct siphash_seed base_seed;
+	struct route_cache_key key;
+	bool use_cache;
 
 	saved_capacity = tal_arr(tmpctx, struct amount_msat, 0);
 	excluded_chan = tal_arr(tmpctx, struct short_channel_id_dir, 0);
@@ -2660,6 +3040,18 @@ struct route_hop **get_route(const tal_t *ctx, struct routing_state *rstate,
 	if (amount_msat_eq(msat, AMOUNT_MSAT(0)))
 		return NULL;
 
+	/* Channel updates and closes remove stale entries, but a cached
+	 * route stays even if a cheaper one appears.  Fuzz is there so
+	 * each call can get a different route, so we don't cache those. */
+	use_cache = (fuzz == 0);
+	if (use_cache) {
+		route_cache_key_init(&key, source, destination, msat,
+				     riskfactor, excluded, max_hops);
+		route = route_cache_get(rstate, &key, destination, msat);
+		if (route)
+			goto have_route;
+	}
+
 	/* Temporarily set the capacity of the excluded channels and the incoming channels
 	 * of excluded nodes to zero. */
 	for (size_t i = 0; i < tal_count(excluded); i++) {
@@ -2697,6 +3089,8 @@ struct route_hop **get_route(const tal_t *ctx, struct routing_state *rstate,
 	route = find_route(ctx, rstate, source, destination, msat,
 			   riskfactor / BLOCKS_PER_YEAR / 100,
 			   fuzz, &base_seed, max_hops, &fee);
+	if (route && use_cache)
+		route_cache_add(rstate, &key, route);
 
 	/* Now restore the capacity. */
 	/* Restoring is done in reverse order, in order to properly
@@ -2719,6 +3113,7 @@ struct route_hop **get_route(const tal_t *ctx, struct routing_state *rstate,
 		return NULL;
 	}
 
+have_route:
 	/* Fees, delays need to be calculated backwards along route. */
 	hops = tal_arr(ctx, struct route_hop *, tal_count(route));
 	total_amount = msat;
@@ -2780,18 +3175,18 @@ void route_prune(struct routing_state *rstate)
 		 *    - MAY prune the channel.
 		 */
 		/* This is a fancy way of saying "both ends must refresh!" */
-		if (!is_halfchan_defined(&chan->half[0])
-		    || chan->half[0].bcast.timestamp < highwater
-		    || !is_halfchan_defined(&chan->half[1])
-		    || chan->half[1].bcast.timestamp < highwater) {
+		if (!is_halfchan_defined(chan, 0)
+		    || chan->half_bcast[0].timestamp < highwater
+		    || !is_halfchan_defined(chan, 1)
+		    || chan->half_bcast[1].timestamp < highwater) {
 			status_debug(
 			    "Pruning channel %s from network view (ages %"PRIu64" and %"PRIu64"s)",
 			    type_to_string(tmpctx, struct short_channel_id,
 					   &chan->scid),
-			    is_halfchan_defined(&chan->half[0])
-			    ? now - chan->half[0].bcast.timestamp : 0,
-			    is_halfchan_defined(&chan->half[1])
-			    ? now - chan->half[1].bcast.timestamp : 0);
+			    is_halfchan_defined(chan, 0)
+			    ? now - chan->half_bcast[0].timestamp : 0,
+			    is_halfchan_defined(chan, 1)
+			    ? now - chan->half_bcast[1].timestamp : 0);
 
 			/* This may perturb iteration so do outside loop. */
 			tal_arr_expand(&pruned, chan);
@@ -5,6 +5,7 @@
 #include <ccan/crypto/siphash24/siphash24.h>
 #include <ccan/htable/htable_type.h>
 #include <ccan/intmap/intmap.h>
+#include <ccan/list/list.h>
 #include <ccan/time/time.h>
 #include <common/amount.h>
 #include <common/gossip_constants.h>
@@ -17,8 +18,16 @@
 struct daemon;
 struct peer;
 struct routing_state;
+struct sigcheck;
 
+/* What routing needs for one direction of a channel: the gossip metadata
+ * (store index, timestamp, checksum, rate limit) lives in the tail of
+ * struct chan, so a route search only pulls in the cachelines it actually
+ * uses. */
 struct half_chan {
+	/* Minimum and maximum number of msatoshi in an HTLC */
+	struct amount_msat htlc_minimum, htlc_maximum;
+
 	/* millisatoshi. */
 	u32 base_fee;
 	/* millionths */
@@ -27,43 +36,47 @@ struct half_chan {
 	/* Delay for HTLC in blocks.*/
 	u32 delay;
 
-	/* Timestamp and index into store file */
-	struct broadcastable bcast;
-
 	/* Flags as specified by the `channel_update`s, among other
-	 * things indicated direction wrt the `channel_id` */
+	 * things indicated direction wrt the `channel_id`.  Until we get
+	 * a `channel_update`, this has ROUTING_FLAGS_DISABLED set. */
 	u8 channel_flags;
 
 	/* Flags as specified by the `channel_update`s, indicates
 	 * optional fields.  */
 	u8 message_flags;
 
-	/* Token bucket */
-	u8 tokens;
-
 	/* Feature cache for parent chan: squeezed in here where it would
 	 * otherwise simply be padding. */
 	u8 any_features;
-
-	/* Minimum and maximum number of msatoshi in an HTLC */
-	struct amount_msat htlc_minimum, htlc_maximum;
 };
 
 struct chan {
 	struct short_channel_id scid;
 
+	/* node[0].id < node[1].id */
+	struct node *nodes[2];
+
 	/*
 	 * half[0]->src == nodes[0] half[0]->dst == nodes[1]
 	 * half[1]->src == nodes[1] half[1]->dst == nodes[0]
 	 */
 	struct half_chan half[2];
-	/* node[0].id < node[1].id */
-	struct node *nodes[2];
+
+	/* Routing doesn't look past here. */
+
+	/* Timestamp and index into store file for each half's update */
+	struct broadcastable half_bcast[2];
+
+	/* Checksum of each half's update, for reply_channel_range */
+	u32 half_csum[2];
 
 	/* Timestamp and index into store file */
 	struct broadcastable bcast;
 
 	struct amount_sat sat;
+
+	/* Token bucket for each half's updates */
+	u8 half_tokens[2];
 };
 
 /* Shadow structure for local channels: owned by the chan above, but kept
@@ -90,14 +103,15 @@ static inline bool is_chan_public(const struct chan *chan)
 	return chan->bcast.timestamp != 0;
 }
 
-static inline bool is_halfchan_defined(const struct half_chan *hc)
+static inline bool is_halfchan_defined(const struct chan *chan, int idx)
 {
-	return hc->bcast.index != 0;
+	return chan->half_bcast[idx].index != 0;
 }
 
-static inline bool is_halfchan_enabled(const struct half_chan *hc)
+static inline bool is_halfchan_enabled(const struct chan *chan, int idx)
 {
-	return is_halfchan_defined(hc) && !(hc->channel_flags & ROUTING_FLAGS_DISABLED);
+	return is_halfchan_defined(chan, idx)
+		&& !(chan->half[idx].channel_flags & ROUTING_FLAGS_DISABLED);
 }
 
 /* Container for per-node channel pointers.  Better cache performance
@@ -159,6 +173,13 @@ struct node {
 	/* route_hop_style */
 	enum route_hop_style hop_style;
 
+	/* Can we reach it over enabled channels?  (See reachable_dirty) */
+	bool reachable;
+
+	/* Parsed id, so we only decompress it once (see get_node_pubkey) */
+	bool key_parsed;
+	struct pubkey key;
+
 	/* Channels connecting us to other nodes */
 	union {
 		struct chan_map map;
@@ -263,6 +284,44 @@ static inline int half_chan_to(const struct node *n, const struct chan *chan)
 	return !idx;
 }
 
+/* Parsed keys for nodes we don't have (yet): a simple direct-mapped cache,
+ * since the same few unknown nodes tend to sign everything we receive. */
+#define PUBKEY_CACHE_SIZE 1024
+struct pubkey_cache_entry {
+	bool valid;
+	struct node_id id;
+	struct pubkey key;
+};
+
+/* get_route() remembers the routes it found without fuzz, keyed by
+ * everything which affects them, except the amount is rounded (to a
+ * quarter of a power of 2).  The source is all zeroes for us. */
+struct route_cache_key {
+	struct node_id source, destination;
+	u64 amount_bucket;
+	double riskfactor;
+	u32 max_hops;
+	u64 excluded_hash;
+};
+
+struct route_cache_entry {
+	/* In routing_state->route_cache_lru: least recently used first */
+	struct list_node list;
+	struct route_cache_key key;
+	/* The route, starting at the source */
+	struct short_channel_id *scids;
+};
+
+const struct route_cache_key *route_cache_keyof(const struct route_cache_entry *e);
+size_t route_cache_hash(const struct route_cache_key *key);
+bool route_cache_eq(const struct route_cache_entry *e,
+		    const struct route_cache_key *key);
+HTABLE_DEFINE_TYPE(struct route_cache_entry, route_cache_keyof,
+		   route_cache_hash, route_cache_eq, route_cache_map);
+
+/* We don't keep more routes than this. */
+#define ROUTE_CACHE_MAX 1000
+
 struct routing_state {
 	/* TImers base from struct gossipd. */
 	struct timers *timers;
@@ -304,6 +363,32 @@ struct routing_state {
 	/* Highest timestamp of gossip we accepted (before now) */
 	u32 last_timestamp;
 
+	/* Signatures already checked for the msg we're handling, or NULL */
+	const struct sigcheck *sigchecked;
+
+	/* Keys for get_node_pubkey() which aren't in a struct node. */
+	struct pubkey_cache_entry pubkey_cache[PUBKEY_CACHE_SIZE];
+	u64 pubkey_cache_hits, pubkey_cache_misses;
+
+	/* Enabling a channel extends node->reachable as it goes, but
+	 * disabling one may cut off anything, so we just set this and
+	 * recalculate when we next route. */
+	bool reachable_dirty;
+
+	/* Routes we've found, and those which use each short_channel_id. */
+	struct route_cache_map route_cache;
+	UINTMAP(struct route_cache_entry **) route_cache_scids;
+	struct list_head route_cache_lru;
+	size_t route_cache_num;
+	u64 route_cache_hits, route_cache_misses;
+
+	/* Bumped whenever a public channel is announced or removed, so cached
+	 * reply_channel_range replies know their scid lists are stale. */
+	u64 chans_generation;
+	/* Bumped whenever a public channel_update is accepted: only replies
+	 * carrying timestamps or checksums depend on this. */
+	u64 updates_generation;
+
 #if DEVELOPER
 	/* Override local time for gossip messages */
 	struct timeabs *gossip_time;
@@ -410,10 +495,21 @@ u8 *handle_channel_update(struct routing_state *rstate, const u8 *update TAKES,
 u8 *handle_node_announcement(struct routing_state *rstate, const u8 *node,
 			     struct peer *peer, bool *was_unknown);
 
+/* Who signs channel_updates for this direction, if we know the channel */
+const struct node_id *get_channel_owner(struct routing_state *rstate,
+					const struct short_channel_id *scid,
+					int direction);
+
 /* Get a node: use this instead of node_map_get() */
 struct node *get_node(struct routing_state *rstate,
 		      const struct node_id *id);
 
+/* Get the parsed key for this node_id (false if it's not a valid key).
+ * This caches, since decompressing a key is expensive. */
+bool get_node_pubkey(struct routing_state *rstate,
+		     const struct node_id *id,
+		     struct pubkey *key);
+
 /* Compute a route to a destination, for a given amount and riskfactor. */
 struct route_hop **get_route(const tal_t *ctx, struct routing_state *rstate,
 			     const struct node_id *source,
@@ -497,9 +593,13 @@ static inline struct local_chan *is_local_chan(struct routing_state *rstate,
 
 /* Would we ratelimit a channel_update with this timestamp? */
 bool would_ratelimit_cupdate(struct routing_state *rstate,
-			     const struct half_chan *hc,
+			     const struct chan *chan, int direction,
 			     u32 timestamp);
 
+/* Something changed on this channel: forget cached routes which use it. */
+void route_cache_invalidate(struct routing_state *rstate,
+			    const struct short_channel_id *scid);
+
 /* Because we can have millions of channels, and we only want a local_disable
  * flag on ones connected to us, we keep a separate hashtable for that flag.
  */
@@ -515,6 +615,8 @@ static inline void local_disable_chan(struct routing_state *rstate,
 {
 	struct local_chan *local_chan = is_local_chan(rstate, chan);
 	local_chan->local_disabled = true;
+	rstate->reachable_dirty = true;
+	route_cache_invalidate(rstate, &chan->scid);
 }
 
 static inline void local_enable_chan(struct routing_state *rstate,
@@ -522,6 +624,8 @@ static inline void local_enable_chan(struct routing_state *rstate,
 {
 	struct local_chan *local_chan = is_local_chan(rstate, chan);
 	local_chan->local_disabled = false;
+	rstate->reachable_dirty = true;
+	route_cache_invalidate(rstate, &chan->scid);
 }
 
 /* Helper to convert on-wire addresses format to wireaddrs array */
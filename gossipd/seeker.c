@@ -595,15 +595,16 @@ static void peer_gossip_probe_nannounces(struct seeker *seeker)
 
 /* They have update with this timestamp: do we want it? */
 static bool want_update(struct seeker *seeker,
-			u32 timestamp, const struct half_chan *hc)
+			u32 timestamp, const struct chan *chan, int direction)
 {
-	if (!is_halfchan_defined(hc))
+	if (!is_halfchan_defined(chan, direction))
 		return timestamp != 0;
 
-	if (timestamp <= hc->bcast.timestamp)
+	if (timestamp <= chan->half_bcast[direction].timestamp)
 		return false;
 
-	return !would_ratelimit_cupdate(seeker->daemon->rstate, hc, timestamp);
+	return !would_ratelimit_cupdate(seeker->daemon->rstate, chan, direction,
+					timestamp);
 }
 
 /* They gave us timestamps.  Do we want updated versions? */
@@ -623,9 +624,9 @@ static void check_timestamps(struct seeker *seeker,
 	 *    for `node_id_2`, or 0 if there was no `channel_update` from that
 	 *    node.
 	 */
-	if (want_update(seeker, ts->timestamp_node_id_1, &c->half[0]))
+	if (want_update(seeker, ts->timestamp_node_id_1, c, 0))
 		query_flag |= SCID_QF_UPDATE1;
-	if (want_update(seeker, ts->timestamp_node_id_2, &c->half[1]))
+	if (want_update(seeker, ts->timestamp_node_id_2, c, 1))
 		query_flag |= SCID_QF_UPDATE2;
 
 	if (!query_flag)
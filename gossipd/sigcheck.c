@@ -0,0 +1,286 @@
+#include "sigcheck.h"
+#include <bitcoin/pubkey.h>
+#include <bitcoin/signature.h>
+#include <ccan/io/io.h>
+#include <ccan/read_write_all/read_write_all.h>
+#include <ccan/tal/tal.h>
+#include <common/memleak.h>
+#include <common/status.h>
+#include <errno.h>
+#include <gossipd/gossipd.h>
+#include <gossipd/routing.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <wire/peer_wire.h>
+
+struct sigcheck_workers {
+	struct daemon *daemon;
+
+	/* Checks waiting for a worker (protected by lock). */
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+	struct list_head queue;
+
+	/* Everything submitted and not yet applied, in arrival order:
+	 * only touched by the main loop. */
+	struct list_head inflight;
+	size_t num_inflight;
+
+	/* Workers write finished sigcheck pointers into fds[1]. */
+	int fds[2];
+	struct sigcheck *done;
+};
+
+/* NULL if we don't have any workers. */
+static struct sigcheck_workers *sigcheck_workers;
+
+static void *sigcheck_worker(void *arg)
+{
+	struct sigcheck_workers *sw = arg;
+
+	for (;;) {
+		struct sigcheck *sc;
+
+		pthread_mutex_lock(&sw->lock);
+		while (!(sc = list_pop(&sw->queue, struct sigcheck, list)))
+			pthread_cond_wait(&sw->cond, &sw->lock);
+		pthread_mutex_unlock(&sw->lock);
+
+		sha256_double(&sc->hash, sc->msg + sc->signed_off,
+			      tal_bytelen(sc->msg) - sc->signed_off);
+		for (size_t i = 0; i < sc->num_sigs; i++)
+			sc->sigs[i].ok = check_signed_hash(&sc->hash,
+							   &sc->sigs[i].sig,
+							   &sc->sigs[i].key);
+
+		/* Writes this small to a pipe are atomic, so workers can
+		 * share it. */
+		if (!write_all(sw->fds[1], &sc, sizeof(sc)))
+			abort();
+	}
+	return NULL;
+}
+
+/* Apply everything at the front which is finished. */
+static void sigcheck_apply(struct sigcheck_workers *sw)
+{
+	struct sigcheck *sc;
+	bool was_full = (sw->num_inflight >= SIGCHECK_MAX_INFLIGHT);
+
+	while ((sc = list_top(&sw->inflight, struct sigcheck, inflight))
+	       && sc->done) {
+		list_del_from(&sw->inflight, &sc->inflight);
+		sw->num_inflight--;
+		if (sc->peer) {
+			sc->peer->sigchecks_inflight--;
+			/* Its reader may be waiting for this. */
+			io_wake(&sc->peer->sigchecks_inflight);
+		}
+		peer_gossip_checked(sw->daemon, sc);
+		tal_free(sc);
+	}
+
+	/* Anyone could have been waiting for room. */
+	if (was_full && sw->num_inflight < SIGCHECK_MAX_INFLIGHT) {
+		struct peer *peer;
+		list_for_each(&sw->daemon->peers, peer, list)
+			io_wake(&peer->sigchecks_inflight);
+	}
+}
+
+static struct io_plan *sigcheck_read(struct io_conn *conn,
+				     struct sigcheck_workers *sw);
+
+static struct io_plan *sigcheck_conn_init(struct io_conn *conn,
+					  struct sigcheck_workers *sw)
+{
+	return io_read(conn, &sw->done, sizeof(sw->done), sigcheck_read, sw);
+}
+
+static struct io_plan *sigcheck_read(struct io_conn *conn,
+				     struct sigcheck_workers *sw)
+{
+	sw->done->done = true;
+	sigcheck_apply(sw);
+	return sigcheck_conn_init(conn, sw);
+}
+
+void sigcheck_init(struct daemon *daemon, u32 num_threads)
+{
+	struct sigcheck_workers *sw;
+
+	if (num_threads == 0)
+		return;
+
+	sw = notleak_with_children(tal(daemon, struct sigcheck_workers));
+	sw->daemon = daemon;
+	pthread_mutex_init(&sw->lock, NULL);
+	pthread_cond_init(&sw->cond, NULL);
+	list_head_init(&sw->queue);
+	list_head_init(&sw->inflight);
+	sw->num_inflight = 0;
+	if (pipe(sw->fds) != 0)
+		status_failed(STATUS_FAIL_INTERNAL_ERROR,
+			      "Creating sigcheck pipe: %s", strerror(errno));
+	io_new_conn(sw, sw->fds[0], sigcheck_conn_init, sw);
+
+	for (size_t i = 0; i < num_threads; i++) {
+		pthread_t thread;
+		int err;
+
+		err = pthread_create(&thread, NULL, sigcheck_worker, sw);
+		if (err)
+			status_failed(STATUS_FAIL_INTERNAL_ERROR,
+				      "Creating sigcheck thread: %s",
+				      strerror(err));
+		pthread_detach(thread);
+	}
+	sigcheck_workers = sw;
+}
+
+static void add_sig_pubkey(struct sigcheck *sc,
+			   const secp256k1_ecdsa_signature *sig,
+			   const struct pubkey *key)
+{
+	sc->sigs[sc->num_sigs].sig = *sig;
+	sc->sigs[sc->num_sigs].key = *key;
+	node_id_from_pubkey(&sc->sigs[sc->num_sigs].signer, key);
+	sc->num_sigs++;
+}
+
+/* If the key is invalid, we leave it for the main loop to complain about. */
+static void add_sig(struct routing_state *rstate,
+		    struct sigcheck *sc,
+		    const secp256k1_ecdsa_signature *sig,
+		    const struct node_id *signer)
+{
+	struct pubkey key;
+
+	if (get_node_pubkey(rstate, signer, &key))
+		add_sig_pubkey(sc, sig, &key);
+}
+
+/* Work out what signatures we can check.  It's fine if that's none:
+ * it's still queued, so it's applied in order. */
+static void sigcheck_setup(struct daemon *daemon, struct sigcheck *sc)
+{
+	secp256k1_ecdsa_signature sigs[4];
+	struct bitcoin_blkid chain_hash;
+	struct short_channel_id scid;
+	struct node_id ids[2];
+	struct pubkey keys[2];
+	u8 *features, *addresses, rgb_color[3], alias[32];
+	u32 timestamp, fee_base_msat, fee_proportional_millionths;
+	u8 message_flags, channel_flags;
+	u16 expiry;
+	struct amount_msat htlc_minimum;
+	const struct node_id *owner;
+
+	sc->num_sigs = 0;
+	switch (fromwire_peektype(sc->msg)) {
+	case WIRE_CHANNEL_ANNOUNCEMENT:
+		if (!fromwire_channel_announcement(tmpctx, sc->msg,
+						   &sigs[0], &sigs[1],
+						   &sigs[2], &sigs[3],
+						   &features, &chain_hash,
+						   &scid, &ids[0], &ids[1],
+						   &keys[0], &keys[1]))
+			return;
+		/* 2 byte msg type + 256 byte signatures */
+		sc->signed_off = 258;
+		add_sig(daemon->rstate, sc, &sigs[0], &ids[0]);
+		add_sig(daemon->rstate, sc, &sigs[1], &ids[1]);
+		add_sig_pubkey(sc, &sigs[2], &keys[0]);
+		add_sig_pubkey(sc, &sigs[3], &keys[1]);
+		return;
+	case WIRE_CHANNEL_UPDATE:
+		if (!fromwire_channel_update(sc->msg, &sigs[0],
+					     &chain_hash, &scid,
+					     &timestamp, &message_flags,
+					     &channel_flags, &expiry,
+					     &htlc_minimum, &fee_base_msat,
+					     &fee_proportional_millionths))
+			return;
+		/* We can only check it if we know the channel already. */
+		owner = get_channel_owner(daemon->rstate, &scid,
+					  channel_flags & 0x1);
+		if (!owner)
+			return;
+		/* 2 byte msg type + 64 byte signature */
+		sc->signed_off = 66;
+		add_sig(daemon->rstate, sc, &sigs[0], owner);
+		return;
+	case WIRE_NODE_ANNOUNCEMENT:
+		if (!fromwire_node_announcement(tmpctx, sc->msg, &sigs[0],
+						&features, &timestamp,
+						&ids[0], rgb_color, alias,
+						&addresses))
+			return;
+		/* 2 byte msg type + 64 byte signature */
+		sc->signed_off = 66;
+		add_sig(daemon->rstate, sc, &sigs[0], &ids[0]);
+		return;
+	}
+}
+
+bool sigcheck_submit(struct daemon *daemon, struct peer *peer, const u8 *msg)
+{
+	struct sigcheck_workers *sw = sigcheck_workers;
+	struct sigcheck *sc;
+
+	if (!sw)
+		return false;
+
+	/* Zeroed: if there's nothing to check, hash is never set. */
+	sc = talz(sw, struct sigcheck);
+	sc->peer = peer;
+	sc->msg = tal_dup_talarr(sc, u8, msg);
+	sc->done = false;
+	sigcheck_setup(daemon, sc);
+
+	/* Nothing to wait for?  Then it doesn't need to wait for a worker. */
+	if (sc->num_sigs == 0) {
+		if (list_empty(&sw->inflight)) {
+			tal_free(sc);
+			return false;
+		}
+		sc->done = true;
+		goto inflight;
+	}
+
+	pthread_mutex_lock(&sw->lock);
+	list_add_tail(&sw->queue, &sc->list);
+	pthread_cond_signal(&sw->cond);
+	pthread_mutex_unlock(&sw->lock);
+
+inflight:
+	list_add_tail(&sw->inflight, &sc->inflight);
+	sw->num_inflight++;
+	peer->sigchecks_inflight++;
+	return true;
+}
+
+bool sigcheck_peer_full(const struct peer *peer)
+{
+	struct sigcheck_workers *sw = sigcheck_workers;
+
+	if (!sw)
+		return false;
+
+	return peer->sigchecks_inflight >= SIGCHECK_MAX_PEER_INFLIGHT
+		|| sw->num_inflight >= SIGCHECK_MAX_INFLIGHT;
+}
+
+void sigcheck_peer_gone(struct peer *peer)
+{
+	struct sigcheck_workers *sw = sigcheck_workers;
+	struct sigcheck *sc;
+
+	if (!sw || !peer->sigchecks_inflight)
+		return;
+
+	list_for_each(&sw->inflight, sc, inflight) {
+		if (sc->peer == peer)
+			sc->peer = NULL;
+	}
+}
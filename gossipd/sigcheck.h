@@ -0,0 +1,94 @@
+#ifndef LIGHTNING_GOSSIPD_SIGCHECK_H
+#define LIGHTNING_GOSSIPD_SIGCHECK_H
+#include "config.h"
+#include <bitcoin/shadouble.h>
+#include <bitcoin/pubkey.h>
+#include <ccan/list/list.h>
+#include <ccan/short_types/short_types.h>
+#include <common/node_id.h>
+#include <common/utils.h>
+#include <secp256k1.h>
+#include <stdbool.h>
+#include <string.h>
+
+struct daemon;
+struct peer;
+
+/*~ Checking signatures is most of the work of accepting gossip, so we
+ * can hand that off to worker threads.  The main loop still parses and
+ * applies the messages (in the order they arrived): when it comes to
+ * check a signature, it uses the worker's answer if there is one. */
+struct sigcheck_sig {
+	/* Who should have signed (bitcoin keys are converted too) */
+	struct node_id signer;
+	/* Parsed by the main loop, which caches them */
+	struct pubkey key;
+	secp256k1_ecdsa_signature sig;
+	bool ok;
+};
+
+struct sigcheck {
+	/* In sigcheck_workers->queue, then in ->inflight. */
+	struct list_node list, inflight;
+
+	/* Who sent it (NULL if they've gone), and what was it? */
+	struct peer *peer;
+	const u8 *msg;
+
+	/* The part of msg which is signed, and its hash. */
+	size_t signed_off;
+	struct sha256_double hash;
+
+	/* The signatures the worker checked. */
+	size_t num_sigs;
+	struct sigcheck_sig sigs[4];
+
+	/* Only touched by the main loop. */
+	bool done;
+};
+
+/* Did a worker check this signature?  If so, sets *ok. */
+static inline bool sigcheck_result(const struct sigcheck *sc,
+				   const struct sha256_double *hash,
+				   const secp256k1_ecdsa_signature *sig,
+				   const struct node_id *signer,
+				   bool *ok)
+{
+	/* No signatures means the worker didn't check (or hash) anything. */
+	if (!sc || sc->num_sigs == 0 || !sha256_eq(&sc->hash.sha, &hash->sha))
+		return false;
+
+	for (size_t i = 0; i < sc->num_sigs; i++) {
+		if (!node_id_eq(&sc->sigs[i].signer, signer))
+			continue;
+		if (memcmp(&sc->sigs[i].sig, sig, sizeof(*sig)) != 0)
+			continue;
+		*ok = sc->sigs[i].ok;
+		return true;
+	}
+	return false;
+}
+
+/* We stop reading from a peer while it has this many messages waiting
+ * to be checked, or while everyone together has this many. */
+#define SIGCHECK_MAX_PEER_INFLIGHT 200
+#define SIGCHECK_MAX_INFLIGHT 5000
+
+/* Start @num_threads workers (0 means we check signatures as we go). */
+void sigcheck_init(struct daemon *daemon, u32 num_threads);
+
+/* Queue this gossip message from the peer, if we have workers: returns
+ * false if the caller should simply handle it now. */
+bool sigcheck_submit(struct daemon *daemon, struct peer *peer, const u8 *msg);
+
+/* Should we stop reading from this peer for now?  If so, we
+ * io_wake(&peer->sigchecks_inflight) as its messages are applied. */
+bool sigcheck_peer_full(const struct peer *peer);
+
+/* This peer is being freed: its queued messages are simply dropped. */
+void sigcheck_peer_gone(struct peer *peer);
+
+/* Callback inside gossipd for each message, in order, once checked. */
+void peer_gossip_checked(struct daemon *daemon, const struct sigcheck *sc);
+
+#endif /* LIGHTNING_GOSSIPD_SIGCHECK_H */
@@ -29,9 +29,12 @@ void status_fmt(enum log_level level UNUSED,
 }
 
 /* AUTOGENERATED MOCKS START */
+/* Generated stub for crc32_of_update */
+u32 crc32_of_update(const u8 *channel_update UNNEEDED)
+{ fprintf(stderr, "crc32_of_update called!\n"); abort(); }
 /* Generated stub for cupdate_different */
 bool cupdate_different(struct gossip_store *gs UNNEEDED,
-		       const struct half_chan *hc UNNEEDED,
+		       const struct chan *chan UNNEEDED, int direction UNNEEDED,
 		       const u8 *cupdate UNNEEDED)
 { fprintf(stderr, "cupdate_different called!\n"); abort(); }
 /* Generated stub for fmt_wireaddr_without_port */
@@ -165,7 +168,7 @@ static void add_connection(struct routing_state *rstate,
 	c->delay = delay;
 	c->channel_flags = node_id_idx(&nodes[from], &nodes[to]);
 	/* This must be non-zero, otherwise we consider it disabled! */
-	c->bcast.index = 1;
+	chan->half_bcast[idx].index = 1;
 	c->htlc_maximum = AMOUNT_MSAT(-1ULL);
 	c->htlc_minimum = AMOUNT_MSAT(0);
 }
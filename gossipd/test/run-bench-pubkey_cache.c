@@ -0,0 +1,233 @@
+#include <assert.h>
+#include <bitcoin/privkey.h>
+#include <bitcoin/pubkey.h>
+#include <bitcoin/signature.h>
+#include <ccan/opt/opt.h>
+#include <ccan/time/time.h>
+#include <common/json_stream.h>
+#include <common/pseudorand.h>
+#include <common/status.h>
+#include <stdio.h>
+
+#include "../routing.c"
+#include "../gossip_store.c"
+
+void status_fmt(enum log_level level UNUSED,
+		const struct node_id *node_id,
+		const char *fmt, ...)
+{
+	va_list ap;
+
+	va_start(ap, fmt);
+	vprintf(fmt, ap);
+	printf("\n");
+	va_end(ap);
+}
+
+
+/* AUTOGENERATED MOCKS START */
+/* Generated stub for crc32_of_update */
+u32 crc32_of_update(const u8 *channel_update UNNEEDED)
+{ fprintf(stderr, "crc32_of_update called!\n"); abort(); }
+/* Generated stub for cupdate_different */
+bool cupdate_different(struct gossip_store *gs UNNEEDED,
+		       const struct chan *chan UNNEEDED, int direction UNNEEDED,
+		       const u8 *cupdate UNNEEDED)
+{ fprintf(stderr, "cupdate_different called!\n"); abort(); }
+/* Generated stub for fmt_wireaddr_without_port */
+char *fmt_wireaddr_without_port(const tal_t *ctx UNNEEDED, const struct wireaddr *a UNNEEDED)
+{ fprintf(stderr, "fmt_wireaddr_without_port called!\n"); abort(); }
+/* Generated stub for fromwire_gossip_store_channel_amount */
+bool fromwire_gossip_store_channel_amount(const void *p UNNEEDED, struct amount_sat *satoshis UNNEEDED)
+{ fprintf(stderr, "fromwire_gossip_store_channel_amount called!\n"); abort(); }
+/* Generated stub for fromwire_gossip_store_private_channel */
+bool fromwire_gossip_store_private_channel(const tal_t *ctx UNNEEDED, const void *p UNNEEDED, struct amount_sat *satoshis UNNEEDED, u8 **announcement UNNEEDED)
+{ fprintf(stderr, "fromwire_gossip_store_private_channel called!\n"); abort(); }
+/* Generated stub for fromwire_gossip_store_private_update */
+bool fromwire_gossip_store_private_update(const tal_t *ctx UNNEEDED, const void *p UNNEEDED, u8 **update UNNEEDED)
+{ fprintf(stderr, "fromwire_gossip_store_private_update called!\n"); abort(); }
+/* Generated stub for fromwire_gossipd_local_add_channel_obs */
+bool fromwire_gossipd_local_add_channel_obs(const tal_t *ctx UNNEEDED, const void *p UNNEEDED, struct short_channel_id *short_channel_id UNNEEDED, struct node_id *remote_node_id UNNEEDED, struct amount_sat *satoshis UNNEEDED, u8 **features UNNEEDED)
+{ fprintf(stderr, "fromwire_gossipd_local_add_channel_obs called!\n"); abort(); }
+/* Generated stub for fromwire_wireaddr */
+bool fromwire_wireaddr(const u8 **cursor UNNEEDED, size_t *max UNNEEDED, struct wireaddr *addr UNNEEDED)
+{ fprintf(stderr, "fromwire_wireaddr called!\n"); abort(); }
+/* Generated stub for json_add_member */
+void json_add_member(struct json_stream *js UNNEEDED,
+		     const char *fieldname UNNEEDED,
+		     bool quote UNNEEDED,
+		     const char *fmt UNNEEDED, ...)
+{ fprintf(stderr, "json_add_member called!\n"); abort(); }
+/* Generated stub for json_member_direct */
+char *json_member_direct(struct json_stream *js UNNEEDED,
+			 const char *fieldname UNNEEDED, size_t extra UNNEEDED)
+{ fprintf(stderr, "json_member_direct called!\n"); abort(); }
+/* Generated stub for json_object_end */
+void json_object_end(struct json_stream *js UNNEEDED)
+{ fprintf(stderr, "json_object_end called!\n"); abort(); }
+/* Generated stub for json_object_start */
+void json_object_start(struct json_stream *ks UNNEEDED, const char *fieldname UNNEEDED)
+{ fprintf(stderr, "json_object_start called!\n"); abort(); }
+/* Generated stub for memleak_add_helper_ */
+void memleak_add_helper_(const tal_t *p UNNEEDED, void (*cb)(struct htable *memtable UNNEEDED,
+						    const tal_t *)){ }
+/* Generated stub for nannounce_different */
+bool nannounce_different(struct gossip_store *gs UNNEEDED,
+			 const struct node *node UNNEEDED,
+			 const u8 *nannounce UNNEEDED)
+{ fprintf(stderr, "nannounce_different called!\n"); abort(); }
+/* Generated stub for notleak_ */
+void *notleak_(const void *ptr UNNEEDED, bool plus_children UNNEEDED)
+{ fprintf(stderr, "notleak_ called!\n"); abort(); }
+/* Generated stub for peer_supplied_good_gossip */
+void peer_supplied_good_gossip(struct peer *peer UNNEEDED, size_t amount UNNEEDED)
+{ fprintf(stderr, "peer_supplied_good_gossip called!\n"); abort(); }
+/* Generated stub for private_channel_announcement */
+const u8 *private_channel_announcement(const tal_t *ctx UNNEEDED,
+				       const struct short_channel_id *scid UNNEEDED,
+				       const struct node_id *local_node_id UNNEEDED,
+				       const struct node_id *remote_node_id UNNEEDED,
+				       const u8 *features UNNEEDED)
+{ fprintf(stderr, "private_channel_announcement called!\n"); abort(); }
+/* Generated stub for sanitize_error */
+char *sanitize_error(const tal_t *ctx UNNEEDED, const u8 *errmsg UNNEEDED,
+		     struct channel_id *channel_id UNNEEDED)
+{ fprintf(stderr, "sanitize_error called!\n"); abort(); }
+/* Generated stub for status_failed */
+void status_failed(enum status_failreason code UNNEEDED,
+		   const char *fmt UNNEEDED, ...)
+{ fprintf(stderr, "status_failed called!\n"); abort(); }
+/* Generated stub for towire_errorfmt */
+u8 *towire_errorfmt(const tal_t *ctx UNNEEDED,
+		    const struct channel_id *channel UNNEEDED,
+		    const char *fmt UNNEEDED, ...)
+{ fprintf(stderr, "towire_errorfmt called!\n"); abort(); }
+/* Generated stub for towire_gossip_store_channel_amount */
+u8 *towire_gossip_store_channel_amount(const tal_t *ctx UNNEEDED, struct amount_sat satoshis UNNEEDED)
+{ fprintf(stderr, "towire_gossip_store_channel_amount called!\n"); abort(); }
+/* Generated stub for towire_gossip_store_delete_chan */
+u8 *towire_gossip_store_delete_chan(const tal_t *ctx UNNEEDED, const struct short_channel_id *scid UNNEEDED)
+{ fprintf(stderr, "towire_gossip_store_delete_chan called!\n"); abort(); }
+/* Generated stub for towire_gossip_store_private_channel */
+u8 *towire_gossip_store_private_channel(const tal_t *ctx UNNEEDED, struct amount_sat satoshis UNNEEDED, const u8 *announcement UNNEEDED)
+{ fprintf(stderr, "towire_gossip_store_private_channel called!\n"); abort(); }
+/* Generated stub for towire_gossip_store_private_update */
+u8 *towire_gossip_store_private_update(const tal_t *ctx UNNEEDED, const u8 *update UNNEEDED)
+{ fprintf(stderr, "towire_gossip_store_private_update called!\n"); abort(); }
+/* Generated stub for update_peers_broadcast_index */
+void update_peers_broadcast_index(struct list_head *peers UNNEEDED, u32 offset UNNEEDED)
+{ fprintf(stderr, "update_peers_broadcast_index called!\n"); abort(); }
+/* AUTOGENERATED MOCKS END */
+
+#if DEVELOPER
+/* Generated stub for memleak_remove_htable */
+void memleak_remove_htable(struct htable *memtable UNNEEDED, const struct htable *ht UNNEEDED)
+{ fprintf(stderr, "memleak_remove_htable called!\n"); abort(); }
+/* Generated stub for memleak_remove_intmap_ */
+void memleak_remove_intmap_(struct htable *memtable UNNEEDED, const struct intmap *m UNNEEDED)
+{ fprintf(stderr, "memleak_remove_intmap_ called!\n"); abort(); }
+#endif
+
+/* NOOP for new_reltimer_ */
+struct oneshot *new_reltimer_(struct timers *timers UNNEEDED,
+			      const tal_t *ctx UNNEEDED,
+			      struct timerel expire UNNEEDED,
+			      void (*cb)(void *) UNNEEDED, void *arg UNNEEDED)
+{
+	return NULL;
+}
+
+static struct privkey nodekey(size_t n)
+{
+	struct privkey k;
+
+	memset(&k, 0xFF, sizeof(k));
+	memcpy(&k, &n, sizeof(n));
+	return k;
+}
+
+int main(int argc, char *argv[])
+{
+	setup_locale();
+
+	struct routing_state *rstate;
+	size_t num_nodes = 100, num_runs = 1000, num_ok;
+	struct timemono start, end;
+	struct node_id me, *ids;
+	secp256k1_ecdsa_signature *sigs;
+	struct sha256_double hash;
+
+	secp256k1_ctx = secp256k1_context_create(SECP256K1_CONTEXT_VERIFY
+						 | SECP256K1_CONTEXT_SIGN);
+	setup_tmpctx();
+
+	opt_parse(&argc, argv, opt_log_stderr_exit);
+	if (argc > 1)
+		num_nodes = atoi(argv[1]);
+	if (argc > 2)
+		num_runs = atoi(argv[2]);
+	if (argc > 3)
+		opt_usage_and_exit("[num_nodes [num_runs]]");
+
+	memset(&me, 0, sizeof(me));
+	rstate = new_routing_state(tmpctx, &me, NULL, NULL, NULL,
+				   false, false);
+
+	/* Half the signers are nodes we know, half aren't (yet). */
+	printf("Creating nodes...\n");
+	memset(&hash, 0x42, sizeof(hash));
+	ids = tal_arr(tmpctx, struct node_id, num_nodes);
+	sigs = tal_arr(tmpctx, secp256k1_ecdsa_signature, num_nodes);
+	for (size_t i = 0; i < num_nodes; i++) {
+		struct privkey k = nodekey(i);
+		struct pubkey pk;
+
+		pubkey_from_privkey(&k, &pk);
+		node_id_from_pubkey(&ids[i], &pk);
+		sign_hash(&k, &hash, &sigs[i]);
+		if (i % 2)
+			new_node(rstate, &ids[i]);
+	}
+
+	/* What we used to do: parse the key every time. */
+	num_ok = 0;
+	start = time_mono();
+	for (size_t i = 0; i < num_runs; i++) {
+		size_t n = pseudorand(num_nodes);
+		struct pubkey key;
+
+		if (pubkey_from_node_id(&key, &ids[n])
+		    && check_signed_hash(&hash, &sigs[n], &key))
+			num_ok++;
+	}
+	end = time_mono();
+	assert(num_ok == num_runs);
+	printf("uncached: %zu checks in %"PRIu64" msec (%"PRIu64" nanoseconds per check)\n",
+	       num_runs, time_to_msec(timemono_between(end, start)),
+	       time_to_nsec(time_divide(timemono_between(end, start),
+					num_runs)));
+
+	num_ok = 0;
+	start = time_mono();
+	for (size_t i = 0; i < num_runs; i++) {
+		size_t n = pseudorand(num_nodes);
+
+		if (check_signed_hash_nodeid(rstate, &hash, &sigs[n], &ids[n]))
+			num_ok++;
+	}
+	end = time_mono();
+	assert(num_ok == num_runs);
+	printf("cached: %zu checks in %"PRIu64" msec (%"PRIu64" nanoseconds per check)\n",
+	       num_runs, time_to_msec(timemono_between(end, start)),
+	       time_to_nsec(time_divide(timemono_between(end, start),
+					num_runs)));
+	printf("pubkey cache: %"PRIu64" hits, %"PRIu64" misses\n",
+	       rstate->pubkey_cache_hits, rstate->pubkey_cache_misses);
+	assert(rstate->pubkey_cache_hits + rstate->pubkey_cache_misses
+	       == num_runs);
+
+	tal_free(tmpctx);
+	secp256k1_context_destroy(secp256k1_ctx);
+	opt_free_table();
+	return 0;
+}
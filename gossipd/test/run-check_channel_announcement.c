@@ -33,9 +33,12 @@ In particular, we set feature bit 19.  The spec says we should set feature bit 1
 #include <stdio.h>
 
 /* AUTOGENERATED MOCKS START */
+/* Generated stub for crc32_of_update */
+u32 crc32_of_update(const u8 *channel_update UNNEEDED)
+{ fprintf(stderr, "crc32_of_update called!\n"); abort(); }
 /* Generated stub for cupdate_different */
 bool cupdate_different(struct gossip_store *gs UNNEEDED,
-		       const struct half_chan *hc UNNEEDED,
+		       const struct chan *chan UNNEEDED, int direction UNNEEDED,
 		       const u8 *cupdate UNNEEDED)
 { fprintf(stderr, "cupdate_different called!\n"); abort(); }
 /* Generated stub for fmt_wireaddr_without_port */
@@ -140,12 +143,17 @@ int main(void)
 	struct node_id node_id_1, node_id_2;
 	struct pubkey bitcoin_key_1, bitcoin_key_2;
 	const u8 *cannounce;
+	struct routing_state *rstate;
 
 	setup_locale();
 	secp256k1_ctx = secp256k1_context_create(SECP256K1_CONTEXT_VERIFY
 						 | SECP256K1_CONTEXT_SIGN);
 	setup_tmpctx();
 
+	/* Just enough for checking signatures. */
+	rstate = talz(tmpctx, struct routing_state);
+	rstate->nodes = new_node_map(rstate);
+
 	cannounce = tal_hexdata(tmpctx, "010011effc9ed10fceccfae5f9e3fef20d983b06eed030e968fd8d1e6c5905e18f9f2df6a43f00d7c0ddf52e0467ab1e32394051b72ea6343fb008a4117c265f3d7b732bab7df4ee404ac926aef6610f4eb33e31baabfd9afdbf897c8a80057efa1468362b4d2cc0a5482013e1058c8205717f85c3bc82c3ea89f17cfeac21e2cb2ac65b429f79b24fbd51094bee5e080d4c7cfc28a584e279075643054a48b2972f0b72becfd57e03297bf0102b09329982e0ac839dc120959c07456431d3c8fd1430ffe2cc2710e9600e602779c9cf5f91e95874ef4bcf9f0bdda2ce2be97bba562848a2717acdb8dec30bd5073f2f853776cc98f0b6cddc2dcfb57aa69fa7c43400030800006fe28c0ab6f1b372c1a6a246ae63f74f931e8365e15a089c68d619000000000009984d00063a00010254ff808f53b2f8c45e74b70430f336c6c76ba2f4af289f48d6086ae6e60462d303baa70886d9200af0ffbd3f9e18d96008331c858456b16e3a9b41e735c6208fef03c8731bbac446b7d11b7f5a1861c7d2c87ccf429780c74463de3428dceeb73ad702b3e55c7a1a6cdf17a83a801f7f8f698e4980323e2584f27a643a1b0519ebf8c7", strlen("010011effc9ed10fceccfae5f9e3fef20d983b06eed030e968fd8d1e6c5905e18f9f2df6a43f00d7c0ddf52e0467ab1e32394051b72ea6343fb008a4117c265f3d7b732bab7df4ee404ac926aef6610f4eb33e31baabfd9afdbf897c8a80057efa1468362b4d2cc0a5482013e1058c8205717f85c3bc82c3ea89f17cfeac21e2cb2ac65b429f79b24fbd51094bee5e080d4c7cfc28a584e279075643054a48b2972f0b72becfd57e03297bf0102b09329982e0ac839dc120959c07456431d3c8fd1430ffe2cc2710e9600e602779c9cf5f91e95874ef4bcf9f0bdda2ce2be97bba562848a2717acdb8dec30bd5073f2f853776cc98f0b6cddc2dcfb57aa69fa7c43400030800006fe28c0ab6f1b372c1a6a246ae63f74f931e8365e15a089c68d619000000000009984d00063a00010254ff808f53b2f8c45e74b70430f336c6c76ba2f4af289f48d6086ae6e60462d303baa70886d9200af0ffbd3f9e18d96008331c858456b16e3a9b41e735c6208fef03c8731bbac446b7d11b7f5a1861c7d2c87ccf429780c74463de3428dceeb73ad702b3e55c7a1a6cdf17a83a801f7f8f698e4980323e2584f27a643a1b0519ebf8c7"));
 	if (!fromwire_channel_announcement(cannounce, cannounce,
 					   &node_signature_1,
@@ -161,7 +169,7 @@ int main(void)
 					   &bitcoin_key_2))
 		abort();
 
-	err = check_channel_announcement(cannounce,
+	err = check_channel_announcement(cannounce, rstate,
 					 &node_id_1, &node_id_2,
 					 &bitcoin_key_1, &bitcoin_key_2,
 					 &node_signature_1, &node_signature_2,
@@ -185,7 +193,7 @@ int main(void)
 						&node_id_2,
 						&bitcoin_key_1,
 						&bitcoin_key_2);
-	err = check_channel_announcement(cannounce,
+	err = check_channel_announcement(cannounce, rstate,
 					 &node_id_1, &node_id_2,
 					 &bitcoin_key_1, &bitcoin_key_2,
 					 &node_signature_1, &node_signature_2,
@@ -195,6 +203,9 @@ int main(void)
 	assert(err);
 	assert(memmem(err, tal_bytelen(err),
 		      "Bad node_signature_2", strlen("Bad node_signature_2")));
+	/* Second time, node_id_1's key came from the cache. */
+	assert(rstate->pubkey_cache_hits == 1);
+	assert(rstate->pubkey_cache_misses == 2);
 
 	tal_free(tmpctx);
 	secp256k1_context_destroy(secp256k1_ctx);
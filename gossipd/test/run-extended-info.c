@@ -3,6 +3,7 @@
 #define ZLIB_EVEN_IF_EXPANDS 1
 
 #include "../queries.c"
+#include <ccan/array_size/array_size.h>
 #include <ccan/str/hex/hex.h>
 #include <common/json.h>
 #include <common/json_helpers.h>
@@ -39,20 +40,10 @@ char *fmt_wireaddr_without_port(const tal_t *ctx UNNEEDED, const struct wireaddr
 /* Generated stub for fromwire_gossipd_dev_set_max_scids_encode_size */
 bool fromwire_gossipd_dev_set_max_scids_encode_size(const void *p UNNEEDED, u32 *max UNNEEDED)
 { fprintf(stderr, "fromwire_gossipd_dev_set_max_scids_encode_size called!\n"); abort(); }
-/* Generated stub for get_cupdate_parts */
-void get_cupdate_parts(const u8 *channel_update UNNEEDED,
-		       const u8 *parts[2] UNNEEDED,
-		       size_t sizes[2])
-{ fprintf(stderr, "get_cupdate_parts called!\n"); abort(); }
 /* Generated stub for get_node */
 struct node *get_node(struct routing_state *rstate UNNEEDED,
 		      const struct node_id *id UNNEEDED)
 { fprintf(stderr, "get_node called!\n"); abort(); }
-/* Generated stub for gossip_store_get */
-const u8 *gossip_store_get(const tal_t *ctx UNNEEDED,
-			   struct gossip_store *gs UNNEEDED,
-			   u64 offset UNNEEDED)
-{ fprintf(stderr, "gossip_store_get called!\n"); abort(); }
 /* Generated stub for json_add_member */
 void json_add_member(struct json_stream *js UNNEEDED,
 		     const char *fieldname UNNEEDED,
@@ -16,9 +16,12 @@ void status_fmt(enum log_level level UNUSED,
 }
 
 /* AUTOGENERATED MOCKS START */
+/* Generated stub for crc32_of_update */
+u32 crc32_of_update(const u8 *channel_update UNNEEDED)
+{ fprintf(stderr, "crc32_of_update called!\n"); abort(); }
 /* Generated stub for cupdate_different */
 bool cupdate_different(struct gossip_store *gs UNNEEDED,
-		       const struct half_chan *hc UNNEEDED,
+		       const struct chan *chan UNNEEDED, int direction UNNEEDED,
 		       const u8 *cupdate UNNEEDED)
 { fprintf(stderr, "cupdate_different called!\n"); abort(); }
 /* Generated stub for fmt_wireaddr_without_port */
@@ -153,7 +156,7 @@ static void add_connection(struct routing_state *rstate,
 
 	c = &chan->half[node_id_idx(from, to)];
 	/* Make sure it's seen as initialized (index non-zero). */
-	c->bcast.index = 1;
+	chan->half_bcast[node_id_idx(from, to)].index = 1;
 	c->base_fee = base_fee;
 	c->proportional_fee = proportional_fee;
 	c->delay = delay;
@@ -219,10 +222,15 @@ int main(void)
 	setup_locale();
 
 	struct routing_state *rstate;
-	struct node_id a, b, c, d;
+	struct node_id a, b, c, d, e;
 	struct privkey tmp;
+	struct chan *chan;
+	int idx;
 	struct amount_msat fee;
 	struct chan **route;
+	struct route_hop **hops, **hops2;
+	struct exclude_entry **excluded;
+	size_t num_cached;
 	const double riskfactor = 1.0 / BLOCKS_PER_YEAR / 10000;
 
 	secp256k1_ctx = secp256k1_context_create(SECP256K1_CONTEXT_VERIFY
@@ -301,6 +309,107 @@ int main(void)
 	assert(channel_is_between(route[1], &d, &c));
 	assert(amount_msat_eq(fee, AMOUNT_MSAT(0 + 6)));
 
+	/* E->D: E can pay us, but we can't pay E. */
+	memset(&tmp, 'e', sizeof(tmp));
+	node_id_from_privkey(&tmp, &e);
+	new_node(rstate, &e);
+	add_connection(rstate, &e, &d, 1, 1, 1);
+
+	route = find_route(tmpctx, rstate, NULL, &c, AMOUNT_MSAT(1000), riskfactor, 0.0, NULL,
+			   ROUTING_MAX_HOPS, &fee);
+	assert(route);
+	assert(!rstate->reachable_dirty);
+	assert(get_node(rstate, &c)->reachable);
+	assert(!get_node(rstate, &e)->reachable);
+
+	route = find_route(tmpctx, rstate, NULL, &e, AMOUNT_MSAT(1000), riskfactor, 0.0, NULL,
+			   ROUTING_MAX_HOPS, &fee);
+	assert(!route);
+
+	/* A->E: an update enabling it makes E reachable, without starting
+	 * again. */
+	add_connection(rstate, &a, &e, 1, 1, 1);
+	chan = find_channel(rstate, get_node(rstate, &a), get_node(rstate, &e),
+			    &idx);
+	reachable_add(rstate, chan, idx);
+	assert(!rstate->reachable_dirty);
+	assert(get_node(rstate, &e)->reachable);
+
+	route = find_route(tmpctx, rstate, NULL, &e, AMOUNT_MSAT(1000), riskfactor, 0.0, NULL,
+			   ROUTING_MAX_HOPS, &fee);
+	assert(route);
+	assert(tal_count(route) == 1);
+
+	/* Disabling it again means we have to recalculate. */
+	reachable_remove(rstate, chan, idx);
+	chan->half[idx].channel_flags |= ROUTING_FLAGS_DISABLED;
+	assert(rstate->reachable_dirty);
+	route = find_route(tmpctx, rstate, NULL, &e, AMOUNT_MSAT(1000), riskfactor, 0.0, NULL,
+			   ROUTING_MAX_HOPS, &fee);
+	assert(!route);
+	assert(!rstate->reachable_dirty);
+	assert(!get_node(rstate, &e)->reachable);
+
+	/* A similar amount gets the same route from the cache. */
+	hops = get_route(tmpctx, rstate, NULL, &c, AMOUNT_MSAT(1000),
+			 riskfactor, 9, 0.0, 0, NULL, ROUTING_MAX_HOPS);
+	assert(tal_count(hops) == 2);
+	assert(rstate->route_cache_num == 1);
+	assert(rstate->route_cache_misses == 1);
+	hops2 = get_route(tmpctx, rstate, NULL, &c, AMOUNT_MSAT(1010),
+			  riskfactor, 9, 0.0, 0, NULL, ROUTING_MAX_HOPS);
+	assert(tal_count(hops2) == 2);
+	assert(rstate->route_cache_hits == 1);
+	assert(short_channel_id_eq(&hops2[0]->channel_id, &hops[0]->channel_id));
+	assert(short_channel_id_eq(&hops2[1]->channel_id, &hops[1]->channel_id));
+	assert(amount_msat_eq(hops2[1]->amount, AMOUNT_MSAT(1010)));
+
+	/* A different bucket is a different entry. */
+	hops2 = get_route(tmpctx, rstate, NULL, &c, AMOUNT_MSAT(2000),
+			  riskfactor, 9, 0.0, 0, NULL, ROUTING_MAX_HOPS);
+	assert(tal_count(hops2) == 2);
+	assert(rstate->route_cache_num == 2);
+	assert(rstate->route_cache_misses == 2);
+
+	assert(short_channel_id_eq(&hops2[1]->channel_id, &hops[1]->channel_id));
+	/* Closing a channel on the route forgets both. */
+	free_chan(rstate, get_channel(rstate, &hops[1]->channel_id));
+	assert(rstate->route_cache_num == 0);
+	assert(uintmap_empty(&rstate->route_cache_scids));
+	get_route(tmpctx, rstate, NULL, &c, AMOUNT_MSAT(1000),
+		  riskfactor, 9, 0.0, 0, NULL, ROUTING_MAX_HOPS);
+	assert(rstate->route_cache_hits == 1);
+	assert(rstate->route_cache_misses == 3);
+
+	/* The order of the exclusions doesn't matter. */
+	excluded = tal_arr(tmpctx, struct exclude_entry *, 2);
+	excluded[0] = tal(excluded, struct exclude_entry);
+	excluded[0]->type = EXCLUDE_NODE;
+	excluded[0]->u.node_id = d;
+	excluded[1] = tal(excluded, struct exclude_entry);
+	excluded[1]->type = EXCLUDE_NODE;
+	excluded[1]->u.node_id = e;
+	hops = get_route(tmpctx, rstate, NULL, &b, AMOUNT_MSAT(1000),
+			 riskfactor, 9, 0.0, 0, excluded, ROUTING_MAX_HOPS);
+	assert(tal_count(hops) == 1);
+	assert(rstate->route_cache_misses == 4);
+	excluded[0]->u.node_id = e;
+	excluded[1]->u.node_id = d;
+	hops = get_route(tmpctx, rstate, NULL, &b, AMOUNT_MSAT(1000),
+			 riskfactor, 9, 0.0, 0, excluded, ROUTING_MAX_HOPS);
+	assert(tal_count(hops) == 1);
+	assert(rstate->route_cache_hits == 2);
+	assert(rstate->route_cache_misses == 4);
+
+	/* With fuzz, it's neither used nor added to. */
+	num_cached = rstate->route_cache_num;
+	hops = get_route(tmpctx, rstate, NULL, &b, AMOUNT_MSAT(1000),
+			 riskfactor, 9, 0.05, 0, excluded, ROUTING_MAX_HOPS);
+	assert(tal_count(hops) == 1);
+	assert(rstate->route_cache_hits == 2);
+	assert(rstate->route_cache_misses == 4);
+	assert(rstate->route_cache_num == num_cached);
+
 	tal_free(tmpctx);
 	secp256k1_context_destroy(secp256k1_ctx);
 	return 0;
@@ -72,7 +72,7 @@ void status_fmt(enum log_level level UNNEEDED,
 { fprintf(stderr, "status_fmt called!\n"); abort(); }
 /* Generated stub for would_ratelimit_cupdate */
 bool would_ratelimit_cupdate(struct routing_state *rstate UNNEEDED,
-			     const struct half_chan *hc UNNEEDED,
+			     const struct chan *chan UNNEEDED, int direction UNNEEDED,
 			     u32 timestamp UNNEEDED)
 { fprintf(stderr, "would_ratelimit_cupdate called!\n"); abort(); }
 /* AUTOGENERATED MOCKS END */
@@ -16,9 +16,12 @@ void status_fmt(enum log_level level UNUSED,
 }
 
 /* AUTOGENERATED MOCKS START */
+/* Generated stub for crc32_of_update */
+u32 crc32_of_update(const u8 *channel_update UNNEEDED)
+{ fprintf(stderr, "crc32_of_update called!\n"); abort(); }
 /* Generated stub for cupdate_different */
 bool cupdate_different(struct gossip_store *gs UNNEEDED,
-		       const struct half_chan *hc UNNEEDED,
+		       const struct chan *chan UNNEEDED, int direction UNNEEDED,
 		       const u8 *cupdate UNNEEDED)
 { fprintf(stderr, "cupdate_different called!\n"); abort(); }
 /* Generated stub for fmt_wireaddr_without_port */
@@ -173,7 +176,7 @@ int main(void)
 				AMOUNT_SAT(1000000), NULL);
 
 		hc = &chan->half[node_id_idx(&ids[i-1], &ids[i])];
-		hc->bcast.index = 1;
+		chan->half_bcast[node_id_idx(&ids[i-1], &ids[i])].index = 1;
 		hc->base_fee = 1;
 		hc->proportional_fee = 0;
 		hc->delay = 0;
@@ -192,7 +195,7 @@ int main(void)
 		chan = new_chan(rstate, &scid, &ids[i], &ids[1],
 				AMOUNT_SAT(1000000), NULL);
 		hc = &chan->half[node_id_idx(&ids[1], &ids[i])];
-		hc->bcast.index = 1;
+		chan->half_bcast[node_id_idx(&ids[1], &ids[i])].index = 1;
 		hc->base_fee = 1 << i;
 		hc->proportional_fee = 0;
 		hc->delay = 0;
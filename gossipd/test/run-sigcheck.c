@@ -0,0 +1,153 @@
+#include "../sigcheck.c"
+#include <assert.h>
+#include <bitcoin/privkey.h>
+#include <ccan/io/io.h>
+#include <stdio.h>
+#include <wire/peer_wire.h>
+
+/* AUTOGENERATED MOCKS START */
+/* Generated stub for status_failed */
+void status_failed(enum status_failreason code UNNEEDED,
+		   const char *fmt UNNEEDED, ...)
+{ fprintf(stderr, "status_failed called!\n"); abort(); }
+/* AUTOGENERATED MOCKS END */
+
+/* NOOP for notleak_ */
+void *notleak_(const void *ptr, bool plus_children UNNEEDED)
+{
+	return cast_const(void *, ptr);
+}
+
+#define NUM_MSGS 1000
+
+static struct privkey owner_key, other_key;
+static struct node_id owner;
+static struct peer *peer;
+/* What we expect each msg to give, in order. */
+static size_t next_msg, num_checked;
+static bool expect_known[NUM_MSGS], expect_ok[NUM_MSGS];
+
+/* We know every channel, except every third one. */
+const struct node_id *get_channel_owner(struct routing_state *rstate UNNEEDED,
+					const struct short_channel_id *scid,
+					int direction UNNEEDED)
+{
+	if (scid->u64 % 3 == 0)
+		return NULL;
+	return &owner;
+}
+
+/* No cache here: just parse it. */
+bool get_node_pubkey(struct routing_state *rstate UNNEEDED,
+		     const struct node_id *id,
+		     struct pubkey *key)
+{
+	return pubkey_from_node_id(key, id);
+}
+
+void peer_gossip_checked(struct daemon *daemon, const struct sigcheck *sc)
+{
+	secp256k1_ecdsa_signature sig;
+	struct bitcoin_blkid chain_hash;
+	struct short_channel_id scid;
+	u32 timestamp, fee_base_msat, fee_proportional_millionths;
+	u8 message_flags, channel_flags;
+	u16 expiry;
+	struct amount_msat htlc_minimum;
+	struct sha256_double hash;
+	bool ok;
+
+	assert(fromwire_channel_update(sc->msg, &sig, &chain_hash, &scid,
+				       &timestamp, &message_flags,
+				       &channel_flags, &expiry,
+				       &htlc_minimum, &fee_base_msat,
+				       &fee_proportional_millionths));
+	/* In order? */
+	assert(timestamp == next_msg);
+	assert(sc->peer == peer);
+
+	sha256_double(&hash, sc->msg + 66, tal_bytelen(sc->msg) - 66);
+	if (expect_known[timestamp]) {
+		assert(sigcheck_result(sc, &hash, &sig, &owner, &ok));
+		assert(ok == expect_ok[timestamp]);
+		num_checked++;
+	} else
+		assert(!sigcheck_result(sc, &hash, &sig, &owner, &ok));
+
+	if (++next_msg == NUM_MSGS)
+		io_break(daemon);
+}
+
+static u8 *make_update(const tal_t *ctx, u32 timestamp,
+		       const struct privkey *key)
+{
+	secp256k1_ecdsa_signature sig;
+	struct bitcoin_blkid chain_hash;
+	struct short_channel_id scid;
+	struct sha256_double hash;
+	u8 *msg;
+
+	memset(&sig, 0, sizeof(sig));
+	memset(&chain_hash, 0, sizeof(chain_hash));
+	scid.u64 = timestamp;
+	msg = towire_channel_update(ctx, &sig, &chain_hash, &scid, timestamp,
+				    0, 0, 6, AMOUNT_MSAT(0), 1, 1);
+	sha256_double(&hash, msg + 66, tal_bytelen(msg) - 66);
+	sign_hash(key, &hash, &sig);
+	return towire_channel_update(ctx, &sig, &chain_hash, &scid, timestamp,
+				     0, 0, 6, AMOUNT_MSAT(0), 1, 1);
+}
+
+int main(void)
+{
+	struct daemon *daemon;
+	struct pubkey pk;
+
+	setup_locale();
+	secp256k1_ctx = secp256k1_context_create(SECP256K1_CONTEXT_VERIFY
+						 | SECP256K1_CONTEXT_SIGN);
+	setup_tmpctx();
+
+	daemon = tal(tmpctx, struct daemon);
+	list_head_init(&daemon->peers);
+	peer = tal(tmpctx, struct peer);
+	memset(&peer->id, 1, sizeof(peer->id));
+	peer->sigchecks_inflight = 0;
+	list_add_tail(&daemon->peers, &peer->list);
+	memset(&owner_key, 2, sizeof(owner_key));
+	memset(&other_key, 3, sizeof(other_key));
+	pubkey_from_privkey(&owner_key, &pk);
+	node_id_from_pubkey(&owner, &pk);
+
+	sigcheck_init(daemon, 4);
+
+	for (size_t i = 0; i < NUM_MSGS; i++) {
+		const u8 *msg;
+
+		expect_known[i] = (i % 3 != 0);
+		expect_ok[i] = (i % 7 != 0);
+		msg = make_update(tmpctx, i,
+				  expect_ok[i] ? &owner_key : &other_key);
+		/* Only the very first can be handled immediately: after
+		 * that, it has to wait its turn. */
+		if (!sigcheck_submit(daemon, peer, msg)) {
+			assert(i == 0);
+			assert(!expect_known[i]);
+			next_msg++;
+		}
+	}
+
+	/* That's more than we'd read from one peer before waiting. */
+	assert(peer->sigchecks_inflight == NUM_MSGS - 1);
+	assert(sigcheck_peer_full(peer));
+
+	io_loop(NULL, NULL);
+	assert(next_msg == NUM_MSGS);
+	assert(num_checked == NUM_MSGS - (NUM_MSGS + 2) / 3);
+	assert(peer->sigchecks_inflight == 0);
+	assert(!sigcheck_peer_full(peer));
+
+	tal_free(tmpctx);
+	secp256k1_context_destroy(secp256k1_ctx);
+	return 0;
+}
@@ -4,9 +4,12 @@
 #include <stdio.h>
 
 /* AUTOGENERATED MOCKS START */
+/* Generated stub for crc32_of_update */
+u32 crc32_of_update(const u8 *channel_update UNNEEDED)
+{ fprintf(stderr, "crc32_of_update called!\n"); abort(); }
 /* Generated stub for cupdate_different */
 bool cupdate_different(struct gossip_store *gs UNNEEDED,
-		       const struct half_chan *hc UNNEEDED,
+		       const struct chan *chan UNNEEDED, int direction UNNEEDED,
 		       const u8 *cupdate UNNEEDED)
 { fprintf(stderr, "cupdate_different called!\n"); abort(); }
 /* Generated stub for fmt_wireaddr_without_port */
@@ -475,16 +475,16 @@ static unsigned channel_msg(struct subd *sd, const u8 *msg, const int *fds)
 
 	switch (t) {
 	case WIRE_CHANNELD_SENDING_COMMITSIG:
-		peer_sending_commitsig(sd->channel, msg);
+		peer_htlcs_group_commit(sd->channel, msg, peer_sending_commitsig);
 		break;
 	case WIRE_CHANNELD_GOT_COMMITSIG:
-		peer_got_commitsig(sd->channel, msg);
+		peer_htlcs_group_commit(sd->channel, msg, peer_got_commitsig);
 		break;
 	case WIRE_CHANNELD_FUNDING_SIGS:
 		peer_tx_sigs_msg(sd->channel, msg);
 		break;
 	case WIRE_CHANNELD_GOT_REVOKE:
-		peer_got_revoke(sd->channel, msg);
+		peer_htlcs_group_commit(sd->channel, msg, peer_got_revoke);
 		break;
 	case WIRE_CHANNELD_GOT_FUNDING_LOCKED:
 		peer_got_funding_locked(sd->channel, msg);
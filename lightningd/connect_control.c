@@ -372,7 +372,8 @@ int connectd_init(struct lightningd *ld)
 	    IFDEV(ld->dev_allow_localhost, false), ld->config.use_dns,
 	    ld->tor_service_password ? ld->tor_service_password : "",
 	    ld->config.use_v3_autotor,
-	    ld->config.connection_timeout_secs);
+	    ld->config.connection_timeout_secs,
+	    ld->config.gossip_batch_bytes);
 
 	subd_req(ld->connectd, ld->connectd, take(msg), -1, 0,
 		 connect_init_done, NULL);
@@ -13,9 +13,12 @@
 #include <ccan/tal/str/str.h>
 #include <common/amount.h>
 #include <common/features.h>
+#include <common/gossip_constants.h>
+#include <common/gossmap.h>
 #include <common/json_command.h>
 #include <common/json_helpers.h>
 #include <common/jsonrpc_errors.h>
+#include <common/memleak.h>
 #include <common/param.h>
 #include <common/type_to_string.h>
 #include <common/utils.h>
@@ -142,6 +145,8 @@ static unsigned gossip_msg(struct subd *gossip, const u8 *msg, const int *fds)
 	case WIRE_GOSSIPD_OUTPOINT_SPENT:
 	case WIRE_GOSSIPD_PAYMENT_FAILURE:
 	case WIRE_GOSSIPD_GET_INCOMING_CHANNELS:
+	case WIRE_GOSSIPD_GET_ROUTE_CACHE_STATS:
+	case WIRE_GOSSIPD_SYNC_STORE:
 	case WIRE_GOSSIPD_DEV_SET_MAX_SCIDS_ENCODE_SIZE:
 	case WIRE_GOSSIPD_DEV_SUPPRESS:
 	case WIRE_GOSSIPD_LOCAL_CHANNEL_CLOSE:
@@ -154,6 +159,8 @@ static unsigned gossip_msg(struct subd *gossip, const u8 *msg, const int *fds)
 	case WIRE_GOSSIPD_GETROUTE_REPLY:
 	case WIRE_GOSSIPD_GETCHANNELS_REPLY:
 	case WIRE_GOSSIPD_GET_INCOMING_CHANNELS_REPLY:
+	case WIRE_GOSSIPD_GET_ROUTE_CACHE_STATS_REPLY:
+	case WIRE_GOSSIPD_SYNC_STORE_REPLY:
 	case WIRE_GOSSIPD_DEV_MEMLEAK_REPLY:
 	case WIRE_GOSSIPD_DEV_COMPACT_STORE_REPLY:
 	case WIRE_GOSSIPD_GET_STRIPPED_CUPDATE_REPLY:
@@ -215,7 +222,8 @@ void gossip_init(struct lightningd *ld, int connectd_fd)
 	    ld->announcable,
 	    IFDEV(ld->dev_gossip_time ? &ld->dev_gossip_time: NULL, NULL),
 	    IFDEV(ld->dev_fast_gossip, false),
-	    IFDEV(ld->dev_fast_gossip_prune, false));
+	    IFDEV(ld->dev_fast_gossip_prune, false),
+	    ld->config.gossip_sigcheck_threads);
 	subd_send_msg(ld->gossip, msg);
 }
 
@@ -226,51 +234,330 @@ void gossipd_notify_spend(struct lightningd *ld,
 	subd_send_msg(ld->gossip, msg);
 }
 
+/*~ listnodes and listchannels can be asked for only some fields, which is
+ * a lot cheaper for (say) a plugin which only wants the short_channel_ids.
+ * The field names are exactly the JSON names. */
+enum listnodes_field {
+	LISTNODES_NODEID,
+	LISTNODES_ALIAS,
+	LISTNODES_COLOR,
+	LISTNODES_LAST_TIMESTAMP,
+	LISTNODES_FEATURES,
+	LISTNODES_ADDRESSES,
+};
+
+static const char *listnodes_fields[] = {
+	[LISTNODES_NODEID] = "nodeid",
+	[LISTNODES_ALIAS] = "alias",
+	[LISTNODES_COLOR] = "color",
+	[LISTNODES_LAST_TIMESTAMP] = "last_timestamp",
+	[LISTNODES_FEATURES] = "features",
+	[LISTNODES_ADDRESSES] = "addresses",
+};
+
+enum listchannels_field {
+	LISTCHANNELS_SOURCE,
+	LISTCHANNELS_DESTINATION,
+	LISTCHANNELS_SHORT_CHANNEL_ID,
+	LISTCHANNELS_PUBLIC,
+	LISTCHANNELS_AMOUNT_MSAT,
+	LISTCHANNELS_MESSAGE_FLAGS,
+	LISTCHANNELS_CHANNEL_FLAGS,
+	LISTCHANNELS_ACTIVE,
+	LISTCHANNELS_LAST_UPDATE,
+	LISTCHANNELS_BASE_FEE_MILLISATOSHI,
+	LISTCHANNELS_FEE_PER_MILLIONTH,
+	LISTCHANNELS_DELAY,
+	LISTCHANNELS_HTLC_MINIMUM_MSAT,
+	LISTCHANNELS_HTLC_MAXIMUM_MSAT,
+	LISTCHANNELS_FEATURES,
+};
+
+static const char *listchannels_fields[] = {
+	[LISTCHANNELS_SOURCE] = "source",
+	[LISTCHANNELS_DESTINATION] = "destination",
+	[LISTCHANNELS_SHORT_CHANNEL_ID] = "short_channel_id",
+	[LISTCHANNELS_PUBLIC] = "public",
+	/* This also controls the deprecated "satoshis" field */
+	[LISTCHANNELS_AMOUNT_MSAT] = "amount_msat",
+	[LISTCHANNELS_MESSAGE_FLAGS] = "message_flags",
+	[LISTCHANNELS_CHANNEL_FLAGS] = "channel_flags",
+	[LISTCHANNELS_ACTIVE] = "active",
+	[LISTCHANNELS_LAST_UPDATE] = "last_update",
+	[LISTCHANNELS_BASE_FEE_MILLISATOSHI] = "base_fee_millisatoshi",
+	[LISTCHANNELS_FEE_PER_MILLIONTH] = "fee_per_millionth",
+	[LISTCHANNELS_DELAY] = "delay",
+	[LISTCHANNELS_HTLC_MINIMUM_MSAT] = "htlc_minimum_msat",
+	[LISTCHANNELS_HTLC_MAXIMUM_MSAT] = "htlc_maximum_msat",
+	[LISTCHANNELS_FEATURES] = "features",
+};
+
+/* NULL fields means they didn't specify, so they want everything. */
+static bool want_field(const u32 *fields, unsigned int field)
+{
+	return !fields || (*fields & (1U << field));
+}
+
+static struct command_result *param_fields(struct command *cmd,
+					   const char *name,
+					   const char *buffer,
+					   const jsmntok_t *tok,
+					   const char **names,
+					   size_t num_names,
+					   u32 **fields)
+{
+	size_t i;
+	const jsmntok_t *t;
+
+	if (tok->type != JSMN_ARRAY)
+		return command_fail_badparam(cmd, name, buffer, tok,
+					     "should be an array of field names");
+
+	*fields = tal(cmd, u32);
+	**fields = 0;
+	json_for_each_arr(i, t, tok) {
+		size_t f;
+
+		for (f = 0; f < num_names; f++) {
+			if (json_tok_streq(buffer, t, names[f]))
+				break;
+		}
+		if (f == num_names)
+			return command_fail_badparam(cmd, name, buffer, t,
+						     "unknown field");
+		**fields |= (1U << f);
+	}
+	return NULL;
+}
+
+static struct command_result *param_listnodes_fields(struct command *cmd,
+						     const char *name,
+						     const char *buffer,
+						     const jsmntok_t *tok,
+						     u32 **fields)
+{
+	return param_fields(cmd, name, buffer, tok, listnodes_fields,
+			    ARRAY_SIZE(listnodes_fields), fields);
+}
+
+static struct command_result *param_listchannels_fields(struct command *cmd,
+							const char *name,
+							const char *buffer,
+							const jsmntok_t *tok,
+							u32 **fields)
+{
+	return param_fields(cmd, name, buffer, tok, listchannels_fields,
+			    ARRAY_SIZE(listchannels_fields), fields);
+}
+
+/*~ For listnodes and listchannels, rather than have gossipd marshal the
+ * whole network to us in one message, we map its gossip_store ourselves
+ * and write the JSON a slice at a time, as the client drains it.  gossipd
+ * still has to flush the store first (and tell us which of our channels
+ * it has locally disabled, since that's not in the store).
+ *
+ * If we can't map the store for some reason, we ask gossipd for it. */
+#define GOSSMAP_SLICE 1000
+
+static struct gossmap *get_gossmap(struct lightningd *ld)
+{
+	if (!ld->gossmap) {
+		ld->gossmap = gossmap_load(ld, GOSSIP_STORE_FILENAME);
+		if (!ld->gossmap) {
+			log_unusual(ld->log, "Could not map %s: %s",
+				    GOSSIP_STORE_FILENAME, strerror(errno));
+			return NULL;
+		}
+		notleak_with_children(ld->gossmap);
+	} else
+		gossmap_refresh(ld->gossmap);
+	return ld->gossmap;
+}
+
+static void json_add_node_entry(struct json_stream *response,
+				const struct gossip_getnodes_entry *e,
+				const u32 *fields)
+{
+	json_object_start(response, NULL);
+	if (want_field(fields, LISTNODES_NODEID))
+		json_add_node_id(response, "nodeid", &e->nodeid);
+	if (e->last_timestamp < 0) {
+		json_object_end(response);
+		return;
+	}
+	if (want_field(fields, LISTNODES_ALIAS)) {
+		struct json_escape *esc;
+		esc = json_escape(NULL,
+				  take(tal_strndup(NULL,
+						   (const char *)e->alias,
+						   ARRAY_SIZE(e->alias))));
+		json_add_escaped_string(response, "alias", take(esc));
+	}
+	if (want_field(fields, LISTNODES_COLOR))
+		json_add_hex(response, "color", e->color, ARRAY_SIZE(e->color));
+	if (want_field(fields, LISTNODES_LAST_TIMESTAMP))
+		json_add_u64(response, "last_timestamp", e->last_timestamp);
+	if (want_field(fields, LISTNODES_FEATURES))
+		json_add_hex_talarr(response, "features", e->features);
+	if (want_field(fields, LISTNODES_ADDRESSES)) {
+		json_array_start(response, "addresses");
+		for (size_t i = 0; i < tal_count(e->addresses); i++)
+			json_add_address(response, NULL, &e->addresses[i]);
+		json_array_end(response);
+	}
+	json_object_end(response);
+}
+
+struct listnodes_info {
+	struct command *cmd;
+	struct json_stream *response;
+	struct node_id *id;
+	u32 *fields;
+	/* Index of the next node to print, or 0 to start.  A next node
+	 * always follows one we printed, so its index is never 0: we resume
+	 * from the one after index next_idx - 1 (which may since be freed). */
+	u32 next_idx;
+};
+
 static void json_getnodes_reply(struct subd *gossip UNUSED, const u8 *reply,
 				const int *fds UNUSED,
-				struct command *cmd)
+				struct listnodes_info *linfo)
 {
 	struct gossip_getnodes_entry **nodes;
 	struct json_stream *response;
-	size_t i, j;
 
 	if (!fromwire_gossipd_getnodes_reply(reply, reply, &nodes)) {
-		was_pending(command_fail(cmd, LIGHTNINGD,
+		was_pending(command_fail(linfo->cmd, LIGHTNINGD,
 					 "Malformed gossip_getnodes response"));
 		return;
 	}
 
-	response = json_stream_success(cmd);
+	response = json_stream_success(linfo->cmd);
 	json_array_start(response, "nodes");
+	for (size_t i = 0; i < tal_count(nodes); i++)
+		json_add_node_entry(response, nodes[i], linfo->fields);
+	json_array_end(response);
+	was_pending(command_success(linfo->cmd, response));
+}
 
-	for (i = 0; i < tal_count(nodes); i++) {
-		struct json_escape *esc;
-
-		json_object_start(response, NULL);
-		json_add_node_id(response, "nodeid", &nodes[i]->nodeid);
-		if (nodes[i]->last_timestamp < 0) {
-			json_object_end(response);
-			continue;
-		}
-		esc = json_escape(NULL,
-				  take(tal_strndup(NULL,
-						   (const char *)nodes[i]->alias,
-						   ARRAY_SIZE(nodes[i]->alias))));
-		json_add_escaped_string(response, "alias", take(esc));
-		json_add_hex(response, "color",
-			     nodes[i]->color, ARRAY_SIZE(nodes[i]->color));
-		json_add_u64(response, "last_timestamp",
-			     nodes[i]->last_timestamp);
-		json_add_hex_talarr(response, "features", nodes[i]->features);
-		json_array_start(response, "addresses");
-		for (j=0; j<tal_count(nodes[i]->addresses); j++) {
-			json_add_address(response, NULL, &nodes[i]->addresses[j]);
+/* Same as gossipd's read_addresses, but we don't log. */
+static struct wireaddr *parse_node_addresses(const tal_t *ctx, const u8 *ser)
+{
+	const u8 *cursor = ser;
+	size_t len = tal_count(ser);
+	struct wireaddr *wireaddrs = tal_arr(ctx, struct wireaddr, 0);
+
+	while (cursor && len) {
+		struct wireaddr wireaddr;
+
+		if (!fromwire_wireaddr(&cursor, &len, &wireaddr)) {
+			/* Parsing address failed */
+			if (!cursor)
+				return tal_free(wireaddrs);
+			/* Unknown type, stop there. */
+			break;
 		}
-		json_array_end(response);
-		json_object_end(response);
+		tal_arr_expand(&wireaddrs, wireaddr);
+	}
+	return wireaddrs;
+}
+
+static void json_add_gossmap_node(struct json_stream *response,
+				  const struct gossmap *map,
+				  const struct gossmap_node *n,
+				  const u32 *fields)
+{
+	struct gossip_getnodes_entry e;
+	secp256k1_ecdsa_signature signature;
+	struct node_id id;
+	u32 timestamp;
+	u8 *nannounce, *addresses;
+
+	gossmap_node_get_id(map, n, &e.nodeid);
+	e.last_timestamp = -1;
+	e.addresses = NULL;
+	nannounce = gossmap_node_get_announce(tmpctx, map, n);
+	if (nannounce
+	    && fromwire_node_announcement(tmpctx, nannounce, &signature,
+					  &e.features, &timestamp, &id,
+					  e.color, e.alias, &addresses)) {
+		e.last_timestamp = timestamp;
+		if (want_field(fields, LISTNODES_ADDRESSES))
+			e.addresses = parse_node_addresses(tmpctx, addresses);
+	}
+	json_add_node_entry(response, &e, fields);
+}
+
+static void listnodes_more(struct json_stream *response,
+			   struct listnodes_info *linfo)
+{
+	const struct gossmap *map = linfo->cmd->ld->gossmap;
+	struct gossmap_node *n;
+
+	if (linfo->next_idx == 0)
+		n = gossmap_first_node(map);
+	else if (linfo->next_idx > gossmap_max_node_idx(map))
+		n = NULL;
+	else
+		n = gossmap_next_node(map,
+				      gossmap_node_byidx(map,
+							 linfo->next_idx - 1));
+
+	/* If they've gone away, there's no point going on. */
+	if (!linfo->cmd->jcon)
+		n = NULL;
+
+	for (size_t i = 0; n && i < GOSSMAP_SLICE; i++) {
+		json_add_gossmap_node(response, map, n, linfo->fields);
+		n = gossmap_next_node(map, n);
+	}
+
+	if (n) {
+		linfo->next_idx = gossmap_node_idx(map, n);
+		json_stream_when_drained(response, listnodes_more, linfo);
+		return;
 	}
+
 	json_array_end(response);
-	was_pending(command_success(cmd, response));
+	was_pending(command_success(linfo->cmd, response));
+}
+
+static void listnodes_synced(struct subd *gossip UNUSED, const u8 *reply,
+			     const int *fds UNUSED,
+			     struct listnodes_info *linfo)
+{
+	struct short_channel_id *local_disabled;
+	struct gossmap *map;
+
+	if (!fromwire_gossipd_sync_store_reply(tmpctx, reply,
+					       &local_disabled)) {
+		was_pending(command_fail(linfo->cmd, LIGHTNINGD,
+					 "Malformed gossip_sync_store response"));
+		return;
+	}
+
+	map = get_gossmap(linfo->cmd->ld);
+	if (!map) {
+		subd_req(linfo->cmd, linfo->cmd->ld->gossip,
+			 take(towire_gossipd_getnodes_request(NULL, linfo->id)),
+			 -1, 0, json_getnodes_reply, linfo);
+		return;
+	}
+
+	linfo->response = json_stream_success(linfo->cmd);
+	json_array_start(linfo->response, "nodes");
+	if (linfo->id) {
+		const struct gossmap_node *n = gossmap_find_node(map, linfo->id);
+		if (n)
+			json_add_gossmap_node(linfo->response, map, n,
+					      linfo->fields);
+		json_array_end(linfo->response);
+		was_pending(command_success(linfo->cmd, linfo->response));
+		return;
+	}
+
+	linfo->next_idx = 0;
+	listnodes_more(linfo->response, linfo);
 }
 
 static struct command_result *json_listnodes(struct command *cmd,
@@ -278,16 +565,18 @@ static struct command_result *json_listnodes(struct command *cmd,
 					     const jsmntok_t *obj UNNEEDED,
 					     const jsmntok_t *params)
 {
-	u8 *req;
-	struct node_id *id;
+	struct listnodes_info *linfo = tal(cmd, struct listnodes_info);
 
+	linfo->cmd = cmd;
 	if (!param(cmd, buffer, params,
-		   p_opt("id", param_node_id, &id),
+		   p_opt("id", param_node_id, &linfo->id),
+		   p_opt("fields", param_listnodes_fields, &linfo->fields),
 		   NULL))
 		return command_param_failed();
 
-	req = towire_gossipd_getnodes_request(cmd, id);
-	subd_req(cmd, cmd->ld->gossip, req, -1, 0, json_getnodes_reply, cmd);
+	subd_req(cmd, cmd->ld->gossip,
+		 take(towire_gossipd_sync_store(NULL)),
+		 -1, 0, listnodes_synced, linfo);
 	return command_still_pending(cmd);
 }
 
@@ -295,7 +584,8 @@ static const struct json_command listnodes_command = {
 	"listnodes",
 	"network",
 	json_listnodes,
-	"Show node {id} (or all, if no {id}), in our local network view"
+	"Show node {id} (or all, if no {id}), in our local network view, "
+	"only showing {fields} if specified"
 };
 AUTODATA(json_command, &listnodes_command);
 
@@ -452,34 +742,101 @@ static const struct json_command getroute_command = {
 };
 AUTODATA(json_command, &getroute_command);
 
+static void json_getroutecache_reply(struct subd *gossip UNUSED,
+				     const u8 *reply, const int *fds UNUSED,
+				     struct command *cmd)
+{
+	struct json_stream *response;
+	u32 entries;
+	u64 hits, misses;
+
+	if (!fromwire_gossipd_get_route_cache_stats_reply(reply, &entries,
+							  &hits, &misses)) {
+		was_pending(command_fail(cmd, LIGHTNINGD,
+					 "Gossip gave bad get_route_cache_stats_reply"));
+		return;
+	}
+
+	response = json_stream_success(cmd);
+	json_add_num(response, "entries", entries);
+	json_add_u64(response, "hits", hits);
+	json_add_u64(response, "misses", misses);
+	was_pending(command_success(cmd, response));
+}
+
+static struct command_result *json_getroutecache(struct command *cmd,
+						 const char *buffer,
+						 const jsmntok_t *obj UNNEEDED,
+						 const jsmntok_t *params)
+{
+	u8 *req;
+
+	if (!param(cmd, buffer, params, NULL))
+		return command_param_failed();
+
+	req = towire_gossipd_get_route_cache_stats(NULL);
+	subd_req(cmd->ld->gossip, cmd->ld->gossip, take(req), -1, 0,
+		 json_getroutecache_reply, cmd);
+	return command_still_pending(cmd);
+}
+
+static const struct json_command getroutecache_command = {
+	"getroutecache",
+	"channels",
+	json_getroutecache,
+	"Show how many routes getroute has cached, and how often they were used."
+};
+AUTODATA(json_command, &getroutecache_command);
+
 static void json_add_halfchan(struct json_stream *response,
 			      const struct gossip_getchannels_entry *e,
-			      int idx)
+			      int idx,
+			      const u32 *fields)
 {
 	const struct gossip_halfchannel_entry *he = e->e[idx];
 	if (!he)
 		return;
 
 	json_object_start(response, NULL);
-	json_add_node_id(response, "source", &e->node[idx]);
-	json_add_node_id(response, "destination", &e->node[!idx]);
-	json_add_short_channel_id(response, "short_channel_id",
-				  &e->short_channel_id);
-	json_add_bool(response, "public", e->public);
-	json_add_amount_sat_compat(response, e->sat,
-				   "satoshis", "amount_msat");
-	json_add_num(response, "message_flags", he->message_flags);
-	json_add_num(response, "channel_flags", he->channel_flags);
-	json_add_bool(response, "active",
-		      !(he->channel_flags & ROUTING_FLAGS_DISABLED)
-		      && !e->local_disabled);
-	json_add_num(response, "last_update", he->last_update_timestamp);
-	json_add_num(response, "base_fee_millisatoshi", he->base_fee_msat);
-	json_add_num(response, "fee_per_millionth", he->fee_per_millionth);
-	json_add_num(response, "delay", he->delay);
-	json_add_amount_msat_only(response, "htlc_minimum_msat", he->min);
-	json_add_amount_msat_only(response, "htlc_maximum_msat", he->max);
-	json_add_hex_talarr(response, "features", e->features);
+	if (want_field(fields, LISTCHANNELS_SOURCE))
+		json_add_node_id(response, "source", &e->node[idx]);
+	if (want_field(fields, LISTCHANNELS_DESTINATION))
+		json_add_node_id(response, "destination", &e->node[!idx]);
+	if (want_field(fields, LISTCHANNELS_SHORT_CHANNEL_ID))
+		json_add_short_channel_id(response, "short_channel_id",
+					  &e->short_channel_id);
+	if (want_field(fields, LISTCHANNELS_PUBLIC))
+		json_add_bool(response, "public", e->public);
+	if (want_field(fields, LISTCHANNELS_AMOUNT_MSAT))
+		json_add_amount_sat_compat(response, e->sat,
+					   "satoshis", "amount_msat");
+	if (want_field(fields, LISTCHANNELS_MESSAGE_FLAGS))
+		json_add_num(response, "message_flags", he->message_flags);
+	if (want_field(fields, LISTCHANNELS_CHANNEL_FLAGS))
+		json_add_num(response, "channel_flags", he->channel_flags);
+	if (want_field(fields, LISTCHANNELS_ACTIVE))
+		json_add_bool(response, "active",
+			      !(he->channel_flags & ROUTING_FLAGS_DISABLED)
+			      && !e->local_disabled);
+	if (want_field(fields, LISTCHANNELS_LAST_UPDATE))
+		json_add_num(response, "last_update",
+			     he->last_update_timestamp);
+	if (want_field(fields, LISTCHANNELS_BASE_FEE_MILLISATOSHI))
+		json_add_num(response, "base_fee_millisatoshi",
+			     he->base_fee_msat);
+	if (want_field(fields, LISTCHANNELS_FEE_PER_MILLIONTH))
+		json_add_num(response, "fee_per_millionth",
+			     he->fee_per_millionth);
+	if (want_field(fields, LISTCHANNELS_DELAY))
+		json_add_num(response, "delay", he->delay);
+	if (want_field(fields, LISTCHANNELS_HTLC_MINIMUM_MSAT))
+		json_add_amount_msat_only(response, "htlc_minimum_msat",
+					  he->min);
+	if (want_field(fields, LISTCHANNELS_HTLC_MAXIMUM_MSAT))
+		json_add_amount_msat_only(response, "htlc_maximum_msat",
+					  he->max);
+	if (want_field(fields, LISTCHANNELS_FEATURES))
+		json_add_hex_talarr(response, "features", e->features);
 	json_object_end(response);
 }
 
@@ -488,6 +845,12 @@ struct listchannels_info {
 	struct json_stream *response;
 	struct short_channel_id *id;
 	struct node_id *source;
+	u32 *fields;
+	/* What gossipd told us it has disabled. */
+	struct short_channel_id *local_disabled;
+	/* Index of the next channel to print, or 0 to start (see
+	 * listnodes_info). */
+	u32 next_idx;
 };
 
 /* Called upon receiving a getchannels_reply from `gossipd` */
@@ -508,8 +871,10 @@ static void json_listchannels_reply(struct subd *gossip UNUSED, const u8 *reply,
 	}
 
 	for (i = 0; i < tal_count(entries); i++) {
-		json_add_halfchan(linfo->response, entries[i], 0);
-		json_add_halfchan(linfo->response, entries[i], 1);
+		json_add_halfchan(linfo->response, entries[i], 0,
+				  linfo->fields);
+		json_add_halfchan(linfo->response, entries[i], 1,
+				  linfo->fields);
 	}
 
 	/* More coming?  Ask from this point on.. */
@@ -529,18 +894,167 @@ static void json_listchannels_reply(struct subd *gossip UNUSED, const u8 *reply,
 	}
 }
 
+/* This is the same as gossipd's append_channel, from the gossmap. */
+static void json_add_gossmap_chan(struct json_stream *response,
+				  const struct listchannels_info *linfo,
+				  const struct gossmap *map,
+				  struct gossmap_chan *c)
+{
+	struct gossip_getchannels_entry e;
+	struct gossip_halfchannel_entry he[2];
+
+	e.short_channel_id = gossmap_chan_scid(map, c);
+	e.public = !gossmap_chan_is_private(map, c);
+	if (!gossmap_chan_get_capacity(map, c, &e.sat))
+		e.sat = AMOUNT_SAT(0);
+	e.local_disabled = false;
+	for (size_t i = 0; i < tal_count(linfo->local_disabled); i++) {
+		if (short_channel_id_eq(&linfo->local_disabled[i],
+					&e.short_channel_id)) {
+			e.local_disabled = true;
+			break;
+		}
+	}
+	if (want_field(linfo->fields, LISTCHANNELS_FEATURES))
+		e.features = gossmap_chan_get_features(tmpctx, map, c);
+	else
+		e.features = NULL;
+
+	for (int dir = 0; dir < 2; dir++) {
+		u32 timestamp, fee_base_msat, fee_proportional_millionths;
+		u16 cltv_expiry_delta;
+
+		gossmap_node_get_id(map, gossmap_nth_node(map, c, dir),
+				    &e.node[dir]);
+		e.e[dir] = NULL;
+		if (!gossmap_chan_has_update(c, dir))
+			continue;
+		if (linfo->source && !node_id_eq(&e.node[dir], linfo->source))
+			continue;
+
+		/* No htlc_maximum_msat means capacity, which gossipd
+		 * trims like this too. */
+		if (!amount_sat_to_msat(&he[dir].max, e.sat))
+			he[dir].max = chainparams->max_payment;
+		gossmap_chan_get_update_details(map, c, dir,
+						&timestamp,
+						&he[dir].message_flags,
+						&he[dir].channel_flags,
+						&cltv_expiry_delta,
+						&fee_base_msat,
+						&fee_proportional_millionths,
+						&he[dir].min,
+						&he[dir].max);
+		if (amount_msat_greater(he[dir].max,
+					chainparams->max_payment))
+			he[dir].max = chainparams->max_payment;
+		he[dir].last_update_timestamp = timestamp;
+		he[dir].delay = cltv_expiry_delta;
+		he[dir].base_fee_msat = fee_base_msat;
+		he[dir].fee_per_millionth = fee_proportional_millionths;
+		e.e[dir] = &he[dir];
+	}
+
+	json_add_halfchan(response, &e, 0, linfo->fields);
+	json_add_halfchan(response, &e, 1, linfo->fields);
+}
+
+static void listchannels_more(struct json_stream *response,
+			      struct listchannels_info *linfo)
+{
+	const struct gossmap *map = linfo->cmd->ld->gossmap;
+	struct gossmap_chan *c;
+
+	if (linfo->next_idx == 0)
+		c = gossmap_first_chan(map);
+	else if (linfo->next_idx > gossmap_max_chan_idx(map))
+		c = NULL;
+	else
+		c = gossmap_next_chan(map,
+				      gossmap_chan_byidx(map,
+							 linfo->next_idx - 1));
+
+	/* If they've gone away, there's no point going on. */
+	if (!linfo->cmd->jcon)
+		c = NULL;
+
+	for (size_t i = 0; c && i < GOSSMAP_SLICE; i++) {
+		json_add_gossmap_chan(response, linfo, map, c);
+		c = gossmap_next_chan(map, c);
+	}
+
+	if (c) {
+		linfo->next_idx = gossmap_chan_idx(map, c);
+		json_stream_when_drained(response, listchannels_more, linfo);
+		return;
+	}
+
+	json_array_end(response);
+	was_pending(command_success(linfo->cmd, response));
+}
+
+static void listchannels_synced(struct subd *gossip UNUSED, const u8 *reply,
+				const int *fds UNUSED,
+				struct listchannels_info *linfo)
+{
+	struct gossmap *map;
+
+	if (!fromwire_gossipd_sync_store_reply(linfo, reply,
+					       &linfo->local_disabled)) {
+		was_pending(command_fail(linfo->cmd, LIGHTNINGD,
+					 "Malformed gossip_sync_store response"));
+		return;
+	}
+
+	/* Start JSON response, then we stream. */
+	linfo->response = json_stream_success(linfo->cmd);
+	json_array_start(linfo->response, "channels");
+
+	map = get_gossmap(linfo->cmd->ld);
+	if (!map) {
+		u8 *req = towire_gossipd_getchannels_request(linfo->cmd,
+							     linfo->id,
+							     linfo->source,
+							     NULL);
+		subd_req(linfo->cmd->ld->gossip, linfo->cmd->ld->gossip,
+			 req, -1, 0, json_listchannels_reply, linfo);
+		return;
+	}
+
+	if (linfo->id) {
+		struct gossmap_chan *c = gossmap_find_chan(map, linfo->id);
+		if (c)
+			json_add_gossmap_chan(linfo->response, linfo, map, c);
+	} else if (linfo->source) {
+		const struct gossmap_node *n;
+
+		n = gossmap_find_node(map, linfo->source);
+		for (size_t i = 0; n && i < n->num_chans; i++)
+			json_add_gossmap_chan(linfo->response, linfo, map,
+					      gossmap_nth_chan(map, n, i,
+							       NULL));
+	} else {
+		linfo->next_idx = 0;
+		listchannels_more(linfo->response, linfo);
+		return;
+	}
+
+	json_array_end(linfo->response);
+	was_pending(command_success(linfo->cmd, linfo->response));
+}
+
 static struct command_result *json_listchannels(struct command *cmd,
 						const char *buffer,
 						const jsmntok_t *obj UNNEEDED,
 						const jsmntok_t *params)
 {
-	u8 *req;
 	struct listchannels_info *linfo = tal(cmd, struct listchannels_info);
 
 	linfo->cmd = cmd;
 	if (!param(cmd, buffer, params,
 		   p_opt("short_channel_id", param_short_channel_id, &linfo->id),
 		   p_opt("source", param_node_id, &linfo->source),
+		   p_opt("fields", param_listchannels_fields, &linfo->fields),
 		   NULL))
 		return command_param_failed();
 
@@ -548,15 +1062,9 @@ static struct command_result *json_listchannels(struct command *cmd,
 		return command_fail(cmd, JSONRPC2_INVALID_PARAMS,
 				    "Cannot specify both source and short_channel_id");
 
-	/* Start JSON response, then we stream. */
-	linfo->response = json_stream_success(cmd);
-	json_array_start(linfo->response, "channels");
-
-	req = towire_gossipd_getchannels_request(cmd, linfo->id, linfo->source,
-						NULL);
-	subd_req(cmd->ld->gossip, cmd->ld->gossip,
-		 req, -1, 0, json_listchannels_reply, linfo);
-
+	subd_req(cmd, cmd->ld->gossip,
+		 take(towire_gossipd_sync_store(NULL)),
+		 -1, 0, listchannels_synced, linfo);
 	return command_still_pending(cmd);
 }
 
@@ -564,7 +1072,8 @@ static const struct json_command listchannels_command = {
 	"listchannels",
 	"channels",
 	json_listchannels,
-	"Show channel {short_channel_id} or {source} (or all known channels, if not specified)"
+	"Show channel {short_channel_id} or {source} (or all known channels, if not specified), "
+	"only showing {fields} if specified"
 };
 AUTODATA(json_command, &listchannels_command);
 
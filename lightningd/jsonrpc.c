@@ -157,6 +157,10 @@ static void destroy_jcon(struct json_connection *jcon)
 	list_for_each(&jcon->commands, c, list)
 		c->jcon = NULL;
 
+	/* Nobody will drain these now: don't leave their writers waiting. */
+	for (size_t i = 0; i < tal_count(jcon->js_arr); i++)
+		json_stream_drained(jcon->js_arr[i]);
+
 	/* Make sure this happens last! */
 	tal_free(jcon->log);
 }
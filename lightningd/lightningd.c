@@ -172,6 +172,11 @@ static struct lightningd *new_lightningd(const tal_t *ctx)
 	htlc_in_map_init(&ld->htlcs_in);
 	htlc_out_map_init(&ld->htlcs_out);
 
+	/*~ With --group-commit-ms, commitment updates from channeld wait here
+	 * briefly, so several channels can share a database commit. */
+	list_head_init(&ld->group_commit);
+	ld->group_commit_timer = NULL;
+
 	/*~ For multi-part payments, we need to keep some incoming payments
 	 * in limbo until we get all the parts, or we time them out. */
 	htlc_set_map_init(&ld->htlc_sets);
@@ -232,6 +237,9 @@ static struct lightningd *new_lightningd(const tal_t *ctx)
 	 * so set it to NULL explicitly now. */
 	ld->wallet = NULL;
 
+	/*~ We only map the gossip_store once someone asks for it. */
+	ld->gossmap = NULL;
+
 	/*~ In the next step we will initialize the plugins. This will
 	 *  also populate the JSON-RPC with passthrough methods, hence
 	 *  lightningd needs to have something to put those in. This
@@ -261,6 +269,18 @@ static struct lightningd *new_lightningd(const tal_t *ctx)
 	 */
 	ld->encrypted_hsm = false;
 
+	/*~ By default, we wait for the db_write hook (if any) to answer
+	 * before committing each transaction. */
+	ld->db_write_pipeline = 0;
+
+	/*~ We leave sqlite3's journal, cache and mmap settings alone unless
+	 * told otherwise (see db_sqlite3_setup). */
+	ld->sqlite3_opts.journal_mode = NULL;
+	ld->sqlite3_opts.synchronous = NULL;
+	ld->sqlite3_opts.checkpoint_sec = 0;
+	ld->sqlite3_opts.cache_size_kb = 0;
+	ld->sqlite3_opts.mmap_size = 0;
+
 	/* This is used to override subdaemons */
 	strmap_init(&ld->alt_subdaemons);
 	tal_add_destructor(ld, destroy_alt_subdaemons);
@@ -1035,6 +1055,11 @@ int main(int argc, char *argv[])
 
 	shutdown_subdaemons(ld);
 
+	/* Make sure the db_write hook has everything before it goes. */
+	db_begin_transaction(ld->wallet->db);
+	db_sync_writes(ld->wallet->db);
+	db_commit_transaction(ld->wallet->db);
+
 	/* Remove plugins. */
 	plugins_free(ld->plugins);
 
@@ -42,6 +42,10 @@ struct config {
 	/* How long between changing commit and sending COMMIT message. */
 	u32 commit_time_ms;
 
+	/* How long to gather channels' commitment updates into one db
+	 * transaction (0 means each gets its own). */
+	u32 group_commit_ms;
+
 	/* Do we let the opener set any fee rate they want */
 	bool ignore_fee_limits;
 
@@ -66,6 +70,12 @@ struct config {
 
 	/* How long before we give up waiting for INIT msg */
 	u32 connection_timeout_secs;
+
+	/* How many threads gossipd uses to check gossip signatures */
+	u32 gossip_sigcheck_threads;
+
+	/* How much gossip we send to a peer in one write */
+	u32 gossip_batch_bytes;
 };
 
 typedef STRMAP(const char *) alt_subdaemon_map;
@@ -151,6 +161,10 @@ struct lightningd {
 	/* Daemon for routing */
  	struct subd *gossip;
 
+	/* Our own view of gossipd's gossip_store, for listchannels and
+	 * listnodes (NULL until first used). */
+	struct gossmap *gossmap;
+
 	/* Daemon looking after peers during init / before channel. */
 	struct subd *connectd;
 
@@ -167,6 +181,11 @@ struct lightningd {
 	struct htlc_in_map htlcs_in;
 	struct htlc_out_map htlcs_out;
 
+	/* channeld commitment updates waiting to share a db transaction, and
+	 * the timer which will handle them. */
+	struct list_head group_commit;
+	struct oneshot *group_commit_timer;
+
 	/* Sets of HTLCs we are holding onto for MPP. */
 	struct htlc_set_map htlc_sets;
 
@@ -256,6 +275,13 @@ struct lightningd {
 
 	char *wallet_dsn;
 
+	/* How many db_write hook calls can be unanswered (0 means we wait
+	 * for each one)? */
+	u32 db_write_pipeline;
+
+	/* How to tune sqlite3, if that's what wallet_dsn uses. */
+	struct db_sqlite3_opts sqlite3_opts;
+
 	bool encrypted_hsm;
 
 	mode_t initial_umask;
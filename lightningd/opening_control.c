@@ -209,6 +209,10 @@ wallet_commit_channel(struct lightningd *ld,
 	/* Now we finally put it in the database. */
 	wallet_channel_insert(ld->wallet, channel);
 
+	/* The peer may use it once we hand it to channeld, so make sure the
+	 * db_write hook has it too before we commit. */
+	db_sync_writes(ld->wallet->db);
+
 	return channel;
 }
 
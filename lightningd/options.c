@@ -13,6 +13,7 @@
 #include <common/channel_id.h>
 #include <common/derive_basepoints.h>
 #include <common/features.h>
+#include <common/gossip_store.h>
 #include <common/json_command.h>
 #include <common/jsonrpc_errors.h>
 #include <common/memleak.h>
@@ -130,6 +131,19 @@ static char *opt_set_mode(const char *arg, mode_t *m)
 	return NULL;
 }
 
+/* sqlite3 quietly treats any level it doesn't know as "normal", which
+ * isn't safe for channel state: so insist on one it knows. */
+static char *opt_set_sqlite3_synchronous(const char *arg, char **p)
+{
+	const char *levels[] = { "off", "normal", "full", "extra" };
+
+	for (size_t i = 0; i < ARRAY_SIZE(levels); i++) {
+		if (streq(arg, levels[i]))
+			return opt_set_talstr(arg, p);
+	}
+	return tal_fmt(NULL, "'%s' is not off, normal, full or extra", arg);
+}
+
 static char *opt_add_addr_withtype(const char *arg,
 				   struct lightningd *ld,
 				   enum addr_listen_announce ala,
@@ -620,6 +634,9 @@ static const struct config testnet_config = {
 	/* Send commit 10msec after receiving; almost immediately. */
 	.commit_time_ms = 10,
 
+	/* Commit each channel's updates as they arrive. */
+	.group_commit_ms = 0,
+
 	/* Allow dust payments */
 	.fee_base = 1,
 	/* Take 0.001% */
@@ -640,6 +657,10 @@ static const struct config testnet_config = {
 
 	/* 1 minute should be enough for anyone! */
 	.connection_timeout_secs = 60,
+
+	.gossip_sigcheck_threads = 4,
+
+	.gossip_batch_bytes = GOSSIP_STORE_BATCH_BYTES,
 };
 
 /* aka. "Dude, where's my coins?" */
@@ -674,6 +695,9 @@ static const struct config mainnet_config = {
 	/* Send commit 10msec after receiving; almost immediately. */
 	.commit_time_ms = 10,
 
+	/* Commit each channel's updates as they arrive. */
+	.group_commit_ms = 0,
+
 	/* Discourage dust payments */
 	.fee_base = 1000,
 	/* Take 0.001% */
@@ -695,6 +719,10 @@ static const struct config mainnet_config = {
 
 	/* 1 minute should be enough for anyone! */
 	.connection_timeout_secs = 60,
+
+	.gossip_sigcheck_threads = 4,
+
+	.gossip_batch_bytes = GOSSIP_STORE_BATCH_BYTES,
 };
 
 static void check_config(struct lightningd *ld)
@@ -710,6 +738,8 @@ static void check_config(struct lightningd *ld)
 		      ld->config.max_concurrent_htlcs);
 	if (ld->config.anchor_confirms == 0)
 		fatal("anchor-confirms must be greater than zero");
+	if (ld->config.gossip_batch_bytes == 0)
+		fatal("--gossip-batch-bytes must be greater than zero");
 
 	if (ld->use_proxy_always && !ld->proxyaddr)
 		fatal("--always-use-proxy needs --proxy");
@@ -817,6 +847,31 @@ static void register_opts(struct lightningd *ld)
 	opt_register_early_arg("--wallet", opt_set_talstr, NULL,
 			       &ld->wallet_dsn,
 			       "Location of the wallet database.");
+	opt_register_arg("--db-write-pipeline", opt_set_u32, opt_show_u32,
+			 &ld->db_write_pipeline,
+			 "Number of db_write hook calls we can commit without "
+			 "waiting for them to be answered (we always wait "
+			 "before sending commitments or revocations)");
+	opt_register_arg("--sqlite3-journal-mode", opt_set_talstr, NULL,
+			 &ld->sqlite3_opts.journal_mode,
+			 "sqlite3 journal mode (e.g. wal)");
+	opt_register_arg("--sqlite3-synchronous", opt_set_sqlite3_synchronous,
+			 NULL, &ld->sqlite3_opts.synchronous,
+			 "sqlite3 synchronous level: off, normal, full or extra "
+			 "(default full)");
+	opt_register_arg("--sqlite3-checkpoint-sec", opt_set_u32, opt_show_u32,
+			 &ld->sqlite3_opts.checkpoint_sec,
+			 "In WAL mode, checkpoint from a background thread "
+			 "every this many seconds (0 means sqlite3 does it "
+			 "during commits)");
+	opt_register_arg("--sqlite3-cache-size", opt_set_u64, opt_show_u64,
+			 &ld->sqlite3_opts.cache_size_kb,
+			 "sqlite3 page cache size in KiB (0 means sqlite3's "
+			 "default)");
+	opt_register_arg("--sqlite3-mmap-size", opt_set_u64, opt_show_u64,
+			 &ld->sqlite3_opts.mmap_size,
+			 "Bytes of the sqlite3 database to access through mmap "
+			 "(0 means sqlite3's default)");
 
 	/* This affects our features, so set early. */
 	opt_register_early_noarg("--large-channels|--wumbo",
@@ -856,6 +911,16 @@ static void register_opts(struct lightningd *ld)
 			 opt_set_u32, opt_show_u32,
 			 &ld->config.commit_time_ms,
 			 "Time after changes before sending out COMMIT");
+	opt_register_arg("--group-commit-ms", opt_set_u32, opt_show_u32,
+			 &ld->config.group_commit_ms,
+			 "Time to gather channels' commitment updates into one "
+			 "database commit (0 = commit each at once)");
+	opt_register_arg("--gossip-sigcheck-threads", opt_set_u32, opt_show_u32,
+			 &ld->config.gossip_sigcheck_threads,
+			 "Threads for checking gossip signatures (0 = none)");
+	opt_register_arg("--gossip-batch-bytes", opt_set_u32, opt_show_u32,
+			 &ld->config.gossip_batch_bytes,
+			 "Most gossip to send a peer in one write");
 	opt_register_arg("--fee-base", opt_set_u32, opt_show_u32,
 			 &ld->config.fee_base,
 			 "Millisatoshi minimum to charge for HTLC");
@@ -1265,6 +1330,7 @@ static void add_config(struct lightningd *ld,
 				answer = buf;
 		} else if (opt->cb_arg == (void *)opt_set_talstr
 			   || opt->cb_arg == (void *)opt_set_charp
+			   || opt->cb_arg == (void *)opt_set_sqlite3_synchronous
 			   || is_restricted_print_if_nonnull(opt->cb_arg)) {
 			const char *arg = *(char **)opt->u.carg;
 			if (arg)
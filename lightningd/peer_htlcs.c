@@ -1754,7 +1754,9 @@ void peer_sending_commitsig(struct channel *channel, const u8 *msg)
 	if (pbase)
 		wallet_penalty_base_add(ld->wallet, channel->dbid, pbase);
 
-	/* Tell it we've got it, and to go ahead with commitment_signed. */
+	/* Tell it we've got it, and to go ahead with commitment_signed
+	 * (once the db_write hook has it too). */
+	db_sync_writes(ld->wallet->db);
 	subd_send_msg(channel->owner,
 		      take(towire_channeld_sending_commitsig_reply(msg)));
 }
@@ -1976,7 +1978,9 @@ void peer_got_commitsig(struct channel *channel, const u8 *msg)
 	wallet_htlc_sigs_save(ld->wallet, channel->dbid,
 			      channel->last_htlc_sigs);
 
-	/* Tell it we've committed, and to go ahead with revoke. */
+	/* Tell it we've committed, and to go ahead with revoke (once the
+	 * db_write hook has it too). */
+	db_sync_writes(ld->wallet->db);
 	msg = towire_channeld_got_commitsig_reply(msg);
 	subd_send_msg(channel->owner, take(msg));
 }
@@ -2152,6 +2156,68 @@ void peer_got_revoke(struct channel *channel, const u8 *msg)
 	plugin_hook_call_commitment_revocation(ld, payload);
 }
 
+/* A channeld update waiting to share a db transaction with others. */
+struct group_commit_update {
+	struct list_node list;
+	struct lightningd *ld;
+	struct channel *channel;
+	const u8 *msg;
+	void (*handle)(struct channel *channel, const u8 *msg);
+};
+
+static void destroy_group_commit_update(struct group_commit_update *gcu)
+{
+	list_del_from(&gcu->ld->group_commit, &gcu->list);
+}
+
+/* Timers run inside a db transaction, so these all commit together: the
+ * replies to channeld only go out once that's done. */
+static void group_commit_flush(struct lightningd *ld)
+{
+	struct group_commit_update *gcu;
+
+	ld->group_commit_timer = NULL;
+	while ((gcu = list_pop(&ld->group_commit,
+			       struct group_commit_update, list)) != NULL) {
+		/* Handling it can free the owner (and anything else queued
+		 * by that owner). */
+		tal_del_destructor(gcu, destroy_group_commit_update);
+		tal_steal(tmpctx, gcu);
+		gcu->handle(gcu->channel, gcu->msg);
+	}
+}
+
+void peer_htlcs_group_commit(struct channel *channel, const u8 *msg,
+			     void (*handle)(struct channel *channel,
+					    const u8 *msg))
+{
+	struct lightningd *ld = channel->peer->ld;
+	struct group_commit_update *gcu;
+
+	if (ld->config.group_commit_ms == 0) {
+		handle(channel, msg);
+		return;
+	}
+
+	/* channeld waits for our reply, so it won't send anything else we
+	 * could handle out of order.  If it dies first, its owner is freed
+	 * and this with it: nothing was committed or replied to, so channeld
+	 * will simply retransmit after reconnecting. */
+	gcu = tal(channel->owner, struct group_commit_update);
+	gcu->ld = ld;
+	gcu->channel = channel;
+	gcu->msg = tal_dup_talarr(gcu, u8, msg);
+	gcu->handle = handle;
+	list_add_tail(&ld->group_commit, &gcu->list);
+	tal_add_destructor(gcu, destroy_group_commit_update);
+
+	if (!ld->group_commit_timer)
+		ld->group_commit_timer
+			= new_reltimer(ld->timers, ld,
+				       time_from_msec(ld->config.group_commit_ms),
+				       group_commit_flush, ld);
+}
+
 
 /* FIXME: Load direct from db. */
 const struct existing_htlc **peer_htlcs(const tal_t *ctx,
@@ -37,6 +37,13 @@ void peer_sending_commitsig(struct channel *channel, const u8 *msg);
 void peer_got_commitsig(struct channel *channel, const u8 *msg);
 void peer_got_revoke(struct channel *channel, const u8 *msg);
 
+/* Calls @handle (one of the above) for this message, but with
+ * --group-commit-ms it waits a little so several channels' updates share
+ * one database commit. */
+void peer_htlcs_group_commit(struct channel *channel, const u8 *msg,
+			     void (*handle)(struct channel *channel,
+					    const u8 *msg));
+
 void update_per_commit_point(struct channel *channel,
 			     const struct pubkey *per_commitment_point);
 
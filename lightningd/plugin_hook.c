@@ -282,13 +282,28 @@ bool plugin_hook_call_(struct lightningd *ld, const struct plugin_hook *hook,
 }
 
 /* We open-code this, because it's just different and special enough to be
- * annoying, and to make it clear that it's totally synchronous. */
+ * annoying, and to make it clear that it's synchronous (or, with
+ * --db-write-pipeline, only a bounded number of writes behind). */
 
 /* Special synchronous hook for db */
 static struct plugin_hook db_write_hook = {"db_write", PLUGIN_HOOK_SINGLE, NULL,
 					   NULL, NULL};
 AUTODATA(hooks, &db_write_hook);
 
+/* The db_write calls the plugin hasn't answered yet: with
+ * --db-write-pipeline we don't wait for every one. */
+static size_t num_db_writes_inflight;
+/* Are we in db_writes_wait()? */
+static bool db_writes_waiting;
+
+/* Answered (or the plugin died, taking it with it). */
+static void destroy_db_write(struct plugin_hook_request *ph_req)
+{
+	num_db_writes_inflight--;
+	if (db_writes_waiting)
+		io_break(&num_db_writes_inflight);
+}
+
 static void db_hook_response(const char *buffer, const jsmntok_t *toks,
 			     const jsmntok_t *idtok,
 			     struct plugin_hook_request *ph_req)
@@ -311,8 +326,32 @@ static void db_hook_response(const char *buffer, const jsmntok_t *toks,
 		fatal("Plugin returned an invalid result to the db_write "
 		      "hook: %s", buffer);
 
-	/* We're done, exit exclusive loop. */
-	io_break(ph_req);
+	/* We're done, which exits the exclusive loop if we're waiting. */
+	tal_free(ph_req);
+}
+
+/* Wait until at most @max db_writes are unanswered. */
+static void db_writes_wait(size_t max)
+{
+	const struct plugin_hook *hook = &db_write_hook;
+	void *outer = NULL;
+
+	db_writes_waiting = true;
+	while (num_db_writes_inflight > max) {
+		void *ret = plugin_exclusive_loop(hook->plugins[0]);
+
+		/* We can be called on way out of an io_loop, which is already
+		 * breaking.  That will make this immediately return; save the
+		 * break value, and hand it onwards once we're done. */
+		if (ret != &num_db_writes_inflight) {
+			assert(!outer);
+			outer = ret;
+		}
+	}
+	db_writes_waiting = false;
+
+	if (outer)
+		io_break(outer);
 }
 
 void plugin_hook_db_sync(struct db *db)
@@ -320,40 +359,44 @@ void plugin_hook_db_sync(struct db *db)
 	const struct plugin_hook *hook = &db_write_hook;
 	struct jsonrpc_request *req;
 	struct plugin_hook_request *ph_req;
-	void *ret;
 	struct plugin *plugin;
 
 	const char **changes = db_changes(db);
 	if (tal_count(hook->plugins) == 0)
 		return;
 
-	ph_req = notleak(tal(hook->plugins, struct plugin_hook_request));
-	/* FIXME: do IO logging for this! */
-	req = jsonrpc_request_start(NULL, hook->name, NULL, NULL,
-				    db_hook_response,
-				    ph_req);
+	plugin = hook->plugins[0];
 
-	ph_req->hook = hook;
-	ph_req->db = db;
-	plugin = ph_req->plugin = hook->plugins[0];
+	/* We may only be here to catch up (db_sync_writes). */
+	if (tal_count(changes) != 0) {
+		ph_req = notleak(tal(plugin, struct plugin_hook_request));
+		/* FIXME: do IO logging for this! */
+		req = jsonrpc_request_start(NULL, hook->name, NULL, NULL,
+					    db_hook_response,
+					    ph_req);
 
-	json_add_num(req->stream, "data_version", db_data_version_get(db));
+		ph_req->hook = hook;
+		ph_req->db = db;
+		ph_req->plugin = plugin;
 
-	json_array_start(req->stream, "writes");
-	for (size_t i = 0; i < tal_count(changes); i++)
-		json_add_string(req->stream, NULL, changes[i]);
-	json_array_end(req->stream);
-	jsonrpc_request_end(req);
+		json_add_num(req->stream, "data_version",
+			     db_data_version_get(db));
 
-	plugin_request_send(ph_req->plugin, req);
+		json_array_start(req->stream, "writes");
+		for (size_t i = 0; i < tal_count(changes); i++)
+			json_add_string(req->stream, NULL, changes[i]);
+		json_array_end(req->stream);
+		jsonrpc_request_end(req);
 
-	/* We can be called on way out of an io_loop, which is already breaking.
-	 * That will make this immediately return; save the break value and call
-	 * again, then hand it onwards. */
-	ret = plugin_exclusive_loop(plugin);
-	if (ret != ph_req) {
-		void *ret2 = plugin_exclusive_loop(plugin);
-		assert(ret2 == ph_req);
-		io_break(ret);
+		plugin_request_send(plugin, req);
+		num_db_writes_inflight++;
+		tal_add_destructor(ph_req, destroy_db_write);
 	}
+
+	/* By default we wait for every write; otherwise only if we're about
+	 * to tell a peer something, or too many are unanswered. */
+	if (db->sync_writes)
+		db_writes_wait(0);
+	else
+		db_writes_wait(plugin->plugins->ld->db_write_pipeline);
 }
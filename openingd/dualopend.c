@@ -1922,10 +1922,10 @@ static void handle_gossip_in(struct state *state)
 
 static void try_read_gossip_store(struct state *state)
 {
-	u8 *msg = gossip_store_next(tmpctx, state->pps);
+	u8 **msgs = gossip_store_next_batch(tmpctx, state->pps);
 
-	if (msg)
-		sync_crypto_write(state->pps, take(msg));
+	if (msgs)
+		sync_crypto_write_arr(state->pps, msgs);
 }
 
 /*~ Is this message of type `error` with the special zero-id
@@ -1360,10 +1360,10 @@ static u8 *handle_master_in(struct state *state)
 
 static void try_read_gossip_store(struct state *state)
 {
-	u8 *msg = gossip_store_next(tmpctx, state->pps);
+	u8 **msgs = gossip_store_next_batch(tmpctx, state->pps);
 
-	if (msg)
-		sync_crypto_write(state->pps, take(msg));
+	if (msgs)
+		sync_crypto_write_arr(state->pps, msgs);
 }
 
 int main(int argc, char *argv[])
@@ -1,5 +1,11 @@
 #include <bitcoin/preimage.h>
 #include <ccan/array_size/array_size.h>
+#include <ccan/bitmap/bitmap.h>
+#include <ccan/crypto/siphash24/siphash24.h>
+#include <ccan/htable/htable_type.h>
+#include <ccan/io/io.h>
+#include <ccan/list/list.h>
+#include <ccan/read_write_all/read_write_all.h>
 #include <ccan/tal/str/str.h>
 #include <common/dijkstra.h>
 #include <common/gossmap.h>
@@ -12,8 +18,197 @@
 #include <common/type_to_string.h>
 #include <errno.h>
 #include <plugins/libplugin-pay.h>
+#include <pthread.h>
+#include <unistd.h>
 
 static struct gossmap *gossmap;
+/* Reused for every route search, to avoid reallocating. */
+static struct dijkstra_ctx *dijctx;
+
+/* Where to find a channel_hint in root->channel_hints: that array gets
+ * reallocated as it grows, so we can't point into it. */
+struct channel_hint_index {
+	struct short_channel_id_dir scid;
+	size_t idx;
+};
+
+static const struct short_channel_id_dir *
+channel_hint_index_key(const struct channel_hint_index *chi)
+{
+	return &chi->scid;
+}
+
+static size_t channel_hint_index_hash(const struct short_channel_id_dir *scidd)
+{
+	return siphash24(siphash_seed(), &scidd->scid, sizeof(scidd->scid))
+		+ scidd->dir;
+}
+
+static bool channel_hint_index_eq(const struct channel_hint_index *chi,
+				  const struct short_channel_id_dir *scidd)
+{
+	return short_channel_id_eq(&chi->scid.scid, &scidd->scid)
+		&& chi->scid.dir == scidd->dir;
+}
+
+HTABLE_DEFINE_TYPE(struct channel_hint_index, channel_hint_index_key,
+		   channel_hint_index_hash, channel_hint_index_eq,
+		   channel_hint_map);
+
+static void destroy_channel_hint_map(struct channel_hint_map *map)
+{
+	channel_hint_map_clear(map);
+}
+
+/* Route searches use a copy of the channel_hints, which doesn't move, so
+ * it can index the hints directly. */
+static const struct short_channel_id_dir *
+channel_hint_key(const struct channel_hint *hint)
+{
+	return &hint->scid;
+}
+
+static bool channel_hint_eq(const struct channel_hint *hint,
+			    const struct short_channel_id_dir *scidd)
+{
+	return short_channel_id_eq(&hint->scid.scid, &scidd->scid)
+		&& hint->scid.dir == scidd->dir;
+}
+
+HTABLE_DEFINE_TYPE(struct channel_hint, channel_hint_key,
+		   channel_hint_index_hash, channel_hint_eq,
+		   channel_hint_set);
+
+/* Sibling payments often search one after another without the hints
+ * changing in between, so they share a snapshot. */
+struct channel_hint_snapshot {
+	/* The root payment holds one reference until the hints change, and
+	 * each route_search using it holds one.  Main thread only. */
+	size_t refs;
+	struct channel_hint *hints;
+	struct channel_hint_set set;
+};
+
+static void destroy_channel_hint_snapshot(struct channel_hint_snapshot *snap)
+{
+	channel_hint_set_clear(&snap->set);
+}
+
+static struct channel_hint_snapshot *channel_hints_snapshot(struct payment *root)
+{
+	struct channel_hint_snapshot *snap = root->channel_hints_snapshot;
+
+	if (!snap) {
+		snap = tal(NULL, struct channel_hint_snapshot);
+		snap->refs = 1;
+		snap->hints = tal_dup_talarr(snap, struct channel_hint,
+					     root->channel_hints);
+		channel_hint_set_init(&snap->set);
+		tal_add_destructor(snap, destroy_channel_hint_snapshot);
+		for (size_t i = 0; i < tal_count(snap->hints); i++)
+			channel_hint_set_add(&snap->set, &snap->hints[i]);
+		root->channel_hints_snapshot = snap;
+	}
+	snap->refs++;
+	return snap;
+}
+
+static void channel_hint_snapshot_put(struct channel_hint_snapshot *snap)
+{
+	if (snap && --snap->refs == 0)
+		tal_free(snap);
+}
+
+/* Must be called whenever root->channel_hints changes. */
+static void channel_hints_changed(struct payment *root)
+{
+	channel_hint_snapshot_put(root->channel_hints_snapshot);
+	root->channel_hints_snapshot = NULL;
+}
+
+static void destroy_payment_channel_hints(struct payment *root)
+{
+	channel_hints_changed(root);
+}
+
+static void channel_hints_init(struct payment *root)
+{
+	root->channel_hints = tal_arr(root, struct channel_hint, 0);
+	root->channel_hints_map = tal(root, struct channel_hint_map);
+	channel_hint_map_init(root->channel_hints_map);
+	tal_add_destructor(root->channel_hints_map, destroy_channel_hint_map);
+	root->channel_hints_snapshot = NULL;
+	tal_add_destructor(root, destroy_payment_channel_hints);
+}
+
+/* Main thread only: the payment a route_search is for.  It's a separate
+ * allocation so the payment's destructor never writes to a route_search a
+ * worker may be using. */
+struct route_search_payment {
+	/* NULL if the payment was freed while we were searching. */
+	struct payment *p;
+};
+
+/* One hop of a route_search result. */
+struct route_search_hop {
+	u32 chan_idx;
+	int dir;
+};
+
+/* Everything we need to search for a route, copied out of the payment so
+ * a worker thread can search while the payment tree keeps changing.  It's
+ * all set up (and later freed) by the main thread: the worker only reads
+ * the gossmap, this and the hints, and writes into its own dijkstra_ctx
+ * and route_len/route here, so it never calls into tal. */
+struct route_search {
+	/* In route_workers->queue while waiting for a worker. */
+	struct list_node list;
+
+	struct route_search_payment *payment;
+
+	const struct gossmap_node *src, *dst;
+	struct amount_msat amount;
+	double riskfactor;
+	u32 max_hops;
+
+	/* root->channel_hints as of when we started. */
+	struct channel_hint_snapshot *hints;
+
+	/* excluded_nodes and temp_exclusion by gossmap node index, or NULL
+	 * if none. */
+	bitmap *excluded;
+
+	/* The result: number of hops, or UINT_MAX if no path found.  If
+	 * that's no more than max_hops, route (malloc'd with room for
+	 * max_hops) holds them, starting from src. */
+	u32 route_len;
+	struct route_search_hop *route;
+};
+
+/* Worker threads, if payment_route_threads is non-zero. */
+struct route_workers {
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+	struct list_head queue;
+
+	/* Searches submitted but not yet completed: only touched by the
+	 * main thread. */
+	size_t num_pending;
+
+	/* We can't refresh the gossmap while searches are pending, so if it
+	 * needs it, new searches wait here (struct route_search_wait) until
+	 * they're done.  Main thread only. */
+	struct list_head waiting;
+
+	/* Workers write finished route_search pointers into fds[1]. */
+	int fds[2];
+	struct route_search *done;
+};
+
+u32 payment_route_threads = 4;
+static struct route_workers *route_workers;
+
+static void route_workers_new(struct plugin *plugin);
 
 /* BOLT #11:
  * * `c` (24): `data_length` variable.
@@ -32,11 +227,16 @@ struct payment *payment_new(tal_t *ctx, struct command *cmd,
 
 	/* Now we're actually creating a payment, load gossip store */
 	if (!gossmap) {
-		gossmap = notleak_with_children(gossmap_load(NULL,
-							     GOSSIP_STORE_FILENAME));
+		gossmap = notleak_with_children(
+			gossmap_load_indexed(NULL, GOSSIP_STORE_FILENAME));
 		if (!gossmap)
 			plugin_err(cmd->plugin, "Could not load gossmap %s: %s",
 				   GOSSIP_STORE_FILENAME, strerror(errno));
+		/* We route a lot more than we refresh. */
+		gossmap_enable_csr(gossmap);
+		dijctx = notleak_with_children(dijkstra_ctx_new(NULL));
+		if (payment_route_threads)
+			route_workers_new(cmd->plugin);
 	}
 
 	p->children = tal_arr(p, struct payment *, 0);
@@ -82,7 +282,7 @@ struct payment *payment_new(tal_t *ctx, struct command *cmd,
 		p->partid = 0;
 		p->next_partid = 1;
 		p->plugin = cmd->plugin;
-		p->channel_hints = tal_arr(p, struct channel_hint, 0);
+		channel_hints_init(p);
 		p->excluded_nodes = tal_arr(p, struct node_id, 0);
 		p->id = next_id++;
 		/* Caller must set this.  */
@@ -301,6 +501,21 @@ void payment_start(struct payment *p)
 	payment_start_at_blockheight(p, INVALID_BLOCKHEIGHT);
 }
 
+static struct channel_hint *find_hint(struct payment *root,
+				      const struct short_channel_id *scid,
+				      int dir)
+{
+	struct short_channel_id_dir scidd;
+	const struct channel_hint_index *chi;
+
+	scidd.scid = *scid;
+	scidd.dir = dir;
+	chi = channel_hint_map_get(root->channel_hints_map, &scidd);
+	if (!chi)
+		return NULL;
+	return &root->channel_hints[chi->idx];
+}
+
 static void channel_hints_update(struct payment *p,
 				 const struct short_channel_id scid,
 				 int direction, bool enabled, bool local,
@@ -308,49 +523,50 @@ static void channel_hints_update(struct payment *p,
 				 u16 *htlc_budget)
 {
 	struct payment *root = payment_root(p);
-	struct channel_hint hint;
+	struct channel_hint hint, *oldhint;
+	struct channel_hint_index *chi;
 
 	/* If the channel is marked as enabled it must have an estimate. */
 	assert(!enabled || estimated_capacity != NULL);
 
 	/* Try and look for an existing hint: */
-	for (size_t i=0; i<tal_count(root->channel_hints); i++) {
-		struct channel_hint *hint = &root->channel_hints[i];
-		if (short_channel_id_eq(&hint->scid.scid, &scid) &&
-		    hint->scid.dir == direction) {
-			bool modified = false;
-			/* Prefer to disable a channel. */
-			if (!enabled && hint->enabled) {
-				hint->enabled = false;
-				modified = true;
-			}
-
-			/* Prefer the more conservative estimate. */
-			if (estimated_capacity != NULL &&
-			    amount_msat_greater(hint->estimated_capacity,
-						*estimated_capacity)) {
-				hint->estimated_capacity = *estimated_capacity;
-				modified = true;
-			}
-			if (htlc_budget != NULL && *htlc_budget < hint->htlc_budget) {
-				hint->htlc_budget = *htlc_budget;
-				modified = true;
-			}
+	oldhint = find_hint(root, &scid, direction);
+	if (oldhint) {
+		bool modified = false;
+		/* Prefer to disable a channel. */
+		if (!enabled && oldhint->enabled) {
+			oldhint->enabled = false;
+			modified = true;
+		}
 
-			if (modified)
-				paymod_log(p, LOG_DBG,
-					   "Updated a channel hint for %s: "
-					   "enabled %s, "
-					   "estimated capacity %s",
-					   type_to_string(tmpctx,
-						struct short_channel_id_dir,
-						&hint->scid),
-					   hint->enabled ? "true" : "false",
-					   type_to_string(tmpctx,
-						struct amount_msat,
-						&hint->estimated_capacity));
-			return;
+		/* Prefer the more conservative estimate. */
+		if (estimated_capacity != NULL &&
+		    amount_msat_greater(oldhint->estimated_capacity,
+					*estimated_capacity)) {
+			oldhint->estimated_capacity = *estimated_capacity;
+			modified = true;
 		}
+		if (htlc_budget != NULL && *htlc_budget < oldhint->htlc_budget) {
+			oldhint->htlc_budget = *htlc_budget;
+			modified = true;
+		}
+
+		if (modified)
+			channel_hints_changed(root);
+
+		if (modified)
+			paymod_log(p, LOG_DBG,
+				   "Updated a channel hint for %s: "
+				   "enabled %s, "
+				   "estimated capacity %s",
+				   type_to_string(tmpctx,
+					struct short_channel_id_dir,
+					&oldhint->scid),
+				   oldhint->enabled ? "true" : "false",
+				   type_to_string(tmpctx,
+					struct amount_msat,
+					&oldhint->estimated_capacity));
+		return;
 	}
 
 	/* No hint found, create one. */
@@ -364,7 +580,12 @@ static void channel_hints_update(struct payment *p,
 	if (htlc_budget != NULL)
 		hint.htlc_budget = *htlc_budget;
 
+	chi = tal(root->channel_hints_map, struct channel_hint_index);
+	chi->scid = hint.scid;
+	chi->idx = tal_count(root->channel_hints);
+	channel_hint_map_add(root->channel_hints_map, chi);
 	tal_arr_expand(&root->channel_hints, hint);
+	channel_hints_changed(root);
 
 	paymod_log(
 	    p, LOG_DBG,
@@ -459,49 +680,41 @@ static void payment_chanhints_apply_route(struct payment *p, bool remove)
 	struct channel_hint *curhint;
 	struct payment *root = payment_root(p);
 	assert(p->route != NULL);
+	channel_hints_changed(root);
 	for (size_t i = 0; i < tal_count(p->route); i++) {
 		curhop = &p->route[i];
-		for (size_t j = 0; j < tal_count(root->channel_hints); j++) {
-			curhint = &root->channel_hints[j];
-			if (short_channel_id_eq(&curhint->scid.scid,
-						&curhop->channel_id) &&
-			    curhint->scid.dir == curhop->direction) {
-
-				/* Update the number of htlcs for any local
-				 * channel in the route */
-				if (curhint->local && remove)
-					curhint->htlc_budget++;
-				else if (curhint->local)
-					curhint->htlc_budget--;
-
-				if (remove && !amount_msat_add(
-						  &curhint->estimated_capacity,
-						  curhint->estimated_capacity,
-						  curhop->amount)) {
-					/* This should never happen, it'd mean
-					 * that we unapply a route that would
-					 * result in a msatoshi
-					 * wrap-around. */
-					abort();
-				} else if (!amount_msat_sub(
-					       &curhint->estimated_capacity,
+		curhint = find_hint(root, &curhop->channel_id,
+				    curhop->direction);
+		if (!curhint)
+			continue;
+
+		/* Update the number of htlcs for any local
+		 * channel in the route */
+		if (curhint->local && remove)
+			curhint->htlc_budget++;
+		else if (curhint->local)
+			curhint->htlc_budget--;
+
+		if (remove && !amount_msat_add(&curhint->estimated_capacity,
 					       curhint->estimated_capacity,
 					       curhop->amount)) {
-					/* This can happen in case of multipl
-					 * concurrent getroute calls using the
-					 * same channel_hints, no biggy, it's
-					 * an estimation anyway. */
-					paymod_log(
-					    p, LOG_UNUSUAL,
-					    "Could not update the channel hint "
-					    "for %s. Could be a concurrent "
-					    "`getroute` call.",
-					    type_to_string(
-						tmpctx,
-						struct short_channel_id_dir,
-						&curhint->scid));
-				}
-			}
+			/* This should never happen, it'd mean that we unapply
+			 * a route that would result in a msatoshi
+			 * wrap-around. */
+			abort();
+		} else if (!amount_msat_sub(&curhint->estimated_capacity,
+					    curhint->estimated_capacity,
+					    curhop->amount)) {
+			/* This can happen in case of multipl concurrent
+			 * getroute calls using the same channel_hints, no
+			 * biggy, it's an estimation anyway. */
+			paymod_log(p, LOG_UNUSUAL,
+				   "Could not update the channel hint "
+				   "for %s. Could be a concurrent "
+				   "`getroute` call.",
+				   type_to_string(tmpctx,
+						  struct short_channel_id_dir,
+						  &curhint->scid));
 		}
 	}
 }
@@ -540,57 +753,69 @@ static const struct node_id *payment_get_excluded_nodes(const tal_t *ctx,
 	return root->excluded_nodes;
 }
 
-/* FIXME: This is slow! */
-static const struct channel_hint *find_hint(const struct channel_hint *hints,
-					    const struct short_channel_id *scid,
-					    int dir)
-{
-	for (size_t i = 0; i < tal_count(hints); i++) {
-		if (short_channel_id_eq(scid, &hints[i].scid.scid)
-		    && dir == hints[i].scid.dir)
-			return &hints[i];
-	}
-	return NULL;
-}
-
-/* FIXME: This is slow! */
-static bool dst_is_excluded(const struct gossmap *gossmmap,
-			    const struct gossmap_chan *c,
+/* Called for every edge dijkstra looks at, so this needs to be fast. */
+static bool dst_is_excluded(const struct gossmap_chan *c,
 			    int dir,
-			    const struct node_id *nodes)
+			    const bitmap *excluded)
 {
-	struct node_id dstid;
-
 	/* Premature optimization */
-	if (!tal_count(nodes))
+	if (!excluded)
 		return false;
 
-	gossmap_node_get_id(gossmap, gossmap_nth_node(gossmap, c, !dir),
-			    &dstid);
+	return bitmap_test_bit(excluded, c->half[!dir].nodeidx);
+}
+
+static void exclude_nodes(bitmap *excluded,
+			  const struct gossmap *gossmap,
+			  const struct node_id *nodes)
+{
 	for (size_t i = 0; i < tal_count(nodes); i++) {
-		if (node_id_eq(&dstid, &nodes[i]))
-			return true;
+		const struct gossmap_node *n = gossmap_find_node(gossmap,
+								 &nodes[i]);
+		/* Not in gossip?  Then we won't route through it anyway. */
+		if (n)
+			bitmap_set_bit(excluded, gossmap_node_idx(gossmap, n));
 	}
-	return false;
+}
+
+/* Gossmap node indexes can change on refresh, so we redo this for each
+ * route search. */
+static bitmap *excluded_node_bitmap(const tal_t *ctx,
+				    const struct gossmap *gossmap,
+				    struct payment *p)
+{
+	const struct node_id *excluded_nodes = payment_root(p)->excluded_nodes;
+	bitmap *excluded;
+
+	if (!tal_count(excluded_nodes) && !tal_count(p->temp_exclusion))
+		return NULL;
+
+	excluded = tal_arrz(ctx, bitmap,
+			    BITMAP_NWORDS(gossmap_max_node_idx(gossmap)));
+	exclude_nodes(excluded, gossmap, excluded_nodes);
+	exclude_nodes(excluded, gossmap, p->temp_exclusion);
+	return excluded;
 }
 
 static bool payment_route_check(const struct gossmap *gossmap,
 				const struct gossmap_chan *c,
 				int dir,
 				struct amount_msat amount,
-				struct payment *p)
+				struct route_search *rs)
 {
-	struct short_channel_id scid;
+	struct short_channel_id_dir scidd;
 	const struct channel_hint *hint;
 
-	if (dst_is_excluded(gossmap, c, dir, payment_root(p)->excluded_nodes))
+	if (dst_is_excluded(c, dir, rs->excluded))
 		return false;
 
-	if (dst_is_excluded(gossmap, c, dir, p->temp_exclusion))
-		return false;
+	/* Don't bother looking up the scid if we have no hints */
+	if (channel_hint_set_count(&rs->hints->set) == 0)
+		return true;
 
-	scid = gossmap_chan_scid(gossmap, c);
-	hint = find_hint(payment_root(p)->channel_hints, &scid, dir);
+	scidd.scid = gossmap_chan_scid(gossmap, c);
+	scidd.dir = dir;
+	hint = channel_hint_set_get(&rs->hints->set, &scidd);
 	if (!hint)
 		return true;
 
@@ -614,24 +839,24 @@ static bool payment_route_can_carry(const struct gossmap *map,
 				    const struct gossmap_chan *c,
 				    int dir,
 				    struct amount_msat amount,
-				    struct payment *p)
+				    struct route_search *rs)
 {
-	if (!route_can_carry(map, c, dir, amount, p))
+	if (!route_can_carry(map, c, dir, amount, rs))
 		return false;
 
-	return payment_route_check(map, c, dir, amount, p);
+	return payment_route_check(map, c, dir, amount, rs);
 }
 
 static bool payment_route_can_carry_even_disabled(const struct gossmap *map,
 						  const struct gossmap_chan *c,
 						  int dir,
 						  struct amount_msat amount,
-						  struct payment *p)
+						  struct route_search *rs)
 {
-	if (!route_can_carry_even_disabled(map, c, dir, amount, p))
+	if (!route_can_carry_even_disabled(map, c, dir, amount, rs))
 		return false;
 
-	return payment_route_check(map, c, dir, amount, p);
+	return payment_route_check(map, c, dir, amount, rs);
 }
 
 static struct route_hop *route_hops_from_route(const tal_t *ctx,
@@ -662,7 +887,7 @@ static struct route_hop *route_hops_from_route(const tal_t *ctx,
 	amt = p->getroute->amount;
 	delay = p->getroute->cltv;
 	for (int i = tal_count(hops) - 1; i >= 0; i--) {
-		const struct half_chan *h = &r[i]->c->half[r[i]->dir];
+		const struct gossmap_half_chan *h = &r[i]->c->half[r[i]->dir];
 
 		hops[i].amount = amt;
 		hops[i].delay = delay;
@@ -676,80 +901,164 @@ static struct route_hop *route_hops_from_route(const tal_t *ctx,
 	return hops;
 }
 
-static struct command_result *payment_getroute(struct payment *p)
+static void route_search_payment_freed(struct payment *p,
+				       struct route_search_payment *rsp)
 {
-	const struct dijkstra *dij;
-	const struct gossmap_node *dst, *src;
-	struct route **r;
-	struct amount_msat fee;
-	bool (*can_carry)(const struct gossmap *,
-			  const struct gossmap_chan *,
-			  int,
-			  struct amount_msat,
-			  struct payment *);
+	rsp->p = NULL;
+}
 
-	/* Make sure we're up-to-date with any new entries */
-	gossmap_refresh(gossmap);
+static void destroy_route_search_payment(struct route_search_payment *rsp)
+{
+	if (rsp->p)
+		tal_del_destructor2(rsp->p, route_search_payment_freed, rsp);
+}
 
-	dst = gossmap_find_node(gossmap, p->getroute->destination);
-	if (!dst) {
-		payment_fail(
-			p, "Unknown destination %s",
-			type_to_string(tmpctx, struct node_id,
-				       p->getroute->destination));
+static void destroy_route_search(struct route_search *rs)
+{
+	channel_hint_snapshot_put(rs->hints);
+	free(rs->route);
+}
 
-		/* Let payment_finished_ handle this, so we mark it as pending */
-		return command_still_pending(p->cmd);
-	}
+static struct route_search *route_search_new(struct payment *p,
+					     const struct gossmap_node *src,
+					     const struct gossmap_node *dst)
+{
+	struct route_search *rs = tal(NULL, struct route_search);
 
-	/* If we don't exist in gossip, routing can't happen. */
-	src = gossmap_find_node(gossmap, p->local_id);
-	if (!src) {
-		payment_fail(p, "We don't have any channels");
+	rs->payment = tal(rs, struct route_search_payment);
+	rs->payment->p = p;
+	tal_add_destructor2(p, route_search_payment_freed, rs->payment);
+	tal_add_destructor(rs->payment, destroy_route_search_payment);
 
-		/* Let payment_finished_ handle this, so we mark it as pending */
-		return command_still_pending(p->cmd);
+	rs->src = src;
+	rs->dst = dst;
+	rs->amount = p->getroute->amount;
+	rs->riskfactor = p->getroute->riskfactorppm / 1000000.0;
+	rs->max_hops = p->getroute->max_hops;
+
+	rs->hints = channel_hints_snapshot(payment_root(p));
+	rs->excluded = excluded_node_bitmap(rs, gossmap, p);
+	rs->route_len = UINT_MAX;
+	rs->route = malloc(rs->max_hops * sizeof(*rs->route));
+	if (rs->max_hops && !rs->route)
+		abort();
+
+	tal_add_destructor(rs, destroy_route_search);
+	return rs;
+}
+
+/* Like route_from_dijkstra(), but only records chan indexes, in rs.
+ * Returns false if there's no path. */
+static bool route_search_path(struct route_search *rs,
+			      const struct dijkstra *dij)
+{
+	u32 curidx = gossmap_node_idx(gossmap, rs->src);
+
+	rs->route_len = dijkstra_distance(dij, curidx);
+	if (rs->route_len == UINT_MAX)
+		return false;
+
+	/* Too long: caller will try again, or fail it. */
+	if (rs->route_len > rs->max_hops)
+		return true;
+
+	for (size_t i = 0; i < rs->route_len; i++) {
+		const struct gossmap_chan *c = dijkstra_best_chan(dij, curidx);
+		int dir;
+
+		if (c->half[0].nodeidx == curidx) {
+			dir = 0;
+		} else {
+			assert(c->half[1].nodeidx == curidx);
+			dir = 1;
+		}
+		rs->route[i].chan_idx = gossmap_chan_idx(gossmap, c);
+		rs->route[i].dir = dir;
+		curidx = gossmap_node_idx(gossmap,
+					  gossmap_nth_node(gossmap, c, !dir));
 	}
+	return true;
+}
+
+/* This may run on a worker thread: it must only touch rs, dctx and the
+ * gossmap (which we don't refresh while searches are pending), and must
+ * not use tal. */
+static void route_search_run(struct dijkstra_ctx *dctx,
+			     struct route_search *rs)
+{
+	const struct dijkstra *dij;
+	bool (*can_carry)(const struct gossmap *,
+			  const struct gossmap_chan *,
+			  int,
+			  struct amount_msat,
+			  struct route_search *);
 
 	can_carry = payment_route_can_carry;
-	dij = dijkstra(tmpctx, gossmap, dst, p->getroute->amount,
-		       p->getroute->riskfactorppm / 1000000.0,
-		       can_carry, route_score_cheaper, p);
-	r = route_from_dijkstra(tmpctx, gossmap, dij, src);
-	if (!r) {
+	dij = dijkstra_run(dctx, gossmap, rs->dst, rs->src,
+			   rs->amount, rs->riskfactor,
+			   can_carry, route_score_cheaper, rs);
+	if (!route_search_path(rs, dij)) {
 		/* Try using disabled channels too */
 		/* FIXME: is there somewhere we can annotate this for paystatus? */
 		can_carry = payment_route_can_carry_even_disabled;
-		dij = dijkstra(tmpctx, gossmap, dst, p->getroute->amount,
-			       p->getroute->riskfactorppm / 1000000.0,
-			       can_carry, route_score_cheaper, p);
-		r = route_from_dijkstra(tmpctx, gossmap, dij, src);
-		if (!r) {
-			payment_fail(p, "No path found");
-			return command_still_pending(p->cmd);
-		}
+		dij = dijkstra_run(dctx, gossmap, rs->dst, rs->src,
+				   rs->amount, rs->riskfactor,
+				   can_carry, route_score_cheaper, rs);
+		if (!route_search_path(rs, dij))
+			return;
 	}
 
 	/* If it's too far, fall back to using shortest path. */
-	if (tal_count(r) > p->getroute->max_hops) {
+	if (rs->route_len > rs->max_hops) {
 		/* FIXME: is there somewhere we can annotate this for paystatus? */
-		dij = dijkstra(tmpctx, gossmap, dst, p->getroute->amount,
-			       p->getroute->riskfactorppm / 1000000.0,
-			       can_carry, route_score_shorter, p);
-		r = route_from_dijkstra(tmpctx, gossmap, dij, src);
-		if (!r) {
-			payment_fail(p, "No path found");
-			return command_still_pending(p->cmd);
-		}
+		dij = dijkstra_run(dctx, gossmap, rs->dst, rs->src,
+				   rs->amount, rs->riskfactor,
+				   can_carry, route_score_shorter, rs);
+		route_search_path(rs, dij);
+	}
+}
 
-		/* If it's still too far, fail. */
-		if (tal_count(r) > p->getroute->max_hops) {
-			payment_fail(p, "Shortest path found was length %zu",
-				     tal_count(p->route));
-			return command_still_pending(p->cmd);
-		}
+/* Back on the main thread: turn rs->route into a route. */
+static struct route **route_search_route(const tal_t *ctx,
+					 const struct route_search *rs)
+{
+	struct route **r = tal_arr(ctx, struct route *, rs->route_len);
+
+	for (size_t i = 0; i < rs->route_len; i++) {
+		r[i] = tal(r, struct route);
+		r[i]->c = gossmap_chan_byidx(gossmap, rs->route[i].chan_idx);
+		r[i]->dir = rs->route[i].dir;
+	}
+	return r;
+}
+
+/* Back on the main thread: use the route we found, if any. */
+static void route_search_done(struct route_search *rs)
+{
+	struct payment *p = rs->payment->p;
+	struct route **r;
+	struct amount_msat fee;
+
+	tal_steal(tmpctx, rs);
+
+	/* Payment went away while we were searching? */
+	if (!p)
+		return;
+
+	if (rs->route_len == UINT_MAX) {
+		payment_fail(p, "No path found");
+		return;
 	}
 
+	/* If it's still too far, fail. */
+	if (rs->route_len > rs->max_hops) {
+		payment_fail(p, "Shortest path found was length %u",
+			     rs->route_len);
+		return;
+	}
+
+	r = route_search_route(tmpctx, rs);
+
 	/* OK, now we *have* a route */
 	p->step = PAYMENT_STEP_GOT_ROUTE;
 	p->route = route_hops_from_route(p, p, r);
@@ -765,7 +1074,7 @@ static struct command_result *payment_getroute(struct payment *p)
 		    type_to_string(tmpctx, struct amount_msat, &fee),
 		    type_to_string(tmpctx, struct amount_msat,
 				   &p->constraints.fee_budget));
-		return command_still_pending(p->cmd);
+		return;
 	}
 
 	if (p->route[0].delay > p->constraints.cltv_budget) {
@@ -774,7 +1083,7 @@ static struct command_result *payment_getroute(struct payment *p)
 		p->route = tal_free(p->route);
 		payment_fail(p, "CLTV delay exceeds our CLTV budget: %d > %d",
 			     delay, p->constraints.cltv_budget);
-		return command_still_pending(p->cmd);
+		return;
 	}
 
 	/* Now update the constraints in fee_budget and cltv_budget so
@@ -789,6 +1098,181 @@ static struct command_result *payment_getroute(struct payment *p)
 	 * payment_compute_onion_payloads uses the route to generate the
 	 * onion_payloads */
 	payment_continue(p);
+}
+
+static void *route_worker(void *arg)
+{
+	struct dijkstra_ctx *dctx = arg;
+
+	for (;;) {
+		struct route_search *rs;
+
+		pthread_mutex_lock(&route_workers->lock);
+		while (!(rs = list_pop(&route_workers->queue,
+				       struct route_search, list)))
+			pthread_cond_wait(&route_workers->cond,
+					  &route_workers->lock);
+		pthread_mutex_unlock(&route_workers->lock);
+
+		route_search_run(dctx, rs);
+
+		/* Writes this small to a pipe are atomic, so workers can
+		 * share it. */
+		if (!write_all(route_workers->fds[1], &rs, sizeof(rs)))
+			abort();
+	}
+	return NULL;
+}
+
+static struct io_plan *route_search_read(struct io_conn *conn,
+					 struct route_workers *rw);
+
+static struct io_plan *route_workers_conn_init(struct io_conn *conn,
+					       struct route_workers *rw)
+{
+	return io_read(conn, &rw->done, sizeof(rw->done),
+		       route_search_read, rw);
+}
+
+static struct command_result *payment_getroute(struct payment *p);
+
+/* A payment waiting for pending searches to finish, so we can refresh. */
+struct route_search_wait {
+	struct list_node list;
+	struct payment *p;
+};
+
+static void destroy_route_search_wait(struct route_search_wait *w)
+{
+	list_del(&w->list);
+}
+
+static void route_search_wait(struct route_workers *rw, struct payment *p)
+{
+	struct route_search_wait *w = tal(p, struct route_search_wait);
+
+	w->p = p;
+	list_add_tail(&rw->waiting, &w->list);
+	tal_add_destructor(w, destroy_route_search_wait);
+}
+
+static struct io_plan *route_search_read(struct io_conn *conn,
+					 struct route_workers *rw)
+{
+	struct route_search_wait *w;
+	struct list_head waiting;
+
+	route_search_done(rw->done);
+	rw->num_pending--;
+	if (rw->num_pending != 0)
+		return route_workers_conn_init(conn, rw);
+
+	/* Now we can refresh: the first waiter will do it.  Any which have
+	 * to wait again go back on rw->waiting.  (Payments can be freed as
+	 * we go, which removes them from the list.) */
+	list_head_init(&waiting);
+	list_append_list(&waiting, &rw->waiting);
+	while ((w = list_top(&waiting, struct route_search_wait, list))
+	       != NULL) {
+		struct payment *p = w->p;
+		tal_free(w);
+		payment_getroute(p);
+	}
+	return route_workers_conn_init(conn, rw);
+}
+
+static void route_search_submit(struct route_workers *rw,
+				struct route_search *rs)
+{
+	rw->num_pending++;
+	pthread_mutex_lock(&rw->lock);
+	list_add_tail(&rw->queue, &rs->list);
+	pthread_cond_signal(&rw->cond);
+	pthread_mutex_unlock(&rw->lock);
+}
+
+static void route_workers_new(struct plugin *plugin)
+{
+	struct route_workers *rw;
+
+	rw = notleak_with_children(tal(NULL, struct route_workers));
+	pthread_mutex_init(&rw->lock, NULL);
+	pthread_cond_init(&rw->cond, NULL);
+	list_head_init(&rw->queue);
+	rw->num_pending = 0;
+	list_head_init(&rw->waiting);
+	if (pipe(rw->fds) != 0)
+		plugin_err(plugin, "Creating route worker pipe: %s",
+			   strerror(errno));
+	io_new_conn(rw, rw->fds[0], route_workers_conn_init, rw);
+
+	/* Workers find this via the global. */
+	route_workers = rw;
+	for (size_t i = 0; i < payment_route_threads; i++) {
+		pthread_t thread;
+		int err;
+
+		/* Each worker gets its own dijkstra scratch space. */
+		err = pthread_create(&thread, NULL, route_worker,
+				     dijkstra_ctx_new(rw));
+		if (err)
+			plugin_err(plugin, "Creating route worker thread: %s",
+				   strerror(err));
+		pthread_detach(thread);
+	}
+}
+
+static struct command_result *payment_getroute(struct payment *p)
+{
+	const struct gossmap_node *dst, *src;
+	struct route_search *rs;
+
+	/* Make sure we're up-to-date with any new entries, but not while
+	 * workers are using it!  If it needs it, wait until they're done,
+	 * otherwise steady load would keep it stale forever. */
+	if (route_workers && route_workers->num_pending != 0) {
+		if (gossmap_refresh_needed(gossmap)) {
+			route_search_wait(route_workers, p);
+			return command_still_pending(p->cmd);
+		}
+	} else if (gossmap_refresh(gossmap)) {
+		const struct gossmap_stats *stats = gossmap_stats(gossmap);
+		plugin_log(p->plugin, LOG_DBG,
+			   "gossmap refreshed: %"PRIu64"/%"PRIu64" refreshes"
+			   " changed, %"PRIu64" remaps, %"PRIu64" compactions,"
+			   " %"PRIu64" bytes parsed, %"PRIu64" msec total",
+			   stats->changed, stats->refreshes, stats->remaps,
+			   stats->compactions, stats->bytes_parsed,
+			   time_to_msec(stats->refresh_time));
+	}
+
+	dst = gossmap_find_node(gossmap, p->getroute->destination);
+	if (!dst) {
+		payment_fail(
+			p, "Unknown destination %s",
+			type_to_string(tmpctx, struct node_id,
+				       p->getroute->destination));
+
+		/* Let payment_finished_ handle this, so we mark it as pending */
+		return command_still_pending(p->cmd);
+	}
+
+	/* If we don't exist in gossip, routing can't happen. */
+	src = gossmap_find_node(gossmap, p->local_id);
+	if (!src) {
+		payment_fail(p, "We don't have any channels");
+
+		/* Let payment_finished_ handle this, so we mark it as pending */
+		return command_still_pending(p->cmd);
+	}
+
+	rs = route_search_new(p, src, dst);
+	if (route_workers)
+		route_search_submit(route_workers, rs);
+	else {
+		route_search_run(dijctx, rs);
+		route_search_done(rs);
+	}
 	return command_still_pending(p->cmd);
 }
 
@@ -2827,7 +3311,7 @@ static void direct_pay_override(struct payment *p) {
 	/* The root has performed the search for a direct channel. */
 	struct payment *root = payment_root(p);
 	struct direct_pay_data *d;
-	struct channel_hint *hint = NULL;
+	struct channel_hint *hint;
 
 	/* If we were unable to find a direct channel we don't need to do
 	 * anything. */
@@ -2838,14 +3322,7 @@ static void direct_pay_override(struct payment *p) {
 
 	/* If we have a channel we need to make sure that it still has
 	 * sufficient capacity. Look it up in the channel_hints. */
-	for (size_t i=0; i<tal_count(root->channel_hints); i++) {
-		struct short_channel_id_dir *cur = &root->channel_hints[i].scid;
-		if (short_channel_id_eq(&cur->scid, &d->chan->scid) &&
-		    cur->dir == d->chan->dir) {
-			hint = &root->channel_hints[i];
-			break;
-		}
-	}
+	hint = find_hint(root, &d->chan->scid, d->chan->dir);
 
 	if (hint && hint->enabled &&
 	    amount_msat_greater(hint->estimated_capacity, p->amount)) {
@@ -6,6 +6,9 @@
 #include <plugins/libplugin.h>
 #include <wire/onion_wire.h>
 
+struct channel_hint_map;
+struct channel_hint_snapshot;
+
 struct legacy_payload {
 	struct short_channel_id scid;
 	struct amount_msat forward_amt;
@@ -232,6 +235,10 @@ struct payment {
 	/* tal_arr of channel_hints we incrementally learn while performing
 	 * payment attempts. */
 	struct channel_hint *channel_hints;
+	/* Index into the above, by short_channel_id_dir. */
+	struct channel_hint_map *channel_hints_map;
+	/* Copy of the above for route searches, NULL if out of date. */
+	struct channel_hint_snapshot *channel_hints_snapshot;
 	struct node_id *excluded_nodes;
 
 	/* Optional temporarily excluded channels/nodes (i.e. this routehint) */
@@ -411,6 +418,11 @@ struct payment *payment_new(tal_t *ctx, struct command *cmd,
 void payment_start(struct payment *p);
 void payment_continue(struct payment *p);
 
+/* How many threads to search for routes with, so the parts of a multi-part
+ * payment don't wait for each other.  0 means search on the main thread.
+ * Only read when the first payment is created. */
+extern u32 payment_route_threads;
+
 /**
  * Set the payment to the current step.
  *
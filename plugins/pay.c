@@ -2103,5 +2103,9 @@ int main(int argc, char *argv[])
 		    plugin_option("disable-mpp", "flag",
 				  "Disable multi-part payments.",
 				  flag_option, &disablempp),
+		    plugin_option("pay-route-threads", "int",
+				  "Number of threads to find routes with"
+				  " (0 to use the main thread).",
+				  u32_option, &payment_route_threads),
 		    NULL);
 }
@@ -0,0 +1,614 @@
+#include <assert.h>
+#include <ccan/err/err.h>
+#include <ccan/opt/opt.h>
+#include <ccan/time/time.h>
+#include <common/gossip_store.h>
+#include <common/setup.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <wire/peer_wire.h>
+
+#include "../libplugin-pay.c"
+
+/* We don't want hashes to be random: we're a benchmark. */
+const struct siphash_seed *siphash_seed(void)
+{
+	static struct siphash_seed seed;
+	return &seed;
+}
+
+/* AUTOGENERATED MOCKS START */
+/* Generated stub for command_finished */
+struct command_result *command_finished(struct command *cmd UNNEEDED, struct json_stream *response UNNEEDED)
+{ fprintf(stderr, "command_finished called!\n"); abort(); }
+/* Generated stub for command_still_pending */
+struct command_result *command_still_pending(struct command *cmd)
+
+{ fprintf(stderr, "command_still_pending called!\n"); abort(); }
+/* Generated stub for feature_offered */
+bool feature_offered(const u8 *features UNNEEDED, size_t f UNNEEDED)
+{ fprintf(stderr, "feature_offered called!\n"); abort(); }
+/* Generated stub for fromwire_incorrect_or_unknown_payment_details */
+bool fromwire_incorrect_or_unknown_payment_details(const void *p UNNEEDED, struct amount_msat *htlc_msat UNNEEDED, u32 *height UNNEEDED)
+{ fprintf(stderr, "fromwire_incorrect_or_unknown_payment_details called!\n"); abort(); }
+/* Generated stub for json_add_amount_msat_compat */
+void json_add_amount_msat_compat(struct json_stream *result UNNEEDED,
+				 struct amount_msat msat UNNEEDED,
+				 const char *rawfieldname UNNEEDED,
+				 const char *msatfieldname)
+
+{ fprintf(stderr, "json_add_amount_msat_compat called!\n"); abort(); }
+/* Generated stub for json_add_amount_msat_only */
+void json_add_amount_msat_only(struct json_stream *result UNNEEDED,
+			  const char *msatfieldname UNNEEDED,
+			  struct amount_msat msat)
+
+{ fprintf(stderr, "json_add_amount_msat_only called!\n"); abort(); }
+/* Generated stub for json_add_hex_talarr */
+void json_add_hex_talarr(struct json_stream *result UNNEEDED,
+			 const char *fieldname UNNEEDED,
+			 const tal_t *data UNNEEDED)
+{ fprintf(stderr, "json_add_hex_talarr called!\n"); abort(); }
+/* Generated stub for json_add_node_id */
+void json_add_node_id(struct json_stream *response UNNEEDED,
+				const char *fieldname UNNEEDED,
+				const struct node_id *id UNNEEDED)
+{ fprintf(stderr, "json_add_node_id called!\n"); abort(); }
+/* Generated stub for json_add_num */
+void json_add_num(struct json_stream *result UNNEEDED, const char *fieldname UNNEEDED,
+		  unsigned int value UNNEEDED)
+{ fprintf(stderr, "json_add_num called!\n"); abort(); }
+/* Generated stub for json_add_preimage */
+void json_add_preimage(struct json_stream *result UNNEEDED, const char *fieldname UNNEEDED,
+		     const struct preimage *preimage UNNEEDED)
+{ fprintf(stderr, "json_add_preimage called!\n"); abort(); }
+/* Generated stub for json_add_secret */
+void json_add_secret(struct json_stream *response UNNEEDED,
+		     const char *fieldname UNNEEDED,
+		     const struct secret *secret UNNEEDED)
+{ fprintf(stderr, "json_add_secret called!\n"); abort(); }
+/* Generated stub for json_add_sha256 */
+void json_add_sha256(struct json_stream *result UNNEEDED, const char *fieldname UNNEEDED,
+		     const struct sha256 *hash UNNEEDED)
+{ fprintf(stderr, "json_add_sha256 called!\n"); abort(); }
+/* Generated stub for json_add_short_channel_id */
+void json_add_short_channel_id(struct json_stream *response UNNEEDED,
+			       const char *fieldname UNNEEDED,
+			       const struct short_channel_id *id UNNEEDED)
+{ fprintf(stderr, "json_add_short_channel_id called!\n"); abort(); }
+/* Generated stub for json_add_string */
+void json_add_string(struct json_stream *result UNNEEDED, const char *fieldname UNNEEDED, const char *value UNNEEDED)
+{ fprintf(stderr, "json_add_string called!\n"); abort(); }
+/* Generated stub for json_add_timeabs */
+void json_add_timeabs(struct json_stream *result UNNEEDED, const char *fieldname UNNEEDED,
+		      struct timeabs t UNNEEDED)
+{ fprintf(stderr, "json_add_timeabs called!\n"); abort(); }
+/* Generated stub for json_add_u32 */
+void json_add_u32(struct json_stream *result UNNEEDED, const char *fieldname UNNEEDED,
+		  uint32_t value UNNEEDED)
+{ fprintf(stderr, "json_add_u32 called!\n"); abort(); }
+/* Generated stub for json_add_u64 */
+void json_add_u64(struct json_stream *result UNNEEDED, const char *fieldname UNNEEDED,
+		  uint64_t value UNNEEDED)
+{ fprintf(stderr, "json_add_u64 called!\n"); abort(); }
+/* Generated stub for json_array_end */
+void json_array_end(struct json_stream *js UNNEEDED)
+{ fprintf(stderr, "json_array_end called!\n"); abort(); }
+/* Generated stub for json_array_start */
+void json_array_start(struct json_stream *js UNNEEDED, const char *fieldname UNNEEDED)
+{ fprintf(stderr, "json_array_start called!\n"); abort(); }
+/* Generated stub for json_get_member */
+const jsmntok_t *json_get_member(const char *buffer UNNEEDED, const jsmntok_t tok[] UNNEEDED,
+				 const char *label UNNEEDED)
+{ fprintf(stderr, "json_get_member called!\n"); abort(); }
+/* Generated stub for json_next */
+const jsmntok_t *json_next(const jsmntok_t *tok UNNEEDED)
+{ fprintf(stderr, "json_next called!\n"); abort(); }
+/* Generated stub for json_object_end */
+void json_object_end(struct json_stream *js UNNEEDED)
+{ fprintf(stderr, "json_object_end called!\n"); abort(); }
+/* Generated stub for json_object_start */
+void json_object_start(struct json_stream *ks UNNEEDED, const char *fieldname UNNEEDED)
+{ fprintf(stderr, "json_object_start called!\n"); abort(); }
+/* Generated stub for json_strdup */
+char *json_strdup(const tal_t *ctx UNNEEDED, const char *buffer UNNEEDED, const jsmntok_t *tok UNNEEDED)
+{ fprintf(stderr, "json_strdup called!\n"); abort(); }
+/* Generated stub for json_to_bool */
+bool json_to_bool(const char *buffer UNNEEDED, const jsmntok_t *tok UNNEEDED, bool *b UNNEEDED)
+{ fprintf(stderr, "json_to_bool called!\n"); abort(); }
+/* Generated stub for json_to_createonion_response */
+struct createonion_response *json_to_createonion_response(const tal_t *ctx UNNEEDED,
+							  const char *buffer UNNEEDED,
+							  const jsmntok_t *toks UNNEEDED)
+{ fprintf(stderr, "json_to_createonion_response called!\n"); abort(); }
+/* Generated stub for json_to_int */
+bool json_to_int(const char *buffer UNNEEDED, const jsmntok_t *tok UNNEEDED, int *num UNNEEDED)
+{ fprintf(stderr, "json_to_int called!\n"); abort(); }
+/* Generated stub for json_to_listpeers_result */
+struct listpeers_result *json_to_listpeers_result(const tal_t *ctx UNNEEDED,
+						  const char *buffer UNNEEDED,
+						  const jsmntok_t *tok UNNEEDED)
+{ fprintf(stderr, "json_to_listpeers_result called!\n"); abort(); }
+/* Generated stub for json_to_msat */
+bool json_to_msat(const char *buffer UNNEEDED, const jsmntok_t *tok UNNEEDED,
+		  struct amount_msat *msat UNNEEDED)
+{ fprintf(stderr, "json_to_msat called!\n"); abort(); }
+/* Generated stub for json_to_node_id */
+bool json_to_node_id(const char *buffer UNNEEDED, const jsmntok_t *tok UNNEEDED,
+			       struct node_id *id UNNEEDED)
+{ fprintf(stderr, "json_to_node_id called!\n"); abort(); }
+/* Generated stub for json_to_number */
+bool json_to_number(const char *buffer UNNEEDED, const jsmntok_t *tok UNNEEDED,
+		    unsigned int *num UNNEEDED)
+{ fprintf(stderr, "json_to_number called!\n"); abort(); }
+/* Generated stub for json_to_preimage */
+bool json_to_preimage(const char *buffer UNNEEDED, const jsmntok_t *tok UNNEEDED, struct preimage *preimage UNNEEDED)
+{ fprintf(stderr, "json_to_preimage called!\n"); abort(); }
+/* Generated stub for json_to_sat */
+bool json_to_sat(const char *buffer UNNEEDED, const jsmntok_t *tok UNNEEDED,
+		 struct amount_sat *sat UNNEEDED)
+{ fprintf(stderr, "json_to_sat called!\n"); abort(); }
+/* Generated stub for json_to_short_channel_id */
+bool json_to_short_channel_id(const char *buffer UNNEEDED, const jsmntok_t *tok UNNEEDED,
+			      struct short_channel_id *scid UNNEEDED)
+{ fprintf(stderr, "json_to_short_channel_id called!\n"); abort(); }
+/* Generated stub for json_to_u16 */
+bool json_to_u16(const char *buffer UNNEEDED, const jsmntok_t *tok UNNEEDED,
+                 uint16_t *num UNNEEDED)
+{ fprintf(stderr, "json_to_u16 called!\n"); abort(); }
+/* Generated stub for json_to_u32 */
+bool json_to_u32(const char *buffer UNNEEDED, const jsmntok_t *tok UNNEEDED,
+		 uint32_t *num UNNEEDED)
+{ fprintf(stderr, "json_to_u32 called!\n"); abort(); }
+/* Generated stub for json_to_u64 */
+bool json_to_u64(const char *buffer UNNEEDED, const jsmntok_t *tok UNNEEDED,
+		 uint64_t *num UNNEEDED)
+{ fprintf(stderr, "json_to_u64 called!\n"); abort(); }
+/* Generated stub for json_tok_bin_from_hex */
+u8 *json_tok_bin_from_hex(const tal_t *ctx UNNEEDED, const char *buffer UNNEEDED, const jsmntok_t *tok UNNEEDED)
+{ fprintf(stderr, "json_tok_bin_from_hex called!\n"); abort(); }
+/* Generated stub for json_tok_full */
+const char *json_tok_full(const char *buffer UNNEEDED, const jsmntok_t *t UNNEEDED)
+{ fprintf(stderr, "json_tok_full called!\n"); abort(); }
+/* Generated stub for json_tok_full_len */
+int json_tok_full_len(const jsmntok_t *t UNNEEDED)
+{ fprintf(stderr, "json_tok_full_len called!\n"); abort(); }
+/* Generated stub for json_tok_streq */
+bool json_tok_streq(const char *buffer UNNEEDED, const jsmntok_t *tok UNNEEDED, const char *str UNNEEDED)
+{ fprintf(stderr, "json_tok_streq called!\n"); abort(); }
+/* Generated stub for jsonrpc_request_start_ */
+struct out_req *jsonrpc_request_start_(struct plugin *plugin UNNEEDED, struct command *cmd UNNEEDED,
+				       const char *method UNNEEDED,
+				       struct command_result *(*cb)(struct command *command UNNEEDED,
+								    const char *buf UNNEEDED,
+								    const jsmntok_t *result UNNEEDED,
+								    void *arg) UNNEEDED,
+				       struct command_result *(*errcb)(struct command *command UNNEEDED,
+								       const char *buf UNNEEDED,
+								       const jsmntok_t *result UNNEEDED,
+								       void *arg) UNNEEDED,
+				       void *arg UNNEEDED)
+{ fprintf(stderr, "jsonrpc_request_start_ called!\n"); abort(); }
+/* Generated stub for jsonrpc_stream_fail */
+struct json_stream *jsonrpc_stream_fail(struct command *cmd UNNEEDED,
+					int code UNNEEDED,
+					const char *err UNNEEDED)
+{ fprintf(stderr, "jsonrpc_stream_fail called!\n"); abort(); }
+/* Generated stub for jsonrpc_stream_success */
+struct json_stream *jsonrpc_stream_success(struct command *cmd UNNEEDED)
+{ fprintf(stderr, "jsonrpc_stream_success called!\n"); abort(); }
+/* Generated stub for notleak_ */
+void *notleak_(const void *ptr UNNEEDED, bool plus_children UNNEEDED)
+{ fprintf(stderr, "notleak_ called!\n"); abort(); }
+/* Generated stub for onion_wire_name */
+const char *onion_wire_name(int e UNNEEDED)
+{ fprintf(stderr, "onion_wire_name called!\n"); abort(); }
+/* Generated stub for plugin_err */
+void  plugin_err(struct plugin *p UNNEEDED, const char *fmt UNNEEDED, ...)
+{ fprintf(stderr, "plugin_err called!\n"); abort(); }
+/* Generated stub for pseudorand */
+uint64_t pseudorand(uint64_t max UNNEEDED)
+{ fprintf(stderr, "pseudorand called!\n"); abort(); }
+/* Generated stub for pseudorand_double */
+double pseudorand_double(void)
+{ fprintf(stderr, "pseudorand_double called!\n"); abort(); }
+/* Generated stub for random_select */
+bool random_select(double weight UNNEEDED, double *tot_weight UNNEEDED)
+{ fprintf(stderr, "random_select called!\n"); abort(); }
+/* Generated stub for send_outreq */
+struct command_result *send_outreq(struct plugin *plugin UNNEEDED, const struct out_req *req UNNEEDED)
+{ fprintf(stderr, "send_outreq called!\n"); abort(); }
+/* Generated stub for tlv_tlv_payload_new */
+struct tlv_tlv_payload *tlv_tlv_payload_new(const tal_t *ctx UNNEEDED)
+{ fprintf(stderr, "tlv_tlv_payload_new called!\n"); abort(); }
+/* Generated stub for tlvstream_set_raw */
+void tlvstream_set_raw(struct tlv_field **stream UNNEEDED, u64 type UNNEEDED, void *value UNNEEDED, size_t valuelen UNNEEDED)
+{ fprintf(stderr, "tlvstream_set_raw called!\n"); abort(); }
+/* Generated stub for tlvstream_set_short_channel_id */
+void tlvstream_set_short_channel_id(struct tlv_field **stream UNNEEDED, u64 type UNNEEDED,
+				    struct short_channel_id *value UNNEEDED)
+{ fprintf(stderr, "tlvstream_set_short_channel_id called!\n"); abort(); }
+/* Generated stub for tlvstream_set_tu32 */
+void tlvstream_set_tu32(struct tlv_field **stream UNNEEDED, u64 type UNNEEDED, u32 value UNNEEDED)
+{ fprintf(stderr, "tlvstream_set_tu32 called!\n"); abort(); }
+/* Generated stub for tlvstream_set_tu64 */
+void tlvstream_set_tu64(struct tlv_field **stream UNNEEDED, u64 type UNNEEDED, u64 value UNNEEDED)
+{ fprintf(stderr, "tlvstream_set_tu64 called!\n"); abort(); }
+/* Generated stub for towire_bigsize */
+void towire_bigsize(u8 **pptr UNNEEDED, const bigsize_t val UNNEEDED)
+{ fprintf(stderr, "towire_bigsize called!\n"); abort(); }
+/* Generated stub for towire_secret */
+void towire_secret(u8 **pptr UNNEEDED, const struct secret *secret UNNEEDED)
+{ fprintf(stderr, "towire_secret called!\n"); abort(); }
+/* Generated stub for towire_tlvstream_raw */
+void towire_tlvstream_raw(u8 **pptr UNNEEDED, const struct tlv_field *fields UNNEEDED)
+{ fprintf(stderr, "towire_tlvstream_raw called!\n"); abort(); }
+/* AUTOGENERATED MOCKS END */
+
+/* Hints are logged as they're added */
+void plugin_log(struct plugin *p, enum log_level l, const char *fmt, ...)
+{
+}
+
+static struct node_id nodeid(u32 n)
+{
+	struct node_id id;
+
+	/* gossmap never checks these are valid points */
+	memset(&id, 0, sizeof(id));
+	id.k[0] = 0x02;
+	id.k[1] = n >> 24;
+	id.k[2] = n >> 16;
+	id.k[3] = n >> 8;
+	id.k[4] = n;
+	return id;
+}
+
+static void add_bytes(u8 **p, const void *mem, size_t len)
+{
+	size_t off = tal_count(*p);
+	tal_resize(p, off + len);
+	memcpy(*p + off, mem, len);
+}
+
+static void add_be16(u8 **p, u16 v)
+{
+	be16 be = cpu_to_be16(v);
+	add_bytes(p, &be, sizeof(be));
+}
+
+static void add_be32(u8 **p, u32 v)
+{
+	be32 be = cpu_to_be32(v);
+	add_bytes(p, &be, sizeof(be));
+}
+
+static void add_be64(u8 **p, u64 v)
+{
+	be64 be = cpu_to_be64(v);
+	add_bytes(p, &be, sizeof(be));
+}
+
+static void add_zeros(u8 **p, size_t len)
+{
+	size_t off = tal_count(*p);
+	tal_resizez(p, off + len);
+}
+
+static void write_record(int fd, const u8 *msg)
+{
+	struct gossip_hdr hdr;
+
+	hdr.len = cpu_to_be32(tal_count(msg));
+	hdr.crc = 0;
+	hdr.timestamp = 0;
+	if (write(fd, &hdr, sizeof(hdr)) != sizeof(hdr)
+	    || write(fd, msg, tal_count(msg)) != tal_count(msg))
+		err(1, "writing gossip_store");
+}
+
+static void write_announce(int fd, u64 scid, u32 n1, u32 n2)
+{
+	u8 *msg = tal_arr(tmpctx, u8, 0);
+	struct node_id id[2];
+
+	/* Lesser node_id goes first */
+	id[0] = nodeid(n1 < n2 ? n1 : n2);
+	id[1] = nodeid(n1 < n2 ? n2 : n1);
+
+	add_be16(&msg, WIRE_CHANNEL_ANNOUNCEMENT);
+	add_zeros(&msg, 64 * 4);
+	/* features */
+	add_be16(&msg, 0);
+	/* chain_hash */
+	add_zeros(&msg, 32);
+	add_be64(&msg, scid);
+	add_bytes(&msg, id[0].k, sizeof(id[0].k));
+	add_bytes(&msg, id[1].k, sizeof(id[1].k));
+	/* bitcoin keys */
+	add_zeros(&msg, PUBKEY_CMPR_LEN * 2);
+	write_record(fd, msg);
+}
+
+static void write_update(int fd, u64 scid, int dir,
+			 u32 base_fee, u32 proportional_fee, u16 delay)
+{
+	u8 *msg = tal_arr(tmpctx, u8, 0);
+
+	add_be16(&msg, WIRE_CHANNEL_UPDATE);
+	add_zeros(&msg, 64 + 32);
+	add_be64(&msg, scid);
+	/* timestamp */
+	add_be32(&msg, 1);
+	/* message_flags: option_channel_htlc_max */
+	tal_arr_expand(&msg, 1);
+	/* channel_flags */
+	tal_arr_expand(&msg, dir);
+	add_be16(&msg, delay);
+	add_be64(&msg, 0);
+	add_be32(&msg, base_fee);
+	add_be32(&msg, proportional_fee);
+	add_be64(&msg, 1000000000);
+	write_record(fd, msg);
+}
+
+/* Every node gets two random channels to lower nodes. */
+static struct gossmap *random_gossmap(const tal_t *ctx, size_t num_nodes)
+{
+	char *fname = tal_strdup(tmpctx, "/tmp/run-bench-chanhints.XXXXXX");
+	int fd = mkstemp(fname);
+	u8 version = GOSSIP_STORE_VERSION;
+	struct gossmap *map;
+	u64 scid = 1;
+
+	if (fd < 0)
+		err(1, "Creating %s", fname);
+	if (write(fd, &version, sizeof(version)) != sizeof(version))
+		err(1, "writing gossip_store");
+
+	for (size_t n = 1; n < num_nodes; n++) {
+		for (size_t i = 0; i < 2; i++) {
+			u32 randnode = random() % n;
+
+			write_announce(fd, scid, n, randnode);
+			for (int dir = 0; dir < 2; dir++)
+				write_update(fd, scid, dir,
+					     random() % 1000,
+					     random() % 1000,
+					     random() % 144);
+			scid++;
+		}
+	}
+	close(fd);
+
+	map = gossmap_load(ctx, fname);
+	unlink(fname);
+	return map;
+}
+
+/* Just enough of a root payment for route searches. */
+static struct payment *new_root_payment(const tal_t *ctx)
+{
+	struct payment *p = talz(ctx, struct payment);
+
+	p->parent = NULL;
+	channel_hints_init(p);
+	p->excluded_nodes = tal_arr(p, struct node_id, 0);
+	p->getroute = tal(p, struct getroute_request);
+	p->getroute->amount = AMOUNT_MSAT(100000);
+	p->getroute->riskfactorppm = 10000000;
+	p->getroute->max_hops = ROUTING_MAX_HOPS;
+	return p;
+}
+
+static struct route_search *random_search(const tal_t *ctx,
+					  struct payment *p,
+					  size_t num_nodes)
+{
+	struct node_id srcid = nodeid(random() % num_nodes);
+	struct node_id dstid = nodeid(random() % num_nodes);
+
+	return tal_steal(ctx,
+			 route_search_new(p,
+					  gossmap_find_node(gossmap, &srcid),
+					  gossmap_find_node(gossmap, &dstid)));
+}
+
+static struct timerel time_routes(struct payment *p,
+				  struct dijkstra_ctx *dctx,
+				  size_t num_nodes, size_t num_runs)
+{
+	struct timemono start = time_mono();
+
+	for (size_t i = 0; i < num_runs; i++)
+		route_search_run(dctx, random_search(tmpctx, p, num_nodes));
+	return timemono_since(start);
+}
+
+/* Our fake worker pool: each thread takes the next search. */
+struct bench_workers {
+	pthread_mutex_t lock;
+	struct route_search **searches;
+	size_t next;
+};
+
+struct bench_worker {
+	struct bench_workers *bw;
+	/* Like the real workers, we allocate this on the main thread. */
+	struct dijkstra_ctx *dctx;
+};
+
+static void *bench_worker(void *arg)
+{
+	struct bench_worker *w = arg;
+	struct bench_workers *bw = w->bw;
+
+	for (;;) {
+		struct route_search *rs = NULL;
+
+		pthread_mutex_lock(&bw->lock);
+		if (bw->next < tal_count(bw->searches))
+			rs = bw->searches[bw->next++];
+		pthread_mutex_unlock(&bw->lock);
+		if (!rs)
+			break;
+		route_search_run(w->dctx, rs);
+	}
+	return NULL;
+}
+
+static struct route_search **random_searches(const tal_t *ctx,
+					     struct payment *p,
+					     size_t num_nodes, size_t num_runs)
+{
+	struct route_search **searches;
+
+	searches = tal_arr(ctx, struct route_search *, num_runs);
+	for (size_t i = 0; i < num_runs; i++)
+		searches[i] = random_search(searches, p, num_nodes);
+	return searches;
+}
+
+int main(int argc, char *argv[])
+{
+	struct payment *root;
+	struct dijkstra_ctx *dctx;
+	struct route_search *rs, **serial, **parallel;
+	struct bench_workers bw;
+	struct bench_worker *workers;
+	pthread_t *threads;
+	struct gossmap_chan *c;
+	struct gossmap_node *n;
+	struct short_channel_id scid;
+	struct amount_msat big = AMOUNT_MSAT(1000000000000);
+	size_t num_nodes = 100, num_runs = 1, num_threads = 2, num_hints;
+	struct node_id id;
+	struct timemono start;
+	struct timerel serial_time, parallel_time;
+
+	common_setup(argv[0]);
+	opt_parse(&argc, argv, opt_log_stderr_exit);
+
+	if (argc > 1)
+		num_nodes = atoi(argv[1]);
+	if (argc > 2)
+		num_runs = atoi(argv[2]);
+	if (argc > 3)
+		num_threads = atoi(argv[3]);
+	if (argc > 4)
+		opt_usage_and_exit("[num_nodes [num_runs [num_threads]]]");
+
+	srandom(1);
+	gossmap = random_gossmap(NULL, num_nodes);
+	assert(gossmap);
+	dctx = dijkstra_ctx_new(gossmap);
+	root = new_root_payment(gossmap);
+
+	/* Hints are found, and used. */
+	c = gossmap_first_chan(gossmap);
+	scid = gossmap_chan_scid(gossmap, c);
+	rs = random_search(tmpctx, root, num_nodes);
+	assert(payment_route_check(gossmap, c, 0, AMOUNT_MSAT(1000), rs));
+	channel_hints_update(root, scid, 0, false, false, NULL, NULL);
+	assert(find_hint(root, &scid, 0));
+	assert(!find_hint(root, &scid, 1));
+
+	/* A search only sees hints from when it started. */
+	assert(payment_route_check(gossmap, c, 0, AMOUNT_MSAT(1000), rs));
+	rs = random_search(tmpctx, root, num_nodes);
+	assert(!payment_route_check(gossmap, c, 0, AMOUNT_MSAT(1000), rs));
+	assert(payment_route_check(gossmap, c, 1, AMOUNT_MSAT(1000), rs));
+
+	channel_hints_update(root, scid, 1, true, false,
+			     &AMOUNT_MSAT(1000), NULL);
+	rs = random_search(tmpctx, root, num_nodes);
+	assert(!payment_route_check(gossmap, c, 1, AMOUNT_MSAT(1000), rs));
+	assert(payment_route_check(gossmap, c, 1, AMOUNT_MSAT(999), rs));
+
+	/* Excluded nodes are excluded. */
+	n = gossmap_nth_node(gossmap, c, 0);
+	gossmap_node_get_id(gossmap, n, &id);
+	tal_arr_expand(&root->excluded_nodes, id);
+	rs = random_search(tmpctx, root, num_nodes);
+	for (size_t i = 0; i < n->num_chans; i++) {
+		int dir;
+		struct gossmap_chan *nc = gossmap_nth_chan(gossmap, n, i, &dir);
+		/* Going *to* n means going in direction !dir */
+		assert(!payment_route_check(gossmap, nc, !dir,
+					    AMOUNT_MSAT(1), rs));
+	}
+
+	/* Searches outlive their payments. */
+	tal_free(root);
+	assert(!rs->payment->p);
+	clean_tmpctx();
+
+	/* Now time routing as the number of hints grows. */
+	root = new_root_payment(gossmap);
+	c = gossmap_first_chan(gossmap);
+	num_hints = 0;
+	for (size_t target = 0; c; target = target ? target * 10 : 10) {
+		while (c && num_hints < target) {
+			scid = gossmap_chan_scid(gossmap, c);
+			for (int dir = 0; dir < 2; dir++)
+				channel_hints_update(root, scid, dir, true,
+						     false, &big, NULL);
+			num_hints += 2;
+			c = gossmap_next_chan(gossmap, c);
+		}
+		printf("%zu hints: %zu routes in %zu nodes in %"PRIu64" usec\n",
+		       num_hints, num_runs, num_nodes,
+		       time_to_usec(time_routes(root, dctx,
+						num_nodes, num_runs)));
+		clean_tmpctx();
+	}
+
+	/* Searching in parallel must give the same answers. */
+	srandom(2);
+	serial = random_searches(tmpctx, root, num_nodes, num_runs);
+	srandom(2);
+	parallel = random_searches(tmpctx, root, num_nodes, num_runs);
+
+	start = time_mono();
+	for (size_t i = 0; i < num_runs; i++)
+		route_search_run(dctx, serial[i]);
+	serial_time = timemono_since(start);
+
+	pthread_mutex_init(&bw.lock, NULL);
+	bw.searches = parallel;
+	bw.next = 0;
+	threads = tal_arr(tmpctx, pthread_t, num_threads);
+	workers = tal_arr(tmpctx, struct bench_worker, num_threads);
+	for (size_t i = 0; i < num_threads; i++) {
+		workers[i].bw = &bw;
+		workers[i].dctx = dijkstra_ctx_new(workers);
+	}
+	start = time_mono();
+	for (size_t i = 0; i < num_threads; i++)
+		pthread_create(&threads[i], NULL, bench_worker, &workers[i]);
+	for (size_t i = 0; i < num_threads; i++)
+		pthread_join(threads[i], NULL);
+	parallel_time = timemono_since(start);
+
+	for (size_t i = 0; i < num_runs; i++) {
+		assert(serial[i]->route_len == parallel[i]->route_len);
+		if (serial[i]->route_len > serial[i]->max_hops)
+			continue;
+		for (size_t j = 0; j < serial[i]->route_len; j++) {
+			assert(serial[i]->route[j].chan_idx
+			       == parallel[i]->route[j].chan_idx);
+			assert(serial[i]->route[j].dir
+			       == parallel[i]->route[j].dir);
+		}
+	}
+	printf("%zu routes in %zu nodes: serial %"PRIu64" usec,"
+	       " %zu threads %"PRIu64" usec\n",
+	       num_runs, num_nodes, time_to_usec(serial_time),
+	       num_threads, time_to_usec(parallel_time));
+
+	clean_tmpctx();
+	tal_free(gossmap);
+	common_shutdown();
+	opt_free_table();
+	return 0;
+}
@@ -7,6 +7,7 @@ from utils import wait_for, sync_blockheight, COMPAT, VALGRIND, DEVELOPER, only_
 import base64
 import os
 import pytest
+import sqlite3
 import time
 import unittest
 
@@ -298,3 +299,36 @@ def test_psql_key_value_dsn(node_factory, db_provider, monkeypatch):
     l1 = node_factory.get_node()
     opt = [o for o in l1.daemon.cmd_line if '--wallet' in o][0]
     assert('host=127.0.0.1' in opt)
+
+
+@unittest.skipIf(os.getenv('TEST_DB_PROVIDER', 'sqlite3') != 'sqlite3', "Only applicable to sqlite3")
+def test_sqlite3_wal(node_factory, bitcoind):
+    """Channel state survives restarts in WAL mode, with our checkpointer"""
+    l1, l2 = node_factory.line_graph(2, opts=[{'sqlite3-journal-mode': 'wal',
+                                               'sqlite3-checkpoint-sec': 1,
+                                               'sqlite3-cache-size': 4096},
+                                              {}])
+    configs = l1.rpc.listconfigs()
+    assert configs['sqlite3-journal-mode'] == 'wal'
+    assert configs['sqlite3-checkpoint-sec'] == 1
+
+    for i in range(5):
+        inv = l2.rpc.invoice(1000, 'test_sqlite3_wal{}'.format(i), 'desc')
+        l1.rpc.pay(inv['bolt11'])
+        # Let the checkpointer run between some of them.
+        time.sleep(0.5)
+
+    def to_us():
+        return only_one(only_one(l1.rpc.listpeers(l2.info['id'])['peers'])['channels'])['to_us_msat']
+
+    before = to_us()
+    l1.restart()
+    assert to_us() == before
+    l1.rpc.connect(l2.info['id'], 'localhost', l2.port)
+    wait_for(lambda: only_one(l1.rpc.listpeers(l2.info['id'])['peers'])['connected'])
+    inv = l2.rpc.invoice(1000, 'test_sqlite3_wal_restarted', 'desc')
+    l1.rpc.pay(inv['bolt11'])
+
+    # It's a property of the database, so it sticks.
+    db = sqlite3.connect(os.path.join(l1.daemon.lightning_dir, TEST_NETWORK, 'lightningd.sqlite3'))
+    assert db.execute("PRAGMA journal_mode;").fetchone()[0] == 'wal'
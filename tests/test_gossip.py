@@ -587,6 +587,12 @@ def test_gossip_query_channel_range(node_factory, bitcoind, chainparams):
                     + format(len(encoded) // 2, '04x')
                     + encoded]
 
+    # Asking again gives the same answer (from the cache this time).
+    assert l2.query_gossip('query_channel_range',
+                           chainparams['chain_hash'],
+                           0, 1000000,
+                           filters=['0109']) == msgs
+
     # Does not include scid12
     msgs = l2.query_gossip('query_channel_range',
                            genesis_blockhash,
@@ -1171,6 +1177,57 @@ def test_getroute_exclude_duplicate(node_factory):
     assert route == route3
 
 
+@unittest.skipIf(not DEVELOPER, "gossip propagation is slow without DEVELOPER=1")
+def test_getroute_cache(node_factory):
+    """Test that getroute reuses routes for similar amounts, without fuzz"""
+    l1, l2, l3 = node_factory.line_graph(3, wait_for_announce=True)
+
+    route = l1.rpc.getroute(l3.info['id'], 1000, 1, fuzzpercent=0)['route']
+    assert l1.rpc.getroutecache() == {'entries': 1, 'hits': 0, 'misses': 1}
+
+    # Same amount bucket, so we get the same channels.
+    route2 = l1.rpc.getroute(l3.info['id'], 1010, 1, fuzzpercent=0)['route']
+    assert [r['channel'] for r in route] == [r['channel'] for r in route2]
+    assert route2[-1]['msatoshi'] == 1010
+    assert l1.rpc.getroutecache() == {'entries': 1, 'hits': 1, 'misses': 1}
+
+    # Different bucket, different entry.
+    l1.rpc.getroute(l3.info['id'], 100000, 1, fuzzpercent=0)
+    assert l1.rpc.getroutecache() == {'entries': 2, 'hits': 1, 'misses': 2}
+
+    # Fuzzed routes are always searched for, and not cached.
+    l1.rpc.getroute(l3.info['id'], 1000, 1)
+    assert l1.rpc.getroutecache() == {'entries': 2, 'hits': 1, 'misses': 2}
+
+    # An update to a channel on the route forgets them.
+    l2.rpc.setchannelfee(l3.info['id'], 10, 10)
+    wait_for(lambda: l1.rpc.getroutecache()['entries'] == 0)
+    route3 = l1.rpc.getroute(l3.info['id'], 1000, 1, fuzzpercent=0)['route']
+    assert route3[0]['msatoshi'] < route[0]['msatoshi']
+    assert l1.rpc.getroutecache()['misses'] == 3
+
+
+def test_list_fields(node_factory):
+    """Test listchannels and listnodes only return the fields asked for"""
+    l1, l2, l3 = node_factory.line_graph(3, wait_for_announce=True)
+    wait_for(lambda: len(l1.rpc.listchannels()['channels']) == 4)
+
+    full = l1.rpc.listchannels()['channels']
+    chans = l1.rpc.listchannels(fields=['short_channel_id', 'active'])['channels']
+    assert chans == [{'short_channel_id': c['short_channel_id'],
+                      'active': c['active']} for c in full]
+
+    chans = l1.rpc.listchannels(source=l2.info['id'],
+                                fields=['destination'])['channels']
+    assert sorted([c['destination'] for c in chans]) == sorted([l1.info['id'], l3.info['id']])
+
+    nodes = l1.rpc.listnodes(l3.info['id'], fields=['alias'])['nodes']
+    assert nodes == [{'alias': l1.rpc.listnodes(l3.info['id'])['nodes'][0]['alias']}]
+
+    with pytest.raises(RpcError, match='unknown field'):
+        l1.rpc.listchannels(fields=['nodeid'])
+
+
 @unittest.skipIf(not DEVELOPER, "gossip propagation is slow without DEVELOPER=1")
 def test_getroute_exclude(node_factory, bitcoind):
     """Test getroute's exclude argument"""
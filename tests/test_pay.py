@@ -1000,6 +1000,20 @@ def test_decodepay(node_factory):
         l1.rpc.decodepay('1111111')
 
 
+@unittest.skipIf(not DEVELOPER, "Too slow without --dev-fast-gossip")
+def test_forward_group_commit(node_factory, executor):
+    """l2 gathers commitment updates from both channels into shared commits"""
+    l1, l2, l3 = node_factory.line_graph(3, opts=[{}, {'group-commit-ms': 50}, {}],
+                                         wait_for_announce=True)
+    assert l2.rpc.listconfigs()['group-commit-ms'] == 50
+
+    invs = [l3.rpc.invoice(1000, 'test_forward_group_commit{}'.format(i), 'desc')['bolt11']
+            for i in range(5)]
+    futs = [executor.submit(l1.rpc.pay, inv) for inv in invs]
+    for f in futs:
+        assert f.result(TIMEOUT)['status'] == 'complete'
+
+
 @unittest.skipIf(not DEVELOPER, "Too slow without --dev-fast-gossip")
 def test_forward(node_factory, bitcoind):
     # Connect 1 -> 2 -> 3.
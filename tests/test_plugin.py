@@ -477,6 +477,29 @@ def test_db_hook(node_factory, executor):
     assert [x for x in db1.iterdump()] == [x for x in db2.iterdump()]
 
 
+@unittest.skipIf(os.getenv('TEST_DB_PROVIDER', 'sqlite3') != 'sqlite3', "Only sqlite3 implements the db_write_hook currently")
+def test_db_hook_pipeline(node_factory, executor):
+    """The db hook still sees every write if we don't wait for each"""
+    dbfile = os.path.join(node_factory.directory, "dblog.sqlite3")
+    l1, l2 = node_factory.line_graph(2, opts=[{'plugin': os.path.join(os.getcwd(), 'tests/plugins/dblog.py'),
+                                               'dblog-file': dbfile,
+                                               'db-write-pipeline': 3},
+                                              {}])
+    assert l1.rpc.listconfigs()['db-write-pipeline'] == 3
+
+    for i in range(5):
+        inv = l2.rpc.invoice(1000, 'test_db_hook_pipeline{}'.format(i), 'desc')
+        l1.rpc.pay(inv['bolt11'])
+
+    # Stopping waits for the plugin to catch up.
+    l1.stop()
+
+    db1 = sqlite3.connect(os.path.join(l1.daemon.lightning_dir, TEST_NETWORK, 'lightningd.sqlite3'))
+    db2 = sqlite3.connect(dbfile)
+
+    assert [x for x in db1.iterdump()] == [x for x in db2.iterdump()]
+
+
 def test_utf8_passthrough(node_factory, executor):
     l1 = node_factory.get_node(options={'plugin': os.path.join(os.getcwd(), 'tests/plugins/utf8.py'),
                                         'log-level': 'io'})
@@ -5,7 +5,7 @@ set -e
 
 DIR=""
 TARGETS=""
-DEFAULT_TARGETS=" store_load_msec vsz_kb store_rewrite_sec listnodes_sec listchannels_sec routing_sec peer_write_all_sec peer_read_all_sec "
+DEFAULT_TARGETS=" store_load_msec vsz_kb store_rewrite_sec listnodes_sec listchannels_sec routing_sec peer_write_all_sec peer_read_all_sec store_load_nothreads_msec "
 MCP_DIR=../million-channels-project/data/1M/gossip/
 CSV=false
 
@@ -185,5 +185,22 @@ if [ -z "${TARGETS##* peer_read_all_sec *}" ] && [ "$DEVELOPER" = 1 ]; then
     mv "$DIR"/gossip_store.bak "$DIR"/gossip_store
 fi
 
+# Now load again with no worker threads, to compare with store_load_msec.
+if [ -z "${TARGETS##* store_load_nothreads_msec *}" ]; then
+    # shellcheck disable=SC2086
+    $LCLI1 stop > /dev/null
+    sleep 5
+    rm -f "$DIR"/peer
+    mv "$DIR"/log "$DIR"/log.threads.$$
+
+    $LIGHTNINGD --lightning-dir="$DIR" --log-file="$DIR"/log --log-level=debug --bind-addr="$DIR"/peer --gossip-sigcheck-threads=0 &
+    wait_for_start > /dev/null
+
+    while ! grep -q 'gossipd.*: total store load time' "$DIR"/log 2>/dev/null; do
+	sleep 1
+    done
+    grep 'gossipd.*: total store load time' "$DIR"/log | cut -d\  -f7 | print_stat store_load_nothreads_msec
+fi
+
 # shellcheck disable=SC2086
 $LCLI1 stop > /dev/null
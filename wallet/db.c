@@ -674,6 +674,23 @@ static void db_stmt_free(struct db_stmt *stmt)
 	assert(stmt->inner_stmt == NULL);
 }
 
+/* Every query has a slot in the perfect hash: anything else lands on the
+ * wrong query (or an empty slot). */
+static struct db_query *db_query_find(const struct db_config *config,
+				      const char *query_id)
+{
+	u32 h = db_query_hash(query_id);
+	u16 seed, idx;
+
+	seed = config->query_seeds[h % config->num_query_seeds];
+	idx = config->query_slots[db_query_seeded_hash(h, seed)
+				  % config->num_query_slots];
+	if (idx >= config->num_queries
+	    || !streq(config->queries[idx].name, query_id))
+		return NULL;
+	return &config->queries[idx];
+}
+
 struct db_stmt *db_prepare_v2_(const char *location, struct db *db,
 				     const char *query_id)
 {
@@ -691,12 +708,7 @@ struct db_stmt *db_prepare_v2_(const char *location, struct db *db,
 			 "transaction: %s", location);
 
 	/* Look up the query by its ID */
-	for (size_t i = 0; i < db->config->num_queries; i++) {
-		if (streq(query_id, db->config->queries[i].name)) {
-			stmt->query = &db->config->queries[i];
-			break;
-		}
-	}
+	stmt->query = db_query_find(db->config, query_id);
 	if (stmt->query == NULL)
 		fatal("Could not resolve query %s", query_id);
 
@@ -825,7 +837,7 @@ static void db_report_changes(struct db *db, const char *final, size_t min)
 	 * changes yet. */
 	assert(!tal_count(db->changes) || db->dirty);
 
-	if (tal_count(db->changes) > min)
+	if (tal_count(db->changes) > min || db->sync_writes)
 		plugin_hook_db_sync(db);
 	db->changes = tal_free(db->changes);
 }
@@ -904,6 +916,13 @@ void db_commit_transaction(struct db *db)
 
 	db->in_transaction = NULL;
 	db->dirty = false;
+	db->sync_writes = false;
+}
+
+void db_sync_writes(struct db *db)
+{
+	assert(db->in_transaction);
+	db->sync_writes = true;
 }
 
 static struct db_config *db_config_find(const char *dsn)
@@ -932,7 +951,8 @@ static struct db_config *db_config_find(const char *dsn)
 /**
  * db_open - Open or create a sqlite3 database
  */
-static struct db *db_open(const tal_t *ctx, char *filename)
+static struct db *db_open(const tal_t *ctx, char *filename,
+			  const struct db_sqlite3_opts *sqlite3_opts)
 {
 	struct db *db;
 
@@ -949,6 +969,12 @@ static struct db *db_open(const tal_t *ctx, char *filename)
 	tal_add_destructor(db, destroy_db);
 	db->in_transaction = NULL;
 	db->changes = NULL;
+	db->sync_writes = false;
+	db->query_stats = tal_arrz(db, struct db_query_stats,
+				   db->config->num_queries);
+	db->stmt_cache = NULL;
+	db->sqlite3_opts = sqlite3_opts;
+	db->driver_state = NULL;
 
 	/* This must be outside a transaction, so catch it */
 	assert(!db->in_transaction);
@@ -1061,7 +1087,7 @@ u32 db_data_version_get(struct db *db)
 struct db *db_setup(const tal_t *ctx, struct lightningd *ld,
 		    const struct ext_key *bip32_base)
 {
-	struct db *db = db_open(ctx, ld->wallet_dsn);
+	struct db *db = db_open(ctx, ld->wallet_dsn, &ld->sqlite3_opts);
 	db->log = new_log(db, ld->log_book, NULL, "database");
 
 	db_begin_transaction(db);
@@ -1770,7 +1796,10 @@ u8 *db_column_talarr(const tal_t *ctx, struct db_stmt *stmt, int col)
 
 bool db_exec_prepared_v2(struct db_stmt *stmt TAKES)
 {
-	bool ret = stmt->db->config->exec_fn(stmt);
+	bool ret;
+
+	stmt->db->query_stats[db_query_index(stmt)].execs++;
+	ret = stmt->db->config->exec_fn(stmt);
 
 	/* If this was a write we need to bump the data_version upon commit. */
 	stmt->db->dirty = stmt->db->dirty || !stmt->query->readonly;
@@ -1798,6 +1827,7 @@ bool db_query_prepared(struct db_stmt *stmt)
 	 * read-only path. */
 	bool ret;
 	assert(stmt->query->readonly);
+	stmt->db->query_stats[db_query_index(stmt)].execs++;
 	ret = stmt->db->config->query_fn(stmt);
 	stmt->executed = true;
 	list_del_from(&stmt->db->pending_statements, &stmt->list);
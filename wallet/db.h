@@ -47,6 +47,22 @@ struct wally_tx;
  */
 #define SQL(x) NAMED_SQL( __FILE__ ":" stringify(__COUNTER__), x)
 
+/* Tuning for the sqlite3 driver (ignored by others): NULL or 0 means
+ * we leave sqlite3's default. */
+struct db_sqlite3_opts {
+	/* PRAGMA journal_mode, e.g. "wal" */
+	char *journal_mode;
+	/* PRAGMA synchronous: "off", "normal", "full" or "extra"
+	 * (we use "full" if unset, so commits survive power loss). */
+	char *synchronous;
+	/* In WAL mode, checkpoint from a background thread this often,
+	 * rather than from whichever commit fills the WAL. */
+	u32 checkpoint_sec;
+	/* PRAGMA cache_size, in KiB */
+	u64 cache_size_kb;
+	/* PRAGMA mmap_size, in bytes */
+	u64 mmap_size;
+};
 
 /**
  * db_setup - Open a the lightningd database and update the schema
@@ -82,6 +98,16 @@ bool db_in_transaction(struct db *db);
  */
 void db_commit_transaction(struct db *db);
 
+/**
+ * db_sync_writes - Make the db_write hook catch up before committing
+ *
+ * With --db-write-pipeline, we don't wait for the db_write hook to
+ * acknowledge each transaction.  Call this before telling a peer about
+ * anything we saved, so committing this transaction waits until the hook
+ * has acknowledged it, and everything before it.
+ */
+void db_sync_writes(struct db *db);
+
 /**
  * db_set_intvar - Set an integer variable in the database
  *
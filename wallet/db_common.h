@@ -11,6 +11,8 @@
 #define db_fatal fatal
 #endif
 
+struct db_sqlite3_opts;
+
 struct db {
 	char *filename;
 	const char *in_transaction;
@@ -37,6 +39,29 @@ struct db {
 	/* The current DB version we expect to update if changes are
 	 * committed. */
 	u32 data_version;
+
+	/* Must the db_write hook catch up before we commit?  (see
+	 * db_sync_writes) */
+	bool sync_writes;
+
+	/* Indexed by query (see db_query_index): how often was each
+	 * prepared, and executed? */
+	struct db_query_stats *query_stats;
+
+	/* Driver-specific cache of prepared statements, indexed by query,
+	 * which lives as long as the connection. */
+	void *stmt_cache;
+
+	/* Tuning for the sqlite3 driver, or NULL for defaults. */
+	const struct db_sqlite3_opts *sqlite3_opts;
+
+	/* Driver-specific background state (e.g. checkpointer), or NULL. */
+	void *driver_state;
+};
+
+struct db_query_stats {
+	u64 prepares;
+	u64 execs;
 };
 
 struct db_query {
@@ -103,6 +128,14 @@ struct db_config {
 	struct db_query *queries;
 	size_t num_queries;
 
+	/* Perfect hash of the query names, generated with them: the hash
+	 * picks a seed, and the seeded hash picks a slot holding the index
+	 * into queries. */
+	const u16 *query_seeds;
+	size_t num_query_seeds;
+	const u16 *query_slots;
+	size_t num_query_slots;
+
 	/* Function used to execute a statement that doesn't result in a
 	 * response. */
 	bool (*exec_fn)(struct db_stmt *stmt);
@@ -144,6 +177,38 @@ struct db_config {
 	u32 (*version)(struct db *db);
 };
 
+/* Queries are always one of db->config->queries, so this is a cheap,
+ * dense index for per-query state. */
+static inline size_t db_query_index(const struct db_stmt *stmt)
+{
+	return stmt->query - stmt->db->config->queries;
+}
+
+/* FNV-1a: devtools/sql-rewrite.py uses the same (and the seeded hash below)
+ * to build the perfect hash in db_config. */
+static inline u32 db_query_hash(const char *name)
+{
+	u32 h = 2166136261U;
+
+	for (const u8 *p = (const u8 *)name; *p; p++) {
+		h ^= *p;
+		h *= 16777619U;
+	}
+	return h;
+}
+
+/* Mix the seed in, so we don't have to hash the name again. */
+static inline u32 db_query_seeded_hash(u32 h, u32 seed)
+{
+	h ^= seed * 0x9E3779B9U;
+	h ^= h >> 16;
+	h *= 0x85EBCA6BU;
+	h ^= h >> 13;
+	h *= 0xC2B2AE35U;
+	h ^= h >> 16;
+	return h;
+}
+
 /* Provide a way for DB backends to register themselves */
 AUTODATA_TYPE(db_backends, struct db_config);
 
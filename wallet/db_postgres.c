@@ -1,4 +1,5 @@
 #include "db_postgres_sqlgen.c"
+#include <ccan/array_size/array_size.h>
 #include <ccan/ccan/tal/str/str.h>
 #include <ccan/endian/endian.h>
 #include <lightningd/log.h>
@@ -41,6 +42,8 @@ static bool db_postgres_setup(struct db *db)
 		db->conn = NULL;
 		return false;
 	}
+	/* For each query, the types we prepared it with (NULL if not yet) */
+	db->stmt_cache = tal_arrz(db, Oid *, db->config->num_queries);
 	return true;
 }
 
@@ -74,6 +77,58 @@ static bool db_postgres_commit_tx(struct db *db)
 	return true;
 }
 
+/* A NULL can go anywhere; otherwise the types must be what we prepared with. */
+static bool db_postgres_types_match(const Oid *prepared, const Oid *types,
+				    size_t slots)
+{
+	for (size_t i = 0; i < slots; i++) {
+		if (types[i] != 0 && types[i] != prepared[i])
+			return false;
+	}
+	return true;
+}
+
+/* Statements are prepared the first time we see them, and kept for the
+ * life of the connection under their index. */
+static PGresult *db_postgres_exec_cached(struct db_stmt *stmt, int slots,
+					 const Oid *paramTypes,
+					 const char *const *paramValues,
+					 const int *paramLengths,
+					 const int *paramFormats,
+					 int resultFormat)
+{
+	Oid **cache = stmt->db->stmt_cache;
+	size_t idx = db_query_index(stmt);
+	char name[sizeof("cln_q") + 20];
+
+	snprintf(name, sizeof(name), "cln_q%zu", idx);
+	if (!cache[idx]) {
+		PGresult *res;
+
+		stmt->db->query_stats[idx].prepares++;
+		res = PQprepare(stmt->db->conn, name, stmt->query->query,
+				slots, paramTypes);
+		/* The caller reports the error (the transaction is dead now
+		 * anyway). */
+		if (PQresultStatus(res) != PGRES_COMMAND_OK)
+			return res;
+		PQclear(res);
+		cache[idx] = tal_arr(cache, Oid, slots);
+		memcpy(cache[idx], paramTypes, slots * sizeof(Oid));
+	}
+
+	if (db_postgres_types_match(cache[idx], paramTypes, slots))
+		return PQexecPrepared(stmt->db->conn, name, slots,
+				      paramValues, paramLengths, paramFormats,
+				      resultFormat);
+
+	/* Different types this time: the server has to parse it again. */
+	stmt->db->query_stats[idx].prepares++;
+	return PQexecParams(stmt->db->conn, stmt->query->query, slots,
+			    paramTypes, paramValues, paramLengths, paramFormats,
+			    resultFormat);
+}
+
 static PGresult *db_postgres_do_exec(struct db_stmt *stmt)
 {
 	int slots = stmt->query->placeholders;
@@ -130,9 +185,9 @@ static PGresult *db_postgres_do_exec(struct db_stmt *stmt)
 			break;
 		}
 	}
-	return PQexecParams(stmt->db->conn, stmt->query->query, slots,
-			    paramTypes, paramValues, paramLengths, paramFormats,
-			    resultFormat);
+	return db_postgres_exec_cached(stmt, slots, paramTypes, paramValues,
+				       paramLengths, paramFormats,
+				       resultFormat);
 }
 
 static bool db_postgres_query(struct db_stmt *stmt)
@@ -250,12 +305,19 @@ static size_t db_postgres_count_changes(struct db_stmt *stmt)
 
 static void db_postgres_teardown(struct db *db)
 {
+	/* Prepared statements go away with the connection. */
+	db->stmt_cache = tal_free(db->stmt_cache);
 }
 
 struct db_config db_postgres_config = {
     .name = "postgres",
     .queries = db_postgres_queries,
     .num_queries = DB_POSTGRES_QUERY_COUNT,
+
+    .query_seeds = db_postgres_query_seeds,
+    .num_query_seeds = ARRAY_SIZE(db_postgres_query_seeds),
+    .query_slots = db_postgres_query_slots,
+    .num_query_slots = ARRAY_SIZE(db_postgres_query_slots),
     .exec_fn = db_postgres_exec,
     .query_fn = db_postgres_query,
     .step_fn = db_postgres_step,
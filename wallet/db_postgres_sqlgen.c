@@ -1656,8 +1656,357 @@ struct db_query db_postgres_queries[] = {
 
 #define DB_POSTGRES_QUERY_COUNT 274
 
+const u16 db_postgres_query_seeds[] = {
+    16,
+    26,
+    238,
+    55,
+    751,
+    241,
+    1,
+    11,
+    81,
+    142,
+    22,
+    21,
+    1,
+    2,
+    104,
+    10,
+    1,
+    1,
+    31,
+    226,
+    30,
+    4,
+    39,
+    42,
+    224,
+    18,
+    1,
+    12,
+    27,
+    1,
+    55,
+    43,
+    94,
+    483,
+    505,
+    9,
+    2,
+    3,
+    158,
+    124,
+    5,
+    6,
+    5,
+    383,
+    428,
+    197,
+    103,
+    98,
+    6,
+    461,
+    23,
+    37,
+    189,
+    25,
+    7,
+    2,
+    4007,
+    4,
+    297,
+    23,
+    1201,
+    12,
+    65,
+    2762,
+    357,
+    685,
+    5,
+    814,
+    6,
+};
+
+const u16 db_postgres_query_slots[] = {
+    45,
+    44,
+    49,
+    58,
+    120,
+    216,
+    214,
+    152,
+    198,
+    71,
+    238,
+    97,
+    30,
+    199,
+    232,
+    158,
+    122,
+    235,
+    147,
+    98,
+    41,
+    209,
+    263,
+    20,
+    12,
+    145,
+    244,
+    249,
+    177,
+    208,
+    114,
+    135,
+    236,
+    133,
+    107,
+    59,
+    3,
+    221,
+    69,
+    70,
+    52,
+    223,
+    50,
+    176,
+    82,
+    143,
+    230,
+    5,
+    161,
+    63,
+    112,
+    262,
+    255,
+    38,
+    93,
+    256,
+    175,
+    121,
+    154,
+    197,
+    62,
+    48,
+    15,
+    85,
+    210,
+    25,
+    53,
+    115,
+    27,
+    0,
+    67,
+    171,
+    84,
+    57,
+    170,
+    34,
+    179,
+    250,
+    188,
+    54,
+    165,
+    131,
+    259,
+    61,
+    151,
+    234,
+    246,
+    181,
+    272,
+    32,
+    186,
+    138,
+    13,
+    124,
+    260,
+    76,
+    264,
+    261,
+    96,
+    195,
+    116,
+    189,
+    193,
+    88,
+    47,
+    194,
+    106,
+    73,
+    212,
+    75,
+    160,
+    225,
+    64,
+    196,
+    18,
+    104,
+    129,
+    105,
+    89,
+    28,
+    123,
+    242,
+    220,
+    162,
+    68,
+    273,
+    43,
+    101,
+    119,
+    146,
+    77,
+    51,
+    35,
+    173,
+    270,
+    87,
+    191,
+    174,
+    134,
+    127,
+    168,
+    205,
+    16,
+    167,
+    29,
+    103,
+    192,
+    144,
+    91,
+    11,
+    183,
+    100,
+    46,
+    201,
+    65,
+    78,
+    42,
+    117,
+    247,
+    231,
+    157,
+    190,
+    7,
+    8,
+    215,
+    14,
+    31,
+    258,
+    6,
+    56,
+    22,
+    60,
+    172,
+    140,
+    159,
+    206,
+    269,
+    125,
+    9,
+    228,
+    149,
+    36,
+    150,
+    213,
+    240,
+    219,
+    108,
+    211,
+    24,
+    248,
+    253,
+    130,
+    245,
+    243,
+    207,
+    241,
+    90,
+    2,
+    185,
+    164,
+    80,
+    251,
+    202,
+    66,
+    155,
+    19,
+    99,
+    204,
+    224,
+    178,
+    222,
+    37,
+    265,
+    257,
+    239,
+    95,
+    271,
+    136,
+    4,
+    109,
+    92,
+    33,
+    79,
+    184,
+    1,
+    40,
+    39,
+    26,
+    218,
+    237,
+    227,
+    102,
+    233,
+    94,
+    180,
+    254,
+    153,
+    55,
+    166,
+    10,
+    139,
+    203,
+    110,
+    156,
+    83,
+    226,
+    169,
+    252,
+    86,
+    113,
+    182,
+    137,
+    132,
+    21,
+    17,
+    72,
+    229,
+    128,
+    141,
+    81,
+    111,
+    118,
+    268,
+    187,
+    200,
+    267,
+    148,
+    23,
+    217,
+    163,
+    126,
+    74,
+    142,
+    266,
+};
+
 #endif /* HAVE_POSTGRES */
 
 #endif /* LIGHTNINGD_WALLET_GEN_DB_POSTGRES */
 
-// SHA256STAMP:8a260050ced7606fcad6e15df51a42a442f3119ad82d8e86fa2d348a2a45ee1a
+// SHA256STAMP:6c04934c194e808eb6d9f47e38399351835b6e76d6582b1b92f211fc99d9d6dc
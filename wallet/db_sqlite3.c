@@ -1,7 +1,14 @@
 #include "db_sqlite3_sqlgen.c"
+#include <ccan/array_size/array_size.h>
 #include <ccan/ccan/tal/str/str.h>
+#include <errno.h>
+#include <inttypes.h>
 #include <lightningd/log.h>
+#include <pthread.h>
 #include <stdio.h>
+#include <strings.h>
+#include <time.h>
+#include <wallet/db.h>
 #include <wallet/db_common.h>
 
 #if HAVE_SQLITE3
@@ -22,6 +29,210 @@ static const char *db_sqlite3_fmt_error(struct db_stmt *stmt)
 		       sqlite3_errmsg(stmt->db->conn));
 }
 
+/* Run a PRAGMA, and return the first column it answers (if any). */
+static bool db_sqlite3_pragma(struct db *db, sqlite3 *conn,
+			      const char *pragma, char **answer)
+{
+	sqlite3_stmt *stmt;
+	int err;
+
+	err = sqlite3_prepare_v2(conn, pragma, -1, &stmt, NULL);
+	if (err != SQLITE_OK) {
+		db->error = tal_fmt(db, "%s: %s", pragma, sqlite3_errmsg(conn));
+		return false;
+	}
+
+	err = sqlite3_step(stmt);
+	if (err != SQLITE_ROW && err != SQLITE_DONE) {
+		db->error = tal_fmt(db, "%s: %s", pragma, sqlite3_errmsg(conn));
+		sqlite3_finalize(stmt);
+		return false;
+	}
+	if (answer) {
+		const unsigned char *text = NULL;
+		if (err == SQLITE_ROW)
+			text = sqlite3_column_text(stmt, 0);
+		*answer = tal_strdup(db, text ? (const char *)text : "");
+	}
+	sqlite3_finalize(stmt);
+	return true;
+}
+
+/* In WAL mode, each commit only has to append to the WAL (and, with
+ * synchronous=full, fsync it once): copying the WAL back into the
+ * database ("checkpointing") is normally done by whichever commit
+ * happens to fill it.  If asked, we do that from a thread instead, on
+ * its own connection, so it never holds up a commit. */
+struct db_sqlite3_checkpointer {
+	sqlite3 *conn;
+	u32 interval_sec;
+
+	pthread_t thread;
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+	bool stop;
+};
+
+static void *db_sqlite3_checkpointer(void *arg)
+{
+	struct db_sqlite3_checkpointer *cp = arg;
+
+	pthread_mutex_lock(&cp->lock);
+	while (!cp->stop) {
+		struct timespec deadline;
+
+		clock_gettime(CLOCK_REALTIME, &deadline);
+		deadline.tv_sec += cp->interval_sec;
+		/* We're only woken early to stop (or spuriously). */
+		if (pthread_cond_timedwait(&cp->cond, &cp->lock, &deadline)
+		    != ETIMEDOUT)
+			continue;
+
+		pthread_mutex_unlock(&cp->lock);
+		/* A passive checkpoint does what it can without waiting for
+		 * the main connection: the rest is done next time. */
+		sqlite3_wal_checkpoint_v2(cp->conn, NULL,
+					  SQLITE_CHECKPOINT_PASSIVE,
+					  NULL, NULL);
+		pthread_mutex_lock(&cp->lock);
+	}
+	pthread_mutex_unlock(&cp->lock);
+	return NULL;
+}
+
+static bool db_sqlite3_start_checkpointer(struct db *db, const char *filename,
+					  const char *synchronous,
+					  u32 interval_sec)
+{
+	struct db_sqlite3_checkpointer *cp;
+	int err;
+
+	/* Our thread uses its own connection, but even that needs sqlite3's
+	 * mutexes, which a SQLITE_THREADSAFE=0 build leaves out. */
+	if (!sqlite3_threadsafe()) {
+		db->error = tal_fmt(db, "sqlite3-checkpoint-sec needs a"
+				    " thread-safe sqlite3 library");
+		return false;
+	}
+
+	/* Commits no longer checkpoint: we do. */
+	if (!db_sqlite3_pragma(db, db->conn,
+			       "PRAGMA wal_autocheckpoint = 0;", NULL))
+		return false;
+
+	cp = tal(db, struct db_sqlite3_checkpointer);
+	err = sqlite3_open_v2(filename, &cp->conn, SQLITE_OPEN_READWRITE,
+			      NULL);
+	if (err != SQLITE_OK) {
+		db->error = tal_fmt(db, "opening checkpoint connection: %s",
+				    sqlite3_errstr(err));
+		sqlite3_close(cp->conn);
+		return false;
+	}
+	/* The checkpoint's fsync of the database depends on this, too. */
+	if (!db_sqlite3_pragma(db, cp->conn,
+			       tal_fmt(tmpctx, "PRAGMA synchronous = %s;",
+				       synchronous), NULL)) {
+		sqlite3_close(cp->conn);
+		return false;
+	}
+
+	cp->interval_sec = interval_sec;
+	cp->stop = false;
+	pthread_mutex_init(&cp->lock, NULL);
+	pthread_cond_init(&cp->cond, NULL);
+	err = pthread_create(&cp->thread, NULL, db_sqlite3_checkpointer, cp);
+	if (err) {
+		db->error = tal_fmt(db, "creating checkpoint thread: %s",
+				    strerror(err));
+		sqlite3_close(cp->conn);
+		return false;
+	}
+	db->driver_state = cp;
+	return true;
+}
+
+static void db_sqlite3_stop_checkpointer(struct db *db)
+{
+	struct db_sqlite3_checkpointer *cp = db->driver_state;
+
+	if (!cp)
+		return;
+
+	pthread_mutex_lock(&cp->lock);
+	cp->stop = true;
+	pthread_cond_signal(&cp->cond);
+	pthread_mutex_unlock(&cp->lock);
+	pthread_join(cp->thread, NULL);
+
+	sqlite3_close(cp->conn);
+	pthread_cond_destroy(&cp->cond);
+	pthread_mutex_destroy(&cp->lock);
+	db->driver_state = tal_free(cp);
+}
+
+/* Apply db->sqlite3_opts (if any) to the freshly opened database. */
+static bool db_sqlite3_tune(struct db *db, const char *filename)
+{
+	const struct db_sqlite3_opts *opts = db->sqlite3_opts;
+	const char *synchronous;
+	char *mode;
+
+	if (!opts)
+		return true;
+
+	if (opts->journal_mode) {
+		if (!db_sqlite3_pragma(db, db->conn,
+				       tal_fmt(tmpctx,
+					       "PRAGMA journal_mode = %s;",
+					       opts->journal_mode),
+				       &mode))
+			return false;
+		/* sqlite3 answers with the mode it's actually in, which
+		 * isn't what we asked for if it can't (or doesn't know it). */
+		if (strcasecmp(mode, opts->journal_mode) != 0) {
+			db->error = tal_fmt(db, "cannot set journal_mode %s"
+					    " (still %s)",
+					    opts->journal_mode, mode);
+			return false;
+		}
+	} else {
+		/* WAL mode is stored in the database, so it can already be
+		 * in it. */
+		if (!db_sqlite3_pragma(db, db->conn, "PRAGMA journal_mode;",
+				       &mode))
+			return false;
+	}
+
+	/* Anything less than full can lose the last commits on power
+	 * failure, and with them channel state our peers have seen. */
+	synchronous = opts->synchronous ? opts->synchronous : "full";
+	if (!db_sqlite3_pragma(db, db->conn,
+			       tal_fmt(tmpctx, "PRAGMA synchronous = %s;",
+				       synchronous), NULL))
+		return false;
+
+	/* Negative means KiB, rather than pages. */
+	if (opts->cache_size_kb
+	    && !db_sqlite3_pragma(db, db->conn,
+				  tal_fmt(tmpctx,
+					  "PRAGMA cache_size = -%"PRIu64";",
+					  opts->cache_size_kb), NULL))
+		return false;
+
+	if (opts->mmap_size
+	    && !db_sqlite3_pragma(db, db->conn,
+				  tal_fmt(tmpctx,
+					  "PRAGMA mmap_size = %"PRIu64";",
+					  opts->mmap_size), NULL))
+		return false;
+
+	if (strcasecmp(mode, "wal") == 0 && opts->checkpoint_sec)
+		return db_sqlite3_start_checkpointer(db, filename, synchronous,
+						     opts->checkpoint_sec);
+	return true;
+}
+
 static bool db_sqlite3_setup(struct db *db)
 {
 	char *filename;
@@ -42,20 +253,39 @@ static bool db_sqlite3_setup(struct db *db)
 			 sqlite3_errstr(err));
 	}
 	db->conn = sql;
+	db->stmt_cache = tal_arrz(db, sqlite3_stmt *, db->config->num_queries);
 
 	sqlite3_prepare_v2(db->conn, "PRAGMA foreign_keys = ON;", -1, &stmt, NULL);
 	err = sqlite3_step(stmt);
 	sqlite3_finalize(stmt);
-	return err == SQLITE_DONE;
+	if (err != SQLITE_DONE)
+		return false;
+
+	return db_sqlite3_tune(db, filename);
 }
 
 static bool db_sqlite3_query(struct db_stmt *stmt)
 {
+	sqlite3_stmt **cache = stmt->db->stmt_cache;
+	size_t idx = db_query_index(stmt);
 	sqlite3_stmt *s;
 	sqlite3 *conn = (sqlite3*)stmt->db->conn;
 	int err;
 
-	err = sqlite3_prepare_v2(conn, stmt->query->query, -1, &s, NULL);
+	/* Take the cached statement if there is one: if the same query is
+	 * in use elsewhere (nested loops), we prepare another. */
+	s = cache[idx];
+	if (s) {
+		cache[idx] = NULL;
+	} else {
+		stmt->db->query_stats[idx].prepares++;
+		err = sqlite3_prepare_v2(conn, stmt->query->query, -1, &s, NULL);
+		if (err != SQLITE_OK) {
+			tal_free(stmt->error);
+			stmt->error = db_sqlite3_fmt_error(stmt);
+			return false;
+		}
+	}
 
 	for (size_t i=0; i<stmt->query->placeholders; i++) {
 		struct db_binding *b = &stmt->bindings[i];
@@ -87,12 +317,6 @@ static bool db_sqlite3_query(struct db_stmt *stmt)
 		}
 	}
 
-	if (err != SQLITE_OK) {
-		tal_free(stmt->error);
-		stmt->error = db_sqlite3_fmt_error(stmt);
-		return false;
-	}
-
 	stmt->inner_stmt = s;
 	return true;
 }
@@ -208,7 +432,19 @@ static const unsigned char *db_sqlite3_column_text(struct db_stmt *stmt, int col
 
 static void db_sqlite3_stmt_free(struct db_stmt *stmt)
 {
-	if (stmt->inner_stmt)
+	sqlite3_stmt **cache = stmt->db->stmt_cache;
+	size_t idx = db_query_index(stmt);
+
+	if (!stmt->inner_stmt)
+		return;
+
+	/* Keep it for next time, unless we already have one (or we're
+	 * shutting down). */
+	if (cache && !cache[idx]) {
+		sqlite3_reset(stmt->inner_stmt);
+		sqlite3_clear_bindings(stmt->inner_stmt);
+		cache[idx] = stmt->inner_stmt;
+	} else
 		sqlite3_finalize(stmt->inner_stmt);
 	stmt->inner_stmt = NULL;
 }
@@ -221,6 +457,15 @@ static size_t db_sqlite3_count_changes(struct db_stmt *stmt)
 
 static void db_sqlite3_close(struct db *db)
 {
+	sqlite3_stmt **cache = db->stmt_cache;
+
+	/* sqlite3_close() refuses to close with statements outstanding. */
+	for (size_t i = 0; i < tal_count(cache); i++)
+		sqlite3_finalize(cache[i]);
+	db->stmt_cache = tal_free(db->stmt_cache);
+
+	/* Last out checkpoints (and removes) the WAL: make that us. */
+	db_sqlite3_stop_checkpointer(db);
 	sqlite3_close(db->conn);
 	db->conn = NULL;
 }
@@ -235,6 +480,11 @@ struct db_config db_sqlite3_config = {
 	.name = "sqlite3",
 	.queries = db_sqlite3_queries,
 	.num_queries = DB_SQLITE3_QUERY_COUNT,
+
+	.query_seeds = db_sqlite3_query_seeds,
+	.num_query_seeds = ARRAY_SIZE(db_sqlite3_query_seeds),
+	.query_slots = db_sqlite3_query_slots,
+	.num_query_slots = ARRAY_SIZE(db_sqlite3_query_slots),
 	.exec_fn = &db_sqlite3_exec,
 	.query_fn = &db_sqlite3_query,
 	.step_fn = &db_sqlite3_step,
@@ -0,0 +1,166 @@
+  #include <lightningd/log.h>
+
+static void db_test_fatal(const char *fmt, ...);
+#define db_fatal db_test_fatal
+
+static void db_log_(struct log *log UNUSED, enum log_level level UNUSED, const struct node_id *node_id UNUSED, bool call_notifier UNUSED, const char *fmt UNUSED, ...)
+{
+}
+#define log_ db_log_
+
+#include "wallet/db.c"
+
+#include "test_utils.h"
+
+#include <ccan/err/err.h>
+#include <ccan/opt/opt.h>
+#include <ccan/time/time.h>
+#include <common/setup.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <unistd.h>
+
+/* AUTOGENERATED MOCKS START */
+/* Generated stub for derive_channel_id */
+void derive_channel_id(struct channel_id *channel_id UNNEEDED,
+		       const struct bitcoin_txid *txid UNNEEDED, u16 txout UNNEEDED)
+{ fprintf(stderr, "derive_channel_id called!\n"); abort(); }
+/* Generated stub for fatal */
+void   fatal(const char *fmt UNNEEDED, ...)
+{ fprintf(stderr, "fatal called!\n"); abort(); }
+/* Generated stub for fromwire_hsmd_get_output_scriptpubkey_reply */
+bool fromwire_hsmd_get_output_scriptpubkey_reply(const tal_t *ctx UNNEEDED, const void *p UNNEEDED, u8 **script UNNEEDED)
+{ fprintf(stderr, "fromwire_hsmd_get_output_scriptpubkey_reply called!\n"); abort(); }
+/* Generated stub for get_channel_basepoints */
+void get_channel_basepoints(struct lightningd *ld UNNEEDED,
+			    const struct node_id *peer_id UNNEEDED,
+			    const u64 dbid UNNEEDED,
+			    struct basepoints *local_basepoints UNNEEDED,
+			    struct pubkey *local_funding_pubkey UNNEEDED)
+{ fprintf(stderr, "get_channel_basepoints called!\n"); abort(); }
+/* Generated stub for new_log */
+struct log *new_log(const tal_t *ctx UNNEEDED, struct log_book *record UNNEEDED,
+		    const struct node_id *default_node_id UNNEEDED,
+		    const char *fmt UNNEEDED, ...)
+{ fprintf(stderr, "new_log called!\n"); abort(); }
+/* Generated stub for plugin_hook_db_sync */
+void plugin_hook_db_sync(struct db *db UNNEEDED)
+{ fprintf(stderr, "plugin_hook_db_sync called!\n"); abort(); }
+/* Generated stub for towire_hsmd_get_output_scriptpubkey */
+u8 *towire_hsmd_get_output_scriptpubkey(const tal_t *ctx UNNEEDED, u64 channel_id UNNEEDED, const struct node_id *peer_id UNNEEDED, const struct pubkey *commitment_point UNNEEDED)
+{ fprintf(stderr, "towire_hsmd_get_output_scriptpubkey called!\n"); abort(); }
+/* Generated stub for wire_sync_read */
+u8 *wire_sync_read(const tal_t *ctx UNNEEDED, int fd UNNEEDED)
+{ fprintf(stderr, "wire_sync_read called!\n"); abort(); }
+/* Generated stub for wire_sync_write */
+bool wire_sync_write(int fd UNNEEDED, const void *msg TAKES UNNEEDED)
+{ fprintf(stderr, "wire_sync_write called!\n"); abort(); }
+/* AUTOGENERATED MOCKS END */
+
+static void db_test_fatal(const char *fmt, ...)
+{
+	va_list ap;
+
+	va_start(ap, fmt);
+	verrx(1, fmt, ap);
+	va_end(ap);
+}
+
+/* This is what db_prepare_v2_ used to do. */
+static struct db_query *db_query_find_linear(const struct db_config *config,
+					     const char *query_id)
+{
+	for (size_t i = 0; i < config->num_queries; i++) {
+		if (streq(query_id, config->queries[i].name))
+			return &config->queries[i];
+	}
+	return NULL;
+}
+
+/* Look up every query, @rounds times. */
+static struct timerel time_lookups(const struct db_config *config,
+				   struct db_query *(*find)(const struct db_config *,
+							    const char *),
+				   size_t rounds)
+{
+	struct timemono start = time_mono();
+
+	for (size_t r = 0; r < rounds; r++) {
+		for (size_t i = 0; i < config->num_queries; i++) {
+			if (find(config, config->queries[i].name)
+			    != &config->queries[i])
+				abort();
+		}
+	}
+	return timemono_since(start);
+}
+
+/* Prepare (and discard) every query, @rounds times. */
+static struct timerel time_prepares(struct db *db, size_t rounds)
+{
+	struct timemono start = time_mono();
+
+	for (size_t r = 0; r < rounds; r++) {
+		for (size_t i = 0; i < db->config->num_queries; i++) {
+			struct db_stmt *stmt;
+
+			stmt = db_prepare_v2_("bench", db,
+					      db->config->queries[i].name);
+			/* We never execute them. */
+			list_del_from(&db->pending_statements, &stmt->list);
+			stmt->executed = true;
+			tal_free(stmt);
+		}
+	}
+	return timemono_since(start);
+}
+
+static u64 nsec_per(struct timerel t, size_t rounds, size_t num)
+{
+	return time_to_nsec(t) / (rounds * num);
+}
+
+int main(int argc, char *argv[])
+{
+	char *dsn, filename[] = "/tmp/run-bench-db_prepare.XXXXXX";
+	struct db *db;
+	size_t rounds = 100, n;
+	struct timerel linear, hashed, prepare;
+	int fd;
+
+	common_setup(argv[0]);
+	opt_parse(&argc, argv, opt_log_stderr_exit);
+	if (argc > 1)
+		rounds = atoi(argv[1]);
+	if (argc > 2)
+		opt_usage_and_exit("[rounds]");
+
+	fd = mkstemp(filename);
+	if (fd < 0)
+		err(1, "Creating %s", filename);
+	close(fd);
+	dsn = tal_fmt(tmpctx, "sqlite3://%s", filename);
+	db = db_open(tmpctx, dsn, NULL);
+	n = db->config->num_queries;
+
+	/* Unknown queries aren't found, even if they hash somewhere. */
+	assert(!db_query_find(db->config, "SELECT nonsense FROM nowhere;"));
+	assert(!db_query_find(db->config, ""));
+
+	linear = time_lookups(db->config, db_query_find_linear, rounds);
+	hashed = time_lookups(db->config, db_query_find, rounds);
+	printf("%zu queries, lookup: linear %"PRIu64" nsec, hashed %"PRIu64
+	       " nsec\n",
+	       n, nsec_per(linear, rounds, n), nsec_per(hashed, rounds, n));
+
+	db_begin_transaction(db);
+	prepare = time_prepares(db, rounds);
+	printf("%zu queries, db_prepare_v2: %"PRIu64" nsec\n",
+	       n, nsec_per(prepare, rounds, n));
+	db->dirty = false;
+	db_commit_transaction(db);
+
+	unlink(filename);
+	common_shutdown();
+	return 0;
+}
@@ -0,0 +1,290 @@
+  #include <lightningd/log.h>
+
+static void db_test_fatal(const char *fmt, ...);
+#define db_fatal db_test_fatal
+
+static void db_log_(struct log *log UNUSED, enum log_level level UNUSED, const struct node_id *node_id UNUSED, bool call_notifier UNUSED, const char *fmt UNUSED, ...)
+{
+}
+#define log_ db_log_
+
+#include "wallet/db.c"
+
+#include "test_utils.h"
+
+#include <ccan/err/err.h>
+#include <ccan/opt/opt.h>
+#include <ccan/tal/grab_file/grab_file.h>
+#include <ccan/time/time.h>
+#include <common/setup.h>
+#include <inttypes.h>
+#include <sqlite3.h>
+#include <stdio.h>
+#include <unistd.h>
+
+/* AUTOGENERATED MOCKS START */
+/* Generated stub for derive_channel_id */
+void derive_channel_id(struct channel_id *channel_id UNNEEDED,
+		       const struct bitcoin_txid *txid UNNEEDED, u16 txout UNNEEDED)
+{ fprintf(stderr, "derive_channel_id called!\n"); abort(); }
+/* Generated stub for fatal */
+void   fatal(const char *fmt UNNEEDED, ...)
+{ fprintf(stderr, "fatal called!\n"); abort(); }
+/* Generated stub for fromwire_hsmd_get_output_scriptpubkey_reply */
+bool fromwire_hsmd_get_output_scriptpubkey_reply(const tal_t *ctx UNNEEDED, const void *p UNNEEDED, u8 **script UNNEEDED)
+{ fprintf(stderr, "fromwire_hsmd_get_output_scriptpubkey_reply called!\n"); abort(); }
+/* Generated stub for get_channel_basepoints */
+void get_channel_basepoints(struct lightningd *ld UNNEEDED,
+			    const struct node_id *peer_id UNNEEDED,
+			    const u64 dbid UNNEEDED,
+			    struct basepoints *local_basepoints UNNEEDED,
+			    struct pubkey *local_funding_pubkey UNNEEDED)
+{ fprintf(stderr, "get_channel_basepoints called!\n"); abort(); }
+/* Generated stub for new_log */
+struct log *new_log(const tal_t *ctx UNNEEDED, struct log_book *record UNNEEDED,
+		    const struct node_id *default_node_id UNNEEDED,
+		    const char *fmt UNNEEDED, ...)
+{ fprintf(stderr, "new_log called!\n"); abort(); }
+/* Generated stub for towire_hsmd_get_output_scriptpubkey */
+u8 *towire_hsmd_get_output_scriptpubkey(const tal_t *ctx UNNEEDED, u64 channel_id UNNEEDED, const struct node_id *peer_id UNNEEDED, const struct pubkey *commitment_point UNNEEDED)
+{ fprintf(stderr, "towire_hsmd_get_output_scriptpubkey called!\n"); abort(); }
+/* Generated stub for wire_sync_read */
+u8 *wire_sync_read(const tal_t *ctx UNNEEDED, int fd UNNEEDED)
+{ fprintf(stderr, "wire_sync_read called!\n"); abort(); }
+/* Generated stub for wire_sync_write */
+bool wire_sync_write(int fd UNNEEDED, const void *msg TAKES UNNEEDED)
+{ fprintf(stderr, "wire_sync_write called!\n"); abort(); }
+/* AUTOGENERATED MOCKS END */
+
+static void db_test_fatal(const char *fmt, ...)
+{
+	va_list ap;
+
+	va_start(ap, fmt);
+	verrx(1, fmt, ap);
+	va_end(ap);
+}
+
+/* No db_write hook here. */
+void plugin_hook_db_sync(struct db *db UNNEEDED)
+{
+}
+
+struct mode {
+	const char *name;
+	struct db_sqlite3_opts opts;
+};
+
+/* The rollback journal we had, and WAL: the second is as safe for
+ * channel state, the last isn't (it can lose commits on power loss). */
+static const struct mode modes[] = {
+	{ "delete, full", { NULL, "full", 0, 0, 0 } },
+	{ "wal, full", { "wal", "full", 0, 0, 0 } },
+	{ "wal, full, checkpoint thread", { "wal", "full", 1, 0, 0 } },
+	{ "wal, normal", { "wal", "normal", 0, 0, 0 } },
+};
+
+#define NUM_CHANNELS 10
+
+/* The transactions an HTLC we offer and see fulfilled causes, roughly as
+ * the wallet writes them: each element is one transaction. */
+static void add_htlc_txs(const char ***txs, size_t htlc)
+{
+	size_t chan = 1 + htlc % NUM_CHANNELS;
+
+	/* We add it, and send commitment_signed. */
+	tal_arr_expand(txs, tal_fmt(*txs,
+		"INSERT INTO channel_htlcs (channel_id, channel_htlc_id,"
+		" direction, msatoshi, cltv_expiry, payment_hash,"
+		" routing_onion, hstate, shared_secret, received_time)"
+		" VALUES (%zu, %zu, 1, 100000, 700000, randomblob(32),"
+		" randomblob(1366), 3, randomblob(32), %zu);"
+		"UPDATE channels SET next_index_remote = next_index_remote + 1,"
+		" next_htlc_id = next_htlc_id + 1,"
+		" last_sent_commit = randomblob(40) WHERE id = %zu;",
+		chan, htlc, htlc, chan));
+
+	/* They revoke. */
+	tal_arr_expand(txs, tal_fmt(*txs,
+		"UPDATE channel_htlcs SET hstate = 4"
+		" WHERE channel_id = %zu AND channel_htlc_id = %zu;"
+		"UPDATE shachains SET min_index = %zu, num_valid = %zu"
+		" WHERE id = %zu;"
+		"INSERT OR REPLACE INTO shachain_known"
+		" (shachain_id, pos, idx, hash)"
+		" VALUES (%zu, %zu, %zu, randomblob(32));"
+		"UPDATE channels SET old_per_commit_remote = per_commit_remote,"
+		" per_commit_remote = randomblob(33) WHERE id = %zu;",
+		chan, htlc, htlc, htlc % 49, chan, chan, htlc % 49, htlc,
+		chan));
+
+	/* They send commitment_signed. */
+	tal_arr_expand(txs, tal_fmt(*txs,
+		"UPDATE channel_htlcs SET hstate = 5"
+		" WHERE channel_id = %zu AND channel_htlc_id = %zu;"
+		"UPDATE channels SET next_index_local = next_index_local + 1,"
+		" last_tx = randomblob(350), last_sig = randomblob(64)"
+		" WHERE id = %zu;"
+		"DELETE FROM htlc_sigs WHERE channelid = %zu;"
+		"INSERT INTO htlc_sigs (channelid, signature)"
+		" VALUES (%zu, randomblob(64));",
+		chan, htlc, chan, chan, chan));
+
+	/* They fulfill it. */
+	tal_arr_expand(txs, tal_fmt(*txs,
+		"UPDATE channel_htlcs SET hstate = 9,"
+		" payment_key = randomblob(32)"
+		" WHERE channel_id = %zu AND channel_htlc_id = %zu;"
+		"UPDATE channels SET msatoshi_local = msatoshi_local - 100000,"
+		" out_payments_fulfilled = out_payments_fulfilled + 1,"
+		" out_msatoshi_fulfilled = out_msatoshi_fulfilled + 100000"
+		" WHERE id = %zu;",
+		chan, htlc, chan));
+}
+
+/* The channels (and what they need) which the HTLCs use. */
+static const char *setup_sql(const tal_t *ctx)
+{
+	char *sql = tal_strdup(ctx, "");
+
+	for (size_t i = 1; i <= NUM_CHANNELS; i++)
+		tal_append_fmt(&sql,
+			"INSERT INTO peers (id, node_id, address)"
+			" VALUES (%zu, randomblob(33), 'localhost:9735');"
+			"INSERT INTO shachains (id, min_index, num_valid)"
+			" VALUES (%zu, 0, 0);"
+			"INSERT INTO channels (id, peer_id, shachain_remote_id,"
+			" state, next_index_local, next_index_remote,"
+			" next_htlc_id, msatoshi_local)"
+			" VALUES (%zu, %zu, %zu, 2, 1, 1, 0, 1000000000000);",
+			i, i, i, i, i);
+	return sql;
+}
+
+/* A recorded workload is the `writes` of each db_write hook call, one
+ * statement per line, with an empty line between transactions. */
+static const char **load_workload(const tal_t *ctx, const char *filename)
+{
+	const char **txs = tal_arr(ctx, const char *, 0);
+	char *contents = grab_file(ctx, filename), **lines, *tx = NULL;
+
+	if (!contents)
+		err(1, "Reading %s", filename);
+
+	lines = tal_strsplit(ctx, contents, "\n", STR_EMPTY_OK);
+	for (size_t i = 0; lines[i]; i++) {
+		if (streq(lines[i], "")) {
+			if (tx)
+				tal_arr_expand(&txs, tx);
+			tx = NULL;
+			continue;
+		}
+		if (!tx)
+			tx = tal_strdup(txs, "");
+		tal_append_fmt(&tx, "%s;", lines[i]);
+	}
+	if (tx)
+		tal_arr_expand(&txs, tx);
+	return txs;
+}
+
+static void exec_sql(struct db *db, const char *sql)
+{
+	char *errmsg;
+
+	if (sqlite3_exec(db->conn, sql, NULL, NULL, &errmsg) != SQLITE_OK)
+		errx(1, "%s: %s", sql, errmsg);
+}
+
+static struct timerel replay(struct lightningd *ld, const char *dir,
+			     const struct mode *mode,
+			     const char *setup, const char **txs)
+{
+	char *dsn, *filename = tal_fmt(tmpctx, "%s/run-bench-sqlite3.XXXXXX",
+				       dir);
+	struct db *db;
+	struct timemono start;
+	struct timerel elapsed;
+	int fd;
+
+	fd = mkstemp(filename);
+	if (fd < 0)
+		err(1, "Creating %s", filename);
+	close(fd);
+	dsn = tal_fmt(tmpctx, "sqlite3://%s", filename);
+	db = db_open(tmpctx, dsn, &mode->opts);
+	db->data_version = 0;
+
+	db_begin_transaction(db);
+	db_migrate(ld, db, NULL);
+	if (setup)
+		exec_sql(db, setup);
+	db_commit_transaction(db);
+
+	/* A recorded workload refers to channels (etc) created before it
+	 * started, which we don't have. */
+	if (!setup)
+		exec_sql(db, "PRAGMA foreign_keys = OFF;");
+
+	start = time_mono();
+	for (size_t i = 0; i < tal_count(txs); i++) {
+		db_begin_transaction(db);
+		exec_sql(db, txs[i]);
+		/* So commit bumps data_version, as usual. */
+		db->dirty = true;
+		db_commit_transaction(db);
+	}
+	elapsed = timemono_since(start);
+
+	tal_free(db);
+	unlink(filename);
+	return elapsed;
+}
+
+int main(int argc, char *argv[])
+{
+	struct lightningd *ld;
+	const char *setup, **txs;
+	char *dir = NULL, *workload = NULL;
+	unsigned int num_htlcs = 10;
+
+	common_setup(argv[0]);
+	opt_register_arg("--dir", opt_set_charp, NULL, &dir,
+			 "Directory for the databases (default /tmp, which"
+			 " may not fsync like your real disk)");
+	opt_register_arg("--workload", opt_set_charp, NULL, &workload,
+			 "Replay this recorded workload instead of HTLCs");
+	opt_parse(&argc, argv, opt_log_stderr_exit);
+	if (argc > 1)
+		num_htlcs = atoi(argv[1]);
+	if (argc > 2)
+		opt_usage_and_exit("[num_htlcs]");
+	if (!dir)
+		dir = "/tmp";
+
+	/* Dummy for migration hooks */
+	ld = tal(tmpctx, struct lightningd);
+	ld->config = test_config;
+
+	if (workload) {
+		setup = NULL;
+		txs = load_workload(tmpctx, workload);
+	} else {
+		setup = setup_sql(tmpctx);
+		txs = tal_arr(tmpctx, const char *, 0);
+		for (size_t i = 0; i < num_htlcs; i++)
+			add_htlc_txs(&txs, i);
+	}
+
+	for (size_t i = 0; i < ARRAY_SIZE(modes); i++) {
+		struct timerel t = replay(ld, dir, &modes[i], setup, txs);
+
+		printf("%s: %zu transactions in %"PRIu64" msec"
+		       " (%"PRIu64" usec each)\n",
+		       modes[i].name, tal_count(txs), time_to_msec(t),
+		       tal_count(txs) ? time_to_usec(t) / tal_count(txs) : 0);
+	}
+
+	common_shutdown();
+	return 0;
+}
@@ -14,6 +14,7 @@ static void db_log_(struct log *log UNUSED, enum log_level level UNUSED, const s
 
 #include <common/amount.h>
 #include <common/memleak.h>
+#include <sqlite3.h>
 #include <stdio.h>
 #include <unistd.h>
 
@@ -68,7 +69,7 @@ void plugin_hook_db_sync(struct db *db UNNEEDED)
 {
 }
 
-static struct db *create_test_db(void)
+static struct db *create_tuned_test_db(const struct db_sqlite3_opts *opts)
 {
 	struct db *db;
 	char *dsn, filename[] = "/tmp/ldb-XXXXXX";
@@ -79,12 +80,30 @@ static struct db *create_test_db(void)
 	close(fd);
 
 	dsn = tal_fmt(NULL, "sqlite3://%s", filename);
-	db = db_open(NULL, dsn);
+	db = db_open(NULL, dsn, opts);
 	db->data_version = 0;
 	tal_free(dsn);
 	return db;
 }
 
+static struct db *create_test_db(void)
+{
+	return create_tuned_test_db(NULL);
+}
+
+static const char *sqlite3_pragma(struct db *db, const char *pragma)
+{
+	sqlite3_stmt *stmt;
+	const char *answer = NULL;
+
+	sqlite3_prepare_v2(db->conn, pragma, -1, &stmt, NULL);
+	if (sqlite3_step(stmt) == SQLITE_ROW)
+		answer = tal_strdup(tmpctx,
+				    (const char *)sqlite3_column_text(stmt, 0));
+	sqlite3_finalize(stmt);
+	return answer;
+}
+
 static bool test_empty_db_migrate(struct lightningd *ld)
 {
 	struct db *db = create_test_db();
@@ -162,6 +181,107 @@ static bool test_vars(struct lightningd *ld)
 	return true;
 }
 
+static bool test_stmt_cache(void)
+{
+	struct db_stmt *stmt, *stmt2;
+	struct db *db = create_test_db();
+	size_t idx;
+
+	db_begin_transaction(db);
+	for (size_t i = 0; i < 3; i++) {
+		stmt = db_prepare_v2(db, SQL("SELECT name FROM sqlite_master WHERE type='table';"));
+		CHECK(db_query_prepared(stmt));
+		idx = db_query_index(stmt);
+		tal_free(stmt);
+	}
+	/* Prepared once, then reused. */
+	CHECK(db->query_stats[idx].prepares == 1);
+	CHECK(db->query_stats[idx].execs == 3);
+
+	/* Using the same query twice at once needs another. */
+	stmt = db_prepare_v2(db, SQL("SELECT name FROM sqlite_master WHERE type='table';"));
+	CHECK(db_query_prepared(stmt));
+	stmt2 = db_prepare_v2(db, SQL("SELECT name FROM sqlite_master WHERE type='table';"));
+	CHECK(db_query_prepared(stmt2));
+	CHECK(db->query_stats[idx].prepares == 2);
+	tal_free(stmt);
+	tal_free(stmt2);
+
+	/* But only one is kept. */
+	stmt = db_prepare_v2(db, SQL("SELECT name FROM sqlite_master WHERE type='table';"));
+	CHECK(db_query_prepared(stmt));
+	CHECK(db->query_stats[idx].prepares == 2);
+	CHECK(db->query_stats[idx].execs == 6);
+	tal_free(stmt);
+
+	db->dirty = false;
+	db_commit_transaction(db);
+	tal_free(db);
+	return true;
+}
+
+static bool test_sqlite3_tune(struct lightningd *ld)
+{
+	struct db_sqlite3_opts opts;
+	struct db *db;
+	char *dsn;
+
+	/* Defaults, but never less than full sync. */
+	db = create_test_db();
+	CHECK(streq(sqlite3_pragma(db, "PRAGMA journal_mode;"), "delete"));
+	CHECK(!db->driver_state);
+	tal_free(db);
+
+	opts.journal_mode = "wal";
+	opts.synchronous = NULL;
+	opts.checkpoint_sec = 1;
+	opts.cache_size_kb = 4096;
+	opts.mmap_size = 1 << 20;
+	db = create_tuned_test_db(&opts);
+	CHECK(streq(sqlite3_pragma(db, "PRAGMA journal_mode;"), "wal"));
+	/* 2 == FULL */
+	CHECK(streq(sqlite3_pragma(db, "PRAGMA synchronous;"), "2"));
+	CHECK(streq(sqlite3_pragma(db, "PRAGMA cache_size;"), "-4096"));
+	CHECK(streq(sqlite3_pragma(db, "PRAGMA wal_autocheckpoint;"), "0"));
+	CHECK(db->driver_state);
+
+	/* Give the checkpointer something to do while we write. */
+	db_begin_transaction(db);
+	db_migrate(ld, db, NULL);
+	db_commit_transaction(db);
+	sleep(1);
+	db_begin_transaction(db);
+	db_set_intvar(db, "tune", 1);
+	db_commit_transaction(db);
+	db_begin_transaction(db);
+	CHECK(db_get_intvar(db, "tune", 0) == 1);
+	db_commit_transaction(db);
+
+	/* Stops the checkpointer. */
+	tal_free(db);
+
+	/* Without a checkpoint interval, sqlite3 checkpoints on commit. */
+	opts.checkpoint_sec = 0;
+	opts.synchronous = "normal";
+	db = create_tuned_test_db(&opts);
+	CHECK(streq(sqlite3_pragma(db, "PRAGMA synchronous;"), "1"));
+	CHECK(!streq(sqlite3_pragma(db, "PRAGMA wal_autocheckpoint;"), "0"));
+	CHECK(!db->driver_state);
+	dsn = tal_strdup(tmpctx, db->filename);
+	tal_free(db);
+
+	/* It's still in WAL mode when reopened, so we checkpoint even if
+	 * we don't ask for it again. */
+	opts.journal_mode = NULL;
+	opts.checkpoint_sec = 1;
+	db = db_open(NULL, dsn, &opts);
+	CHECK(streq(sqlite3_pragma(db, "PRAGMA journal_mode;"), "wal"));
+	CHECK(streq(sqlite3_pragma(db, "PRAGMA wal_autocheckpoint;"), "0"));
+	CHECK(db->driver_state);
+	tal_free(db);
+	return true;
+}
+
 int main(void)
 {
 	setup_locale();
@@ -175,6 +295,8 @@ int main(void)
 	ok &= test_empty_db_migrate(ld);
 	ok &= test_vars(ld);
 	ok &= test_primitives();
+	ok &= test_stmt_cache();
+	ok &= test_sqlite3_tune(ld);
 
 	tal_free(ld);
 	tal_free(tmpctx);
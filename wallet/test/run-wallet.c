@@ -898,7 +898,7 @@ static struct wallet *create_test_wallet(struct lightningd *ld, const tal_t *ctx
 	close(fd);
 
 	dsn = tal_fmt(NULL, "sqlite3://%s", filename);
-	w->db = db_open(w, dsn);
+	w->db = db_open(w, dsn, NULL);
 	tal_free(dsn);
 	tal_add_destructor2(w, cleanup_test_wallet, filename);
 
@@ -28,6 +28,7 @@
 #include <lightningd/options.h>
 #include <lightningd/peer_control.h>
 #include <lightningd/subd.h>
+#include <wallet/db_common.h>
 #include <wallet/wallet.h>
 #include <wallet/walletrpc.h>
 #include <wally_bip32.h>
@@ -244,6 +245,44 @@ static const struct json_command listaddrs_command = {
 };
 AUTODATA(json_command, &listaddrs_command);
 
+static struct command_result *json_dbstats(struct command *cmd,
+					   const char *buffer,
+					   const jsmntok_t *obj UNNEEDED,
+					   const jsmntok_t *params)
+{
+	struct json_stream *response;
+	struct db *db = cmd->ld->wallet->db;
+
+	if (!param(cmd, buffer, params, NULL))
+		return command_param_failed();
+
+	response = json_stream_success(cmd);
+	json_array_start(response, "queries");
+	for (size_t i = 0; i < db->config->num_queries; i++) {
+		const struct db_query_stats *qs = &db->query_stats[i];
+
+		if (!qs->prepares && !qs->execs)
+			continue;
+		json_object_start(response, NULL);
+		json_add_string(response, "query", db->config->queries[i].name);
+		json_add_u64(response, "prepares", qs->prepares);
+		json_add_u64(response, "executions", qs->execs);
+		json_object_end(response);
+	}
+	json_array_end(response);
+	return command_success(cmd, response);
+}
+
+static const struct json_command dbstats_command = {
+	"dev-dbstats",
+	"developer",
+	json_dbstats,
+	"Show how many times each database query was prepared and executed",
+	false,
+	"Statements are prepared once per connection and reused, so prepares should stay well below executions."
+};
+AUTODATA(json_command, &dbstats_command);
+
 static void json_add_utxo(struct json_stream *response,
 			  const char *fieldname,
 			  struct wallet *wallet,